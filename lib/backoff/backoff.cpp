@@ -0,0 +1,38 @@
+#include "backoff.h"
+
+backoff::backoff(uint32_t baseMs, uint32_t capMs, uint32_t seed)
+    : baseMs_(baseMs), capMs_(capMs), attempt_(0), state_(seed ? seed : 1)
+{
+}
+
+uint32_t backoff::next()
+{
+    uint32_t w = window();
+    if (attempt_ < 31) attempt_++;
+    return w ? random() % w : 0;
+}
+
+void backoff::reset()
+{
+    attempt_ = 0;
+}
+
+void backoff::seed(uint32_t s)
+{
+    state_ = s ? s : 1;   // xorshift must not start at 0
+}
+
+uint32_t backoff::window() const
+{
+    uint64_t w = (uint64_t)baseMs_ << (attempt_ < 31 ? attempt_ : 31);
+    return w < capMs_ ? (uint32_t)w : capMs_;
+}
+
+// xorshift32: cheap, and good enough to decorrelate retry times
+uint32_t backoff::random()
+{
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+}
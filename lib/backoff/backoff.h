@@ -0,0 +1,32 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+// Exponential backoff with full jitter: attempt n waits a uniformly random
+// time in [0, min(cap, base * 2^n)). Devices that lost the same broker at the
+// same moment therefore spread their retries over the whole window instead of
+// reconnecting in lockstep. Time is not read here, so the same code runs on
+// the device and in the swarm simulator.
+class backoff
+{
+public:
+    backoff(uint32_t baseMs, uint32_t capMs, uint32_t seed = 1);
+
+    uint32_t next();             // delay before the next attempt, widens the window
+    void     reset();            // after a success or a fresh network
+    void     seed(uint32_t s);   // e.g. esp_random(), so devices do not share a sequence
+
+    uint32_t attempt() const { return attempt_; }
+    uint32_t window() const;     // current upper bound
+
+private:
+    uint32_t random();
+
+    uint32_t baseMs_;
+    uint32_t capMs_;
+    uint32_t attempt_;
+    uint32_t state_;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "binLog.h"
+
+namespace binLog
+{
+
+// Bounded multi-producer ring (Vyukov): each slot carries a sequence number
+// telling producers and the consumer whose turn it is.
+static const uint32_t RING_SIZE = 64;
+
+struct slot
+{
+    std::atomic<uint32_t> seq;
+    record                rec;
+};
+
+static slot                  ring[RING_SIZE];
+static std::atomic<uint32_t> enqueuePos{0};
+static uint32_t              dequeuePos = 0;
+static std::atomic<uint32_t> droppedCount{0};
+static std::atomic<uint8_t>  initState{0};       // 0 = empty, 1 = initializing, 2 = ready
+static uint32_t              reportedDrops = 0;
+
+// Lazily seed the slot sequences; logging may start from global constructors
+static void init()
+{
+    if (initState.load(std::memory_order_acquire) == 2) return;
+    uint8_t expected = 0;
+    if (initState.compare_exchange_strong(expected, 1, std::memory_order_acq_rel))
+    {
+        for (uint32_t i = 0; i < RING_SIZE; ++i) ring[i].seq.store(i, std::memory_order_relaxed);
+        initState.store(2, std::memory_order_release);
+    }
+    while (initState.load(std::memory_order_acquire) != 2) {}
+}
+
+// Reserve a slot and publish the record; drops it when the ring is full
+bool commit(record& r)
+{
+    init();
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        slot&    s   = ring[pos & (RING_SIZE - 1)];
+        uint32_t seq = s.seq.load(std::memory_order_acquire);
+        int32_t  dif = (int32_t)(seq - pos);
+        if (dif == 0)
+        {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                s.rec = r;
+                s.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (dif < 0)
+        {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+static void writeFrame(Stream& out, const record& r)
+{
+    uint8_t frame[2 + sizeof(record)];
+    frame[0] = FRAME_SYNC0;
+    frame[1] = FRAME_SYNC1;
+    memcpy(frame + 2, &r, sizeof(record));
+    out.write(frame, sizeof(frame));
+}
+
+// Write pending records while the stream can take them without blocking
+size_t drain(Stream& out, size_t maxRecords)
+{
+    init();
+    size_t written = 0;
+    while (written < maxRecords && out.availableForWrite() >= (int)(2 + sizeof(record)))
+    {
+        uint32_t drops = droppedCount.load(std::memory_order_relaxed);
+        if (drops != reportedDrops)
+        {
+            // fmt 0 is the decoder's "records dropped" marker
+            record d = {};
+            d.timestampUs  = (uint32_t)micros();
+            d.nargs        = 1;
+            d.data.args[0] = drops - reportedDrops;
+            reportedDrops  = drops;
+            writeFrame(out, d);
+            written++;
+            continue;
+        }
+
+        slot&    s   = ring[dequeuePos & (RING_SIZE - 1)];
+        uint32_t seq = s.seq.load(std::memory_order_acquire);
+        if ((int32_t)(seq - (dequeuePos + 1)) < 0) break;   // empty
+
+        writeFrame(out, s.rec);
+        s.seq.store(dequeuePos + RING_SIZE, std::memory_order_release);
+        dequeuePos++;
+        written++;
+    }
+    return written;
+}
+
+uint32_t dropped()
+{
+    return droppedCount.load(std::memory_order_relaxed);
+}
+
+// Compare the cost of a log call with the equivalent Serial.println
+void benchmark(Stream& out)
+{
+    const int iterations = 200;
+    int value = 1234;
+
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < iterations; ++i)
+    {
+        LOG_INFO("Moisture reading: %d", value + i);
+        if (i % 32 == 31) drain(out, RING_SIZE);
+    }
+    uint32_t logCycles = ESP.getCycleCount() - start;
+    drain(out, RING_SIZE);
+
+    out.flush();
+    start = ESP.getCycleCount();
+    for (int i = 0; i < iterations; ++i)
+    {
+        out.print("Moisture reading: ");
+        out.println(value + i);
+    }
+    uint32_t printCycles = ESP.getCycleCount() - start;
+
+    out.print("\nbinLog benchmark: LOG_INFO ");
+    out.print(logCycles / iterations);
+    out.print(" cycles/call (incl. drain), Serial.println ");
+    out.print(printCycles / iterations);
+    out.println(" cycles/call");
+}
+
+} // namespace binLog
@@ -0,0 +1,135 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Deferred binary logging. A log call stores the address of its format string
+// (which stays in flash) plus raw arguments in a lock-free ring; drain() later
+// writes the records as frames to a Stream when it has room. The host decoder
+// (tools/binlog/decode.py) resolves the format strings from firmware.elf.
+//
+// Levels above BINLOG_LEVEL are removed at compile time.
+
+#define BINLOG_LEVEL_NONE  0
+#define BINLOG_LEVEL_ERROR 1
+#define BINLOG_LEVEL_WARN  2
+#define BINLOG_LEVEL_INFO  3
+#define BINLOG_LEVEL_DEBUG 4
+
+#ifndef BINLOG_LEVEL
+#define BINLOG_LEVEL BINLOG_LEVEL_INFO
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) binLog::write(BINLOG_LEVEL_ERROR, "" fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) do {} while (0)
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) binLog::write(BINLOG_LEVEL_WARN, "" fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) do {} while (0)
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) binLog::write(BINLOG_LEVEL_INFO, "" fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) do {} while (0)
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...) binLog::write(BINLOG_LEVEL_DEBUG, "" fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) do {} while (0)
+#endif
+
+namespace binLog
+{
+
+// One fixed-size record: up to five integer arguments followed by at most one
+// string, which takes whatever bytes the integers leave free. A format may
+// therefore hold only one %s: further strings are dropped, and the decoder
+// repeats the stored one in every %s
+struct record
+{
+    uint32_t fmt;            // format string address
+    uint32_t timestampUs;
+    uint8_t  level;
+    uint8_t  nargs;
+    uint8_t  strLen;
+    uint8_t  reserved;
+    union
+    {
+        uint32_t args[5];
+        char     bytes[20];
+    } data;
+};
+
+static const uint8_t FRAME_SYNC0 = 0xFE;
+static const uint8_t FRAME_SYNC1 = 0xB1;
+
+bool     commit(record& r);
+size_t   drain(Stream& out, size_t maxRecords = 16);
+uint32_t dropped();
+void     benchmark(Stream& out);
+
+// Integers are packed first, then at most one string into the remaining bytes
+template <typename T>
+inline void packInt(record& r, T v)
+{
+    if (r.nargs < 5) r.data.args[r.nargs++] = (uint32_t)v;
+}
+inline void packInt(record&, const char*) {}
+inline void packInt(record&, char*) {}
+inline void packInt(record&, const String&) {}
+
+template <typename T>
+inline void packString(record&, T) {}
+inline void packString(record& r, const char* s)
+{
+    if (r.strLen) return;
+    size_t used = r.nargs * 4;
+    size_t n = 0;
+    while (s[n] && used + n < sizeof(r.data)) n++;
+    memcpy(r.data.bytes + used, s, n);
+    r.strLen = n;
+}
+inline void packString(record& r, char* s)         { packString(r, (const char*)s); }
+inline void packString(record& r, const String& s) { packString(r, s.c_str()); }
+
+inline void packInts(record&) {}
+template <typename T, typename... Rest>
+inline void packInts(record& r, const T& first, const Rest&... rest)
+{
+    packInt(r, first);
+    packInts(r, rest...);
+}
+
+inline void packStrings(record&) {}
+template <typename T, typename... Rest>
+inline void packStrings(record& r, const T& first, const Rest&... rest)
+{
+    packString(r, first);
+    packStrings(r, rest...);
+}
+
+template <typename... Args>
+inline void write(uint8_t level, const char* fmt, Args... args)
+{
+    record r;
+    r.fmt         = (uint32_t)(uintptr_t)fmt;
+    r.timestampUs = (uint32_t)micros();
+    r.level       = level;
+    r.nargs       = 0;
+    r.strLen      = 0;
+    r.reserved    = 0;
+    packInts(r, args...);
+    packStrings(r, args...);
+    commit(r);
+}
+
+} // namespace binLog
+
+#endif
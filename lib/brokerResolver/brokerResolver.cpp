@@ -0,0 +1,204 @@
+#include "brokerResolver.h"
+
+#include <binLog.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+
+static const uint32_t MDNS_HOST_TIMEOUT_MS   = 2000;
+static const uint32_t MDNS_BROWSE_TIMEOUT_MS = 3000;
+static const uint32_t DNS_TIMEOUT_MS         = 10000;
+static const uint32_t MAX_TTL_MS             = 3600000;
+
+enum : uint8_t { DNS_IDLE, DNS_PENDING, DNS_FOUND, DNS_FAILED };
+
+brokerResolver::brokerResolver(uint32_t defaultTtlMs, uint32_t retryMs)
+    : configuredPort_(1883), method_(MDNS_BROWSE), port_(1883), hasAddress_(false),
+      expiresMs_(0), retryAtMs_(0), defaultTtlMs_(defaultTtlMs), retryMs_(retryMs),
+      lookupActive_(false), lookupTimedOut_(false), lookupStartMs_(0), mdnsQuery_(nullptr),
+      dnsState_(DNS_IDLE), dnsIp_(0), lookups_(0), lastLookupMs_(0)
+{
+}
+
+brokerResolver::~brokerResolver()
+{
+    cancelMdns();
+}
+
+// Select how the broker is found; an empty host means mDNS discovery
+void brokerResolver::setHost(const String& host, uint16_t port)
+{
+    host_           = host;
+    configuredPort_ = port;
+    port_           = port;
+    source_         = host;
+    cancelMdns();
+    lookupActive_ = dnsState_ == DNS_PENDING;   // a DNS query cannot be cancelled, its answer is discarded
+    retryAtMs_    = 0;
+
+    IPAddress literal;
+    if (host.length() == 0) {
+        method_ = MDNS_BROWSE;
+        hasAddress_ = false;
+    } else if (literal.fromString(host)) {
+        method_     = LITERAL;
+        address_    = literal;
+        hasAddress_ = true;
+    } else {
+        method_ = host.endsWith(".local") ? MDNS_HOST : DNS;
+        hasAddress_ = false;
+    }
+}
+
+void brokerResolver::seed(IPAddress ip, uint16_t port)
+{
+    if (method_ == LITERAL) return;
+    address_    = ip;
+    port_       = port;
+    hasAddress_ = true;
+    expiresMs_  = millis();
+}
+
+void brokerResolver::invalidate()
+{
+    if (method_ == LITERAL) return;
+    expiresMs_ = millis();
+    retryAtMs_ = 0;
+}
+
+void brokerResolver::forget()
+{
+    if (method_ == LITERAL) return;
+    hasAddress_ = false;
+    retryAtMs_  = 0;
+}
+
+bool brokerResolver::poll()
+{
+    if (method_ == LITERAL) return true;
+
+    uint32_t now = millis();
+    if (lookupActive_) {
+        if (mdnsQuery_) {
+            pollMdns();
+        } else {
+            uint8_t st = dnsState_;
+            if (st == DNS_FOUND || st == DNS_FAILED) {
+                dnsState_ = DNS_IDLE;
+                if (lookupHost_ != host_ || method_ != DNS) lookupActive_ = false;   // host changed meanwhile
+                else if (st == DNS_FAILED && lookupTimedOut_) lookupActive_ = false;  // already reported
+                else finishLookup(st == DNS_FOUND, dnsIp_, configuredPort_, defaultTtlMs_, host_.c_str());
+            } else if (!lookupTimedOut_ && now - lookupStartMs_ > DNS_TIMEOUT_MS) {
+                // Reported once; a later answer is still accepted as a normal result
+                finishLookup(false, 0, 0, 0, nullptr);
+                lookupTimedOut_ = true;
+                lookupActive_   = dnsState_ == DNS_PENDING;
+            }
+        }
+    }
+
+    bool expired = hasAddress_ && (int32_t)(now - expiresMs_) >= 0;
+    if (hasAddress_ && !expired) return true;
+    if (!lookupActive_ && (int32_t)(now - retryAtMs_) >= 0) startLookup();
+    return hasAddress_;   // stale entries are still served while refreshing
+}
+
+bool brokerResolver::startLookup()
+{
+    lookups_++;
+    lookupStartMs_  = millis();
+    lookupActive_   = true;
+    lookupTimedOut_ = false;
+
+    if (method_ == DNS) {
+        if (dnsState_ == DNS_PENDING) return true;   // an older query still owns the callback
+        lookupHost_ = host_;
+        dnsState_   = DNS_PENDING;
+        if (tcpip_callback(dnsStart, this) != ERR_OK) {
+            dnsState_ = DNS_IDLE;
+            finishLookup(false, 0, 0, 0, nullptr);
+            return false;
+        }
+        return true;
+    }
+
+    if (method_ == MDNS_HOST) {
+        String name = host_.substring(0, host_.length() - 6);   // strip ".local"
+        mdnsQuery_ = mdns_query_async_new(name.c_str(), NULL, NULL, MDNS_TYPE_A, MDNS_HOST_TIMEOUT_MS, 1, NULL);
+    } else {
+        mdnsQuery_ = mdns_query_async_new(NULL, "_mqtt", "_tcp", MDNS_TYPE_PTR, MDNS_BROWSE_TIMEOUT_MS, 4, NULL);
+    }
+    if (!mdnsQuery_) {   // mDNS not started yet (no IP)
+        finishLookup(false, 0, 0, 0, nullptr);
+        return false;
+    }
+    return true;
+}
+
+void brokerResolver::pollMdns()
+{
+    mdns_result_t* results = nullptr;
+    if (!mdns_query_async_get_results(mdnsQuery_, 0, &results)) return;   // still running
+
+    bool found = false;
+    for (mdns_result_t* r = results; r && !found; r = r->next) {
+        for (mdns_ip_addr_t* a = r->addr; a; a = a->next) {
+            if (a->addr.type != ESP_IPADDR_TYPE_V4) continue;
+            uint16_t port = method_ == MDNS_BROWSE && r->port ? r->port : configuredPort_;
+            uint32_t ttl  = r->ttl ? min((uint32_t)r->ttl * 1000, MAX_TTL_MS) : defaultTtlMs_;
+            const char* src = method_ == MDNS_BROWSE && r->instance_name ? r->instance_name : host_.c_str();
+            finishLookup(true, a->addr.u_addr.ip4.addr, port, ttl, src);
+            found = true;
+            break;
+        }
+    }
+    if (results) mdns_query_results_free(results);
+    cancelMdns();
+    if (!found) finishLookup(false, 0, 0, 0, nullptr);
+}
+
+void brokerResolver::finishLookup(bool ok, uint32_t ip, uint16_t port, uint32_t ttlMs, const char* source)
+{
+    lookupActive_ = false;
+    lastLookupMs_ = millis() - lookupStartMs_;
+    if (!ok) {
+        retryAtMs_ = millis() + retryMs_;
+        LOG_WARN("broker lookup failed after %u ms", lastLookupMs_);
+        return;
+    }
+    address_    = IPAddress(ip);
+    port_       = port;
+    source_     = source;
+    hasAddress_ = true;
+    expiresMs_  = millis() + ttlMs;
+    LOG_INFO("broker %s resolved in %u ms", source_.c_str(), lastLookupMs_);
+}
+
+void brokerResolver::cancelMdns()
+{
+    if (mdnsQuery_) {
+        mdns_query_async_delete(mdnsQuery_);
+        mdnsQuery_ = nullptr;
+    }
+}
+
+// Runs on the tcpip task
+void brokerResolver::dnsStart(void* ctx)
+{
+    brokerResolver* self = (brokerResolver*)ctx;
+    ip_addr_t addr;
+    err_t err = dns_gethostbyname(self->lookupHost_.c_str(), &addr, dnsFound, self);
+    if (err == ERR_OK) dnsFound(nullptr, &addr, self);   // answered from the lwip cache
+    else if (err != ERR_INPROGRESS) self->dnsState_ = DNS_FAILED;
+}
+
+// Runs on the tcpip task
+void brokerResolver::dnsFound(const char*, const ip_addr_t* ip, void* ctx)
+{
+    brokerResolver* self = (brokerResolver*)ctx;
+    if (ip && IP_IS_V4(ip)) {
+        self->dnsIp_    = ip4_addr_get_u32(ip_2_ip4(ip));
+        self->dnsState_ = DNS_FOUND;
+    } else {
+        self->dnsState_ = DNS_FAILED;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef BROKERRESOLVER_H
+#define BROKERRESOLVER_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <atomic>
+#include <lwip/ip_addr.h>
+#include <mdns.h>
+
+// Non-blocking broker address resolution with a TTL cache.
+//
+//   - an IP literal is used as is;
+//   - "<name>.local" is resolved with an async mDNS A query;
+//   - any other host name goes through the lwip DNS resolver asynchronously;
+//   - an empty host browses for "_mqtt._tcp" services and takes the first
+//     one with an IPv4 address (and its advertised port).
+//
+// poll() never blocks: it drives the pending lookup and returns true while a
+// usable address is cached. An expired entry keeps being served until the
+// refresh completes, so reconnects do not wait on the resolver.
+class brokerResolver
+{
+public:
+    brokerResolver(uint32_t defaultTtlMs = 600000, uint32_t retryMs = 5000);
+    ~brokerResolver();
+
+    void setHost(const String& host, uint16_t port);
+    void seed(IPAddress ip, uint16_t port);   // last known address, served until refreshed
+    void invalidate();            // expire the cache (still served while refreshing), e.g. new network
+    void forget();                // drop the cached address, e.g. it refused connections
+    bool poll();
+
+    bool          hasAddress() const { return hasAddress_ || method_ == LITERAL; }
+    IPAddress     address() const { return address_; }
+    uint16_t      port() const    { return port_; }
+    const String& source() const  { return source_; }   // host or discovered instance
+
+    uint32_t lookups() const      { return lookups_; }
+    uint32_t lastLookupMs() const { return lastLookupMs_; }
+
+private:
+    enum method : uint8_t { LITERAL, DNS, MDNS_HOST, MDNS_BROWSE };
+
+    bool startLookup();
+    void finishLookup(bool ok, uint32_t ip, uint16_t port, uint32_t ttlMs, const char* source);
+    void pollMdns();
+    void cancelMdns();
+
+    static void dnsStart(void* ctx);
+    static void dnsFound(const char* name, const ip_addr_t* ip, void* ctx);
+
+    String    host_;
+    String    lookupHost_;     // host of the lookup in flight, read by the tcpip task
+    uint16_t  configuredPort_;
+    method    method_;
+    IPAddress address_;
+    uint16_t  port_;
+    String    source_;
+    bool      hasAddress_;
+    uint32_t  expiresMs_;
+    uint32_t  retryAtMs_;
+    uint32_t  defaultTtlMs_;
+    uint32_t  retryMs_;
+
+    bool                  lookupActive_;
+    bool                  lookupTimedOut_;   // the in-flight DNS lookup was already reported as failed
+    uint32_t              lookupStartMs_;
+    mdns_search_once_t*   mdnsQuery_;
+    std::atomic<uint8_t>  dnsState_;   // 0 idle, 1 pending, 2 found, 3 failed (set on the tcpip task)
+    std::atomic<uint32_t> dnsIp_;
+
+    uint32_t lookups_;
+    uint32_t lastLookupMs_;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "deltaPatch.h"
+
+#include <string.h>
+
+static uint32_t readLe32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void deltaPatch::begin(uint32_t oldSize, uint32_t newSize, readFn reader, writeFn writer, void* ctx)
+{
+    reader_     = reader;
+    writer_     = writer;
+    ctx_        = ctx;
+    oldSize_    = oldSize;
+    newSize_    = newSize;
+    written_    = 0;
+    oldPos_     = 0;
+    stage_      = CONTROL;
+    controlLen_ = 0;
+    diffLeft_   = 0;
+    extraLeft_  = 0;
+    seek_       = 0;
+    outLen_     = 0;
+}
+
+deltaPatch::status deltaPatch::flushOut()
+{
+    if (outLen_ == 0) return OK;
+    if (!writer_(ctx_, out_, outLen_)) return ERROR_WRITE;
+    written_ += outLen_;
+    outLen_ = 0;
+    return OK;
+}
+
+// Consume decompressed patch bytes, producing new image bytes through the writer
+deltaPatch::status deltaPatch::feed(const uint8_t* data, size_t len)
+{
+    while (len > 0)
+    {
+        if (stage_ == CONTROL)
+        {
+            size_t n = sizeof(control_) - controlLen_;
+            if (n > len) n = len;
+            memcpy(control_ + controlLen_, data, n);
+            controlLen_ += n;
+            data += n;
+            len -= n;
+            if (controlLen_ < sizeof(control_)) break;
+
+            controlLen_ = 0;
+            diffLeft_   = readLe32(control_);
+            extraLeft_  = readLe32(control_ + 4);
+            seek_       = (int32_t)readLe32(control_ + 8);
+            if ((uint64_t)written_ + outLen_ + diffLeft_ + extraLeft_ > newSize_) return ERROR_OVERFLOW;
+            if (oldPos_ < 0 || oldPos_ + diffLeft_ > oldSize_) return ERROR_FORMAT;
+            stage_ = diffLeft_ ? DIFF : EXTRA;
+        }
+        else if (stage_ == DIFF)
+        {
+            size_t n = diffLeft_;
+            if (n > len) n = len;
+            if (n > SCRATCH - outLen_) n = SCRATCH - outLen_;
+            if (!reader_(ctx_, (uint32_t)oldPos_, old_, n)) return ERROR_READ;
+            for (size_t i = 0; i < n; ++i) out_[outLen_ + i] = old_[i] + data[i];
+            outLen_   += n;
+            oldPos_   += n;
+            diffLeft_ -= n;
+            data      += n;
+            len       -= n;
+            if (diffLeft_ == 0) stage_ = EXTRA;
+        }
+        else
+        {
+            size_t n = extraLeft_;
+            if (n > len) n = len;
+            if (n > SCRATCH - outLen_) n = SCRATCH - outLen_;
+            memcpy(out_ + outLen_, data, n);
+            outLen_    += n;
+            extraLeft_ -= n;
+            data       += n;
+            len        -= n;
+        }
+
+        if (outLen_ == SCRATCH)
+        {
+            status s = flushOut();
+            if (s != OK) return s;
+        }
+
+        if (stage_ == EXTRA && extraLeft_ == 0)
+        {
+            oldPos_ += seek_;
+            stage_ = CONTROL;
+        }
+    }
+
+    if ((uint64_t)written_ + outLen_ == newSize_ && stage_ == CONTROL && controlLen_ == 0)
+    {
+        status s = flushOut();
+        return s == OK ? FINISHED : s;
+    }
+    return OK;
+}
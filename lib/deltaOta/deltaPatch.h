@@ -0,0 +1,53 @@
+#ifndef DELTAPATCH_H
+#define DELTAPATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming applier for bsdiff-style patches. The (already decompressed) patch
+// is a sequence of blocks:
+//   u32 diffLen, u32 extraLen, i32 seek      (little endian)
+//   diffLen bytes  added to the old image at the current old position
+//   extraLen bytes copied verbatim
+// after which the old position advances by diffLen + seek.
+// Only a fixed-size scratch buffer is used, independent of image size.
+class deltaPatch
+{
+public:
+    typedef bool (*readFn)(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+    typedef bool (*writeFn)(void* ctx, const uint8_t* buf, size_t len);
+
+    enum status : uint8_t { OK, FINISHED, ERROR_FORMAT, ERROR_READ, ERROR_WRITE, ERROR_OVERFLOW };
+
+    void   begin(uint32_t oldSize, uint32_t newSize, readFn reader, writeFn writer, void* ctx);
+    status feed(const uint8_t* data, size_t len);
+
+    uint32_t written() const { return written_; }
+    bool     finished() const { return written_ == newSize_; }
+
+private:
+    enum stage : uint8_t { CONTROL, DIFF, EXTRA };
+
+    static const size_t SCRATCH = 256;
+
+    status flushOut();
+
+    readFn   reader_;
+    writeFn  writer_;
+    void*    ctx_;
+    uint32_t oldSize_;
+    uint32_t newSize_;
+    uint32_t written_;
+    int64_t  oldPos_;
+    stage    stage_;
+    uint8_t  control_[12];
+    uint8_t  controlLen_;
+    uint32_t diffLeft_;
+    uint32_t extraLeft_;
+    int32_t  seek_;
+    uint8_t  old_[SCRATCH];
+    uint8_t  out_[SCRATCH];
+    size_t   outLen_;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "otaUpdater.h"
+
+#include <binLog.h>
+#include <string.h>
+
+static uint32_t readLe32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+otaUpdater::otaUpdater()
+    : running_(nullptr), target_(nullptr), handle_(0), newSize_(0), patchSize_(0), received_(0),
+      active_(false), completed_(false), error_("")
+{
+}
+
+otaUpdater::~otaUpdater()
+{
+    abort();
+}
+
+// Validate the header against the running image and open the inactive partition
+bool otaUpdater::begin(const uint8_t* header, size_t len)
+{
+    abort();
+    completed_ = false;
+
+    if (len < HEADER_SIZE || memcmp(header, "IDP1", 4) != 0) return fail("bad header");
+
+    uint32_t oldSize = readLe32(header + 4);
+    newSize_         = readLe32(header + 8);
+    patchSize_       = readLe32(header + 12);
+    memcpy(newSha_, header + 48, 32);
+
+    running_ = esp_ota_get_running_partition();
+    target_  = esp_ota_get_next_update_partition(nullptr);
+    if (!running_ || !target_) return fail("no ota partition");
+    if (oldSize > running_->size || newSize_ > target_->size) return fail("image too large");
+
+    uint8_t oldSha[32];
+    if (!hashRunningImage(oldSize, oldSha)) return fail("read error");
+    if (memcmp(oldSha, header + 16, 32) != 0) return fail("base image mismatch");
+
+    if (inflater_.begin(&patch_) != patchInflater::OK) return fail("out of memory");
+    received_ = 0;
+
+    if (esp_ota_begin(target_, newSize_, &handle_) != ESP_OK) return fail("ota begin");
+
+    mbedtls_sha256_init(&sha_);
+    mbedtls_sha256_starts(&sha_, 0);
+    patch_.begin(oldSize, newSize_, readOld, writeNew, this);
+    active_ = true;
+    return true;
+}
+
+// Inflate one chunk of patch data and apply it; chunks must arrive in order
+bool otaUpdater::chunk(uint32_t offset, const uint8_t* data, size_t len)
+{
+    if (!active_) return fail("not started");
+    if (offset != received_) return true;   // duplicate or out of order, sender resumes from nextOffset()
+    if (received_ + len > patchSize_) return fail("patch overflow");
+
+    received_ += len;
+    bool last = received_ == patchSize_;
+
+    patchInflater::status st = inflater_.feed(data, len, last);
+    if (st == patchInflater::ERROR_PATCH) return fail("patch error");
+    if (st != patchInflater::OK) return fail("inflate error");
+
+    if (!last) return true;
+
+    uint8_t sha[32];
+    mbedtls_sha256_finish(&sha_, sha);
+    mbedtls_sha256_free(&sha_);
+    if (!patch_.finished()) return fail("short image");
+    if (memcmp(sha, newSha_, 32) != 0) return fail("hash mismatch");
+    if (esp_ota_end(handle_) != ESP_OK) { handle_ = 0; return fail("image invalid"); }
+    handle_ = 0;
+    if (esp_ota_set_boot_partition(target_) != ESP_OK) return fail("set boot partition");
+
+    release();
+    active_    = false;
+    completed_ = true;
+    return true;
+}
+
+void otaUpdater::abort()
+{
+    if (handle_) esp_ota_abort(handle_);
+    if (active_) mbedtls_sha256_free(&sha_);
+    handle_ = 0;
+    active_ = false;
+    release();
+}
+
+bool otaUpdater::fail(const char* error)
+{
+    error_ = error;
+    LOG_ERROR("ota failed: %s", error);
+    abort();
+    return false;
+}
+
+void otaUpdater::release()
+{
+    inflater_.release();
+}
+
+bool otaUpdater::hashRunningImage(uint32_t size, uint8_t out[32])
+{
+    uint8_t buf[512];
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    for (uint32_t pos = 0; pos < size; pos += sizeof(buf))
+    {
+        size_t n = size - pos < sizeof(buf) ? size - pos : sizeof(buf);
+        if (esp_partition_read(running_, pos, buf, n) != ESP_OK)
+        {
+            mbedtls_sha256_free(&ctx);
+            return false;
+        }
+        mbedtls_sha256_update(&ctx, buf, n);
+    }
+    mbedtls_sha256_finish(&ctx, out);
+    mbedtls_sha256_free(&ctx);
+    return true;
+}
+
+bool otaUpdater::readOld(void* ctx, uint32_t offset, uint8_t* buf, size_t len)
+{
+    otaUpdater* self = (otaUpdater*)ctx;
+    return esp_partition_read(self->running_, offset, buf, len) == ESP_OK;
+}
+
+bool otaUpdater::writeNew(void* ctx, const uint8_t* buf, size_t len)
+{
+    otaUpdater* self = (otaUpdater*)ctx;
+    mbedtls_sha256_update(&self->sha_, buf, len);
+    return esp_ota_write(self->handle_, buf, len) == ESP_OK;
+}
@@ -0,0 +1,57 @@
+#ifndef OTAUPDATER_H
+#define OTAUPDATER_H
+
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include "deltaPatch.h"
+#include "patchInflater.h"
+
+// Applies a compressed delta patch against the running image into the inactive
+// OTA partition, chunk by chunk. RAM use is bounded by the inflate window.
+//
+// Header (80 bytes, little endian):
+//   "IDP1", u32 oldSize, u32 newSize, u32 patchSize, u8 oldSha256[32], u8 newSha256[32]
+// followed by patchSize bytes of raw deflate data holding the deltaPatch stream.
+class otaUpdater
+{
+public:
+    static const size_t HEADER_SIZE = 80;
+
+    otaUpdater();
+    ~otaUpdater();
+
+    bool begin(const uint8_t* header, size_t len);
+    bool chunk(uint32_t offset, const uint8_t* data, size_t len);
+    void abort();
+
+    bool        active() const { return active_; }
+    bool        completed() const { return completed_; }
+    uint32_t    nextOffset() const { return received_; }
+    uint32_t    patchSize() const { return patchSize_; }
+    const char* lastError() const { return error_; }
+
+private:
+    bool fail(const char* error);
+    void release();
+    bool hashRunningImage(uint32_t size, uint8_t out[32]);
+
+    static bool readOld(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+    static bool writeNew(void* ctx, const uint8_t* buf, size_t len);
+
+    const esp_partition_t* running_;
+    const esp_partition_t* target_;
+    esp_ota_handle_t       handle_;
+    mbedtls_sha256_context sha_;
+    deltaPatch             patch_;
+    patchInflater          inflater_;
+    uint32_t               newSize_;
+    uint32_t               patchSize_;
+    uint32_t               received_;
+    uint8_t                newSha_[32];
+    bool                   active_;
+    bool                   completed_;
+    const char*            error_;
+};
+
+#endif
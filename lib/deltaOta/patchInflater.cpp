@@ -0,0 +1,74 @@
+#include "patchInflater.h"
+
+#include <stdlib.h>
+#if !defined(ESP_PLATFORM)
+#include "miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32C3
+#include "esp32c3/rom/miniz.h"
+#else
+#include "rom/miniz.h"
+#endif
+
+patchInflater::patchInflater()
+    : patch_(nullptr), inflator_(nullptr), dict_(nullptr), dictOfs_(0), inflated_(0)
+{
+}
+
+patchInflater::~patchInflater()
+{
+    release();
+}
+
+patchInflater::status patchInflater::begin(deltaPatch* patch)
+{
+    release();
+    inflator_ = malloc(sizeof(tinfl_decompressor));
+    dict_     = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+    if (!inflator_ || !dict_)
+    {
+        release();
+        return ERROR_MEMORY;
+    }
+    tinfl_init((tinfl_decompressor*)inflator_);
+    patch_    = patch;
+    dictOfs_  = 0;
+    inflated_ = 0;
+    return OK;
+}
+
+// tinfl writes at most up to the end of the dictionary; HAS_MORE_OUTPUT then
+// asks for another pass once those bytes are consumed and the offset wrapped
+patchInflater::status patchInflater::feed(const uint8_t* data, size_t len, bool last)
+{
+    mz_uint32 flags = last ? 0 : TINFL_FLAG_HAS_MORE_INPUT;
+
+    for (;;)
+    {
+        size_t inBytes  = len;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - dictOfs_;
+        tinfl_status st = tinfl_decompress((tinfl_decompressor*)inflator_, data, &inBytes,
+                                           dict_, dict_ + dictOfs_, &outBytes, flags);
+        data += inBytes;
+        len  -= inBytes;
+
+        if (outBytes)
+        {
+            deltaPatch::status ps = patch_->feed(dict_ + dictOfs_, outBytes);
+            if (ps != deltaPatch::OK && ps != deltaPatch::FINISHED) return ERROR_PATCH;
+            dictOfs_   = (dictOfs_ + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+            inflated_ += outBytes;
+        }
+
+        if (st < TINFL_STATUS_DONE) return ERROR_INFLATE;
+        if (st == TINFL_STATUS_DONE) return OK;
+        if (st == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) return OK;
+    }
+}
+
+void patchInflater::release()
+{
+    free(inflator_);
+    free(dict_);
+    inflator_ = nullptr;
+    dict_     = nullptr;
+}
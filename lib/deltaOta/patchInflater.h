@@ -0,0 +1,34 @@
+#ifndef PATCHINFLATER_H
+#define PATCHINFLATER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "deltaPatch.h"
+
+// Inflates the raw deflate stream of a delta patch with tinfl and feeds it to
+// a deltaPatch. The 32 KiB dictionary doubles as the output window and wraps,
+// so RAM use does not depend on the image size. Uses the ROM miniz on the
+// device and a single-file miniz on the host (tools/ota/applyDelta.cpp).
+class patchInflater
+{
+public:
+    enum status : uint8_t { OK, ERROR_MEMORY, ERROR_INFLATE, ERROR_PATCH };
+
+    patchInflater();
+    ~patchInflater();
+
+    status begin(deltaPatch* patch);
+    status feed(const uint8_t* data, size_t len, bool last);   // chunks in order, `last` on the final one
+    void   release();
+
+    uint32_t inflated() const { return inflated_; }
+
+private:
+    deltaPatch* patch_;
+    void*       inflator_;
+    uint8_t*    dict_;
+    size_t      dictOfs_;
+    uint32_t    inflated_;
+};
+
+#endif
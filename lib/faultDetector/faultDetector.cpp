@@ -0,0 +1,106 @@
+#include "faultDetector.h"
+
+faultDetector::faultDetector(const limits& l) : limits_(l), checks_(ALL_CHECKS)
+{
+    reset();
+}
+
+void faultDetector::reset()
+{
+    st_ = state();
+}
+
+faultDetector::fault faultDetector::onSample(int moisture, uint32_t nowMs)
+{
+    // A railed reading says nothing about the soil: it only feeds the rail check
+    bool railed = moisture <= limits_.railLow || moisture >= limits_.railHigh;
+    st_.railRun = railed ? (st_.railRun < 0xFFFF ? st_.railRun + 1 : st_.railRun) : 0;
+    if (railed)
+    {
+        return enabled(SENSOR_RAILED) && st_.railRun >= limits_.railSamples ? SENSOR_RAILED : NONE;
+    }
+
+    int32_t m = moisture * 16;
+    if (!st_.primed)
+    {
+        st_.primed   = true;
+        st_.smoothQ4 = m;
+        st_.dryMaxQ4 = m;
+        st_.flatRef  = moisture;
+    }
+    st_.smoothQ4 += (m - st_.smoothQ4) / (1 << limits_.smoothShift);
+
+    int diff = moisture - st_.flatRef;
+    if (diff <= limits_.flatSpan && -diff <= limits_.flatSpan)
+    {
+        if (st_.flatRun < 0xFFFF) st_.flatRun++;
+    }
+    else
+    {
+        st_.flatRef = moisture;
+        st_.flatRun = 1;
+    }
+    if (enabled(SENSOR_FLAT) && st_.flatRun >= limits_.flatSamples) return SENSOR_FLAT;
+
+    if (st_.inEvent)
+    {
+        if (st_.smoothQ4 < st_.eventMinQ4) st_.eventMinQ4 = st_.smoothQ4;
+        if (st_.open || !st_.closed || nowMs - st_.closedMs < limits_.responseMs) return NONE;
+
+        // Response window over: judge the event, then watch for leaks from here
+        st_.inEvent  = false;
+        st_.dryMaxQ4 = st_.smoothQ4;
+        st_.leakRun  = 0;
+        if (st_.openMs < limits_.responseMinMs) return NONE;
+        st_.lastDrop = (int16_t)((st_.eventBaseQ4 - st_.eventMinQ4) / 16);
+        st_.misses   = st_.lastDrop < limits_.responseDrop ? st_.misses + 1 : 0;
+        return enabled(NO_RESPONSE) && st_.misses >= limits_.responseEvents ? NO_RESPONSE : NONE;
+    }
+
+    if (st_.smoothQ4 > st_.dryMaxQ4) st_.dryMaxQ4 = st_.smoothQ4;
+    if (st_.dryMaxQ4 - st_.smoothQ4 > limits_.leakDrop * 16)
+    {
+        if (st_.leakRun < 0xFFFF) st_.leakRun++;
+    }
+    else
+    {
+        st_.leakRun = 0;
+    }
+    return enabled(LEAK) && st_.leakRun >= limits_.leakSamples ? LEAK : NONE;
+}
+
+// The event starts from the smoothed reading at its first opening; valve time
+// adds up over its openings
+void faultDetector::valve(bool open, uint32_t nowMs)
+{
+    if (open == st_.open) return;
+    st_.open = open;
+    if (open)
+    {
+        st_.openedMs = nowMs;
+        if (st_.inEvent || !st_.primed) return;
+        st_.inEvent     = true;
+        st_.eventBaseQ4 = st_.smoothQ4;
+        st_.eventMinQ4  = st_.smoothQ4;
+        st_.closed      = false;
+        st_.openMs      = 0;
+    }
+    else if (st_.inEvent)
+    {
+        st_.openMs += nowMs - st_.openedMs;
+        if (!st_.closed) st_.closedMs = nowMs;
+        st_.closed = true;
+    }
+}
+
+const char* faultDetector::name(fault f)
+{
+    switch (f)
+    {
+    case SENSOR_RAILED: return "sensor_railed";
+    case SENSOR_FLAT:   return "sensor_flat";
+    case NO_RESPONSE:   return "no_response";
+    case LEAK:          return "leak";
+    default:            return "none";
+    }
+}
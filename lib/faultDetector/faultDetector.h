@@ -0,0 +1,102 @@
+#ifndef FAULTDETECTOR_H
+#define FAULTDETECTOR_H
+
+#include <stdint.h>
+
+// Streaming plausibility checks on the moisture readings, correlated with the
+// valve state, so a broken relay, a burst pipe or a dead probe stops the
+// watering instead of running it forever. Readings are higher when drier.
+//
+//   SENSOR_RAILED  railSamples readings in a row at an ADC rail: a shorted or
+//                  disconnected probe (the latter reads bone dry)
+//   SENSOR_FLAT    flatSamples readings in a row within +-flatSpan of each
+//                  other: a stuck ADC or a probe out of the soil
+//   NO_RESPONSE    responseEvents events in a row whose smoothed reading did
+//                  not drop by responseDrop within responseMs of the valve
+//                  first closing: the valve or the supply is not delivering
+//   LEAK           with the valve closed (and past the response window), the
+//                  smoothed reading stayed leakDrop below the driest value
+//                  since for leakSamples: water arrives from elsewhere
+//
+// Openings before the response window is over belong to the same event: the
+// pulses of a cycle-and-soak event, or a dry soil asking for water again right
+// after a short event. The window runs from the first closing, so an event
+// that keeps reopening (a valve that delivers nothing) is still judged.
+//
+// Each check is O(1) per sample over a few integers of state and fires within
+// a bounded number of samples (events for NO_RESPONSE). The state is plain
+// data so a deep-sleep device can keep it in RTC memory. Latching and the
+// lockout are the caller's.
+class faultDetector
+{
+public:
+    enum fault : uint8_t { NONE, SENSOR_RAILED, SENSOR_FLAT, NO_RESPONSE, LEAK };
+
+    static const uint8_t ALL_CHECKS = (1 << SENSOR_RAILED) | (1 << SENSOR_FLAT) | (1 << NO_RESPONSE) | (1 << LEAK);
+
+    struct limits
+    {
+        uint16_t railLow;            // at or below: shorted probe
+        uint16_t railHigh;           // at or above: disconnected probe
+        uint16_t railSamples;
+        uint16_t flatSpan;
+        uint16_t flatSamples;
+        uint16_t responseDrop;       // counts, smoothed reading before the event minus its lowest
+        uint32_t responseMs;         // judged this long after the valve first closed
+        uint32_t responseMinMs;      // events with less valve time are not judged
+        uint8_t  responseEvents;
+        uint16_t leakDrop;
+        uint16_t leakSamples;
+        uint8_t  smoothShift;        // EWMA weight 1 / 2^shift
+    };
+
+    struct state
+    {
+        bool     primed;
+        bool     open;
+        bool     inEvent;            // opened and not judged yet
+        bool     closed;             // the event closed the valve at least once
+        uint8_t  misses;             // events in a row without a response
+        int32_t  smoothQ4;           // EWMA of the reading, Q4
+        int32_t  eventBaseQ4;        // smoothed reading when the event opened the valve
+        int32_t  eventMinQ4;
+        int32_t  dryMaxQ4;           // driest smoothed reading since the last event
+        int16_t  flatRef;
+        int16_t  lastDrop;           // response of the last judged event, counts
+        uint16_t railRun;
+        uint16_t flatRun;
+        uint16_t leakRun;
+        uint32_t openedMs;
+        uint32_t closedMs;           // first closing of the event
+        uint32_t openMs;             // valve time of the current event
+    };
+
+    explicit faultDetector(const limits& l);
+
+    // Feed every moisture sample; the first fault found, if any
+    fault onSample(int moisture, uint32_t nowMs);
+    void  valve(bool open, uint32_t nowMs);
+
+    // The last reading was at a rail: not worth a watering decision even
+    // before SENSOR_RAILED fires
+    bool railed() const { return st_.railRun > 0; }
+
+    void          setLimits(const limits& l) { limits_ = l; }
+    const limits& getLimits() const          { return limits_; }
+    void          setChecks(uint8_t mask)    { checks_ = mask & ALL_CHECKS; }
+    uint8_t       getChecks() const          { return checks_; }
+    const state&  get() const                { return st_; }
+    void          set(const state& s)        { st_ = s; }
+    void          reset();
+
+    static const char* name(fault f);
+
+private:
+    bool enabled(fault f) const { return checks_ & (1 << f); }
+
+    limits  limits_;
+    state   st_;
+    uint8_t checks_;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#include "historyStore.h"
+
+namespace
+{
+
+const size_t READ_BATCH = 16;   // records per store read
+
+void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = v; p[1] = v >> 8;
+}
+
+void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+uint16_t get16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint16_t saturate16(uint64_t v)
+{
+    return v > 0xFFFF ? 0xFFFF : (uint16_t)v;
+}
+
+}
+
+historyStore::historyStore(store& s, uint8_t segments, uint32_t perSegment)
+    : store_(s),
+      segments_(segments < MAX_SEGMENTS ? segments : MAX_SEGMENTS),
+      perSegment_(perSegment),
+      count_(0),
+      last_(0),
+      refused_(0),
+      reads_(0)
+{
+}
+
+// Layout: u32 start, u16 count, u16 min, u16 max, u16 mean, u16 valve seconds
+void historyStore::encode(uint8_t* out, const record& r)
+{
+    put32(out, r.start);
+    put16(out + 4, r.count);
+    put16(out + 6, r.min);
+    put16(out + 8, r.max);
+    put16(out + 10, r.mean);
+    put16(out + 12, r.valveSec);
+}
+
+void historyStore::decode(const uint8_t* in, record& r)
+{
+    r.start    = get32(in);
+    r.count    = get16(in + 4);
+    r.min      = get16(in + 6);
+    r.max      = get16(in + 8);
+    r.mean     = get16(in + 10);
+    r.valveSec = get16(in + 12);
+}
+
+uint32_t historyStore::startAt(const segmentInfo& s, uint32_t index)
+{
+    uint8_t buf[4];
+    reads_++;
+    if (store_.read(s.slot, index * RECORD_BYTES, buf, sizeof(buf)) != sizeof(buf)) return 0;
+    return get32(buf);
+}
+
+void historyStore::load()
+{
+    count_ = 0;
+    last_  = 0;
+    reads_ = 0;
+    for (uint8_t slot = 0; slot < segments_; ++slot)
+    {
+        uint32_t bytes = store_.size(slot);
+        uint32_t n     = bytes / RECORD_BYTES;
+        if (n == 0)
+        {
+            if (bytes) store_.erase(slot);   // only a torn first record
+            continue;
+        }
+        segmentInfo s = {slot, 0, n, n >= perSegment_ || bytes % RECORD_BYTES != 0};
+        s.first = startAt(s, 0);
+
+        // Insertion by first record time; at most MAX_SEGMENTS entries
+        uint8_t i = count_++;
+        while (i > 0 && order_[i - 1].first > s.first)
+        {
+            order_[i] = order_[i - 1];
+            --i;
+        }
+        order_[i] = s;
+    }
+    if (count_)
+    {
+        const segmentInfo& tail = order_[count_ - 1];
+        last_ = startAt(tail, tail.count - 1);
+    }
+}
+
+bool historyStore::append(const record& r)
+{
+    if (count_ && r.start <= last_)
+    {
+        refused_++;
+        return false;
+    }
+    if (count_ == 0 || order_[count_ - 1].sealed)
+    {
+        // Start a segment in a free slot, or in place of the oldest one
+        uint8_t slot = 0;
+        if (count_ < segments_)
+        {
+            for (bool used = true; used; ++slot)
+            {
+                used = false;
+                for (uint8_t i = 0; i < count_; ++i) used = used || order_[i].slot == slot;
+                if (!used) break;
+            }
+        }
+        else
+        {
+            slot = order_[0].slot;
+            for (uint8_t i = 1; i < count_; ++i) order_[i - 1] = order_[i];
+            count_--;
+        }
+        store_.erase(slot);
+        order_[count_++] = {slot, r.start, 0, false};
+    }
+
+    segmentInfo& tail = order_[count_ - 1];
+    uint8_t buf[RECORD_BYTES];
+    encode(buf, r);
+    if (!store_.append(tail.slot, buf, sizeof(buf)))
+    {
+        tail.sealed = true;          // it may hold part of the record now
+        if (tail.count == 0) count_--;
+        return false;
+    }
+    tail.count++;
+    if (tail.count >= perSegment_) tail.sealed = true;
+    last_ = r.start;
+    return true;
+}
+
+historyStore::cursor historyStore::seek(uint32_t t)
+{
+    // Last segment starting at or before t
+    uint8_t lo = 0, hi = count_;
+    while (lo < hi)
+    {
+        uint8_t mid = (lo + hi) / 2;
+        if (order_[mid].first <= t) lo = mid + 1;
+        else                        hi = mid;
+    }
+    if (lo == 0) return {0, 0};
+
+    // First record of it starting at or after t
+    const segmentInfo& s = order_[lo - 1];
+    uint32_t a = 0, b = s.count;
+    while (a < b)
+    {
+        uint32_t mid = a + (b - a) / 2;
+        if (startAt(s, mid) < t) a = mid + 1;
+        else                     b = mid;
+    }
+    if (a < s.count) return {(uint8_t)(lo - 1), a};
+    return {lo, 0};
+}
+
+size_t historyStore::read(cursor& c, record* out, size_t max)
+{
+    size_t n = 0;
+    while (n < max && !atEnd(c))
+    {
+        const segmentInfo& s = order_[c.order];
+        uint32_t batch = s.count - c.index;
+        if (batch > max - n)    batch = max - n;
+        if (batch > READ_BATCH) batch = READ_BATCH;
+
+        uint8_t buf[READ_BATCH * RECORD_BYTES];
+        reads_++;
+        size_t got = store_.read(s.slot, c.index * RECORD_BYTES, buf, batch * RECORD_BYTES) / RECORD_BYTES;
+        for (size_t i = 0; i < got; ++i) decode(buf + i * RECORD_BYTES, out[n++]);
+        c.index += got;
+        if (got < batch || c.index >= s.count) c = {(uint8_t)(c.order + 1), 0};   // a short read skips the rest
+        if (got < batch) break;
+    }
+    return n;
+}
+
+uint32_t historyStore::records() const
+{
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < count_; ++i) n += order_[i].count;
+    return n;
+}
+
+uint32_t historyStore::first() const
+{
+    return count_ ? order_[0].first : 0;
+}
+
+historyQuery::historyQuery(historyStore& h)
+    : store_(h), pos_(h.end()), from_(0), to_(0), step_(0), bucketStart_(0), count_(0), min_(0), max_(0), sum_(0),
+      valveSec_(0), done_(true)
+{
+}
+
+void historyQuery::begin(uint32_t from, uint32_t to, uint32_t stepSec)
+{
+    pos_         = store_.seek(from);
+    from_        = from;
+    to_          = to;
+    step_        = stepSec;
+    bucketStart_ = from;
+    count_       = 0;
+    done_        = false;
+}
+
+// Every stored record yields at most one output record (itself, or the bucket
+// it closes), so reading no more than the room left never overflows `out`
+size_t historyQuery::fill(historyStore::record* out, size_t max, uint32_t budget)
+{
+    size_t n = 0;
+    while (!done_ && n < max && budget > 0)
+    {
+        historyStore::record buf[READ_BATCH];
+        size_t want = max - n;
+        if (want > READ_BATCH) want = READ_BATCH;
+        if (want > budget)     want = budget;
+
+        size_t got = store_.read(pos_, buf, want);
+        if (got == 0)
+        {
+            flush(out, n);
+            done_ = true;
+            break;
+        }
+        budget -= got;
+        for (size_t i = 0; i < got; ++i)
+        {
+            const historyStore::record& r = buf[i];
+            if (r.start >= to_)
+            {
+                flush(out, n);
+                done_ = true;
+                break;
+            }
+            if (step_ == 0)
+            {
+                out[n++] = r;
+                continue;
+            }
+            if (r.count == 0) continue;
+            uint32_t bucket = from_ + (r.start - from_) / step_ * step_;
+            if (count_ && bucket != bucketStart_) flush(out, n);
+            if (count_ == 0)
+            {
+                bucketStart_ = bucket;
+                min_         = r.min;
+                max_         = r.max;
+                sum_         = 0;
+                valveSec_    = 0;
+            }
+            count_    += r.count;
+            sum_      += (uint64_t)r.mean * r.count;
+            valveSec_ += r.valveSec;
+            if (r.min < min_) min_ = r.min;
+            if (r.max > max_) max_ = r.max;
+        }
+    }
+    return n;
+}
+
+bool historyQuery::flush(historyStore::record* out, size_t& n)
+{
+    if (count_ == 0) return false;
+    historyStore::record& r = out[n++];
+    r.start    = bucketStart_;
+    r.count    = saturate16(count_);
+    r.min      = min_;
+    r.max      = max_;
+    r.mean     = (uint16_t)((sum_ + count_ / 2) / count_);
+    r.valveSec = saturate16(valveSec_);
+    count_     = 0;
+    return true;
+}
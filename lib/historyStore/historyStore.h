@@ -0,0 +1,135 @@
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded on-flash history of one-minute summaries (or any fixed window),
+// with time-range lookups in O(log n) reads.
+//
+// Records rotate over `segments` append-only segments of `perSegment`
+// records each; when the newest segment is full the oldest is erased and
+// reused, so storage never exceeds segments * perSegment * RECORD_BYTES. The
+// first record time of each segment is the sparse index, kept in RAM: a
+// lookup bisects the segments, then the fixed-size records of one segment.
+// Record times must increase; older or equal ones are refused (a clock
+// stepped back by NTP only costs the minutes it repeats).
+//
+// A segment whose size is not a whole number of records was cut short by a
+// reset during an append: its last partial record is ignored and it takes no
+// more appends.
+//
+// Storage is behind a small interface (LittleFS files on the device, memory
+// in the host simulator).
+class historyStore
+{
+public:
+    class store
+    {
+    public:
+        virtual ~store() {}
+        virtual uint32_t size(uint8_t segment) = 0;
+        virtual size_t   read(uint8_t segment, uint32_t offset, uint8_t* buf, size_t len) = 0;
+        virtual bool     append(uint8_t segment, const uint8_t* buf, size_t len) = 0;
+        virtual bool     erase(uint8_t segment) = 0;
+    };
+
+    struct record
+    {
+        uint32_t start;        // window start, epoch seconds
+        uint16_t count;        // samples
+        uint16_t min;
+        uint16_t max;
+        uint16_t mean;
+        uint16_t valveSec;     // saturates at 65535
+    };
+
+    // Position of a record: segment in time order, record inside it
+    struct cursor
+    {
+        uint8_t  order;
+        uint32_t index;
+    };
+
+    static const size_t  RECORD_BYTES = 14;
+    static const uint8_t MAX_SEGMENTS = 32;
+
+    historyStore(store& s, uint8_t segments, uint32_t perSegment);
+
+    // Rebuild the index from the store: one size and two record reads per segment
+    void load();
+    bool append(const record& r);
+
+    // First record starting at or after t; equal to end() if there is none
+    cursor seek(uint32_t t);
+    cursor end() const { return {count_, 0}; }
+    bool   atEnd(const cursor& c) const { return c.order >= count_; }
+
+    // Up to max consecutive records from c, advancing c; one store read per
+    // 16 records at most
+
+    size_t read(cursor& c, record* out, size_t max);
+
+    uint32_t records() const;
+    uint32_t capacity() const { return (uint32_t)segments_ * perSegment_; }
+    uint32_t first() const;                   // oldest record time, 0 if empty
+    uint32_t last() const  { return last_; }
+    uint32_t refused() const { return refused_; }
+    uint32_t reads() const { return reads_; }  // store reads since load(), for the O(log n) check
+
+    static void encode(uint8_t* out, const record& r);
+    static void decode(const uint8_t* in, record& r);
+
+private:
+    struct segmentInfo
+    {
+        uint8_t  slot;
+        uint32_t first;
+        uint32_t count;
+        bool     sealed;       // full or torn: takes no more appends
+    };
+
+    uint32_t startAt(const segmentInfo& s, uint32_t index);
+
+    store&      store_;
+    uint8_t     segments_;
+    uint32_t    perSegment_;
+    segmentInfo order_[MAX_SEGMENTS];   // non-empty segments, oldest first
+    uint8_t     count_;
+    uint32_t    last_;
+    uint32_t    refused_;
+    uint32_t    reads_;
+};
+
+// One range request, streamed: fill() produces the next output records,
+// merged into buckets of stepSec aligned to `from` (0 = the stored records as
+// they are), reading at most `budget` stored records per call so a long range
+// is spread over many passes. Only the partial bucket is kept in RAM.
+class historyQuery
+{
+public:
+    explicit historyQuery(historyStore& h);
+
+    void   begin(uint32_t from, uint32_t to, uint32_t stepSec);
+    size_t fill(historyStore::record* out, size_t max, uint32_t budget);
+    bool   done() const { return done_; }
+    void   cancel()     { done_ = true; }
+
+private:
+    bool flush(historyStore::record* out, size_t& n);
+
+    historyStore&          store_;
+    historyStore::cursor   pos_;
+    uint32_t               from_;
+    uint32_t               to_;
+    uint32_t               step_;
+    uint32_t               bucketStart_;
+    uint32_t               count_;
+    uint16_t               min_;
+    uint16_t               max_;
+    uint64_t               sum_;
+    uint32_t               valveSec_;
+    bool                   done_;
+};
+
+#endif
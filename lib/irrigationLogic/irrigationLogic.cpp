@@ -0,0 +1,172 @@
+#include "irrigationLogic.h"
+
+irrigationLogic::irrigationLogic(uint32_t sampleIntervalMs, uint32_t waterDurationMs, int threshold)
+    : sampleIntervalMs_(sampleIntervalMs), waterDurationMs_(waterDurationMs), threshold_(threshold),
+      lastSampleMs_(0 - sampleIntervalMs), waterStartMs_(0), eventMs_(waterDurationMs), soakMs_(0), target_(-1),
+      pulses_(1), eventPulses_(1), pulse_(0), watering_(false), soaking_(false), lastMoisture_(-1)
+{
+}
+
+// True when not watering and the sample interval elapsed, or at the end of a
+// soak; marks the sample as taken
+bool irrigationLogic::sampleDue(uint32_t nowMs)
+{
+    if (soaking_)
+    {
+        if (nowMs - waterStartMs_ < soakMs_) return false;
+    }
+    else if (watering_ || nowMs - lastSampleMs_ < sampleIntervalMs_)
+    {
+        return false;
+    }
+
+    lastSampleMs_ = nowMs;
+    return true;
+}
+
+// Decide whether a new moisture reading requires watering; after a soak,
+// whether the event needs another pulse
+irrigationLogic::action irrigationLogic::onSample(int moisture, uint32_t nowMs)
+{
+    lastMoisture_ = moisture;
+    if (soaking_)
+    {
+        soaking_ = false;
+        if (moisture <= (target_ < 0 ? threshold_ : target_))
+        {
+            watering_ = false;
+            return STOP_WATERING;
+        }
+        waterStartMs_ = nowMs;
+        return RESUME_WATERING;
+    }
+    if (!watering_ && moisture > threshold_)
+    {
+        watering_ = true;
+        waterStartMs_ = nowMs;
+        eventMs_ = waterDurationMs_;
+        eventPulses_ = pulses_;
+        pulse_ = 0;
+        return START_WATERING;
+    }
+    return NONE;
+}
+
+// End the pulse once its duration elapsed: soak if pulses are left, stop otherwise
+irrigationLogic::action irrigationLogic::update(uint32_t nowMs)
+{
+    if (watering_ && !soaking_ && nowMs - waterStartMs_ > pulseDuration())
+    {
+        if (++pulse_ < eventPulses_)
+        {
+            soaking_ = true;
+            waterStartMs_ = nowMs;
+            return PAUSE_WATERING;
+        }
+        watering_ = false;
+        return STOP_WATERING;
+    }
+    return NONE;
+}
+
+// Start a watering cycle regardless of moisture, e.g. for a fixed schedule.
+// It is one continuous block of the watering duration; alreadyMs counts time
+// watered before a reset, so a resumed cycle ends on time.
+void irrigationLogic::startWatering(uint32_t nowMs, uint32_t alreadyMs)
+{
+    watering_ = true;
+    soaking_ = false;
+    waterStartMs_ = nowMs - alreadyMs;
+    eventMs_ = waterDurationMs_;
+    eventPulses_ = 1;
+    pulse_ = 0;
+}
+
+// Abort a running watering cycle without waiting for its duration
+void irrigationLogic::cancelWatering()
+{
+    watering_ = false;
+    soaking_ = false;
+}
+
+// Integer mean, truncated exactly like the firmware always did
+int irrigationLogic::average(const uint16_t* raw, uint16_t n)
+{
+    if (n == 0) return 0;
+    long total = 0;
+    for (uint16_t i = 0; i < n; ++i) {
+        total += raw[i];
+    }
+    return total / n;
+}
+
+void irrigationLogic::setThreshold(int threshold)
+{
+    threshold_ = threshold;
+}
+
+int irrigationLogic::getThreshold() const
+{
+    return threshold_;
+}
+
+void irrigationLogic::setWaterDuration(uint32_t ms)
+{
+    waterDurationMs_ = ms;
+}
+
+uint32_t irrigationLogic::getWaterDuration() const
+{
+    return waterDurationMs_;
+}
+
+// Size the event that just started differently from the watering duration,
+// e.g. from a soil response estimate; call right after START_WATERING
+void irrigationLogic::setEventDuration(uint32_t ms)
+{
+    eventMs_ = ms;
+}
+
+// Cycle and soak; pulses <= 1 waters continuously, target -1 follows the
+// threshold. Takes effect on the next event.
+void irrigationLogic::setPulses(uint8_t pulses, uint32_t soakMs, int target)
+{
+    pulses_ = pulses ? pulses : 1;
+    soakMs_ = soakMs;
+    target_ = target;
+}
+
+uint8_t irrigationLogic::getPulses() const
+{
+    return pulses_;
+}
+
+uint32_t irrigationLogic::getSoakMs() const
+{
+    return soakMs_;
+}
+
+int irrigationLogic::getTarget() const
+{
+    return target_;
+}
+
+uint32_t irrigationLogic::pulseDuration() const
+{
+    return eventMs_ / eventPulses_;
+}
+
+bool irrigationLogic::watering() const
+{
+    return watering_;
+}
+
+bool irrigationLogic::soaking() const
+{
+    return soaking_;
+}
+
+int irrigationLogic::lastMoisture() const
+{
+    return lastMoisture_;
+}
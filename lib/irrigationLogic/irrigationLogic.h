@@ -0,0 +1,61 @@
+#ifndef IRRIGATIONLOGIC_H
+#define IRRIGATIONLOGIC_H
+
+#include <stdint.h>
+
+// Hardware-independent watering decisions. Time is passed in explicitly so the
+// same logic runs on the device (millis()) and in host tools (virtual time).
+//
+// Cycle and soak: with setPulses(n > 1, ...) a threshold event splits the
+// watering duration into n pulses. After each pulse but the last the valve
+// closes for the soak time, then sampleDue() asks for a fresh reading: at or
+// below the target (the threshold unless set) the event ends early, otherwise the next pulse starts.
+// With one pulse (the default) the behaviour is the continuous one.
+class irrigationLogic
+{
+public:
+    enum action : uint8_t { NONE, START_WATERING, STOP_WATERING, PAUSE_WATERING, RESUME_WATERING };
+
+    irrigationLogic(uint32_t sampleIntervalMs, uint32_t waterDurationMs, int threshold);
+
+    bool   sampleDue(uint32_t nowMs);
+    action onSample(int moisture, uint32_t nowMs);
+    action update(uint32_t nowMs);
+    void   startWatering(uint32_t nowMs, uint32_t alreadyMs = 0);
+    void   cancelWatering();
+
+    // Moisture value the device derives from one burst of raw ADC readings
+    static int average(const uint16_t* raw, uint16_t n);
+
+    void     setThreshold(int threshold);
+    int      getThreshold() const;
+    void     setWaterDuration(uint32_t ms);
+    uint32_t getWaterDuration() const;
+    void     setEventDuration(uint32_t ms);   // total valve time of the running event
+    void     setPulses(uint8_t pulses, uint32_t soakMs, int target);
+    uint8_t  getPulses() const;
+    uint32_t getSoakMs() const;
+    int      getTarget() const;
+    uint32_t pulseDuration() const;   // valve-open time of the current pulse
+    bool     watering() const;        // an event is running, soak included
+    bool     soaking() const;
+    int      lastMoisture() const;
+
+private:
+    uint32_t sampleIntervalMs_;
+    uint32_t waterDurationMs_;
+    int      threshold_;
+    uint32_t lastSampleMs_;
+    uint32_t waterStartMs_;       // start of the current pulse or soak
+    uint32_t eventMs_;            // valve time of the current event
+    uint32_t soakMs_;
+    int      target_;             // moisture that ends a pulsed event early, -1 = threshold
+    uint8_t  pulses_;
+    uint8_t  eventPulses_;        // pulses of the current event
+    uint8_t  pulse_;              // pulses done in the current event
+    bool     watering_;
+    bool     soaking_;
+    int      lastMoisture_;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "reportFilter.h"
+
+reportFilter::reportFilter()
+    : enabled_(false), synced_(false), deadband_(0), heartbeatMs_(0), lastValue_(0), lastState_(false), lastMs_(0)
+{
+    resetCounters();
+}
+
+void reportFilter::configure(bool enabled, uint16_t deadband, uint32_t heartbeatMs)
+{
+    enabled_     = enabled;
+    deadband_    = deadband;
+    heartbeatMs_ = heartbeatMs;
+    synced_      = false;   // consumers see the new setting take effect right away
+}
+
+reportFilter::reason reportFilter::offer(uint32_t nowMs, int32_t value, bool state)
+{
+    reason r;
+    int32_t moved = value > lastValue_ ? value - lastValue_ : lastValue_ - value;
+    if (!enabled_)                                             r = EVERY;
+    else if (!synced_)                                         r = FIRST;
+    else if (state != lastState_)                              r = STATE;
+    else if (moved > deadband_)                                r = DEADBAND;
+    else if (heartbeatMs_ && nowMs - lastMs_ >= heartbeatMs_)  r = HEARTBEAT;
+    else                                                       r = SUPPRESSED;
+
+    offered_++;
+    counts_[r]++;
+    if (r != SUPPRESSED) {
+        synced_    = true;
+        lastValue_ = value;
+        lastState_ = state;
+        lastMs_    = nowMs;
+    }
+    return r;
+}
+
+uint16_t reportFilter::suppressedPermille() const
+{
+    return offered_ ? (uint16_t)((uint64_t)counts_[SUPPRESSED] * 1000 / offered_) : 0;
+}
+
+void reportFilter::resetCounters()
+{
+    offered_ = 0;
+    for (uint32_t& c : counts_) c = 0;
+}
+
+const char* reportFilter::name(reason r)
+{
+    static const char* const NAMES[REASONS] = {"suppressed", "every", "first", "deadband", "state", "heartbeat"};
+    return r < REASONS ? NAMES[r] : "?";
+}
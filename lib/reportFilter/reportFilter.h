@@ -0,0 +1,53 @@
+#ifndef REPORTFILTER_H
+#define REPORTFILTER_H
+
+#include <stdint.h>
+
+// Report by exception for a sampled value and an on/off state. A sample is
+// reported when the value moved more than `deadband` away from the last
+// reported one, when the state changed, or when nothing was reported for
+// `heartbeatMs`; every other sample is suppressed. A consumer that holds the
+// last reported value (a step function) is never more than the deadband off,
+// and never more than one heartbeat stale. Time is passed in, so the same
+// code runs on the device and in the swarm simulator.
+class reportFilter
+{
+public:
+    enum reason : uint8_t { SUPPRESSED, EVERY, FIRST, DEADBAND, STATE, HEARTBEAT, REASONS };
+
+    reportFilter();
+
+    // Disabled, every sample is reported (EVERY)
+    void configure(bool enabled, uint16_t deadband, uint32_t heartbeatMs);
+
+    // Decide for one sample and count it; anything but SUPPRESSED must be sent
+    reason offer(uint32_t nowMs, int32_t value, bool state);
+
+    // Report the next sample whatever it is: new connection, failed send
+    void resync() { synced_ = false; }
+
+    bool     enabled() const     { return enabled_; }
+    uint16_t deadband() const    { return deadband_; }
+    uint32_t heartbeatMs() const { return heartbeatMs_; }
+
+    uint32_t offered() const           { return offered_; }
+    uint32_t count(reason r) const     { return counts_[r]; }
+    uint32_t reported() const          { return offered_ - counts_[SUPPRESSED]; }
+    uint16_t suppressedPermille() const;
+    void     resetCounters();
+
+    static const char* name(reason r);
+
+private:
+    bool     enabled_;
+    bool     synced_;        // last* hold a reported sample
+    uint16_t deadband_;
+    uint32_t heartbeatMs_;
+    int32_t  lastValue_;
+    bool     lastState_;
+    uint32_t lastMs_;
+    uint32_t offered_;
+    uint32_t counts_[REASONS];
+};
+
+#endif
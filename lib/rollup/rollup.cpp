@@ -0,0 +1,93 @@
+#include "rollup.h"
+
+#include <math.h>
+#include <stdio.h>
+
+void rollupStats::reset(uint32_t windowStart)
+{
+    start      = windowStart;
+    count      = 0;
+    min        = UINT16_MAX;
+    max        = 0;
+    sum        = 0;
+    sumSq      = 0;
+    valveOnSec = 0;
+}
+
+void rollupStats::add(uint16_t value, uint32_t valveSec)
+{
+    count++;
+    if (value < min) min = value;
+    if (value > max) max = value;
+    sum        += value;
+    sumSq      += (uint64_t)value * value;
+    valveOnSec += valveSec;
+}
+
+void rollupStats::merge(const rollupStats& other)
+{
+    if (other.count == 0) return;
+    count += other.count;
+    if (other.min < min) min = other.min;
+    if (other.max > max) max = other.max;
+    sum        += other.sum;
+    sumSq      += other.sumSq;
+    valveOnSec += other.valveOnSec;
+}
+
+float rollupStats::mean() const
+{
+    return count ? (float)sum / count : 0.0f;
+}
+
+// Population variance from exact integer sums: (n*sumSq - sum^2) / n^2
+float rollupStats::variance() const
+{
+    if (count < 2) return 0.0f;
+    uint64_t num = (uint64_t)count * sumSq - sum * sum;
+    return (float)((double)num / ((double)count * count));
+}
+
+size_t rollupStats::format(char* out, size_t cap) const
+{
+    int n = snprintf(out, cap, "%lu,%lu,%u,%u,%.1f,%.1f,%lu",
+                     (unsigned long)start, (unsigned long)count, count ? min : 0, max,
+                     mean(), sqrtf(variance()), (unsigned long)valveOnSec);
+    return n < 0 ? 0 : (size_t)n < cap ? (size_t)n : cap - 1;
+}
+
+rollupTier::rollupTier(uint32_t windowSec)
+    : windowSec_(windowSec ? windowSec : 1)
+{
+    current_.reset(0);
+    closed_.reset(0);
+}
+
+void rollupTier::setWindow(uint32_t windowSec)
+{
+    windowSec_ = windowSec ? windowSec : 1;
+    current_.reset(0);
+}
+
+bool rollupTier::add(uint32_t t, const rollupStats& part)
+{
+    uint32_t start = t - t % windowSec_;
+    bool rolled = false;
+    if (start != current_.start) {
+        if (current_.count) {
+            closed_ = current_;
+            rolled  = true;
+        }
+        current_.reset(start);
+    }
+    current_.merge(part);
+    return rolled;
+}
+
+bool rollupTier::add(uint32_t t, uint16_t value, uint32_t valveSec)
+{
+    rollupStats one;
+    one.reset(t);
+    one.add(value, valveSec);
+    return add(t, one);
+}
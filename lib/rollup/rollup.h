@@ -0,0 +1,54 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Summary of a set of moisture samples. Sums are kept as exact integers, so
+// adding a sample or merging two summaries is O(1) and never loses precision;
+// mean and variance are only derived when a window is reported.
+struct rollupStats
+{
+    uint32_t start;        // window start, seconds
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+    uint64_t sum;
+    uint64_t sumSq;
+    uint32_t valveOnSec;
+
+    void  reset(uint32_t windowStart);
+    void  add(uint16_t value, uint32_t valveSec);
+    void  merge(const rollupStats& other);
+    float mean() const;
+    float variance() const;
+
+    // "start,count,min,max,mean,stddev,valve_on_s"
+    size_t format(char* out, size_t cap) const;
+};
+
+// Tumbling windows aligned to multiples of windowSec. Feeding one tier's
+// closed windows into a longer tier builds the next level at O(1) per sample
+// and a fixed footprint, whatever the window lengths are.
+class rollupTier
+{
+public:
+    explicit rollupTier(uint32_t windowSec);
+
+    // Add a sample (or a closed window of a shorter tier) observed at time t.
+    // Returns true when it starts a new window; the finished one is in closed().
+    bool add(uint32_t t, const rollupStats& part);
+    bool add(uint32_t t, uint16_t value, uint32_t valveSec);
+
+    void               setWindow(uint32_t windowSec);
+    uint32_t           window() const  { return windowSec_; }
+    const rollupStats& current() const { return current_; }
+    const rollupStats& closed() const  { return closed_; }
+
+private:
+    uint32_t    windowSec_;
+    rollupStats current_;
+    rollupStats closed_;
+};
+
+#endif
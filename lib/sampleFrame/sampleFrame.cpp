@@ -0,0 +1,126 @@
+#include "sampleFrame.h"
+
+namespace sampleFrame
+{
+
+namespace
+{
+
+void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = v; p[1] = v >> 8;
+}
+
+void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+uint16_t get16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+}
+
+// Reflected CRC-32 (zlib), half a byte per table lookup to keep the table small
+uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    crc = ~crc;
+    while (n--)
+    {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+size_t cobsEncode(const uint8_t* in, size_t len, uint8_t* out)
+{
+    size_t  code = 0;   // position of the current block's length byte
+    size_t  o    = 1;
+    uint8_t run  = 1;
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (in[i] != 0)
+        {
+            out[o++] = in[i];
+            if (++run < 0xFF) continue;
+        }
+        out[code] = run;
+        code = o++;
+        run  = 1;
+    }
+    out[code] = run;
+    return o;
+}
+
+size_t cobsDecode(const uint8_t* in, size_t len, uint8_t* out, size_t cap)
+{
+    size_t o = 0;
+    size_t i = 0;
+    while (i < len)
+    {
+        uint8_t run = in[i++];
+        if (run == 0 || i + run - 1 > len) return 0;
+        for (uint8_t k = 1; k < run; ++k)
+        {
+            if (o >= cap || in[i] == 0) return 0;
+            out[o++] = in[i++];
+        }
+        if (run < 0xFF && i < len)
+        {
+            if (o >= cap) return 0;
+            out[o++] = 0;
+        }
+    }
+    return o;
+}
+
+size_t encode(const header& h, const uint16_t* samples, uint8_t* scratch, uint8_t* out)
+{
+    scratch[0] = h.type;
+    scratch[1] = 0;
+    put16(scratch + 2, h.count);
+    put32(scratch + 4, h.seq);
+    put32(scratch + 8, h.first);
+    put32(scratch + 12, h.timeUs);
+    put32(scratch + 16, h.periodUs);
+    uint8_t* p = scratch + HEADER_BYTES;
+    for (uint16_t i = 0; i < h.count; ++i, p += 2) put16(p, samples[i]);
+    put32(p, crc32(scratch, p - scratch));
+    p += CRC_BYTES;
+
+    out[0] = 0;
+    size_t n = cobsEncode(scratch, p - scratch, out + 1);
+    out[n + 1] = 0;
+    return n + 2;
+}
+
+bool parse(const uint8_t* frame, size_t len, header& h, uint16_t* samples, size_t maxSamples)
+{
+    if (len < HEADER_BYTES + CRC_BYTES) return false;
+    if (get32(frame + len - CRC_BYTES) != crc32(frame, len - CRC_BYTES)) return false;
+
+    h.type     = (frameType)frame[0];
+    h.count    = get16(frame + 2);
+    h.seq      = get32(frame + 4);
+    h.first    = get32(frame + 8);
+    h.timeUs   = get32(frame + 12);
+    h.periodUs = get32(frame + 16);
+    if (HEADER_BYTES + h.count * 2 + CRC_BYTES != len || h.count > maxSamples) return false;
+    for (uint16_t i = 0; i < h.count; ++i) samples[i] = get16(frame + HEADER_BYTES + i * 2);
+    return true;
+}
+
+}
@@ -0,0 +1,62 @@
+#ifndef SAMPLEFRAME_H
+#define SAMPLEFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Framing of the raw ADC stream on USB CDC, shared by the firmware and the
+// host receiver (tools/adcstream).
+//
+// Frame before encoding (little endian):
+//   u8  type        SAMPLES or END
+//   u8  reserved
+//   u16 count       samples in this frame
+//   u32 seq         frame number, +1 per frame
+//   u32 first       index of the first sample since "stream start"
+//   u32 timeUs      esp_timer time of the first sample (low 32 bits)
+//   u32 periodUs    sampling period
+//   u16 samples[count]
+//   u32 crc         CRC-32 (IEEE) of everything above
+// The frame is COBS encoded and sent as 0x00, frame, 0x00. The leading zero
+// flushes any stray bytes (a log line) into their own invalid frame. A gap in
+// `first` is the number of samples lost; a gap in `seq` with contiguous
+// `first` is a frame lost on the link.
+namespace sampleFrame
+{
+
+enum frameType : uint8_t { SAMPLES = 1, END = 2 };
+
+static const size_t HEADER_BYTES = 20;
+static const size_t CRC_BYTES    = 4;
+
+struct header
+{
+    frameType type;
+    uint16_t  count;
+    uint32_t  seq;
+    uint32_t  first;
+    uint32_t  timeUs;
+    uint32_t  periodUs;
+};
+
+// Unencoded frame size and the encoded bound, delimiters included
+constexpr size_t rawBytes(uint16_t count)        { return HEADER_BYTES + count * 2 + CRC_BYTES; }
+constexpr size_t maxEncodedBytes(uint16_t count) { return rawBytes(count) + rawBytes(count) / 254 + 1 + 2; }
+
+uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc = 0);
+
+// COBS; encode() writes no delimiter, decode() takes one frame without them.
+// Both return 0 on error (decode: malformed input or `cap` too small).
+size_t cobsEncode(const uint8_t* in, size_t len, uint8_t* out);
+size_t cobsDecode(const uint8_t* in, size_t len, uint8_t* out, size_t cap);
+
+// Build a delimited frame into `out` (maxEncodedBytes(h.count) bytes);
+// `scratch` holds the unencoded frame (rawBytes(h.count) bytes)
+size_t encode(const header& h, const uint16_t* samples, uint8_t* scratch, uint8_t* out);
+
+// Check and unpack one decoded (un-COBSed) frame into up to `maxSamples` samples
+bool parse(const uint8_t* frame, size_t len, header& h, uint16_t* samples, size_t maxSamples);
+
+}
+
+#endif
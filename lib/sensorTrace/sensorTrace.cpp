@@ -0,0 +1,186 @@
+#include "sensorTrace.h"
+
+#include <string.h>
+
+namespace sensorTrace
+{
+
+static size_t putVarint(uint8_t* out, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static uint32_t zigzag(int32_t v)   { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static int32_t  unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+static void put16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void put32(uint8_t* p, uint32_t v) { put16(p, v); put16(p + 2, v >> 16); }
+static uint16_t get16(const uint8_t* p)   { return p[0] | (p[1] << 8); }
+static uint32_t get32(const uint8_t* p)   { return get16(p) | ((uint32_t)get16(p + 2) << 16); }
+
+size_t writeHeader(uint8_t* out, const header& h)
+{
+    memset(out, 0, HEADER_BYTES);
+    memcpy(out, MAGIC, 4);
+    put16(out + 4, h.rawPerSample);
+    put16(out + 6, h.sampleIntervalMs);
+    put32(out + 8, (uint32_t)h.threshold);
+    put32(out + 12, h.waterMs);
+    put32(out + 16, h.startEpoch);
+    put32(out + 20, h.startMs);
+    out[24] = h.pulses;
+    put16(out + 26, (uint16_t)h.target);
+    put32(out + 28, h.soakMs);
+    return HEADER_BYTES;
+}
+
+bool readHeader(const uint8_t* in, size_t len, header& h)
+{
+    static const uint8_t MAGIC_V1[4] = {'S', 'T', 'R', '1'};
+    bool v1 = len >= HEADER_BYTES && memcmp(in, MAGIC_V1, 4) == 0;
+    if (len < HEADER_BYTES || (!v1 && memcmp(in, MAGIC, 4) != 0)) return false;
+    h.rawPerSample     = get16(in + 4);
+    h.sampleIntervalMs = get16(in + 6);
+    h.threshold        = (int32_t)get32(in + 8);
+    h.waterMs          = get32(in + 12);
+    h.startEpoch       = get32(in + 16);
+    h.startMs          = get32(in + 20);
+    h.pulses           = v1 ? 1 : in[24];
+    h.target           = v1 ? -1 : (int16_t)get16(in + 26);
+    h.soakMs           = v1 ? 0 : get32(in + 28);
+    return h.rawPerSample <= MAX_RAW;
+}
+
+static size_t begin(uint8_t* out, recordType type, uint32_t& lastMs, uint32_t nowMs)
+{
+    out[0] = type;
+    size_t n = 1 + putVarint(out + 1, nowMs - lastMs);
+    lastMs = nowMs;
+    return n;
+}
+
+size_t encodeSample(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, const uint16_t* raw, uint16_t n)
+{
+    if (n > MAX_RAW) n = MAX_RAW;
+    size_t len = begin(out, SAMPLE, lastMs, nowMs);
+    len += putVarint(out + len, n);
+    for (uint16_t i = 0; i < n; ++i) {
+        len += putVarint(out + len, i == 0 ? raw[0] : zigzag((int32_t)raw[i] - raw[i - 1]));
+    }
+    return len;
+}
+
+size_t encodeDecision(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, uint8_t action, int moisture)
+{
+    size_t len = begin(out, DECISION, lastMs, nowMs);
+    out[len++] = action;
+    return len + putVarint(out + len, zigzag(moisture));
+}
+
+size_t encodeValve(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, bool open)
+{
+    size_t len = begin(out, VALVE, lastMs, nowMs);
+    out[len++] = open ? 1 : 0;
+    return len;
+}
+
+size_t encodeConfig(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, int threshold, uint32_t waterMs)
+{
+    size_t len = begin(out, CONFIG, lastMs, nowMs);
+    len += putVarint(out + len, zigzag(threshold));
+    return len + putVarint(out + len, waterMs);
+}
+
+size_t encodePulses(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, uint8_t pulses, uint32_t soakMs, int target)
+{
+    size_t len = begin(out, PULSES, lastMs, nowMs);
+    out[len++] = pulses;
+    len += putVarint(out + len, soakMs);
+    return len + putVarint(out + len, zigzag(target));
+}
+
+size_t encodeEvent(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, uint32_t eventMs)
+{
+    size_t len = begin(out, EVENT, lastMs, nowMs);
+    return len + putVarint(out + len, eventMs);
+}
+
+reader::reader(const uint8_t* buf, size_t len)
+    : buf_(buf), len_(len), pos_(HEADER_BYTES), timeMs_(0), header_(), valid_(false)
+{
+    valid_  = readHeader(buf, len, header_);
+    timeMs_ = header_.startMs;
+}
+
+bool reader::getVarint(uint32_t& v)
+{
+    v = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (pos_ >= len_) return false;
+        uint8_t b = buf_[pos_++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+bool reader::next(record& r)
+{
+    if (!valid_ || pos_ >= len_) return false;
+    size_t start = pos_;
+    uint32_t dt, v;
+    r.type = (recordType)buf_[pos_++];
+    if (!getVarint(dt)) goto truncated;
+    r.timeMs = timeMs_ + dt;
+
+    switch (r.type) {
+    case SAMPLE:
+        if (!getVarint(v) || v > MAX_RAW) goto truncated;
+        r.count = (uint16_t)v;
+        for (uint16_t i = 0; i < r.count; ++i) {
+            if (!getVarint(v)) goto truncated;
+            r.raw[i] = i == 0 ? (uint16_t)v : (uint16_t)(r.raw[i - 1] + unzigzag(v));
+        }
+        break;
+    case DECISION:
+        if (pos_ >= len_) goto truncated;
+        r.action = buf_[pos_++];
+        if (!getVarint(v)) goto truncated;
+        r.value = unzigzag(v);
+        break;
+    case VALVE:
+        if (pos_ >= len_) goto truncated;
+        r.value = buf_[pos_++];
+        break;
+    case CONFIG:
+        if (!getVarint(v)) goto truncated;
+        r.value = unzigzag(v);
+        if (!getVarint(r.waterMs)) goto truncated;
+        break;
+    case PULSES:
+        if (pos_ >= len_) goto truncated;
+        r.pulses = buf_[pos_++];
+        if (!getVarint(r.soakMs) || !getVarint(v)) goto truncated;
+        r.value = unzigzag(v);
+        break;
+    case EVENT:
+        if (!getVarint(r.waterMs)) goto truncated;
+        break;
+    default:
+        goto truncated;
+    }
+    timeMs_ = r.timeMs;
+    return true;
+
+truncated:
+    pos_ = start;
+    return false;
+}
+
+} // namespace sensorTrace
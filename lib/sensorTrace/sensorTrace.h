@@ -0,0 +1,93 @@
+#ifndef SENSORTRACE_H
+#define SENSORTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact trace of what the irrigation loop saw and decided, shared by the
+// firmware (capture) and host tools (replay).
+//
+// Layout: 32-byte header, then records. Integers are LEB128 varints, signed
+// ones zig-zag encoded; every record starts with a type byte and the time in
+// ms since the previous record.
+//   SAMPLE   n raw ADC readings: first absolute, the rest as deltas
+//   DECISION action (START_WATERING / STOP_WATERING) and the averaged moisture
+//   VALVE    0 closed, 1 open (any cause: logic, schedule, stop command)
+//   CONFIG   threshold, watering duration in ms
+//   PULSES   cycle and soak: pulses, soak in ms, target (-1 = threshold)
+//   EVENT    valve time in ms of the event just started, when it is not the
+//            CONFIG duration (adaptive watering); follows its DECISION
+// "STR1" traces have no cycle-and-soak fields and read as one pulse.
+namespace sensorTrace
+{
+
+static const uint8_t  MAGIC[4]          = {'S', 'T', 'R', '2'};
+static const size_t   HEADER_BYTES      = 32;
+static const uint16_t MAX_RAW           = 128;
+static const size_t   MAX_RECORD_BYTES  = 1 + 5 + 2 + MAX_RAW * 3;   // type, dt, count, 16-bit deltas
+
+enum recordType : uint8_t { SAMPLE = 1, DECISION = 2, VALVE = 3, CONFIG = 4, PULSES = 5, EVENT = 6 };
+
+struct header
+{
+    uint16_t rawPerSample;
+    uint16_t sampleIntervalMs;
+    int32_t  threshold;
+    uint32_t waterMs;
+    uint32_t startEpoch;     // 0 if the clock was not synced
+    uint32_t startMs;        // millis() at the first record's time base
+    uint8_t  pulses;         // cycle and soak at the start of the capture
+    int16_t  target;
+    uint32_t soakMs;
+};
+
+struct record
+{
+    recordType type;
+    uint32_t   timeMs;       // absolute, in the capturing device's millis()
+    uint16_t   count;        // SAMPLE: number of raw readings
+    uint16_t   raw[MAX_RAW];
+    uint8_t    action;       // DECISION
+    int32_t    value;        // DECISION: moisture, VALVE: state, CONFIG: threshold, PULSES: target
+    uint32_t   waterMs;      // CONFIG, EVENT
+    uint8_t    pulses;       // PULSES
+    uint32_t   soakMs;       // PULSES
+};
+
+size_t writeHeader(uint8_t* out, const header& h);
+bool   readHeader(const uint8_t* in, size_t len, header& h);
+
+// Record encoders; `lastMs` is the time of the previous record and is updated.
+// `out` must hold MAX_RECORD_BYTES.
+size_t encodeSample(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, const uint16_t* raw, uint16_t n);
+size_t encodeDecision(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, uint8_t action, int moisture);
+size_t encodeValve(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, bool open);
+size_t encodeConfig(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, int threshold, uint32_t waterMs);
+size_t encodePulses(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, uint8_t pulses, uint32_t soakMs, int target);
+size_t encodeEvent(uint8_t* out, uint32_t& lastMs, uint32_t nowMs, uint32_t eventMs);
+
+// Sequential decoder over a complete trace (header included)
+class reader
+{
+public:
+    reader(const uint8_t* buf, size_t len);
+
+    bool          valid() const { return valid_; }
+    const header& info() const  { return header_; }
+    bool          next(record& r);      // false at the end or on a truncated record
+    size_t        offset() const { return pos_; }
+
+private:
+    bool getVarint(uint32_t& v);
+
+    const uint8_t* buf_;
+    size_t         len_;
+    size_t         pos_;
+    uint32_t       timeMs_;
+    header         header_;
+    bool           valid_;
+};
+
+} // namespace sensorTrace
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SEQSNAPSHOT_H
+#define SEQSNAPSHOT_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// Latest value of a plain struct, written by one task and read by others
+// without locks (a seqlock). publish() never waits; a read() that overlapped a
+// publish() sees the sequence change and copies again. A reader must not
+// outrank the writer on a single core: it would spin while the writer it
+// preempted can never finish.
+template <typename T>
+class seqSnapshot
+{
+    static_assert(std::is_trivially_copyable<T>::value, "seqSnapshot needs a plain struct");
+
+private:
+    T                             value_;
+    std::atomic<uint32_t>         seq_{0};       // odd while a publish() is copying
+    mutable std::atomic<uint32_t> retries_{0};
+
+public:
+    // Writer side, one task only
+    void publish(const T& v)
+    {
+        uint32_t s = seq_.load(std::memory_order_relaxed);
+        seq_.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&value_, &v, sizeof(T));
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+    // Any other task; a copy no publish() overlapped
+    T read() const
+    {
+        T out;
+        for (;;)
+        {
+            uint32_t s = seq_.load(std::memory_order_acquire);
+            if (!(s & 1))
+            {
+                memcpy(&out, &value_, sizeof(T));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq_.load(std::memory_order_relaxed) == s) return out;
+            }
+            retries_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t published() const { return seq_.load(std::memory_order_acquire) / 2; }
+    uint32_t retries() const   { return retries_.load(std::memory_order_relaxed); }
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "soilResponse.h"
+
+soilResponse::soilResponse(uint32_t settleMs)
+    : settleMs_(settleMs), phase_(IDLE), open_(false), startMoisture_(0), openedMs_(0), valveMs_(0), closedMs_(0)
+{
+    reset();
+}
+
+void soilResponse::reset()
+{
+    st_ = state();
+}
+
+void soilResponse::begin(int moisture, uint32_t nowMs)
+{
+    phase_         = WATERING;
+    open_          = false;
+    startMoisture_ = moisture;
+    valveMs_       = 0;
+    closedMs_      = nowMs;
+}
+
+void soilResponse::valve(bool open, uint32_t nowMs)
+{
+    if (phase_ != WATERING || open == open_) return;
+    open_ = open;
+    if (open)
+    {
+        openedMs_ = nowMs;
+    }
+    else
+    {
+        valveMs_  += nowMs - openedMs_;
+        closedMs_  = nowMs;
+    }
+}
+
+void soilResponse::end(uint32_t nowMs)
+{
+    if (phase_ != WATERING) return;
+    valve(false, nowMs);
+    phase_ = valveMs_ ? SETTLING : IDLE;
+}
+
+void soilResponse::abort()
+{
+    phase_ = IDLE;
+    open_  = false;
+}
+
+bool soilResponse::onSample(int moisture, uint32_t nowMs)
+{
+    if (phase_ != SETTLING || nowMs - closedMs_ < settleMs_) return false;
+    phase_ = IDLE;
+    observe(valveMs_, startMoisture_ - moisture);
+    return true;
+}
+
+void soilResponse::observe(uint32_t valveMs, int drop)
+{
+    if (valveMs == 0) return;
+    int64_t x = ((int64_t)valveMs << 8) / 1000;                  // Q8 seconds
+    int64_t e = (int64_t)drop * 65536 - ((int64_t)st_.gainQ16 * x >> 8);    // Q16 counts
+
+    st_.info = (st_.info * FORGET_Q16 >> 16) + (uint64_t)(x * x);
+    if (st_.info == 0) return;
+    int64_t gain = st_.gainQ16 + x * e * 256 / (int64_t)st_.info;
+    st_.gainQ16 = gain > MAX_GAIN_Q16 ? MAX_GAIN_Q16 : gain < -MAX_GAIN_Q16 ? -MAX_GAIN_Q16 : (int32_t)gain;
+
+    // Fit quality, on the prediction made before this observation
+    uint32_t err     = (uint32_t)((e < 0 ? -e : e) >> 16);
+    uint32_t absDrop = drop < 0 ? -drop : drop;
+    if (err > 0xFFFF) err = 0xFFFF;
+    if (absDrop > 0xFFFF) absDrop = 0xFFFF;
+    if (st_.count == 0)
+    {
+        st_.errAvg  = 0;   // the first observation only sets the gain
+        st_.dropAvg = absDrop;
+    }
+    else
+    {
+        st_.errAvg  = (st_.errAvg * 3 + err) / 4;
+        st_.dropAvg = (st_.dropAvg * 3 + absDrop) / 4;
+    }
+    if (st_.count < 0xFFFF) st_.count++;
+}
+
+bool soilResponse::reliable() const
+{
+    return st_.count >= MIN_OBSERVATIONS && st_.gainQ16 >= MIN_GAIN_Q16 && st_.gainQ16 <= MAX_GAIN_Q16 &&
+           st_.errAvg * 2 < st_.dropAvg;
+}
+
+uint32_t soilResponse::duration(int moisture, int aim, uint32_t fallbackMs, uint32_t minMs, uint32_t maxMs) const
+{
+    if (!reliable()) return fallbackMs;
+    int64_t need = moisture - aim;
+    int64_t ms   = need > 0 ? (need << 16) * 1000 / st_.gainQ16 : 0;
+    if (ms < minMs) return minMs;
+    if (ms > maxMs) return maxMs;
+    return (uint32_t)ms;
+}
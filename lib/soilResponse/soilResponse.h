@@ -0,0 +1,74 @@
+#ifndef SOILRESPONSE_H
+#define SOILRESPONSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Online estimate of how far one second of valve time moves the moisture
+// reading, used to size each watering so it lands in the target band.
+//
+// The model is drop = gain * valveSeconds, where drop is the reading at the
+// start of an event minus the reading settleMs after the valve last closed
+// (the water takes a while to reach the sensor). The gain is fitted by
+// recursive least squares with exponential forgetting, in fixed point: for
+// one parameter RLS reduces to R = lambda * R + x^2, gain += x * e / R, so
+// the whole state is a few integers and each update is O(1).
+//
+// The estimate counts as reliable after MIN_OBSERVATIONS events with a gain in
+// range and an average residual below half the average drop; until then, or
+// after it degrades, duration() returns the fixed fallback.
+class soilResponse
+{
+public:
+    // Persisted between boots
+    struct state
+    {
+        int32_t  gainQ16;     // reading counts per valve second, Q16.16
+        uint64_t info;        // R, sum of forgotten x^2 with x in Q8 seconds
+        uint16_t count;       // observations so far (saturates)
+        uint16_t errAvg;      // EWMA of |residual|, counts
+        uint16_t dropAvg;     // EWMA of the observed drop, counts
+    };
+
+    static const uint16_t MIN_OBSERVATIONS = 3;
+    static const int32_t  MIN_GAIN_Q16     = 655;          // 0.01 counts/s
+    static const int32_t  MAX_GAIN_Q16     = 50L << 16;    // 50 counts/s
+    static const uint16_t FORGET_Q16       = 58982;        // lambda 0.9 per event
+
+    explicit soilResponse(uint32_t settleMs);
+
+    // Event bookkeeping, driven by the valve owner
+    void begin(int moisture, uint32_t nowMs);   // a threshold event starts
+    void valve(bool open, uint32_t nowMs);      // accumulates valve-open time
+    void end(uint32_t nowMs);                   // the event finished: observe after settleMs
+    void abort();                               // cancelled or taken over: do not learn from it
+
+    // Feed every moisture sample; true when it completed an observation
+    bool onSample(int moisture, uint32_t nowMs);
+
+    // One RLS step; public so tools can feed observations directly
+    void observe(uint32_t valveMs, int drop);
+
+    // Valve time to bring `moisture` down to `aim`, clamped to [minMs, maxMs];
+    // fallbackMs while the estimate is not reliable
+    uint32_t duration(int moisture, int aim, uint32_t fallbackMs, uint32_t minMs, uint32_t maxMs) const;
+
+    bool         reliable() const;
+    const state& get() const { return st_; }
+    void         set(const state& s) { st_ = s; }
+    void         reset();
+
+private:
+    enum phase : uint8_t { IDLE, WATERING, SETTLING };
+
+    state    st_;
+    uint32_t settleMs_;
+    phase    phase_;
+    bool     open_;
+    int      startMoisture_;
+    uint32_t openedMs_;
+    uint32_t valveMs_;
+    uint32_t closedMs_;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-size lock-free single-producer/single-consumer queue.
+// push() may only be called from one task (or ISR) and pop() from one other;
+// N must be a power of two. One slot is never used to tell full from empty.
+template <typename T, size_t N>
+class spscQueue
+{
+    static_assert((N & (N - 1)) == 0, "spscQueue size must be a power of two");
+
+private:
+    T                     items_[N];
+    std::atomic<uint32_t> head_{0};     // next slot to write, owned by the producer
+    std::atomic<uint32_t> tail_{0};     // next slot to read, owned by the consumer
+    std::atomic<uint32_t> dropped_{0};
+
+public:
+    // Producer side; returns false (and counts a drop) when the queue is full
+    bool push(const T& item)
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t next = (head + 1) & (N - 1);
+        if (next == tail_.load(std::memory_order_acquire))
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items_[head] = item;
+        head_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; returns false when the queue is empty
+    bool pop(T& item)
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) return false;
+        item = items_[tail];
+        tail_.store((tail + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+    size_t size() const
+    {
+        return (head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire)) & (N - 1);
+    }
+
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    static constexpr size_t capacity() { return N - 1; }
+};
+
+#endif
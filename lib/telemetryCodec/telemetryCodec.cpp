@@ -0,0 +1,179 @@
+#include "telemetryCodec.h"
+
+// Worst case for one sample: 4+32 timestamp bits, 3+17 value bits, 1 flag bit
+static const size_t MAX_SAMPLE_BITS = 57;
+
+static uint32_t zigzag(int32_t v)    { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static int32_t  unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+static int32_t signExtend(uint32_t v, uint8_t bits)
+{
+    uint32_t m = 1u << (bits - 1);
+    return (int32_t)((v ^ m) - m);
+}
+
+telemetryEncoder::telemetryEncoder(uint8_t* buf, size_t capacity)
+    : buf_(buf), capacity_(capacity)
+{
+    reset();
+}
+
+void telemetryEncoder::reset()
+{
+    bitPos_    = HEADER_BYTES * 8;
+    count_     = 0;
+    lastTime_  = 0;
+    lastDelta_ = 0;
+    lastValue_ = 0;
+    lastFlag_  = false;
+    if (capacity_ >= HEADER_BYTES)
+    {
+        buf_[0] = VERSION;
+        buf_[1] = buf_[2] = 0;
+    }
+}
+
+size_t telemetryEncoder::size() const
+{
+    return (bitPos_ + 7) / 8;
+}
+
+void telemetryEncoder::writeBits(uint32_t value, uint8_t bits)
+{
+    while (bits > 0)
+    {
+        size_t  byte  = bitPos_ >> 3;
+        uint8_t free  = 8 - (bitPos_ & 7);
+        uint8_t n     = bits < free ? bits : free;
+        uint8_t chunk = (value >> (bits - n)) & ((1u << n) - 1);
+        if (free == 8) buf_[byte] = 0;
+        buf_[byte] |= chunk << (free - n);
+        bitPos_ += n;
+        bits    -= n;
+    }
+}
+
+// Append one sample; returns false when the block is full
+bool telemetryEncoder::append(uint32_t timestamp, uint16_t value, bool flag)
+{
+    if (count_ == 0xFFFF || bitPos_ + MAX_SAMPLE_BITS > capacity_ * 8) return false;
+
+    if (count_ == 0)
+    {
+        writeBits(timestamp, 32);
+        writeBits(value, 16);
+        writeBits(flag, 1);
+    }
+    else
+    {
+        int32_t delta = (int32_t)(timestamp - lastTime_);
+        int32_t dod   = delta - lastDelta_;
+        if (dod == 0)                         writeBits(0, 1);
+        else if (dod >= -64 && dod < 64)     { writeBits(0x2, 2); writeBits((uint32_t)dod & 0x7F, 7); }
+        else if (dod >= -256 && dod < 256)   { writeBits(0x6, 3); writeBits((uint32_t)dod & 0x1FF, 9); }
+        else if (dod >= -2048 && dod < 2048) { writeBits(0xE, 4); writeBits((uint32_t)dod & 0xFFF, 12); }
+        else                                 { writeBits(0xF, 4); writeBits((uint32_t)dod, 32); }
+        lastDelta_ = delta;
+
+        uint32_t zz = zigzag((int32_t)value - (int32_t)lastValue_);
+        if (zz == 0)          writeBits(0, 1);
+        else if (zz < 0x10)   { writeBits(0x2, 2); writeBits(zz, 4); }
+        else if (zz < 0x100)  { writeBits(0x6, 3); writeBits(zz, 8); }
+        else                  { writeBits(0x7, 3); writeBits(zz, 17); }
+
+        writeBits(flag != lastFlag_, 1);
+    }
+
+    lastTime_  = timestamp;
+    lastValue_ = value;
+    lastFlag_  = flag;
+    count_++;
+    buf_[1] = count_ & 0xFF;
+    buf_[2] = count_ >> 8;
+    return true;
+}
+
+telemetryDecoder::telemetryDecoder(const uint8_t* buf, size_t len)
+    : buf_(buf), len_(len), bitPos_(telemetryEncoder::HEADER_BYTES * 8), count_(0), index_(0),
+      valid_(false), lastTime_(0), lastDelta_(0), lastValue_(0), lastFlag_(false)
+{
+    if (len >= telemetryEncoder::HEADER_BYTES && buf[0] == telemetryEncoder::VERSION)
+    {
+        count_ = buf[1] | (buf[2] << 8);
+        valid_ = true;
+    }
+}
+
+bool telemetryDecoder::readBits(uint8_t bits, uint32_t& out)
+{
+    if (bitPos_ + bits > len_ * 8) return false;
+    out = 0;
+    while (bits > 0)
+    {
+        uint8_t avail = 8 - (bitPos_ & 7);
+        uint8_t n     = bits < avail ? bits : avail;
+        uint8_t chunk = (buf_[bitPos_ >> 3] >> (avail - n)) & ((1u << n) - 1);
+        out = (out << n) | chunk;
+        bitPos_ += n;
+        bits    -= n;
+    }
+    return true;
+}
+
+// Count leading one bits up to maxOnes, consuming the terminating zero if present
+bool telemetryDecoder::readPrefix(uint8_t maxOnes, uint8_t& ones)
+{
+    ones = 0;
+    uint32_t bit;
+    while (ones < maxOnes)
+    {
+        if (!readBits(1, bit)) return false;
+        if (!bit) break;
+        ones++;
+    }
+    return true;
+}
+
+bool telemetryDecoder::next(uint32_t& timestamp, uint16_t& value, bool& flag)
+{
+    if (!valid_ || index_ >= count_) return false;
+
+    uint32_t v;
+    if (index_ == 0)
+    {
+        if (!readBits(32, lastTime_)) return false;
+        if (!readBits(16, v)) return false;
+        lastValue_ = v;
+        if (!readBits(1, v)) return false;
+        lastFlag_ = v;
+    }
+    else
+    {
+        uint8_t ones;
+        if (!readPrefix(4, ones)) return false;
+        static const uint8_t dodBits[] = {0, 7, 9, 12, 32};
+        int32_t dod = 0;
+        if (ones > 0)
+        {
+            if (!readBits(dodBits[ones], v)) return false;
+            dod = ones == 4 ? (int32_t)v : signExtend(v, dodBits[ones]);
+        }
+        lastDelta_ += dod;
+        lastTime_  += lastDelta_;
+
+        if (!readPrefix(3, ones)) return false;
+        static const uint8_t valueBits[] = {0, 4, 8, 17};
+        uint32_t zz = 0;
+        if (ones > 0 && !readBits(valueBits[ones], zz)) return false;
+        lastValue_ = (uint16_t)(lastValue_ + unzigzag(zz));
+
+        if (!readBits(1, v)) return false;
+        if (v) lastFlag_ = !lastFlag_;
+    }
+
+    timestamp = lastTime_;
+    value     = lastValue_;
+    flag      = lastFlag_;
+    index_++;
+    return true;
+}
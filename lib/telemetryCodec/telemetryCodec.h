@@ -0,0 +1,69 @@
+#ifndef TELEMETRYCODEC_H
+#define TELEMETRYCODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Gorilla-style block codec for (timestamp, moisture, valve) samples.
+//
+// Block layout: u8 version, u16 sample count (little endian), then a
+// big-endian bit stream. The first sample is stored raw (32-bit timestamp,
+// 16-bit value, 1-bit flag); every following sample stores
+//   timestamp delta-of-delta: 0 | 10+7b | 110+9b | 1110+12b | 1111+32b (two's complement)
+//   value delta (zig-zag):    0 | 10+4b | 110+8b | 111+17b
+//   valve flag:               0 = unchanged, 1 = toggled
+// A steady 1 Hz series costs 1 bit per timestamp, so a slowly moving value
+// stays close to one byte per sample.
+class telemetryEncoder
+{
+public:
+    static const size_t HEADER_BYTES = 3;
+    static const uint8_t VERSION = 1;
+
+    telemetryEncoder(uint8_t* buf, size_t capacity);
+
+    bool     append(uint32_t timestamp, uint16_t value, bool flag);
+    void     reset();
+    size_t   size() const;
+    uint16_t count() const { return count_; }
+    const uint8_t* data() const { return buf_; }
+
+private:
+    void writeBits(uint32_t value, uint8_t bits);
+
+    uint8_t* buf_;
+    size_t   capacity_;
+    size_t   bitPos_;
+    uint16_t count_;
+    uint32_t lastTime_;
+    int32_t  lastDelta_;
+    uint16_t lastValue_;
+    bool     lastFlag_;
+};
+
+class telemetryDecoder
+{
+public:
+    telemetryDecoder(const uint8_t* buf, size_t len);
+
+    bool     valid() const { return valid_; }
+    uint16_t count() const { return count_; }
+    bool     next(uint32_t& timestamp, uint16_t& value, bool& flag);
+
+private:
+    bool     readBits(uint8_t bits, uint32_t& out);
+    bool     readPrefix(uint8_t maxOnes, uint8_t& ones);
+
+    const uint8_t* buf_;
+    size_t   len_;
+    size_t   bitPos_;
+    uint16_t count_;
+    uint16_t index_;
+    bool     valid_;
+    uint32_t lastTime_;
+    int32_t  lastDelta_;
+    uint16_t lastValue_;
+    bool     lastFlag_;
+};
+
+#endif
@@ -34,4 +34,25 @@ String timeControl::getTimeString() const {
     char buffer[25];
     strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeinfo);
     return String(buffer);
-}
\ No newline at end of file
+}
+
+// Method to get the current UNIX time, or 0 before the first NTP sync
+time_t timeControl::getEpoch() const {
+    if(!timeInitialized) return 0;
+
+    time_t now = time(nullptr);
+    return now > 1600000000 ? now : 0;
+}
+
+// Method to get the local time offset from UTC in seconds, including daylight saving
+long timeControl::getUtcOffset() const {
+    return gmtOffsetSec_ + daylightOffsetSec_;
+}
+
+// Change the daylight saving offset; local time follows immediately
+void timeControl::setDaylightOffset(int daylightOffsetSec) {
+    daylightOffsetSec_ = daylightOffsetSec;
+    if (timeInitialized) {
+        configTime(gmtOffsetSec_, daylightOffsetSec_, ntpServer_);
+    }
+}
@@ -11,6 +11,9 @@ public:
     void begin();
     void handle();
     String getTimeString() const;
+    time_t getEpoch() const;
+    long getUtcOffset() const;
+    void setDaylightOffset(int daylightOffsetSec);
 
 private:
     const char* ntpServer_;
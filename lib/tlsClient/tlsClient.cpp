@@ -0,0 +1,450 @@
+#include "tlsClient.h"
+
+#include <WiFi.h>
+#include <binLog.h>
+#include <esp_system.h>
+#include <fcntl.h>
+#include <lwip/sockets.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/version.h>
+
+#if MBEDTLS_VERSION_MAJOR >= 3
+#define SSL_STATE(ssl) ((ssl).MBEDTLS_PRIVATE(state))
+#else
+#define SSL_STATE(ssl) ((ssl).state)
+#endif
+
+static const uint32_t WRITE_TIMEOUT_MS = 5000;
+
+// ECDSA first: a P-256 signature check is far cheaper than an RSA-2048 one on
+// a core without an ECC accelerator; RSA suites only as a fallback
+static const int CIPHERSUITES[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256,
+    0
+};
+
+#if MBEDTLS_VERSION_MAJOR < 3
+static const mbedtls_ecp_group_id CURVES[] = {
+#if defined(MBEDTLS_ECP_DP_CURVE25519_ENABLED)
+    MBEDTLS_ECP_DP_CURVE25519,   // cheapest ECDHE in software
+#endif
+    MBEDTLS_ECP_DP_SECP256R1,
+    MBEDTLS_ECP_DP_SECP384R1,
+    MBEDTLS_ECP_DP_NONE
+};
+#endif
+
+static int hardwareRandom(void*, unsigned char* out, size_t len)
+{
+    esp_fill_random(out, len);
+    return 0;
+}
+
+static int sha256(const uint8_t* data, size_t len, uint8_t out[32])
+{
+#if MBEDTLS_VERSION_MAJOR >= 3
+    return mbedtls_sha256(data, len, out, 0);
+#else
+    return mbedtls_sha256_ret(data, len, out, 0);
+#endif
+}
+
+tlsClient::tlsClient()
+    : state_(IDLE), configured_(false), haveCa_(false), havePin_(false), haveSession_(false),
+      sawKeyExchange_(false), havePeerHash_(false), peerPort_(0), peeked_(-1),
+      handshakeTimeoutMs_(15000), stepBudgetMs_(20), startMs_(0), lastMs_(0), lastResumed_(false),
+      fullCount_(0), resumedCount_(0), fullTotalMs_(0), resumedTotalMs_(0), failures_(0), maxStepMs_(0)
+{
+    mbedtls_ssl_init(&ssl_);
+    mbedtls_ssl_config_init(&conf_);
+    mbedtls_ssl_session_init(&session_);
+    mbedtls_x509_crt_init(&ca_);
+    mbedtls_net_init(&net_);
+}
+
+tlsClient::~tlsClient()
+{
+    stop();
+    mbedtls_ssl_free(&ssl_);
+    mbedtls_ssl_config_free(&conf_);
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_x509_crt_free(&ca_);
+}
+
+bool tlsClient::setCACert(const char* pem)
+{
+    mbedtls_x509_crt_free(&ca_);
+    mbedtls_x509_crt_init(&ca_);
+    haveCa_ = false;
+    if (pem == nullptr || *pem == '\0') return true;
+
+    int err = mbedtls_x509_crt_parse(&ca_, (const unsigned char*)pem, strlen(pem) + 1);
+    if (err != 0) {
+        LOG_ERROR("tls CA certificate rejected (%d)", err);
+        return false;
+    }
+    haveCa_ = true;
+    return true;
+}
+
+void tlsClient::setPinnedCert(const uint8_t sha256[32])
+{
+    memcpy(pin_, sha256, sizeof(pin_));
+    havePin_ = true;
+}
+
+void tlsClient::setHostname(const char* host)
+{
+    hostname_ = host ? host : "";
+}
+
+// Allocates the record buffers (about 20 KiB), so it only runs once TLS is used
+bool tlsClient::setup()
+{
+    if (configured_) return true;
+
+    int err = mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    if (err != 0) {
+        fail("config", err);
+        return false;
+    }
+    mbedtls_ssl_conf_rng(&conf_, hardwareRandom, nullptr);
+    mbedtls_ssl_conf_ciphersuites(&conf_, CIPHERSUITES);
+#if MBEDTLS_VERSION_MAJOR >= 3
+    mbedtls_ssl_conf_max_tls_version(&conf_, MBEDTLS_SSL_VERSION_TLS1_2);   // resumption is tracked the 1.2 way
+#else
+    mbedtls_ssl_conf_curves(&conf_, CURVES);
+    mbedtls_ssl_conf_min_version(&conf_, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf_, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+    err = mbedtls_ssl_setup(&ssl_, &conf_);
+    if (err != 0) {
+        fail("setup", err);
+        return false;
+    }
+    configured_ = true;
+    return true;
+}
+
+// Open a non-blocking socket and start the handshake; poll() does the rest
+bool tlsClient::begin(IPAddress ip, uint16_t port)
+{
+    stop();
+    if (!setup()) return false;
+
+    if (haveCa_) {
+        mbedtls_ssl_conf_ca_chain(&conf_, &ca_, nullptr);
+        mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_verify(&conf_, nullptr, nullptr);
+    } else if (havePin_) {
+        // No chain to verify against: the callback accepts exactly the pinned leaf
+        mbedtls_ssl_conf_ca_chain(&conf_, nullptr, nullptr);
+        mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_OPTIONAL);
+        mbedtls_ssl_conf_verify(&conf_, verifyPinned, this);
+    } else {
+        mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_NONE);
+        LOG_WARN("tls without CA or pinned certificate, broker not authenticated");
+    }
+
+    int err = mbedtls_ssl_session_reset(&ssl_);
+    if (err == 0) err = mbedtls_ssl_set_hostname(&ssl_, hostname_.length() ? hostname_.c_str() : nullptr);
+    if (err == 0 && haveSession_) err = mbedtls_ssl_set_session(&ssl_, &session_);
+    if (err != 0) {
+        fail("session", err);
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        fail("socket", errno);
+        return false;
+    }
+    net_.fd = fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        fail("connect", errno);
+        return false;
+    }
+    mbedtls_ssl_set_bio(&ssl_, &net_, mbedtls_net_send, mbedtls_net_recv, nullptr);
+
+    peerIp_         = ip;
+    peerPort_       = port;
+    sawKeyExchange_ = false;
+    startMs_        = millis();
+    state_          = CONNECTING;
+    return true;
+}
+
+// Advance the connection until it would block or the step budget is used up
+tlsClient::state tlsClient::poll()
+{
+    uint32_t t0 = millis();
+    while (pending()) {
+        if (millis() - startMs_ > handshakeTimeoutMs_) {
+            if (state_ == HANDSHAKING) clearSession();
+            return fail("handshake timeout", 0);
+        }
+        uint32_t stepStart = millis();
+        bool progressed = state_ == CONNECTING ? connectStep() : handshakeStep();
+        uint32_t stepMs = millis() - stepStart;
+        if (stepMs > maxStepMs_) maxStepMs_ = stepMs;
+        if (!progressed || millis() - t0 >= stepBudgetMs_) break;
+    }
+    return state_;
+}
+
+bool tlsClient::connectStep()
+{
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(net_.fd, &writable);
+    timeval now = {0, 0};
+    if (select(net_.fd + 1, nullptr, &writable, nullptr, &now) <= 0) return false;
+
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(net_.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+        fail("connect", err);
+        return false;
+    }
+    state_ = HANDSHAKING;
+    return true;
+}
+
+bool tlsClient::handshakeStep()
+{
+    // A resumed handshake goes from ServerHello straight to ChangeCipherSpec
+    if (SSL_STATE(ssl_) == MBEDTLS_SSL_CLIENT_KEY_EXCHANGE) sawKeyExchange_ = true;
+
+    int err = mbedtls_ssl_handshake_step(&ssl_);
+    if (err == MBEDTLS_ERR_SSL_WANT_READ || err == MBEDTLS_ERR_SSL_WANT_WRITE) return false;
+    if (err != 0) {
+        clearSession();   // never retry with a session the broker choked on
+        fail("handshake", err);
+        return false;
+    }
+    if (SSL_STATE(ssl_) == MBEDTLS_SSL_HANDSHAKE_OVER) finishHandshake();
+    return true;
+}
+
+void tlsClient::finishHandshake()
+{
+    lastMs_      = millis() - startMs_;
+    lastResumed_ = !sawKeyExchange_;
+    if (lastResumed_) {
+        resumedCount_++;
+        resumedTotalMs_ += lastMs_;
+    } else {
+        fullCount_++;
+        fullTotalMs_ += lastMs_;
+        const mbedtls_x509_crt* peer = mbedtls_ssl_get_peer_cert(&ssl_);
+        havePeerHash_ = peer && sha256(peer->raw.p, peer->raw.len, peerHash_) == 0;
+    }
+
+    // Keep the (possibly renewed) session for the next connection
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    haveSession_ = mbedtls_ssl_get_session(&ssl_, &session_) == 0;
+
+    state_ = READY;
+    LOG_INFO("tls %s handshake in %u ms", lastResumed_ ? "resumed" : "full", lastMs_);
+}
+
+tlsClient::state tlsClient::fail(const char* where, int err)
+{
+    failures_++;
+    LOG_WARN("tls %s failed (%d)", where, err);
+    closeSocket();
+    state_ = FAILED;
+    return state_;
+}
+
+void tlsClient::closeSocket()
+{
+    mbedtls_net_free(&net_);   // closes the socket and resets the fd
+    peeked_ = -1;
+}
+
+int tlsClient::verifyPinned(void* ctx, mbedtls_x509_crt* crt, int depth, uint32_t* flags)
+{
+    tlsClient* self = static_cast<tlsClient*>(ctx);
+    if (depth != 0) {
+        *flags = 0;   // only the leaf matters
+        return 0;
+    }
+    uint8_t hash[32];
+    if (sha256(crt->raw.p, crt->raw.len, hash) != 0 || memcmp(hash, self->pin_, sizeof(hash)) != 0) {
+        return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;   // fatal from a callback, even with VERIFY_OPTIONAL
+    }
+    *flags = 0;
+    return 0;
+}
+
+void tlsClient::clearSession()
+{
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    haveSession_ = false;
+}
+
+size_t tlsClient::saveSession(uint8_t* out, size_t len) const
+{
+    size_t used = 0;
+    if (!haveSession_ || mbedtls_ssl_session_save(&session_, out, len, &used) != 0) return 0;
+    return used;
+}
+
+bool tlsClient::loadSession(const uint8_t* data, size_t len)
+{
+    clearSession();
+    if (len == 0) return false;
+    if (mbedtls_ssl_session_load(&session_, data, len) != 0) {
+        clearSession();
+        return false;
+    }
+    haveSession_ = true;
+    return true;
+}
+
+bool tlsClient::peerFingerprint(uint8_t out[32]) const
+{
+    if (!havePeerHash_) return false;
+    memcpy(out, peerHash_, sizeof(peerHash_));
+    return true;
+}
+
+// Blocking fallback for callers that need a connection right away
+int tlsClient::connect(IPAddress ip, uint16_t port)
+{
+    bool samePeer = ip == peerIp_ && port == peerPort_;
+    if (state_ == READY && samePeer) return 1;
+    if (!(pending() && samePeer) && !begin(ip, port)) return 0;
+    while (pending()) {
+        if (poll() == HANDSHAKING) delay(1);
+    }
+    return state_ == READY;
+}
+
+int tlsClient::connect(const char* host, uint16_t port)
+{
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip)) return 0;
+    if (hostname_.length() == 0) hostname_ = host;
+    return connect(ip, port);
+}
+
+size_t tlsClient::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t tlsClient::write(const uint8_t* buf, size_t size)
+{
+    if (state_ != READY) return 0;
+
+    size_t   done = 0;
+    uint32_t t0   = millis();
+    while (done < size) {
+        int n = mbedtls_ssl_write(&ssl_, buf + done, size - done);
+        if (n > 0) {
+            done += n;
+        } else if (n != MBEDTLS_ERR_SSL_WANT_WRITE && n != MBEDTLS_ERR_SSL_WANT_READ) {
+            LOG_WARN("tls write failed (%d)", n);
+            stop();
+            break;
+        } else if (millis() - t0 > WRITE_TIMEOUT_MS) {
+            LOG_WARN("tls write timed out");
+            stop();
+            break;
+        } else {
+            delay(1);
+        }
+    }
+    return done;
+}
+
+int tlsClient::available()
+{
+    if (state_ != READY) return 0;
+
+    int n = mbedtls_ssl_get_bytes_avail(&ssl_);
+    if (n == 0) {
+        int err = mbedtls_ssl_read(&ssl_, nullptr, 0);   // pulls in the next record, if any
+        if (err < 0 && err != MBEDTLS_ERR_SSL_WANT_READ && err != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            LOG_INFO("tls connection closed (%d)", err);
+            closeSocket();
+            state_ = IDLE;
+            return 0;
+        }
+        n = mbedtls_ssl_get_bytes_avail(&ssl_);
+    }
+    return n + (peeked_ >= 0 ? 1 : 0);
+}
+
+int tlsClient::read()
+{
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int tlsClient::read(uint8_t* buf, size_t size)
+{
+    if (size == 0) return 0;
+    size_t got = 0;
+    if (peeked_ >= 0) {
+        buf[got++] = (uint8_t)peeked_;
+        peeked_ = -1;
+    }
+    if (got == size || state_ != READY) return got ? (int)got : -1;
+
+    int n = mbedtls_ssl_read(&ssl_, buf + got, size - got);
+    if (n > 0) return got + n;
+    if (n != MBEDTLS_ERR_SSL_WANT_READ && n != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        LOG_INFO("tls connection closed (%d)", n);
+        closeSocket();
+        state_ = IDLE;
+    }
+    return got ? (int)got : -1;
+}
+
+int tlsClient::peek()
+{
+    if (peeked_ < 0) {
+        uint8_t b;
+        if (read(&b, 1) == 1) peeked_ = b;
+    }
+    return peeked_;
+}
+
+void tlsClient::flush()
+{
+}
+
+void tlsClient::stop()
+{
+    if (state_ == READY) mbedtls_ssl_close_notify(&ssl_);
+    closeSocket();
+    state_ = IDLE;
+}
+
+uint8_t tlsClient::connected()
+{
+    return state_ == READY;
+}
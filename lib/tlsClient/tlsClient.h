@@ -0,0 +1,118 @@
+#ifndef TLSCLIENT_H
+#define TLSCLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <IPAddress.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+// mbedtls TLS 1.2 client with a non-blocking handshake and session resumption.
+//
+// begin() opens a non-blocking socket and poll() advances the TCP connect and
+// the handshake for at most a small time budget per call, so loop() keeps
+// running while a full handshake is in progress. A single handshake step (one
+// ECDHE or signature operation) cannot be split and may exceed the budget;
+// maxStepMs() reports the worst one seen.
+//
+// The session of the last successful handshake (ticket or ID) is offered on
+// the next connection, which skips certificate verification and key exchange.
+// saveSession()/loadSession() serialize it, e.g. into RTC memory across deep
+// sleep. Peers are authenticated against a CA certificate or, when no CA is
+// loaded, a pinned SHA-256 fingerprint of the leaf certificate.
+//
+// Once READY it is a regular Arduino Client, so PubSubClient can use it. If
+// connect() is called while not READY it falls back to a blocking handshake.
+class tlsClient : public Client
+{
+public:
+    enum state : uint8_t { IDLE, CONNECTING, HANDSHAKING, READY, FAILED };
+
+    tlsClient();
+    ~tlsClient();
+
+    bool setCACert(const char* pem);            // copied; nullptr or "" clears it
+    void setPinnedCert(const uint8_t sha256[32]);
+    void setHostname(const char* host);         // SNI and name check, nullptr skips the name check
+    void setHandshakeTimeout(uint32_t ms) { handshakeTimeoutMs_ = ms; }
+    void setStepBudget(uint32_t ms)       { stepBudgetMs_ = ms; }
+
+    bool  begin(IPAddress ip, uint16_t port);
+    state poll();
+    state status() const  { return state_; }
+    bool  pending() const { return state_ == CONNECTING || state_ == HANDSHAKING; }
+
+    bool   hasSession() const { return haveSession_; }
+    void   clearSession();
+    size_t saveSession(uint8_t* out, size_t len) const;   // 0 if there is none or it does not fit
+    bool   loadSession(const uint8_t* data, size_t len);
+    bool   peerFingerprint(uint8_t out[32]) const;        // leaf certificate of the last full handshake
+
+    uint32_t fullHandshakes() const    { return fullCount_; }
+    uint32_t resumedHandshakes() const { return resumedCount_; }
+    uint32_t failures() const          { return failures_; }
+    uint32_t lastHandshakeMs() const   { return lastMs_; }
+    bool     lastResumed() const       { return lastResumed_; }
+    uint32_t fullAverageMs() const     { return fullCount_ ? fullTotalMs_ / fullCount_ : 0; }
+    uint32_t resumedAverageMs() const  { return resumedCount_ ? resumedTotalMs_ / resumedCount_ : 0; }
+    uint32_t maxStepMs() const         { return maxStepMs_; }
+
+    // Client
+    int     connect(IPAddress ip, uint16_t port) override;
+    int     connect(const char* host, uint16_t port) override;
+    size_t  write(uint8_t b) override;
+    size_t  write(const uint8_t* buf, size_t size) override;
+    int     available() override;
+    int     read() override;
+    int     read(uint8_t* buf, size_t size) override;
+    int     peek() override;
+    void    flush() override;
+    void    stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+private:
+    bool  setup();
+    state fail(const char* where, int err);
+    bool  connectStep();     // true when the step made progress
+    bool  handshakeStep();
+    void  finishHandshake();
+    void  closeSocket();
+
+    static int verifyPinned(void* ctx, mbedtls_x509_crt* crt, int depth, uint32_t* flags);
+
+    mbedtls_ssl_context  ssl_;
+    mbedtls_ssl_config   conf_;
+    mbedtls_ssl_session  session_;
+    mbedtls_x509_crt     ca_;
+    mbedtls_net_context  net_;
+
+    state     state_;
+    bool      configured_;
+    bool      haveCa_;
+    bool      havePin_;
+    bool      haveSession_;
+    bool      sawKeyExchange_;   // false at the end of a handshake = the session was resumed
+    uint8_t   pin_[32];
+    uint8_t   peerHash_[32];
+    bool      havePeerHash_;
+    String    hostname_;
+    IPAddress peerIp_;
+    uint16_t  peerPort_;
+    int       peeked_;
+
+    uint32_t handshakeTimeoutMs_;
+    uint32_t stepBudgetMs_;
+    uint32_t startMs_;
+    uint32_t lastMs_;
+    bool     lastResumed_;
+    uint32_t fullCount_;
+    uint32_t resumedCount_;
+    uint32_t fullTotalMs_;
+    uint32_t resumedTotalMs_;
+    uint32_t failures_;
+    uint32_t maxStepMs_;
+};
+
+#endif
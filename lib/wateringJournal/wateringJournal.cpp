@@ -0,0 +1,124 @@
+#include "wateringJournal.h"
+
+namespace
+{
+
+void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// CRC-16/CCITT-FALSE
+uint16_t crc16(const uint8_t* p, size_t n)
+{
+    uint16_t crc = 0xFFFF;
+    while (n--)
+    {
+        crc ^= (uint16_t)*p++ << 8;
+        for (int i = 0; i < 8; ++i) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+}
+
+wateringJournal::wateringJournal(store& s)
+    : store_(s), last_(), writes_(0)
+{
+}
+
+// Layout: u32 seq, u8 type, u8 reason, u32 planned ms, u32 watered ms, u16 crc
+size_t wateringJournal::encode(uint8_t* out, const record& r)
+{
+    put32(out, r.seq);
+    out[4] = r.type;
+    out[5] = r.why;
+    put32(out + 6, r.plannedMs);
+    put32(out + 10, r.wateredMs);
+    uint16_t crc = crc16(out, RECORD_BYTES - 2);
+    out[14] = crc;
+    out[15] = crc >> 8;
+    return RECORD_BYTES;
+}
+
+bool wateringJournal::decode(const uint8_t* in, record& r)
+{
+    if ((in[14] | (in[15] << 8)) != crc16(in, RECORD_BYTES - 2)) return false;
+    if (in[4] != START && in[4] != STOP) return false;
+    r.seq       = get32(in);
+    r.type      = (kind)in[4];
+    r.why       = in[5];
+    r.plannedMs = get32(in + 6);
+    r.wateredMs = get32(in + 10);
+    return true;
+}
+
+// Scan all slots for the record with the highest sequence number
+bool wateringJournal::load()
+{
+    last_ = record();
+    bool found = false;
+    for (uint8_t slot = 0; slot < SLOTS; ++slot)
+    {
+        uint8_t buf[RECORD_BYTES];
+        record r;
+        if (!store_.read(slot, buf, sizeof(buf)) || !decode(buf, r)) continue;
+        if (!found || (int32_t)(r.seq - last_.seq) > 0)
+        {
+            last_ = r;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Decide what to do with an event left open by a reset. openMs is how long
+// the valve was open before the reset, as far as the caller still knows.
+wateringJournal::recovery wateringJournal::recover(bool openKnown, uint32_t openMs) const
+{
+    recovery r = {IDLE, openKnown ? openMs : 0, 0};
+    if (!open()) return r;
+
+    // Open-ended events belong to a schedule window, which reopens the valve itself
+    r.what = CLOSE;
+    if (!openKnown || last_.plannedMs == 0 || openMs >= last_.plannedMs) return r;
+    if (last_.plannedMs - openMs < MIN_RESUME_MS) return r;
+
+    r.what        = RESUME;
+    r.remainingMs = last_.plannedMs - openMs;
+    return r;
+}
+
+bool wateringJournal::begin(uint32_t plannedMs)
+{
+    record r = record();
+    r.type      = START;
+    r.plannedMs = plannedMs;
+    return append(r);
+}
+
+bool wateringJournal::end(reason why, uint32_t wateredMs)
+{
+    if (!open()) return true;   // nothing to close, no write
+    record r = last_;
+    r.type      = STOP;
+    r.why       = why;
+    r.wateredMs = wateredMs;
+    return append(r);
+}
+
+bool wateringJournal::append(record& r)
+{
+    r.seq = last_.seq + 1;
+    uint8_t buf[RECORD_BYTES];
+    encode(buf, r);
+    writes_++;
+    if (!store_.write(r.seq % SLOTS, buf, sizeof(buf))) return false;
+    last_ = r;
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef WATERINGJOURNAL_H
+#define WATERINGJOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only journal of watering events, so a reset while the valve is open
+// (brownout, watchdog, panic) neither forgets a half-done event nor waters it
+// twice.
+//
+// An event costs two writes: START (planned duration) before the valve opens
+// and STOP when it closes. Records carry a sequence number and a CRC and
+// rotate over SLOTS slots of the store, so a write torn by a power cut only
+// loses that record and the previous one stays readable.
+//
+// On boot, recover() looks at the newest record. A START without STOP is an
+// interrupted event: it is resumed for the rest of its planned time when the
+// caller still knows how long the valve was open (a counter in RTC memory,
+// which survives watchdog, panic and brownout resets), and closed otherwise,
+// since watering twice is worse than watering short. Resuming writes nothing;
+// the STOP at its end closes the original START.
+//
+// Storage is behind a small interface (NVS on the device, memory in the host
+// power-cut simulator). Each write() must replace the slot as a whole or, if
+// interrupted, leave bytes that fail the CRC.
+class wateringJournal
+{
+public:
+    class store
+    {
+    public:
+        virtual ~store() {}
+        virtual bool read(uint8_t slot, uint8_t* buf, size_t len) = 0;
+        virtual bool write(uint8_t slot, const uint8_t* buf, size_t len) = 0;
+    };
+
+    enum kind : uint8_t { EMPTY, START, STOP };
+    enum reason : uint8_t { DONE, CANCELLED, INTERRUPTED };   // STOP records
+    enum action : uint8_t { IDLE, RESUME, CLOSE };            // recover()
+
+    struct record
+    {
+        uint32_t seq;
+        kind     type;
+        uint8_t  why;          // STOP: reason
+        uint32_t plannedMs;    // 0 = open-ended (schedule window)
+        uint32_t wateredMs;    // STOP: valve-open time of the event
+    };
+
+    struct recovery
+    {
+        action   what;
+        uint32_t elapsedMs;    // valve-open time before the reset, 0 if unknown
+        uint32_t remainingMs;  // RESUME
+    };
+
+    static const uint8_t  SLOTS         = 4;
+    static const size_t   RECORD_BYTES  = 16;
+    static const uint32_t MIN_RESUME_MS = 2000;   // less than this left counts as done
+
+    explicit wateringJournal(store& s);
+
+    bool load();                                  // newest valid record; false if none
+    recovery recover(bool openKnown, uint32_t openMs) const;
+
+    bool begin(uint32_t plannedMs);
+    bool end(reason why, uint32_t wateredMs);
+
+    bool          open() const   { return last_.type == START; }
+    uint32_t      seq() const    { return last_.seq; }
+    const record& last() const   { return last_; }
+    uint32_t      writes() const { return writes_; }
+
+    static size_t encode(uint8_t* out, const record& r);
+    static bool   decode(const uint8_t* in, record& r);
+
+private:
+    bool append(record& r);
+
+    store&   store_;
+    record   last_;
+    uint32_t writes_;
+};
+
+#endif
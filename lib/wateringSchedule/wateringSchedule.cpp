@@ -0,0 +1,220 @@
+#include "wateringSchedule.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const uint16_t MINUTES_PER_DAY = 1440;
+static const uint32_t EPOCH_WEEKDAY   = 4;   // 1970-01-01 was a Thursday
+
+wateringSchedule::wateringSchedule()
+    : count_(0), edgeCount_(0), utcOffset_(0), evalEpoch_(0), validFor_(0),
+      allowed_(true), forced_(false)
+{
+}
+
+uint32_t wateringSchedule::nextChange() const
+{
+    if (evalEpoch_ == 0 || validFor_ == UINT32_MAX) return 0;
+    return evalEpoch_ + validFor_;
+}
+
+// A new offset moves every local edge, so force a re-evaluation
+void wateringSchedule::setUtcOffset(int32_t seconds)
+{
+    if (seconds == utcOffset_) return;
+    utcOffset_ = seconds;
+    validFor_  = 0;
+}
+
+bool wateringSchedule::add(const rule& r)
+{
+    if (count_ >= MAX_RULES || r.kind < ALLOW || r.kind > WATER || (r.days & 0x7F) == 0 ||
+        r.startMin >= MINUTES_PER_DAY || r.lengthMin == 0 || r.lengthMin > MINUTES_PER_DAY) {
+        return false;
+    }
+    rules_[count_++] = r;
+    rebuildCalendar();
+    return true;
+}
+
+void wateringSchedule::clear()
+{
+    count_ = 0;
+    rebuildCalendar();
+}
+
+// Replace all rules, e.g. from a persisted copy; invalid entries reject the whole set
+bool wateringSchedule::load(const rule* rules, uint8_t count)
+{
+    uint8_t old = count_;
+    rule    backup[MAX_RULES];
+    memcpy(backup, rules_, sizeof(rule) * old);
+
+    clear();
+    for (uint8_t i = 0; i < count; ++i) {
+        if (!add(rules[i])) {
+            count_ = old;
+            memcpy(rules_, backup, sizeof(rule) * old);
+            rebuildCalendar();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Collect every rule start/end as a minute of the week, sorted and unique
+void wateringSchedule::rebuildCalendar()
+{
+    edgeCount_ = 0;
+    for (uint8_t i = 0; i < count_; ++i) {
+        const rule& r = rules_[i];
+        for (uint8_t d = 0; d < 7; ++d) {
+            if (!(r.days & (1 << d))) continue;
+            uint16_t start = d * MINUTES_PER_DAY + r.startMin;
+            edges_[edgeCount_++] = start;
+            edges_[edgeCount_++] = (start + r.lengthMin) % MINUTES_PER_WEEK;
+        }
+    }
+
+    // Insertion sort: at most a few hundred entries, only on configuration changes
+    for (uint16_t i = 1; i < edgeCount_; ++i) {
+        uint16_t v = edges_[i], j = i;
+        while (j > 0 && edges_[j - 1] > v) {
+            edges_[j] = edges_[j - 1];
+            --j;
+        }
+        edges_[j] = v;
+    }
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < edgeCount_; ++i) {
+        if (n == 0 || edges_[n - 1] != edges_[i]) edges_[n++] = edges_[i];
+    }
+    edgeCount_ = n;
+    validFor_  = 0;
+}
+
+bool wateringSchedule::inside(const rule& r, uint16_t minuteOfWeek) const
+{
+    for (uint8_t d = 0; d < 7; ++d) {
+        if (!(r.days & (1 << d))) continue;
+        uint16_t start = d * MINUTES_PER_DAY + r.startMin;
+        uint16_t since = (minuteOfWeek + MINUTES_PER_WEEK - start) % MINUTES_PER_WEEK;
+        if (since < r.lengthMin) return true;
+    }
+    return false;
+}
+
+// Recompute the state at utcEpoch and how long it stays valid
+bool wateringSchedule::evaluate(uint32_t utcEpoch)
+{
+    bool wasAllowed = allowed_, wasForced = forced_;
+    evalEpoch_ = utcEpoch;
+
+    if (utcEpoch == 0 || count_ == 0) {
+        allowed_  = true;
+        forced_   = false;
+        validFor_ = utcEpoch == 0 ? 1 : UINT32_MAX;
+        return allowed_ != wasAllowed || forced_ != wasForced;
+    }
+
+    int64_t  local  = (int64_t)utcEpoch + utcOffset_;
+    uint32_t minute = (uint32_t)(local / 60);
+    uint16_t mow    = (minute + EPOCH_WEEKDAY * MINUTES_PER_DAY) % MINUTES_PER_WEEK;
+
+    bool anyAllow = false, inAllow = false, inForbid = false, inWater = false;
+    for (uint8_t i = 0; i < count_; ++i) {
+        const rule& r = rules_[i];
+        bool in = inside(r, mow);
+        if (r.kind == ALLOW) {
+            anyAllow = true;
+            inAllow |= in;
+        }
+        else if (r.kind == FORBID) inForbid |= in;
+        else                       inWater  |= in;
+    }
+    allowed_ = (!anyAllow || inAllow) && !inForbid;
+    forced_  = inWater;
+
+    // First edge strictly after now, wrapping into next week
+    uint16_t lo = 0, hi = edgeCount_;
+    while (lo < hi) {
+        uint16_t mid = (lo + hi) / 2;
+        if (edges_[mid] <= mow) lo = mid + 1;
+        else                    hi = mid;
+    }
+    uint32_t next = lo < edgeCount_ ? edges_[lo] : edges_[0] + MINUTES_PER_WEEK;
+    validFor_ = (next - mow) * 60 - (uint32_t)(local % 60);
+
+    return allowed_ != wasAllowed || forced_ != wasForced;
+}
+
+static const char* parseClock(const char* p, uint16_t& minutes)
+{
+    unsigned h, m;
+    int used = 0;
+    if (sscanf(p, "%2u:%2u%n", &h, &m, &used) != 2 || h > 24 || m > 59 || h * 60 + m > MINUTES_PER_DAY) {
+        return nullptr;
+    }
+    minutes = h * 60 + m;
+    return p + used;
+}
+
+bool wateringSchedule::parse(const char* text)
+{
+    rule parsed[MAX_RULES];
+    uint8_t n = 0;
+    const char* p = text;
+
+    while (*p) {
+        while (*p == ' ' || *p == ';') ++p;
+        if (!*p) break;
+        if (n >= MAX_RULES) return false;
+
+        rule& r = parsed[n];
+        if      (strncmp(p, "allow ", 6) == 0)  { r.kind = ALLOW;  p += 6; }
+        else if (strncmp(p, "forbid ", 7) == 0) { r.kind = FORBID; p += 7; }
+        else if (strncmp(p, "water ", 6) == 0)  { r.kind = WATER;  p += 6; }
+        else return false;
+
+        if (*p == '*') {
+            r.days = 0x7F;
+            ++p;
+        } else {
+            r.days = 0;
+            for (uint8_t d = 0; d < 7; ++d, ++p) {
+                if (*p != '0' && *p != '1') return false;
+                if (*p == '1') r.days |= 1 << d;
+            }
+        }
+        if (*p++ != ' ') return false;
+
+        uint16_t from, to;
+        if (!(p = parseClock(p, from)) || *p++ != '-' || !(p = parseClock(p, to))) return false;
+        if (from >= MINUTES_PER_DAY) return false;
+        r.startMin  = from;
+        r.lengthMin = to > from ? to - from : MINUTES_PER_DAY - from + to % MINUTES_PER_DAY;
+        if (*p && *p != ';') return false;
+        ++n;
+    }
+    return load(parsed, n);
+}
+
+size_t wateringSchedule::format(char* out, size_t cap) const
+{
+    static const char* names[] = {"", "allow", "forbid", "water"};
+    size_t len = 0;
+    if (cap) out[0] = '\0';
+    for (uint8_t i = 0; i < count_ && len < cap; ++i) {
+        const rule& r = rules_[i];
+        char days[8];
+        for (uint8_t d = 0; d < 7; ++d) days[d] = (r.days & (1 << d)) ? '1' : '0';
+        days[7] = '\0';
+        uint16_t end = (r.startMin + r.lengthMin) % MINUTES_PER_DAY;
+        int w = snprintf(out + len, cap - len, "%s%s %s %02u:%02u-%02u:%02u", i ? ";" : "",
+                         names[r.kind], r.days == 0x7F ? "*" : days,
+                         r.startMin / 60, r.startMin % 60, end / 60, end % 60);
+        if (w < 0) break;
+        len += (size_t)w;
+    }
+    return len < cap ? len : cap ? cap - 1 : 0;
+}
@@ -0,0 +1,76 @@
+#ifndef WATERINGSCHEDULE_H
+#define WATERINGSCHEDULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Weekly time-of-day rules evaluated on local time:
+//   ALLOW  - threshold watering is only permitted inside allow windows (if any exist)
+//   FORBID - threshold watering is never permitted (and is cut short) inside these
+//   WATER  - the valve is opened for the whole window regardless of moisture
+//
+// Rule edges are precomputed into a sorted weekly calendar. poll() does a
+// single unsigned comparison per call; the rules are re-evaluated only when
+// the next edge is reached, the clock steps backwards (NTP correction) or the
+// UTC offset changes (DST).
+class wateringSchedule
+{
+public:
+    enum kind : uint8_t { ALLOW = 1, FORBID = 2, WATER = 3 };
+
+    struct rule
+    {
+        uint8_t  kind;
+        uint8_t  days;       // bit 0 = Sunday .. bit 6 = Saturday
+        uint16_t startMin;   // minute of day, 0..1439
+        uint16_t lengthMin;  // 1..1440, may run past midnight
+    };
+
+    static const uint8_t  MAX_RULES = 16;
+    static const uint16_t MINUTES_PER_WEEK = 7 * 1440;
+
+    wateringSchedule();
+
+    // Returns true when the state changed since the last call. epoch 0 (no
+    // time yet) means "no schedule": watering allowed, nothing forced.
+    bool poll(uint32_t utcEpoch)
+    {
+        if (utcEpoch - evalEpoch_ < validFor_) return false;
+        return evaluate(utcEpoch);
+    }
+
+    bool     allowed() const { return allowed_; }
+    bool     forced() const  { return forced_; }
+    uint32_t nextChange() const;          // epoch of the next edge, 0 if none
+
+    void     setUtcOffset(int32_t seconds);
+    int32_t  utcOffset() const { return utcOffset_; }
+
+    bool        add(const rule& r);
+    void        clear();
+    uint8_t     count() const { return count_; }
+    const rule* rules() const { return rules_; }
+    bool        load(const rule* rules, uint8_t count);
+
+    // Text form, rules separated by ';':  "<allow|forbid|water> <days> HH:MM-HH:MM"
+    // days is "*" or seven 0/1 flags starting on Sunday, e.g. "0111110".
+    bool   parse(const char* text);
+    size_t format(char* out, size_t cap) const;
+
+private:
+    bool evaluate(uint32_t utcEpoch);
+    void rebuildCalendar();
+    bool inside(const rule& r, uint16_t minuteOfWeek) const;
+
+    rule     rules_[MAX_RULES];
+    uint8_t  count_;
+    uint16_t edges_[MAX_RULES * 7 * 2];   // sorted minute-of-week rule edges
+    uint16_t edgeCount_;
+    int32_t  utcOffset_;
+    uint32_t evalEpoch_;                  // time of the last evaluation
+    uint32_t validFor_;                   // seconds until the next edge
+    bool     allowed_;
+    bool     forced_;
+};
+
+#endif
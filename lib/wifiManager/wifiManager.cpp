@@ -1,11 +1,32 @@
 #include "wifiManager.h"
-#include "getEventType.h"
 
 wifiManager::wifiManager(int n, unsigned long autoConnectionCheckPeriod, String nameHost)
 {
     this->nameHost = nameHost;
     this->autoConnectionLastTime = 0;
     this->autoConnectionCheckPeriod = autoConnectionCheckPeriod;
+    this->eventsHandled = 0;
+    this->eventLatencyMaxUs = 0;
+    this->eventLatencyTotalUs = 0;
+
+    this->roaming = false;
+    this->waitingScanningToRoam = false;
+    this->roamThresholdDbm = -75;
+    this->roamHysteresisDb = 8;
+    this->rssiCheckPeriod = 5000;
+    this->rssiLastCheckTime = 0;
+    this->roamScanMinInterval = 30000;
+    this->roamLastScanTime = 0;
+    this->roamCandidateChannel = 0;
+    this->roamCount = 0;
+    this->roamScans = 0;
+    this->rssiSamples = 0;
+    this->rssiLowSamples = 0;
+    this->rssiSum = 0;
+    this->rssiLast = 0;
+    this->rssiMin = 0;
+    this->rssiMax = -127;
+    this->mdnsStarted = false;
 }
 
 void wifiManager::begin(bool enableAutoConnection)
@@ -17,8 +38,13 @@ void wifiManager::begin(bool enableAutoConnection)
 
     WiFi.mode(WIFI_STA);
 
-    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) { 
-        this->handleWifiEvent(event, info); 
+    // Runs on the system event task: only record the event, handle() does the work
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+        queuedEvent e;
+        e.event = event;
+        e.timestampUs = micros();
+        e.reason = event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED ? info.wifi_sta_disconnected.reason : 0;
+        this->eventQueue.push(e);
     });
 
     this->waitingScanningToAutoConnect = false;
@@ -30,6 +56,17 @@ void wifiManager::begin(bool enableAutoConnection)
 
 void wifiManager::handle()
 {
+    queuedEvent e;
+    while(this->eventQueue.pop(e))
+    {
+        this->handleWifiEvent(e);
+
+        uint32_t latency = micros() - e.timestampUs;
+        this->eventsHandled++;
+        this->eventLatencyTotalUs += latency;
+        if(latency > this->eventLatencyMaxUs) this->eventLatencyMaxUs = latency;
+    }
+
     if(this->autoConnection && millis()-this->autoConnectionLastTime > this->autoConnectionCheckPeriod)
     {
         this->autoConnectionLastTime = millis();
@@ -41,14 +78,19 @@ void wifiManager::handle()
             }
         }
     }
+
+    if(this->roaming && millis()-this->rssiLastCheckTime > this->rssiCheckPeriod)
+    {
+        this->rssiLastCheckTime = millis();
+        this->_checkSignal();
+    }
 }
 
-void wifiManager::handleWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+void wifiManager::handleWifiEvent(const queuedEvent& e)
 {
-    Serial.println("event trigered: ");
-    Serial.println(getEventName(event));
+    LOG_DEBUG("wifi event %u", e.event);
 
-    switch (event)
+    switch (e.event)
     {
     case SYSTEM_EVENT_SCAN_DONE:
         if(this->waitingScanningToAutoConnect)
@@ -56,20 +98,30 @@ void wifiManager::handleWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
             this->_chooseNetworkFromScanAndConnect();
             this->waitingScanningToAutoConnect = false;
         }
+        else if(this->waitingScanningToRoam)
+        {
+            this->_chooseRoamTargetFromScan();
+        }
+        this->waitingScanningToRoam = false;
         WiFi.scanDelete();
         break;    
     case SYSTEM_EVENT_STA_CONNECTED:
         if(this->waitingForConnection)
         {
-            Serial.println("Connected successfully");
+            LOG_INFO("Connected successfully");
             this->waitingForConnection = false;
         }
 
         break;    
+    case SYSTEM_EVENT_STA_GOT_IP:
+        // (Re)start mDNS once per address so it announces the current one
+        this->startMDNS();
+        for (auto& handler : this->gotIpHandlers) handler();
+        break;
     case SYSTEM_EVENT_STA_DISCONNECTED:
         if(this->waitingForConnection)
         {
-            Serial.println("Could not connect to selected network");
+            LOG_WARN("Could not connect to selected network, reason %u", e.reason);
             this->waitingForConnection = false;
         }
         break;
@@ -80,80 +132,212 @@ void wifiManager::handleWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
 
 void wifiManager::enableAutoConnection()
 {
-    Serial.println("enabling auto connect");
+    LOG_INFO("enabling auto connect");
     this->autoConnection = true;
     this->_autoConnect();
 }
 void wifiManager::disableAutoConnection()
 {
-    Serial.println("disabling auto connect");
+    LOG_INFO("disabling auto connect");
     this->autoConnection = false;
 }
 
+void wifiManager::enableRoaming(int thresholdDbm, int hysteresisDb, unsigned long checkPeriod)
+{
+    LOG_INFO("enabling roaming below %d dBm", thresholdDbm);
+    this->roamThresholdDbm = thresholdDbm;
+    this->roamHysteresisDb = hysteresisDb;
+    this->rssiCheckPeriod = checkPeriod;
+    this->roaming = true;
+}
+void wifiManager::disableRoaming()
+{
+    LOG_INFO("disabling roaming");
+    this->roaming = false;
+}
+
 void wifiManager::_autoConnect()
 {
-    Serial.println("beginning of auto connect");
+    LOG_DEBUG("beginning of auto connect");
     this->waitingScanningToAutoConnect = true;
     
-    Serial.println("getting networks...");
+    LOG_DEBUG("getting networks...");
     WiFi.scanNetworks(true);
 }
 
-void wifiManager::_connect(String ssid, String passwd)
+void wifiManager::_connect(String ssid, String passwd, int32_t channel, const uint8_t* bssid)
 {
-    Serial.print("connecting to ");
-    Serial.println(ssid);
+    LOG_INFO("connecting to %s", ssid);
     
     this->waitingForConnection = true;
-    WiFi.begin(ssid, passwd);
-
-    this->startMDNS();
+    WiFi.begin(ssid.c_str(), passwd.c_str(), channel, bssid);
 }
 
 void wifiManager::startMDNS()
 {
-    if (!MDNS.begin(this->nameHost)) {
-        Serial.println("Erro ao configurar o mDNS");
+    if (this->mdnsStarted) MDNS.end();
+    this->mdnsStarted = MDNS.begin(this->nameHost);
+    if (!this->mdnsStarted) {
+        LOG_ERROR("Erro ao configurar o mDNS");
+        return;
+    }
+    for (auto& s : this->mdnsServices) {
+        MDNS.addService(s.service, s.proto, s.port);
     }
 }
 
-void wifiManager::_chooseNetworkFromScanAndConnect()
+// Register a callback run from handle() whenever the station gets an IP
+void wifiManager::onGotIp(std::function<void()> handler)
 {
-    Serial.println("choosing network to connect");
-    int n = WiFi.scanComplete();
+    this->gotIpHandlers.push_back(handler);
+}
 
-    if(n == -2)
-    {
-        Serial.println("There isn't a network scan yet");
-        return;
-    }
+// Advertise a service on every mDNS (re)start
+void wifiManager::addMDNSService(const char* service, const char* proto, uint16_t port)
+{
+    this->mdnsServices.push_back({String(service), String(proto), port});
+}
 
+// Returns the scan index of the strongest saved network (skipping excludeBssid), or -1
+int wifiManager::_bestSavedNetworkInScan(int n, int& indexInList, const uint8_t* excludeBssid)
+{
     int bestWifiId = -1;
-    int bestWifiIndexInList = -1;
+    indexInList = -1;
 
     for (int i = 0; i < n; i++) {
         auto it = std::find(this->wifiList.begin(), this->wifiList.end(), WiFi.SSID(i));
 
         if(it != this->wifiList.end())
         {
-            Serial.print(">");
-            if(bestWifiId == -1 || WiFi.RSSI(i) > WiFi.RSSI(bestWifiId))
+            bool excluded = excludeBssid != NULL && memcmp(WiFi.BSSID(i), excludeBssid, 6) == 0;
+            if(!excluded && (bestWifiId == -1 || WiFi.RSSI(i) > WiFi.RSSI(bestWifiId)))
             {
                 bestWifiId = i;
-                bestWifiIndexInList = std::distance(wifiList.begin(), it);
+                indexInList = std::distance(wifiList.begin(), it);
             }
         }
-        Serial.println(WiFi.SSID(i));
+        LOG_DEBUG("scan: %s %d dBm ch %d saved=%d", WiFi.SSID(i), WiFi.RSSI(i), WiFi.channel(i),
+                  it != this->wifiList.end());
     }
 
+    return bestWifiId;
+}
+
+void wifiManager::_chooseNetworkFromScanAndConnect()
+{
+    LOG_DEBUG("choosing network to connect");
+    int n = WiFi.scanComplete();
+
+    if(n == -2)
+    {
+        LOG_WARN("There isn't a network scan yet");
+        return;
+    }
+
+    int bestWifiIndexInList;
+    this->_bestSavedNetworkInScan(n, bestWifiIndexInList, NULL);
+
     if(bestWifiIndexInList != -1)
     {
-        Serial.print("chosen network: ");
-        Serial.println(this->wifiList[bestWifiIndexInList]);
+        LOG_INFO("chosen network: %s", this->wifiList[bestWifiIndexInList]);
 
         this->_connect(this->wifiList[bestWifiIndexInList], this->passwdList[bestWifiIndexInList]);
     }
-    else Serial.println("network not found");
+    else LOG_WARN("network not found");
+}
+
+/*----------------------------- ROAMING -----------------------------*/
+
+// Sample the link RSSI and start a background scan when the signal is weak
+void wifiManager::_checkSignal()
+{
+    if(WiFi.status() != WL_CONNECTED) return;
+
+    int rssi = WiFi.RSSI();
+    this->rssiLast = rssi;
+    this->rssiSum += rssi;
+    if(this->rssiSamples == 0 || rssi < this->rssiMin) this->rssiMin = rssi;
+    if(rssi > this->rssiMax) this->rssiMax = rssi;
+    this->rssiSamples++;
+
+    if(rssi >= this->roamThresholdDbm) return;
+    this->rssiLowSamples++;
+
+    if(this->waitingScanningToAutoConnect || this->waitingScanningToRoam || this->waitingForConnection) return;
+    if(this->roamScans > 0 && millis()-this->roamLastScanTime < this->roamScanMinInterval) return;
+
+    LOG_INFO("weak signal (%d dBm), scanning for a better access point", rssi);
+
+    // A candidate seen in the previous scan only needs its own channel scanned
+    this->waitingScanningToRoam = true;
+    this->roamLastScanTime = millis();
+    this->roamScans++;
+    WiFi.scanNetworks(true, false, false, 120, this->roamCandidateChannel);
+}
+
+// Switch to a saved access point that beats the current one by the hysteresis margin
+void wifiManager::_chooseRoamTargetFromScan()
+{
+    int n = WiFi.scanComplete();
+    if(n < 0 || WiFi.status() != WL_CONNECTED) return;
+
+    uint8_t currentBssid[6];
+    memcpy(currentBssid, WiFi.BSSID(), 6);
+    int currentRssi = WiFi.RSSI();
+
+    int indexInList;
+    int best = this->_bestSavedNetworkInScan(n, indexInList, currentBssid);
+    if(best == -1)
+    {
+        this->roamCandidateChannel = 0;
+        return;
+    }
+
+    if(WiFi.RSSI(best) < currentRssi + this->roamHysteresisDb)
+    {
+        // Not good enough yet; keep watching its channel instead of doing full scans
+        this->roamCandidateChannel = WiFi.channel(best);
+        return;
+    }
+
+    LOG_INFO("roaming to %s (%d dBm vs %d dBm)", WiFi.BSSIDstr(best), WiFi.RSSI(best), currentRssi);
+
+    uint8_t bssid[6];
+    memcpy(bssid, WiFi.BSSID(best), 6);
+    this->roamCount++;
+    this->roamCandidateChannel = 0;
+    this->_connect(this->wifiList[indexInList], this->passwdList[indexInList], WiFi.channel(best), bssid);
+}
+
+uint32_t wifiManager::getRoamCount()
+{
+    return this->roamCount;
+}
+uint32_t wifiManager::getRoamScans()
+{
+    return this->roamScans;
+}
+int wifiManager::getRssiLast()
+{
+    return this->rssiLast;
+}
+int wifiManager::getRssiMin()
+{
+    return this->rssiMin;
+}
+int wifiManager::getRssiMax()
+{
+    return this->rssiMax;
+}
+int wifiManager::getRssiAvg()
+{
+    if(this->rssiSamples == 0) return 0;
+    return this->rssiSum / (int64_t)this->rssiSamples;
+}
+uint32_t wifiManager::getRssiLowPercent()
+{
+    if(this->rssiSamples == 0) return 0;
+    return 100 * this->rssiLowSamples / this->rssiSamples;
 }
 
 /*----------------------------- WIFI LIST HANDLING -----------------------------*/
@@ -184,11 +368,18 @@ void wifiManager::loadList()
 
     if(this->wifiList.size() != this->passwdList.size())
     {
-        Serial.println("Error in saved wifi");
+        LOG_ERROR("Error in saved wifi");
         this->wifiList.clear();
         this->passwdList.clear();
     }
 }
+// Reads the saved list without starting WiFi (deep-sleep timer wakes)
+void wifiManager::loadSavedNetworks()
+{
+    this->p.begin("wifi-config", true);
+    this->loadList();
+    this->p.end();
+}
 void wifiManager::saveList()
 {
     String strList = "";
@@ -213,6 +404,18 @@ String wifiManager::getSavedNetwork(int networkIndex)
 {
     return this->wifiList[networkIndex];
 }
+String wifiManager::getSavedPassword(int networkIndex)
+{
+    return this->passwdList[networkIndex];
+}
+int wifiManager::getSavedNetworkIndex(String ssid)
+{
+    for (int i = 0; i < this->wifiList.size(); i++)
+    {
+        if(this->wifiList[i] == ssid) return i;
+    }
+    return -1;
+}
 void wifiManager::listSavedNetworks()
 {
     Serial.println("Saved WIFIs:");
@@ -267,6 +470,26 @@ bool wifiManager::removeNetwork(int id)
 }
 
 
+/*----------------------------- EVENT STATISTICS -----------------------------*/
+
+uint32_t wifiManager::getEventsHandled()
+{
+    return this->eventsHandled;
+}
+uint32_t wifiManager::getEventsDropped()
+{
+    return this->eventQueue.dropped();
+}
+uint32_t wifiManager::getEventLatencyMaxUs()
+{
+    return this->eventLatencyMaxUs;
+}
+uint32_t wifiManager::getEventLatencyAvgUs()
+{
+    if(this->eventsHandled == 0) return 0;
+    return this->eventLatencyTotalUs / this->eventsHandled;
+}
+
 /*----------------------------- OTHER PUBLIC FUNCTIONS -----------------------------*/
 
 void wifiManager::autoConnect()
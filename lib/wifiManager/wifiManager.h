@@ -5,16 +5,53 @@
 #include <WiFi.h>
 #include <ESPmDNS.h>
 #include <vector>
+#include <functional>
 #include <Preferences.h>
+#include <spscQueue.h>
+#include <binLog.h>
 
 class wifiManager
 {
 private:
+    // WiFi event as captured on the system event task
+    struct queuedEvent
+    {
+        WiFiEvent_t event;
+        uint32_t    timestampUs;
+        uint8_t     reason;     // disconnect reason, 0 otherwise
+    };
+
     Preferences p;
-    void _connect(String ssid, String passwd);
+    void _connect(String ssid, String passwd, int32_t channel = 0, const uint8_t* bssid = NULL);
     void _autoConnect();
-    void handleWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+    void handleWifiEvent(const queuedEvent& e);
     void _chooseNetworkFromScanAndConnect();
+    int  _bestSavedNetworkInScan(int n, int& indexInList, const uint8_t* excludeBssid);
+    void _checkSignal();
+    void _chooseRoamTargetFromScan();
+
+    bool roaming;
+    bool waitingScanningToRoam;
+    int roamThresholdDbm;
+    int roamHysteresisDb;
+    unsigned long rssiCheckPeriod;
+    unsigned long rssiLastCheckTime;
+    unsigned long roamScanMinInterval;
+    unsigned long roamLastScanTime;
+    int32_t roamCandidateChannel;
+    uint32_t roamCount;
+    uint32_t roamScans;
+    uint32_t rssiSamples;
+    uint32_t rssiLowSamples;
+    int64_t rssiSum;
+    int rssiLast;
+    int rssiMin;
+    int rssiMax;
+
+    spscQueue<queuedEvent, 32> eventQueue;
+    uint32_t eventsHandled;
+    uint32_t eventLatencyMaxUs;
+    uint64_t eventLatencyTotalUs;
 
     bool autoConnection;
     bool waitingScanningToAutoConnect;
@@ -24,6 +61,17 @@ private:
 
     String nameHost;
 
+    struct mdnsService
+    {
+        String   service;
+        String   proto;
+        uint16_t port;
+    };
+    std::vector<mdnsService> mdnsServices;
+    bool mdnsStarted;
+
+    std::vector<std::function<void()>> gotIpHandlers;
+
 public:
     std::vector<String> wifiList;
     std::vector<String> passwdList;
@@ -33,6 +81,9 @@ public:
     void enableAutoConnection();
     void disableAutoConnection();
 
+    void enableRoaming(int thresholdDbm = -75, int hysteresisDb = 8, unsigned long checkPeriod = 5000);
+    void disableRoaming();
+
     void handle();
 
     void autoConnect();
@@ -47,13 +98,31 @@ public:
 
     void loadList();
     void saveList();
+    void loadSavedNetworks();
 
     void startMDNS();
+    void addMDNSService(const char* service, const char* proto, uint16_t port);
+    void onGotIp(std::function<void()> handler);
     void listAvailableNetworks();
 
     void listSavedNetworks();
     int getNumberOfSavedNetworks();
     String getSavedNetwork(int networkIndex);
+    String getSavedPassword(int networkIndex);
+    int getSavedNetworkIndex(String ssid);
+
+    uint32_t getEventsHandled();
+    uint32_t getEventsDropped();
+    uint32_t getEventLatencyMaxUs();
+    uint32_t getEventLatencyAvgUs();
+
+    uint32_t getRoamCount();
+    uint32_t getRoamScans();
+    int getRssiLast();
+    int getRssiMin();
+    int getRssiMax();
+    int getRssiAvg();
+    uint32_t getRssiLowPercent();
 };
 
 
@@ -2,35 +2,103 @@
 import paho.mqtt.client as mqtt
 import matplotlib.pyplot as plt
 import matplotlib.animation as animation
+import matplotlib.dates as mdates
+import time
 from collections import deque
-from datetime import datetime
+from datetime import datetime, timedelta
+from telemetry_codec import decode_block
 
 # ────────── Configuration ──────────
 BROKER   = "localhost"
 PORT     = 1883
-TOPIC    = "graph/data"
+SITE     = "garden"
+DEVICE   = "+"        # device ID (e.g. garden_irrigator-a1b2c3d4e5f6), "+" = any
+TOPIC    = f"{SITE}/{DEVICE}/telemetry"
+PACKED   = f"{SITE}/{DEVICE}/telemetry/packed"
+ROLLUP   = f"{SITE}/{DEVICE}/telemetry/1m"   # published by default, raw samples only on request
+ROLLUP_SEC = 60
 MAX_LEN  = 2000
 INTERVAL = 1000   # ms between updates
+RAW_SEC  = 600    # raw samples are only streamed on request (cmd/raw), renewed before expiring
+LATENCY_LOG = ""  # CSV of ingest/render stamps for tools/latency (-l), "" = off
 
 # ────────── Data buffers ──────────
+# Reports, not necessarily one per second: with report by exception (cmd/rbe)
+# the device only sends changes, so the series is drawn as a step function
+# holding each value until the next report, and the last one until now.
 times  = deque(maxlen=MAX_LEN)
 values = deque(maxlen=MAX_LEN)
 flags  = deque(maxlen=MAX_LEN)
+last_rx = 0.0     # monotonic time of the newest report
+# One-minute rollups: window start, min, max, mean, valve seconds
+r_times = deque(maxlen=MAX_LEN)
+r_min   = deque(maxlen=MAX_LEN)
+r_max   = deque(maxlen=MAX_LEN)
+r_mean  = deque(maxlen=MAX_LEN)
+r_valve = deque(maxlen=MAX_LEN)
+raw_requested = 0.0
+pending = []      # (device, seq, uptime_ms, ingest_ns) received, not drawn yet
+drawing = []      # handed to the frame being drawn
+latency_log = open(LATENCY_LOG, "a", buffering=1) if LATENCY_LOG else None
 
 # ────────── MQTT callbacks ──────────
 def on_connect(client, userdata, flags, rc):
-    print(f"[MQTT] Connected (rc={rc}), subscribing to {TOPIC}")
+    print(f"[MQTT] Connected (rc={rc}), subscribing to {TOPIC}, {PACKED} and {ROLLUP}")
     client.subscribe(TOPIC)
+    client.subscribe(PACKED)
+    client.subscribe(ROLLUP)
+    if DEVICE == "+":
+        print("[MQTT] DEVICE is '+': raw samples can't be requested, plotting the 1-minute rollups")
+    request_raw()
+
+def request_raw():
+    global raw_requested
+    raw_requested = time.monotonic()
+    if DEVICE != "+":
+        client.publish(f"{SITE}/{DEVICE}/cmd/raw", str(RAW_SEC))
 
 def on_message(client, userdata, msg):
+    global last_rx
+    if msg.topic.endswith("/1m"):
+        try:
+            # start,count,min,max,mean,stddev,valve seconds; start is uptime until NTP syncs
+            start, count, vmin, vmax, mean, _, valve = msg.payload.decode().split(",")
+            if int(count) == 0 or int(start) < 1600000000:
+                return
+            r_times.append(datetime.fromtimestamp(int(start)))
+            r_min.append(int(vmin))
+            r_max.append(int(vmax))
+            r_mean.append(float(mean))
+            r_valve.append(int(valve))
+        except Exception as e:
+            print(f"[MQTT] Bad rollup: {e} – {msg.payload!r}")
+        return
+    last_rx = time.monotonic()
+    if msg.topic.endswith("/packed"):
+        try:
+            samples = decode_block(msg.payload)
+            for t, val, flag in samples:
+                times.append(datetime.fromtimestamp(t))
+                values.append(val)
+                flags.append(flag)
+            print(f"[MQTT] packed block: {len(samples)} samples, {len(msg.payload)} bytes")
+        except Exception as e:
+            print(f"[MQTT] Bad packed block: {e}")
+        return
     try:
-        t_str, val_str, flag_str = msg.payload.decode().split(",")
-        t_fmt = datetime.strptime(t_str, "%Y-%m-%d %H:%M:%S").strftime("%H:%M:%S")
-        times.append(t_fmt)
+        fields = msg.payload.decode().split(",")
+        t_str, val_str, flag_str = fields[:3]
+        if latency_log and len(fields) >= 9:
+            # "<site>/<device>", seq and uptime, matched by tools/latency against the device
+            # stamps; seq restarts on a reboot, the uptime tells the boots apart
+            device = msg.topic.rsplit("/", 1)[0]
+            pending.append((device, int(fields[3]), int(fields[4]), time.monotonic_ns()))
+        t = datetime.strptime(t_str, "%Y-%m-%d %H:%M:%S")
+        times.append(t)
         values.append(int(val_str))
         flags.append(int(flag_str))
         # Debug print:
-        print(f"[MQTT] {t_fmt} → {val_str}, flag={flag_str} (buffer size {len(times)})")
+        print(f"[MQTT] {t:%H:%M:%S} → {val_str}, flag={flag_str} (buffer size {len(times)})")
     except Exception as e:
         print(f"[MQTT] Bad payload: {e} – {msg.payload!r}")
 
@@ -56,24 +124,49 @@ def init():
     return line, scat
 
 def update(frame):
-    if not times:
+    if time.monotonic() - raw_requested > RAW_SEC * 0.8:
+        request_raw()
+    if not times and not r_times:
         return line, scat
-
-    x = list(range(len(times)))
-    y = list(values)
-    c = ["green" if f==1 else "red" for f in flags]
+    if latency_log:
+        drawing.extend(pending)
+        pending.clear()
 
     ax.clear()
-    ax.plot(x, y, color="#888888", linewidth=0.8, zorder=1)
-    ax.scatter(x, y, color=c, s=30, zorder=2)
-    ax.set_xticks(x[::max(1, len(x)//10)])
-    ax.set_xticklabels([times[i] for i in x[::max(1, len(x)//10)]])
+    if r_times:
+        # each rollup holds for its window: min..max band and the mean
+        rx = list(r_times) + [r_times[-1] + timedelta(seconds=ROLLUP_SEC)]
+        ax.fill_between(rx, list(r_min) + [r_min[-1]], list(r_max) + [r_max[-1]],
+                        step="post", color="#1f77b4", alpha=0.15, linewidth=0, zorder=0)
+        ax.step(rx, list(r_mean) + [r_mean[-1]], where="post", color="#1f77b4", linewidth=1.2, zorder=1)
+        ax.scatter(list(r_times), list(r_mean), s=12, zorder=2,
+                   color=["green" if v > 0 else "red" for v in r_valve])
+    if times:
+        x = list(times)
+        y = list(values)
+        c = ["green" if f==1 else "red" for f in flags]
+        # the last report still holds: extend it by the time since it arrived
+        now = x[-1] + timedelta(seconds=time.monotonic() - last_rx)
+        ax.step(x + [now], y + [y[-1]], where="post", color="#888888", linewidth=0.8, zorder=1)
+        ax.scatter(x, y, color=c, s=30, zorder=2)
+    ax.xaxis.set_major_formatter(mdates.DateFormatter("%H:%M:%S"))
+    plt.setp(ax.get_xticklabels(), rotation=45)
     ax.set_xlabel("Time")
     ax.set_ylabel("Humidity")
     ax.set_title("Real-Time Humidity (green = ON, red = OFF)")
     plt.tight_layout()
     return line, scat
 
+def on_draw(event):
+    # the frame with these samples is on screen
+    now = time.monotonic_ns()
+    for device, seq, uptime_ms, ingest_ns in drawing:
+        latency_log.write(f"{device},{seq},{uptime_ms},{ingest_ns},{now}\n")
+    drawing.clear()
+
+if latency_log:
+    fig.canvas.mpl_connect("draw_event", on_draw)
+
 ani = animation.FuncAnimation(
     fig, update, init_func=init,
     blit=False, interval=INTERVAL
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""Decoder for the packed telemetry blocks produced by lib/telemetryCodec
+(published on <site>/<device>/telemetry/packed).
+
+    python3 telemetry_codec.py block.bin   # prints "epoch,moisture,valve" lines
+"""
+import sys
+
+VERSION = 1
+
+
+class _BitReader:
+    def __init__(self, data, pos):
+        self.data = data
+        self.pos = pos
+
+    def bits(self, n):
+        out = 0
+        for _ in range(n):
+            byte = self.data[self.pos >> 3]
+            out = (out << 1) | ((byte >> (7 - (self.pos & 7))) & 1)
+            self.pos += 1
+        return out
+
+    def prefix(self, max_ones):
+        ones = 0
+        while ones < max_ones and self.bits(1):
+            ones += 1
+        return ones
+
+
+def _signed(v, bits):
+    return v - (1 << bits) if v & (1 << (bits - 1)) else v
+
+
+def decode_block(data):
+    """Return a list of (epoch, moisture, valve) tuples."""
+    if len(data) < 3 or data[0] != VERSION:
+        raise ValueError("not a telemetry block")
+    count = data[1] | (data[2] << 8)
+    r = _BitReader(data, 24)
+    out = []
+    t = delta = value = flag = 0
+    for i in range(count):
+        if i == 0:
+            t, value, flag = r.bits(32), r.bits(16), r.bits(1)
+        else:
+            ones = r.prefix(4)
+            if ones:
+                n = (0, 7, 9, 12, 32)[ones]
+                delta += _signed(r.bits(n), n)
+            t = (t + delta) & 0xFFFFFFFF
+            ones = r.prefix(3)
+            zz = r.bits((0, 4, 8, 17)[ones]) if ones else 0
+            value = (value + ((zz >> 1) ^ -(zz & 1))) & 0xFFFF
+            flag ^= r.bits(1)
+        out.append((t, value, flag))
+    return out
+
+
+if __name__ == "__main__":
+    for t, v, f in decode_block(open(sys.argv[1], "rb").read()):
+        print(f"{t},{v},{f}")
@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+"""Per-module flash/RAM usage from the linker map, with a size budget.
+
+As a PlatformIO extra script (platformio.ini: extra_scripts = post:...) it
+adds -Wl,-Map to the link, prints the biggest modules after every build,
+writes size_report.csv next to firmware.elf and fails the build when the
+env's custom_flash_budget / custom_ram_budget (bytes, 0 = no limit) is
+exceeded. Standalone, on any GNU ld map file:
+
+    python3 scripts/size_budget.py .pio/build/sensor/firmware.map [--flash N] [--ram N] [--top 25] [--csv out.csv]
+
+Sizes are summed from the input sections the map lists, so they add up to
+what each module puts in the image. "flash" is everything stored in the
+image (code, constants and RAM initial values), "ram" is static RAM
+(IRAM, DRAM data and bss), "rtc" is RTC memory. Modules are static
+libraries (sdk/<name> for ESP-IDF, arduino-core, toolchain/<name>) and
+object files (src/<file> for the application).
+"""
+import argparse
+import csv
+import os
+import re
+import sys
+from collections import defaultdict
+
+INPUT_LINE = re.compile(r"^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s*(.*)$")
+WRAPPED_LINE = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s*(.*)$")
+ARCHIVE = re.compile(r"(?:^|[/\\])lib([^/\\]+)\.a\((.+)\)$")
+
+SKIPPED = (".debug", ".comment", ".stab", ".xtensa.info", ".riscv.attributes",
+           ".note", ".gnu.attributes", "/DISCARD/")
+
+
+def regions(section):
+    """Which totals an output section counts towards: (flash, ram, rtc)."""
+    if section.startswith(SKIPPED) or section.endswith("_noload"):
+        return (False, False, False)
+    zero_init = "bss" in section or "noinit" in section
+    if section.startswith(".flash."):
+        return (True, False, False)
+    if section.startswith((".iram0.", ".dram0.")):
+        return (not zero_init, True, False)
+    if section.startswith(".noinit"):
+        return (False, True, False)
+    if section.startswith(".rtc"):
+        return (not zero_init, False, True)
+    # host or bare-metal layouts (.text, .rodata, .data, .bss, ...)
+    if section.startswith((".bss", ".tbss", "COMMON")):
+        return (False, True, False)
+    if section.startswith((".data", ".tdata")):
+        return (True, True, False)
+    if section.startswith((".text", ".rodata", ".init", ".fini", ".eh_frame", ".gcc_except_table",
+                           ".plt", ".got", ".rela", ".dyn", ".hash", ".gnu.hash", ".interp")):
+        return (True, False, False)
+    return (False, False, False)
+
+
+def module_of(path):
+    """Group an input file into a module name."""
+    if not path:
+        return "(padding)"
+    path = path.replace("\\", "/")
+    m = ARCHIVE.search(path)
+    if m:
+        name = m.group(1)
+        if name == "FrameworkArduino":
+            return "arduino-core"
+        if "/tools/sdk/" in path or "/esp-idf/" in path:
+            return "sdk/" + name
+        if "/toolchain-" in path or "/gcc/" in path or name in ("c", "m", "gcc", "stdc++", "nosys", "g"):
+            return "toolchain/" + name
+        return name
+    if "/src/" in "/" + path:
+        return "src/" + os.path.basename(path).replace(".cpp.o", ".cpp").replace(".c.o", ".c")
+    return os.path.basename(path)
+
+
+def parse_map(lines):
+    """{module: [flash, ram, rtc]} from the memory map part of a GNU ld map."""
+    usage = defaultdict(lambda: [0, 0, 0])
+    in_map = False
+    section = None
+    pending = False         # input section name on its own line, numbers on the next
+    for line in lines:
+        line = line.rstrip("\n")
+        if not in_map:
+            in_map = line.startswith("Linker script and memory map")
+            continue
+        if line.startswith("OUTPUT("):
+            break
+        if line and not line[0].isspace():
+            section = line.split()[0]
+            pending = False
+            continue
+        if section is None:
+            continue
+        m = INPUT_LINE.match(line)
+        if m:
+            size, path = int(m.group(3), 16), m.group(4).strip()
+            pending = False
+        elif pending and WRAPPED_LINE.match(line):
+            m = WRAPPED_LINE.match(line)
+            size, path = int(m.group(2), 16), m.group(3).strip()
+            pending = False
+        else:
+            pending = line.startswith(" ") and not line.startswith("  ") and len(line.split()) == 1
+            continue
+        if size == 0:
+            continue
+        counted = regions(section)
+        if not any(counted):
+            continue
+        entry = usage[module_of(path)]
+        for i, yes in enumerate(counted):
+            if yes:
+                entry[i] += size
+    return usage
+
+
+def report(usage, flash_budget, ram_budget, top, csv_path, out=sys.stdout):
+    """Print the table and return False when a budget is exceeded."""
+    rows = sorted(usage.items(), key=lambda kv: (kv[1][0], kv[1][1]), reverse=True)
+    flash = sum(v[0] for v in usage.values())
+    ram = sum(v[1] for v in usage.values())
+    rtc = sum(v[2] for v in usage.values())
+
+    print(f"{'module':<32} {'flash':>9} {'ram':>8} {'rtc':>6}", file=out)
+    for name, (f, r, t) in rows[:top]:
+        print(f"{name:<32} {f:>9} {r:>8} {t:>6}", file=out)
+    if len(rows) > top:
+        rest = rows[top:]
+        print(f"{'(' + str(len(rest)) + ' more)':<32} {sum(v[0] for _, v in rest):>9} "
+              f"{sum(v[1] for _, v in rest):>8} {sum(v[2] for _, v in rest):>6}", file=out)
+    print(f"{'total':<32} {flash:>9} {ram:>8} {rtc:>6}", file=out)
+
+    if csv_path:
+        with open(csv_path, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(["module", "flash", "ram", "rtc"])
+            for name, (fl, r, t) in rows:
+                w.writerow([name, fl, r, t])
+
+    ok = True
+    for label, used, budget in (("flash", flash, flash_budget), ("ram", ram, ram_budget)):
+        if budget:
+            state = "OK" if used <= budget else "OVER BUDGET"
+            print(f"{label}: {used} of {budget} bytes ({100.0 * used / budget:.1f}%) {state}", file=out)
+            ok = ok and used <= budget
+    return ok
+
+
+def pio_setup(env):
+    map_path = os.path.join(env.subst("$BUILD_DIR"), env.subst("${PROGNAME}.map"))
+    env.Append(LINKFLAGS=["-Wl,-Map=" + map_path])
+
+    def budget(option):
+        return int(env.GetProjectOption(option, "0") or 0)
+
+    def check(source, target, env):
+        if not os.path.exists(map_path):
+            print("size_budget: no linker map, skipped")
+            return 0
+        with open(map_path, errors="replace") as f:
+            usage = parse_map(f)
+        csv_path = os.path.join(env.subst("$BUILD_DIR"), "size_report.csv")
+        print(f"Size per module ({env.subst('$PIOENV')}):")
+        if not report(usage, budget("custom_flash_budget"), budget("custom_ram_budget"), 20, csv_path):
+            print("size_budget: budget exceeded, see " + csv_path)
+            return 1
+        return 0
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Per-module size report from a GNU ld map file")
+    ap.add_argument("map")
+    ap.add_argument("--flash", type=int, default=0, help="flash budget in bytes")
+    ap.add_argument("--ram", type=int, default=0, help="static RAM budget in bytes")
+    ap.add_argument("--top", type=int, default=25)
+    ap.add_argument("--csv")
+    args = ap.parse_args()
+    with open(args.map, errors="replace") as f:
+        usage = parse_map(f)
+    if not usage:
+        print("no input sections found, is this a GNU ld map file?")
+        return 2
+    return 0 if report(usage, args.flash, args.ram, args.top, args.csv) else 1
+
+
+try:
+    Import   # noqa: F821 - defined by SCons when PlatformIO runs this as an extra script
+    running_in_pio = True
+except NameError:
+    running_in_pio = False
+
+if running_in_pio:
+    Import("env")   # noqa: F821
+    pio_setup(env)  # noqa: F821
+elif __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,49 @@
+#ifndef FEATURES_H
+#define FEATURES_H
+
+// Compile-time feature switches. The platformio.ini profiles set them with
+// -D FEATURE_X=0/1; a plain build without flags gets everything.
+//
+//   FEATURE_OTA          delta OTA over MQTT (cmd/ota/...)
+//   FEATURE_TLS          MQTT over TLS (lib/tlsClient, mbedtls SSL layer)
+//   FEATURE_LIVE_STREAM  HTTP page + WebSocket live view (ESPAsyncWebServer)
+//   FEATURE_TRACE        sensor trace capture on LittleFS (cmd/trace)
+//   FEATURE_DEEP_SLEEP   duty cycle with RTC-retained state (cmd/sleep)
+//   FEATURE_CONSOLE      SimpleCLI commands on the USB serial port
+//   FEATURE_CONTROL_TASK irrigation in its own FreeRTOS task (0 = from loop(),
+//                        to compare control-period jitter)
+//   FEATURE_HISTORY      one-minute history on LittleFS (cmd/history)
+
+#ifndef FEATURE_OTA
+#define FEATURE_OTA 1
+#endif
+
+#ifndef FEATURE_TLS
+#define FEATURE_TLS 1
+#endif
+
+#ifndef FEATURE_LIVE_STREAM
+#define FEATURE_LIVE_STREAM 1
+#endif
+
+#ifndef FEATURE_TRACE
+#define FEATURE_TRACE 1
+#endif
+
+#ifndef FEATURE_DEEP_SLEEP
+#define FEATURE_DEEP_SLEEP 1
+#endif
+
+#ifndef FEATURE_CONSOLE
+#define FEATURE_CONSOLE 1
+#endif
+
+#ifndef FEATURE_CONTROL_TASK
+#define FEATURE_CONTROL_TASK 1
+#endif
+
+#ifndef FEATURE_HISTORY
+#define FEATURE_HISTORY 1
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef LIVEPAGE_H
+#define LIVEPAGE_H
+
+#include <Arduino.h>
+
+// Minimal live view served at "/": opens ws://<device>/ws, plots the binary
+// sample frames on a canvas and lets the user change the sampling rate.
+// Frame layout (little endian): u8 version, u8 count, u16 periodMs, u32 seq,
+// u32 t0Ms, u8 valve, u8 reserved, then count x u16 moisture.
+static const char LIVE_PAGE_HTML[] PROGMEM = R"HTML(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><meta name="viewport" content="width=device-width">
+<title>garden_irrigator live</title>
+<style>
+body{font:14px sans-serif;margin:8px;background:#111;color:#ddd}
+canvas{width:100%;height:60vh;background:#000}
+input{width:4em}
+</style></head><body>
+<div>rate <input id="rate" value="20"> Hz <button onclick="setRate()">set</button>
+ | <span id="info">connecting...</span></div>
+<canvas id="c"></canvas>
+<script>
+const N = 2000, buf = new Uint16Array(N), valve = new Uint8Array(N);
+let head = 0, seq = -1, lost = 0, frames = 0, samples = 0, ws;
+const cv = document.getElementById('c'), g = cv.getContext('2d');
+
+function connect() {
+  ws = new WebSocket('ws://' + location.host + '/ws');
+  ws.binaryType = 'arraybuffer';
+  ws.onmessage = e => {
+    const d = new DataView(e.data), n = d.getUint8(1), s = d.getUint32(4, true);
+    if (seq >= 0 && s !== seq + 1) lost += s - seq - 1;
+    seq = s; frames++;
+    for (let i = 0; i < n; i++) {
+      buf[head] = d.getUint16(14 + 2 * i, true);
+      valve[head] = d.getUint8(12);
+      head = (head + 1) % N;
+    }
+    samples += n;
+  };
+  ws.onclose = () => setTimeout(connect, 1000);
+}
+
+function setRate() {
+  ws.send('rate ' + document.getElementById('rate').value);
+}
+
+function draw() {
+  cv.width = cv.clientWidth; cv.height = cv.clientHeight;
+  let lo = 4095, hi = 0;
+  for (let i = 0; i < N; i++) { lo = Math.min(lo, buf[i]); hi = Math.max(hi, buf[i]); }
+  const span = Math.max(hi - lo, 1), w = cv.width / N;
+  g.strokeStyle = valve[(head + N - 1) % N] ? '#4c4' : '#c44';   // green = valve open
+  g.beginPath();
+  for (let i = 0; i < N; i++) {
+    const k = (head + i) % N, y = cv.height - (buf[k] - lo) / span * (cv.height - 10) - 5;
+    i ? g.lineTo(i * w, y) : g.moveTo(0, y);
+  }
+  g.stroke();
+  requestAnimationFrame(draw);
+}
+
+setInterval(() => {
+  document.getElementById('info').textContent =
+    samples + ' samples/s, ' + frames + ' frames/s, lost frames ' + lost;
+  samples = frames = 0;
+}, 1000);
+
+connect();
+draw();
+</script></body></html>
+)HTML";
+
+#endif
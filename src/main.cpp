@@ -1,24 +1,190 @@
+#include "features.h"
 #include <Arduino.h>
 #include <USB.h>
+#if FEATURE_CONSOLE
 #include <SimpleCLI.h>
+#include <sampleFrame.h>
+#include <esp_timer.h>
+#include <atomic>
+#endif
 #include <Preferences.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <time.h>
-#include <timedLoop.h>
+#include <sys/time.h>
+#include <binLog.h>
 #include <timeout.h>
+#include <irrigationLogic.h>
+#include <soilResponse.h>
+#include <faultDetector.h>
+#include <seqSnapshot.h>
+#include <spscQueue.h>
+#if FEATURE_OTA
+#include <otaUpdater.h>
+#endif
+#include <telemetryCodec.h>
+#include <rollup.h>
+#include <reportFilter.h>
+#include <brokerResolver.h>
+#include <backoff.h>
+#if FEATURE_TLS
+#include <tlsClient.h>
+#endif
+#if FEATURE_TRACE
+#include <sensorTrace.h>
+#endif
+#if FEATURE_TRACE || FEATURE_HISTORY
+#include <LittleFS.h>
+#endif
+#if FEATURE_HISTORY
+#include <historyStore.h>
+#endif
+#include <wateringSchedule.h>
+#include <wateringJournal.h>
+#include <esp_sleep.h>
+#include <esp_sntp.h>
+#if FEATURE_DEEP_SLEEP
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/dhcp.h>
+#endif
+#if FEATURE_LIVE_STREAM
+#include <ESPAsyncWebServer.h>
+#endif
+#include <functional>
+#include <vector>
 #include "wifiManager.h"
 #undef cli  // avoid USB.h macro conflict
 #include "timeControl.h"
+#if FEATURE_LIVE_STREAM
+#include "livePage.h"
+#endif
 
 // ----------------------- Configuration Constants -----------------------
-// Serial speed, device ID, pin assignments, default watering delay, MQTT topic
+// Serial speed, device ID prefix, pin assignments, default watering delay, MQTT topics
 static const long    SERIAL_SPEED         = 115200;
-static const char*   DEVICE_ID            = "garden_irrigator";
+static const char*   DEVICE_ID_PREFIX     = "garden_irrigator";
 static const uint8_t VALVE_OUTPUT_PIN     = 2;
 static const uint8_t MOISTURE_INPUT_PIN   = 3;
 static const uint32_t DEFAULT_WATER_DELAY = 10000UL;
-static const char*   MQTT_TOPIC           = "graph/data";
+static const uint32_t DEFAULT_SOAK_MS     = 600000UL;     // cycle and soak: valve closed between pulses
+static const uint8_t  MAX_PULSES          = 10;
+static const uint32_t RESPONSE_SETTLE_MS  = 1800000UL;    // valve closed to the reading that shows the watering
+static const int      DEFAULT_BAND        = 200;          // adaptive watering aims at threshold - band / 2
+static const uint32_t ADAPTIVE_MIN_MS     = 2000UL;       // shortest adaptive watering
+static const uint8_t  ADAPTIVE_MAX_FACTOR = 3;            // longest: 3x the fixed duration
+static const uint16_t FAULT_RAIL_LOW      = 16;           // averaged reading of a shorted probe...
+static const uint16_t FAULT_RAIL_HIGH     = 4080;         // ...and of a disconnected one (bone dry)
+static const uint16_t FAULT_RAIL_SAMPLES  = 3;
+static const uint32_t FAULT_FLAT_MS       = 1800000UL;    // readings within +-1 this long: stuck ADC
+static const uint16_t FAULT_RESPONSE_DROP = 40;           // a watering with the valve open at least...
+static const uint32_t FAULT_RESPONSE_MIN_MS = 120000UL;   // ...this long lowers the reading this much...
+static const uint8_t  FAULT_RESPONSE_EVENTS = 2;          // ...or, twice in a row, no water arrives
+static const uint16_t FAULT_LEAK_DROP     = 150;          // wetter than the driest reading since, valve closed...
+static const uint32_t FAULT_LEAK_MS       = 600000UL;     // ...this long: leak or valve stuck open
+static const uint16_t SOIL_RAW_SAMPLES    = 100;          // ADC readings averaged per moisture sample
+static const uint16_t IRRIGATION_SAMPLE_MS = 1000;         // moisture sampling period
+static const uint32_t CONTROL_PERIOD_MS   = 10;           // irrigation decisions run this often
+static const uint32_t CONTROL_WAIT_MS     = 100;          // a posted command is applied within this
+static const size_t   CONTROL_QUEUE_SIZE  = 16;           // commands waiting for the control period
+#if FEATURE_CONTROL_TASK
+static const uint32_t CONTROL_STACK_BYTES = 6144;
+static const UBaseType_t CONTROL_PRIORITY = 19;           // above lwIP (18) and loop() (1), below esp_timer and WiFi
+#endif
+static const int     ROAM_THRESHOLD_DBM   = -75;          // start looking for a better AP below this
+static const int     ROAM_HYSTERESIS_DB   = 8;            // required improvement before switching
+static const char*   DEFAULT_MQTT_SITE    = "garden";
+static const char*   MQTT_TELEMETRY_TOPIC = "telemetry";   // <site>/<device>/telemetry
+static const char*   MQTT_STATUS_TOPIC    = "status";      // <site>/<device>/status (retained, LWT)
+static const char*   MQTT_COMMAND_TOPIC   = "cmd/#";       // <site>/<device>/cmd/...
+static const uint16_t MQTT_BUFFER_SIZE    = 1280;          // fits a 1 KiB OTA chunk plus topic
+static const uint32_t MQTT_BACKOFF_BASE_MS = 1000;         // first retry within 1 s, then 2, 4, 8 s...
+static const uint32_t MQTT_BACKOFF_CAP_MS  = 60000;        // ...up to a 60 s window
+static const char*   MQTT_PACKED_TOPIC    = "telemetry/packed"; // telemetryCodec blocks
+static const uint16_t PACKED_BLOCK_SAMPLES = 60;           // samples per packed block
+static const size_t  PACKED_BLOCK_BYTES   = telemetryEncoder::HEADER_BYTES + PACKED_BLOCK_SAMPLES * 8;
+
+// Telemetry formats, stored as a bit mask in "mqtt_cfg"/"format"
+static const uint8_t TELEMETRY_ASCII      = 0x01;
+static const uint8_t TELEMETRY_PACKED     = 0x02;
+static const uint8_t TELEMETRY_ROLLUP     = 0x04;
+
+// Rollup tiers published on <site>/<device>/telemetry/<window>, e.g. telemetry/1m
+static const uint32_t DEFAULT_ROLLUP_SHORT_SEC = 60;
+static const uint32_t DEFAULT_ROLLUP_LONG_SEC  = 3600;
+static const uint32_t MAX_RAW_STREAM_SEC       = 3600;     // cmd/raw upper bound
+
+// Report by exception (cmd/rbe) for the ASCII and packed telemetry
+static const uint16_t DEFAULT_RBE_DEADBAND      = 8;       // ADC counts
+static const uint32_t DEFAULT_RBE_HEARTBEAT_SEC = 300;     // longest silence
+static const uint32_t MAX_RBE_HEARTBEAT_SEC     = 3600;
+
+#if FEATURE_DEEP_SLEEP
+// Deep-sleep duty cycle, enabled through "sleep_cfg" / cmd/sleep
+static const uint32_t SLEEP_COMMISSION_MS  = 120000UL;     // longest a full boot stays awake before sleeping
+static const uint32_t SLEEP_CMD_WINDOW_MS  = 30000UL;      // a full boot stays reachable this long once online
+static const uint32_t FAST_WAKE_NET_MS     = 3000UL;       // WiFi + MQTT budget on a timer wake
+static const uint32_t FAST_WAKE_CMD_MS     = 150UL;        // time to receive retained commands on a timer wake
+static const uint32_t NTP_RESYNC_SEC       = 21600UL;      // the RTC clock drifts, resync every 6 h
+static const uint8_t  FAST_WAKE_MAX_FAILS  = 3;            // then fall back to a full boot to re-learn the network
+static const uint32_t FAST_WAKE_DHCP_MS    = 6000UL;       // budget when the lease ran out and DHCP is needed
+static const uint32_t LEASE_MARGIN_SEC     = 120UL;        // stop reusing a DHCP address this long before it expires
+#endif
+
+#if FEATURE_LIVE_STREAM
+// Local WebSocket live stream (ws://<device>/ws)
+static const uint32_t LIVE_DEFAULT_RATE_HZ = 20;
+static const uint32_t LIVE_MAX_RATE_HZ     = 200;
+static const uint32_t LIVE_FRAME_MS        = 50;           // batch samples into one frame per 50 ms
+static const uint8_t  LIVE_MAX_BATCH       = 16;
+static const uint8_t  LIVE_MAX_CLIENTS     = 3;
+#endif
+
+#if FEATURE_TRACE
+// Sensor trace capture on LittleFS
+static const char*    TRACE_PATH           = "/trace.bin";
+static const size_t   TRACE_FLUSH_BYTES    = 2048;         // RAM staging, one flash write per block
+static const size_t   TRACE_MAX_BYTES      = (FEATURE_HISTORY ? 768UL : 1024UL) * 1024; // about 3 h of 1 Hz samples, 2 h next to the history
+static const uint16_t TRACE_CHUNK_BYTES    = 1024;         // MQTT/USB transfer unit
+#endif
+
+#if FEATURE_HISTORY
+// One-minute history on LittleFS (/hist/<segment>), read back with cmd/history
+static const uint32_t HISTORY_WINDOW_SEC   = 60;
+static const uint8_t  HISTORY_SEGMENTS     = 22;           // the oldest is erased to start a new one: 21 days kept
+static const uint32_t HISTORY_SEGMENT_RECORDS = 1440;      // one day per segment, about 20 KB
+static const size_t   HISTORY_CHUNK_RECORDS = 64;          // per history/<id> message, 904 bytes
+static const uint32_t HISTORY_SCAN_BUDGET  = 1024;         // stored records read per loop() pass
+static const uint8_t  HISTORY_FORMAT       = 1;            // chunk header version
+#endif
+
+#if FEATURE_CONSOLE
+// Raw ADC stream on USB CDC ("stream start <hz>" on the serial console)
+static const uint32_t STREAM_DEFAULT_HZ    = 1000;
+static const uint32_t STREAM_MAX_HZ        = 10000;        // analogRead() costs about 20 us
+static const uint16_t STREAM_BLOCK_SAMPLES = 512;          // samples per frame, two blocks
+static const size_t   STREAM_TX_BUFFER     = 4096;         // USB CDC transmit buffer
+#endif
+
+#if FEATURE_TLS
+// MQTT over TLS (mqtt_cfg "tls" = true, CA PEM in "ca")
+static const int      MQTT_TLS_PORT        = 8883;
+static const uint32_t TLS_STEP_BUDGET_MS   = 20;           // handshake time spent per loop() pass
+static const size_t   TLS_SESSION_BYTES    = 1024;         // serialized session kept in RTC memory
+#endif
+
+// Watering journal (NVS namespace "water_log", one blob per slot)
+static const uint32_t RTC_WATERING_MAGIC   = 0x31524157;   // "WAR1"
+
+// Build a unique device ID from the factory-programmed eFuse MAC
+static String buildDeviceId() {
+  uint64_t mac = ESP.getEfuseMac();
+  char id[48];
+  snprintf(id, sizeof(id), "%s-%02x%02x%02x%02x%02x%02x", DEVICE_ID_PREFIX,
+           (uint8_t)(mac),       (uint8_t)(mac >> 8),  (uint8_t)(mac >> 16),
+           (uint8_t)(mac >> 24), (uint8_t)(mac >> 32), (uint8_t)(mac >> 40));
+  return String(id);
+}
 
 // ----------------------- Valve Driver -----------------------
 // Controls the relay/valve for irrigation
@@ -32,10 +198,19 @@ public:
   // Initialize the valve pin and set it to closed (HIGH)
   void init(uint8_t pin) {
     pin_ = pin;
+    gpio_hold_dis((gpio_num_t)pin_);  // released from a deep-sleep hold
     pinMode(pin_, OUTPUT);
     digitalWrite(pin_, HIGH);  // start closed (HIGH)
   }
 
+  // Latch the pin closed so it cannot float while the chip is in deep sleep
+  void holdClosed() {
+    digitalWrite(pin_, HIGH);
+    isOpen_ = false;
+    gpio_hold_en((gpio_num_t)pin_);
+    gpio_deep_sleep_hold_en();
+  }
+
   // Open the valve (set pin LOW)
   void open() {
     if (!isOpen_) {
@@ -56,59 +231,62 @@ public:
   bool status() const { return isOpen_; }
 };
 
-// ----------------------- Watering Scheduler -----------------------
-// Manages watering timing and persistence
+// ----------------------- Watering Actuator -----------------------
+// Drives the valve and persists the watering duration and the cycle-and-soak
+// parameters; timing decisions live in irrigationLogic
 class WaterManager {
   ValveDriver    valve_;    // Valve control
-  timeout        timer_;    // Watering timer
   Preferences    prefs_;    // Store watering delay
   uint32_t       delayMs_;  // Watering duration
+  uint8_t        pulses_;   // Pulses per event, 1 = continuous
+  uint32_t       soakMs_;   // Valve closed between pulses
+  int            target_;   // Moisture that ends a pulsed event early, -1 = threshold
 
 public:
-  // Load watering delay from preferences or use default
   WaterManager(uint32_t defaultDelay)
-    : timer_(), delayMs_(defaultDelay)
-  {
+    : delayMs_(defaultDelay), pulses_(1), soakMs_(DEFAULT_SOAK_MS), target_(-1)
+  {}
+
+  // Initialize valve hardware and load watering settings from preferences or use defaults
+  void begin(uint8_t valvePin) {
+    valve_.init(valvePin);
     prefs_.begin("water_cfg", false);
-    delayMs_ = prefs_.getULong("delay", defaultDelay);
-    timer_.setTime(delayMs_);
+    delayMs_ = prefs_.getULong("delay", delayMs_);
+    pulses_  = prefs_.getUChar("pulses", pulses_);
+    soakMs_  = prefs_.getULong("soak_ms", soakMs_);
+    target_  = prefs_.getInt("target", target_);
   }
 
-  // Initialize valve hardware
-  void begin(uint8_t valvePin) {
+  // Initialize only the valve, closed, without touching NVS (deep-sleep wake path)
+  void beginValveOnly(uint8_t valvePin) {
     valve_.init(valvePin);
   }
 
-  // Check if watering timer finished and stop if needed
-  void update() {
-    if (timer_.finished()) {
-      stop();
-    }
+  // Close the valve and keep it closed through deep sleep
+  void holdClosed() {
+    valve_.holdClosed();
   }
 
-  // Start watering and timer
+  // Start watering
   void start() {
-    Serial.println(">>> Watering STARTED");
+    LOG_INFO(">>> Watering STARTED");
     valve_.open();
-    timer_.start();
   }
 
-  // Stop watering and timer
+  // Stop watering
   void stop() {
-    Serial.println(">>> Watering STOPPED");
+    LOG_INFO(">>> Watering STOPPED");
     valve_.close();
-    timer_.stop();
   }
 
   // Return if watering is active
-  bool active() {
-    return timer_.isRunning();
+  bool active() const {
+    return valve_.status();
   }
 
   // Set new watering delay and save to preferences
   void setDelay(uint32_t ms) {
     delayMs_ = ms;
-    timer_.setTime(delayMs_);
     prefs_.putULong("delay", delayMs_);
   }
 
@@ -116,6 +294,20 @@ public:
   uint32_t getDelay() const {
     return delayMs_;
   }
+
+  // Set and save the cycle-and-soak parameters
+  void setPulses(uint8_t pulses, uint32_t soakMs, int target) {
+    pulses_ = pulses;
+    soakMs_ = soakMs;
+    target_ = target;
+    prefs_.putUChar("pulses", pulses_);
+    prefs_.putULong("soak_ms", soakMs_);
+    prefs_.putInt("target", target_);
+  }
+
+  uint8_t  getPulses() const { return pulses_; }
+  uint32_t getSoakMs() const { return soakMs_; }
+  int      getTarget() const { return target_; }
 };
 
 // ----------------------- Moisture Sensor -----------------------
@@ -132,190 +324,2869 @@ public:
     pinMode(pin_, INPUT);
   }
 
-  // Read and average multiple samples for stability
-  int readAverage() const {
-    const int samples = 100;
+  // Short average for the live stream: a few tens of microseconds per call
+  int readFast() const {
+    const int samples = 4;
     long total = 0;
     for (int i = 0; i < samples; ++i) {
       total += analogRead(pin_);
     }
     return total / samples;
   }
+
+  // Read and average multiple samples for stability; the raw readings are
+  // returned in `raw` (SOIL_RAW_SAMPLES entries) when given, for trace capture
+  int readAverage(uint16_t* raw = nullptr) const {
+    uint16_t local[SOIL_RAW_SAMPLES];
+    uint16_t* r = raw ? raw : local;
+    for (int i = 0; i < SOIL_RAW_SAMPLES; ++i) {
+      r[i] = analogRead(pin_);
+    }
+    return irrigationLogic::average(r, SOIL_RAW_SAMPLES);
+  }
+};
+
+// ----------------------- Sensor Trace Capture -----------------------
+#if FEATURE_TRACE
+// Records raw ADC bursts, decisions, valve changes and configuration into
+// TRACE_PATH on LittleFS (lib/sensorTrace format) for offline replay.
+// Records are staged in RAM and written in TRACE_FLUSH_BYTES blocks.
+class TraceRecorder {
+  File     file_;
+  uint8_t  buf_[TRACE_FLUSH_BYTES];
+  size_t   len_;
+  size_t   written_;
+  uint32_t lastMs_;
+  uint32_t startMs_;
+  uint32_t durationMs_;
+  bool     active_;
+  bool     mounted_;
+
+public:
+  TraceRecorder()
+    : len_(0), written_(0), lastMs_(0), startMs_(0), durationMs_(0), active_(false), mounted_(false) {}
+
+  // Start a new capture, replacing the previous trace
+  bool start(uint32_t minutes, int threshold, uint32_t waterMs, uint16_t sampleIntervalMs,
+             uint8_t pulses, uint32_t soakMs, int target) {
+    stop();
+    if (!mounted_) mounted_ = LittleFS.begin(true);
+    if (!mounted_) return false;
+    file_ = LittleFS.open(TRACE_PATH, "w");
+    if (!file_) return false;
+
+    sensorTrace::header h;
+    h.rawPerSample     = SOIL_RAW_SAMPLES;
+    h.sampleIntervalMs = sampleIntervalMs;
+    h.threshold        = threshold;
+    h.waterMs          = waterMs;
+    h.startEpoch       = timeCtrl.getEpoch();
+    h.startMs          = millis();
+    h.pulses           = pulses;
+    h.target           = target;
+    h.soakMs           = soakMs;
+    len_        = sensorTrace::writeHeader(buf_, h);
+    written_    = 0;
+    lastMs_     = h.startMs;
+    startMs_    = h.startMs;
+    durationMs_ = minutes * 60000UL;
+    active_     = true;
+    LOG_INFO("trace capture started for %u min", minutes);
+    return true;
+  }
+
+  void stop() {
+    if (!active_) return;
+    flush();
+    file_.close();
+    active_ = false;
+    LOG_INFO("trace capture stopped, %u bytes", written_);
+  }
+
+  // Stop when the requested duration elapsed or the budget is used up
+  void handle() {
+    if (active_ && (millis() - startMs_ >= durationMs_ || written_ >= TRACE_MAX_BYTES)) stop();
+  }
+
+  bool active() const { return active_; }
+
+  void sample(uint32_t now, const uint16_t* raw, uint16_t n) {
+    if (!active_) return;
+    uint8_t rec[sensorTrace::MAX_RECORD_BYTES];
+    append(rec, sensorTrace::encodeSample(rec, lastMs_, now, raw, n));
+  }
+
+  void decision(uint32_t now, uint8_t action, int moisture) {
+    if (!active_) return;
+    uint8_t rec[16];
+    append(rec, sensorTrace::encodeDecision(rec, lastMs_, now, action, moisture));
+  }
+
+  void valve(uint32_t now, bool open) {
+    if (!active_) return;
+    uint8_t rec[16];
+    append(rec, sensorTrace::encodeValve(rec, lastMs_, now, open));
+  }
+
+  void config(uint32_t now, int threshold, uint32_t waterMs) {
+    if (!active_) return;
+    uint8_t rec[16];
+    append(rec, sensorTrace::encodeConfig(rec, lastMs_, now, threshold, waterMs));
+  }
+
+  void pulses(uint32_t now, uint8_t pulses, uint32_t soakMs, int target) {
+    if (!active_) return;
+    uint8_t rec[16];
+    append(rec, sensorTrace::encodePulses(rec, lastMs_, now, pulses, soakMs, target));
+  }
+
+  void eventDuration(uint32_t now, uint32_t eventMs) {
+    if (!active_) return;
+    uint8_t rec[16];
+    append(rec, sensorTrace::encodeEvent(rec, lastMs_, now, eventMs));
+  }
+
+  // Size of the stored trace (0 while capturing, it is still incomplete)
+  size_t size() {
+    if (active_) return 0;
+    if (!mounted_) mounted_ = LittleFS.begin(true);
+    File f = mounted_ ? LittleFS.open(TRACE_PATH, "r") : File();
+    return f ? f.size() : 0;
+  }
+
+  // Read part of the stored trace for transfer
+  size_t read(uint32_t offset, uint8_t* out, size_t len) {
+    if (active_ || !mounted_) return 0;
+    File f = LittleFS.open(TRACE_PATH, "r");
+    if (!f || !f.seek(offset)) return 0;
+    return f.read(out, len);
+  }
+
+private:
+  void append(const uint8_t* rec, size_t n) {
+    if (len_ + n > sizeof(buf_)) flush();
+    memcpy(buf_ + len_, rec, n);
+    len_ += n;
+  }
+
+  void flush() {
+    if (len_ == 0) return;
+    written_ += file_.write(buf_, len_);
+    len_ = 0;
+  }
+};
+#else
+// Trace capture compiled out: the hooks in IrrigationManager cost nothing
+class TraceRecorder {
+public:
+  bool   start(uint32_t, int, uint32_t, uint16_t, uint8_t, uint32_t, int) { return false; }
+  void   stop() {}
+  void   handle() {}
+  bool   active() const { return false; }
+  void   sample(uint32_t, const uint16_t*, uint16_t) {}
+  void   decision(uint32_t, uint8_t, int) {}
+  void   valve(uint32_t, bool) {}
+  void   config(uint32_t, int, uint32_t) {}
+  void   pulses(uint32_t, uint8_t, uint32_t, int) {}
+  void   eventDuration(uint32_t, uint32_t) {}
+  size_t size() { return 0; }
+};
+#endif
+
+TraceRecorder traceRec;
+
+// ----------------------- Watering Journal -----------------------
+// NVS store for lib/wateringJournal. nvs_set_blob() either replaces a blob
+// completely or leaves the old one, so a power cut never yields a half record.
+class NvsJournalStore : public wateringJournal::store {
+  Preferences prefs_;
+  bool        open_;
+
+public:
+  NvsJournalStore() : open_(false) {}
+
+  bool read(uint8_t slot, uint8_t* buf, size_t len) override {
+    char key[] = {'j', char('0' + slot), '\0'};
+    return ensureOpen() && prefs_.getBytes(key, buf, len) == len;
+  }
+
+  bool write(uint8_t slot, const uint8_t* buf, size_t len) override {
+    char key[] = {'j', char('0' + slot), '\0'};
+    return ensureOpen() && prefs_.putBytes(key, buf, len) == len;
+  }
+
+private:
+  bool ensureOpen() {
+    if (!open_) open_ = prefs_.begin("water_log", false);
+    return open_;
+  }
+};
+
+// Valve-open time of the journaled event. RTC memory survives watchdog, panic
+// and brownout resets (not a power loss), so recovery can resume exactly.
+// Cleared before STOP is written: a cut during that write must not resume.
+struct RtcWatering {
+  uint32_t magic;
+  uint32_t seq;      // journal record it belongs to
+  uint32_t openMs;
 };
+RTC_NOINIT_ATTR static RtcWatering rtcWatering;
 
 // ----------------------- Irrigation Logic -----------------------
 // Combines sensor, watering, and threshold logic
 class IrrigationManager {
   SoilSensor      sensor_;        // Soil moisture sensor
-  WaterManager    waterMgr_;      // Watering scheduler
-  timedLoop       sampleLoop_;    // Sampling interval
+  WaterManager    waterMgr_;      // Valve actuator
   Preferences     prefs_;         // Store threshold
-  int             threshold_;     // Moisture threshold
+  irrigationLogic logic_;         // Sampling, threshold and watering timing
+  NvsJournalStore journalStore_;
+  wateringJournal journal_;       // START/STOP of each watering event, for reset recovery
+  bool            journalLoaded_;
+  uint32_t        openedMs_;      // millis() the current event opened the valve (resume-adjusted)
+  uint32_t        recoveries_;    // events resumed or closed after a reset
+  uint32_t        pulsesRun_;     // valve openings of threshold events
+  uint32_t        earlyStops_;    // pulsed events that reached the target before their last pulse
+  soilResponse    response_;      // Reading drop per valve second, learned from every threshold event
+  bool            adaptive_;      // Size threshold events from response_ instead of the fixed duration
+  int             band_;          // Target band below the threshold
+  uint32_t        lastEventMs_;   // Valve time planned for the last threshold event
+  faultDetector   faults_;        // Readings checked against the valve state
+  uint8_t         fault_;         // Latched fault, NONE = watering allowed
+  int             faultMoisture_; // Reading that latched it
+  bool            faultAlert_;    // fault_ changed and the broker has not been told
+  uint32_t        faultChanges_;  // Counts fault_ changes, so a late acknowledgement cannot hide a new one
+  uint32_t        faultClockMs_;  // Added to millis() for the detector (deep-sleep wakes)
+  bool            allowed_;       // Threshold watering permitted by the schedule
+  bool            forced_;        // Inside a fixed watering window
+  uint32_t        samples_;       // Moisture samples since boot
+  int64_t         sampleUs_;      // esp_timer_get_time() when the last one started
+  uint32_t        sampleMs_;
+  uint32_t        adcUs_;         // ...and the time its readings took
+  int             moisture_;
 
 public:
-  // Load threshold from preferences or use default
   IrrigationManager(uint32_t defaultDelay)
     : waterMgr_(defaultDelay),
-      sampleLoop_(1000),
-      threshold_(0)
-  {
-    prefs_.begin("irrig_cfg", false);
-    threshold_ = prefs_.getInt("thresh", 0);
-  }
+      logic_(IRRIGATION_SAMPLE_MS, defaultDelay, 0),
+      journal_(journalStore_),
+      journalLoaded_(false),
+      openedMs_(0),
+      recoveries_(0),
+      pulsesRun_(0),
+      earlyStops_(0),
+      response_(RESPONSE_SETTLE_MS),
+      adaptive_(false),
+      band_(DEFAULT_BAND),
+      lastEventMs_(0),
+      faults_(faultLimits(IRRIGATION_SAMPLE_MS)),
+      fault_(faultDetector::NONE),
+      faultMoisture_(0),
+      faultAlert_(false),
+      faultChanges_(0),
+      faultClockMs_(0),
+      allowed_(true),
+      forced_(false),
+      samples_(0),
+      sampleUs_(0),
+      sampleMs_(0),
+      adcUs_(0),
+      moisture_(0)
+  {}
 
-  // Initialize sensor and valve
+  // Initialize sensor and valve, load threshold from preferences or use default
   void begin(uint8_t valvePin, uint8_t sensorPin) {
     Serial.println("Initializing Irrigation Manager...");
     sensor_.begin(sensorPin);
     waterMgr_.begin(valvePin);
+    prefs_.begin("irrig_cfg", false);
+    logic_.setThreshold(prefs_.getInt("thresh", 0));
+    logic_.setWaterDuration(waterMgr_.getDelay());
+    logic_.setPulses(waterMgr_.getPulses(), waterMgr_.getSoakMs(), waterMgr_.getTarget());
+    adaptive_ = prefs_.getBool("adaptive", false);
+    band_     = prefs_.getInt("band", DEFAULT_BAND);
+    soilResponse::state st;
+    if (prefs_.getBytes("resp", &st, sizeof(st)) == sizeof(st)) response_.set(st);
+    fault_         = prefs_.getUChar("fault", faultDetector::NONE);
+    faultMoisture_ = prefs_.getInt("fault_at", 0);
+    faultAlert_    = fault_ != faultDetector::NONE;   // tell the broker again after a reboot
+    faults_.setChecks(prefs_.getUChar("fault_chk", faultDetector::ALL_CHECKS));
+    recoverWatering();
+  }
+
+  // Initialize hardware with settings restored from RTC memory (deep-sleep wake path)
+  void beginFromRetained(uint8_t valvePin, uint8_t sensorPin, int threshold, uint32_t delayMs,
+                         uint8_t pulses, uint32_t soakMs, int target) {
+    sensor_.begin(sensorPin);
+    waterMgr_.beginValveOnly(valvePin);
+    logic_.setThreshold(threshold);
+    logic_.setWaterDuration(delayMs);
+    logic_.setPulses(pulses, soakMs, target);
+  }
+
+  // Fault detection state kept in RTC memory across deep-sleep wakes; one
+  // sample every sampleMs, clockMs stands in for the time since the first wake
+  void restoreFaults(uint8_t latched, uint8_t checks, bool alert, const faultDetector::state& st,
+                     uint32_t sampleMs, uint32_t clockMs) {
+    fault_        = latched;
+    faultAlert_   = alert;
+    faultClockMs_ = clockMs;
+    faults_.setLimits(faultLimits(sampleMs));
+    faults_.setChecks(checks);
+    faults_.set(st);
+  }
+
+  // Run one blocking sample/decide/water cycle; returns the moisture reading.
+  // A forced schedule window waters regardless of moisture. A pulsed event
+  // stays awake through its soaks.
+  int runSingleCycle(bool& watered, bool allowed, bool forced) {
+    int moisture = sensor_.readAverage();
+    uint32_t now = millis();
+    watered = false;
+    if (faultBlocks(moisture, now)) return moisture;
+    if (forced) {
+      logic_.startWatering(now);
+      watered = true;
+    } else {
+      watered = allowed && logic_.onSample(moisture, now) == irrigationLogic::START_WATERING;
+    }
+    if (watered) {
+      openValve(now, logic_.pulseDuration());
+      for (;;) {
+        now = millis();
+        irrigationLogic::action a = logic_.update(now);
+        if (a == irrigationLogic::STOP_WATERING) {
+          closeValve(now, wateringJournal::DONE);
+          break;
+        }
+        if (a == irrigationLogic::PAUSE_WATERING) closeValve(now, wateringJournal::DONE);
+        if (logic_.sampleDue(now)) {
+          int m = sensor_.readAverage();
+          if (faultBlocks(m, now)) break;
+          if (logic_.onSample(m, now) == irrigationLogic::STOP_WATERING) break;
+          openValve(now, logic_.pulseDuration());
+        }
+        if (waterMgr_.active()) rtcWatering.openMs = now - openedMs_;
+        delay(10);
+      }
+    }
+    return moisture;
+  }
+
+  // Close the valve and latch it closed for deep sleep
+  void prepareForSleep() {
+    logic_.cancelWatering();
+    waterMgr_.holdClosed();
+  }
+
+  // Get current watering duration
+  uint32_t getDelay() const {
+    return logic_.getWaterDuration();
   }
 
   // Periodically sample moisture and trigger watering if needed
   void update() {
-    waterMgr_.update();
+    uint32_t now = millis();
+    if (waterMgr_.active()) rtcWatering.openMs = now - openedMs_;
+
+    irrigationLogic::action a = logic_.update(now);
+    if (a == irrigationLogic::STOP_WATERING || a == irrigationLogic::PAUSE_WATERING) {
+      traceRec.decision(now, a, logic_.lastMoisture());
+      if (!forced_) closeValve(now, wateringJournal::DONE);
+      if (a == irrigationLogic::STOP_WATERING) response_.end(now);
+    }
+
+    if (logic_.sampleDue(now)) {
+      uint16_t raw[SOIL_RAW_SAMPLES];
+      int64_t t0   = esp_timer_get_time();
+      int moisture = sensor_.readAverage(raw);
+      adcUs_    = esp_timer_get_time() - t0;
+      sampleUs_ = t0;
+      sampleMs_ = now;
+      moisture_ = moisture;
+      samples_++;
+      traceRec.sample(now, raw, SOIL_RAW_SAMPLES);
+      LOG_INFO("Moisture reading: %d", moisture);
+      if (response_.onSample(moisture, now)) saveResponse();
+      if (faultBlocks(moisture, now)) return;
 
-    if (!waterMgr_.active() && sampleLoop_.check()) {
-      int moisture = sensor_.readAverage();
-      Serial.print("Moisture reading: ");
-      Serial.println(moisture);
+      a = allowed_ && !forced_ ? logic_.onSample(moisture, now) : irrigationLogic::NONE;
+      if (a == irrigationLogic::START_WATERING) {
+        response_.begin(moisture, now);
+        lastEventMs_ = plannedDuration(moisture);
+        logic_.setEventDuration(lastEventMs_);
+      }
+      if (a == irrigationLogic::START_WATERING || a == irrigationLogic::RESUME_WATERING) {
+        traceRec.decision(now, a, moisture);
+        if (a == irrigationLogic::START_WATERING && lastEventMs_ != logic_.getWaterDuration()) {
+          traceRec.eventDuration(now, lastEventMs_);   // adaptive: replay needs the planned time
+        }
+        openValve(now, logic_.pulseDuration());
+        pulsesRun_++;
+      } else if (a == irrigationLogic::STOP_WATERING) {
+        // the soak brought the soil to the target, the remaining pulses are saved
+        traceRec.decision(now, a, moisture);
+        LOG_INFO("Watering target reached after a soak: %d", moisture);
+        response_.end(now);
+        earlyStops_++;
+      }
+    }
+  }
 
-      if (moisture > threshold_) {
-        waterMgr_.start();
+  // Apply a schedule change: a fixed window holds the valve open, a forbidden
+  // window cuts threshold watering short
+  void applySchedule(bool allowed, bool forced) {
+    allowed_ = allowed;
+    forced   = forced && fault_ == faultDetector::NONE;   // a lockout keeps fixed windows closed too
+    if (forced && !forced_) {
+      logic_.cancelWatering();
+      response_.abort();
+      if (!waterMgr_.active()) {
+        openValve(millis(), 0);
+      } else {
+        // The window takes over a threshold event: it is open-ended from here on
+        rtcWatering.magic = 0;
+        journal_.end(wateringJournal::CANCELLED, millis() - openedMs_);
+        journalStart(millis(), 0);
       }
+    } else if (!forced && forced_) {
+      if (waterMgr_.active()) closeValve(millis(), wateringJournal::DONE);   // a lockout may have closed it
+    } else if (!allowed && logic_.watering()) {
+      stopWatering();
     }
+    forced_ = forced;
   }
 
   // Set and save new moisture threshold
   void setThreshold(int t) {
-    threshold_ = t;
-    prefs_.putInt("thresh", threshold_);
-    Serial.print("New moisture threshold: ");
-    Serial.println(threshold_);
+    logic_.setThreshold(t);
+    prefs_.putInt("thresh", t);
+    traceRec.config(millis(), t, logic_.getWaterDuration());
+    LOG_INFO("New moisture threshold: %d", t);
   }
 
   // Get current threshold
   int getThreshold() const {
-    return threshold_;
+    return logic_.getThreshold();
+  }
+
+  // Set and save new watering duration
+  void setDelay(uint32_t ms) {
+    waterMgr_.setDelay(ms);
+    logic_.setWaterDuration(ms);
+    traceRec.config(millis(), logic_.getThreshold(), ms);
+  }
+
+  // Set and save the cycle-and-soak parameters; pulses 1 waters continuously
+  void setPulses(int pulses, uint32_t soakMs, int target) {
+    uint8_t n = constrain(pulses, 1, (int)MAX_PULSES);
+    waterMgr_.setPulses(n, soakMs, target);
+    logic_.setPulses(n, soakMs, target);
+    traceRec.pulses(millis(), n, soakMs, target);
+  }
+
+  uint8_t  getPulses() const { return logic_.getPulses(); }
+  uint32_t getSoakMs() const { return logic_.getSoakMs(); }
+  int      getTarget() const { return logic_.getTarget(); }
+
+  // Adaptive watering: size threshold events from the learned soil response,
+  // aiming at the middle of [threshold - band, threshold]
+  void setAdaptive(bool on, int band) {
+    adaptive_ = on;
+    band_     = band > 0 ? band : DEFAULT_BAND;
+    prefs_.putBool("adaptive", adaptive_);
+    prefs_.putInt("band", band_);
   }
 
-  // Read current moisture value
-  int    readMoisture() const         { return sensor_.readAverage(); }
+  // Forget the learned response, e.g. after moving the sensor
+  void resetResponse() {
+    response_.reset();
+    saveResponse();
+  }
+
+  bool                 adaptive() const      { return adaptive_; }
+  int                  band() const          { return band_; }
+  const soilResponse&  response() const      { return response_; }
+  uint32_t             lastEventMs() const   { return lastEventMs_; }
+
+  // Lift the lockout and start the checks over; the broker hears "none"
+  void clearFault() {
+    LOG_INFO("fault %s cleared", faultDetector::name((faultDetector::fault)fault_));
+    fault_      = faultDetector::NONE;
+    faultAlert_ = true;
+    faultChanges_++;
+    faults_.reset();
+    prefs_.putUChar("fault", fault_);
+  }
+
+  // Enable checks by faultDetector bit (1 << fault), e.g. without LEAK where rain reaches the probe
+  void setFaultChecks(uint8_t mask) {
+    faults_.setChecks(mask);
+    prefs_.putUChar("fault_chk", faults_.getChecks());
+  }
+
+  uint8_t              fault() const              { return fault_; }
+  int                  faultMoisture() const      { return faultMoisture_; }
+  const faultDetector& faults() const             { return faults_; }
+  bool                 faultAlertPending() const  { return faultAlert_; }
+  uint32_t             faultChanges() const       { return faultChanges_; }
+  // The broker has the fault as of `changes`; a newer change stays pending
+  void                 faultAlertSent(uint32_t changes) { if (changes == faultChanges_) faultAlert_ = false; }
+
+  // Close the valve immediately, e.g. before a restart
+  void stopWatering() {
+    logic_.cancelWatering();
+    response_.abort();
+    if (waterMgr_.active()) closeValve(millis(), wateringJournal::CANCELLED);
+  }
+
+  // Start a trace capture with the current settings
+  bool startTrace(uint32_t minutes) {
+    return traceRec.start(minutes, logic_.getThreshold(), logic_.getWaterDuration(), IRRIGATION_SAMPLE_MS,
+                          logic_.getPulses(), logic_.getSoakMs(), logic_.getTarget());
+  }
+
+  // Last sample taken by update(): count, start time, ADC time and reading
+  uint32_t samples() const           { return samples_; }
+  int64_t  sampleUs() const          { return sampleUs_; }
+  uint32_t sampleMs() const          { return sampleMs_; }
+  uint32_t adcUs() const             { return adcUs_; }
+  int      moisture() const          { return moisture_; }
+  // Quick reading for high-rate streaming; only touches the ADC, safe from any task
+  int    readMoistureFast() const     { return sensor_.readFast(); }
   // Return if watering is active
   bool   isCurrentlyWatering()       { return waterMgr_.active(); }
+  // Journal counters for cmd/stats
+  uint32_t journalWrites() const     { return journal_.writes(); }
+  uint32_t journalRecoveries() const { return recoveries_; }
+  // Cycle-and-soak counters for cmd/stats
+  uint32_t pulsesRun() const         { return pulsesRun_; }
+  uint32_t earlyStops() const        { return earlyStops_; }
+
+private:
+  // Detector limits for one sample every sampleMs. The sample-counted checks
+  // keep their duration, with a floor for the minutes between deep-sleep
+  // wakes; a wake's reading is already averaged, so it is not smoothed again.
+  static faultDetector::limits faultLimits(uint32_t sampleMs) {
+    uint32_t flat = FAULT_FLAT_MS / sampleMs;
+    uint32_t leak = FAULT_LEAK_MS / sampleMs;
+    faultDetector::limits l;
+    l.railLow         = FAULT_RAIL_LOW;
+    l.railHigh        = FAULT_RAIL_HIGH;
+    l.railSamples     = FAULT_RAIL_SAMPLES;
+    l.flatSpan        = 1;
+    l.flatSamples     = constrain(flat, 12UL, 0xFFFFUL);
+    l.responseDrop    = FAULT_RESPONSE_DROP;
+    l.responseMs      = RESPONSE_SETTLE_MS;
+    l.responseMinMs   = FAULT_RESPONSE_MIN_MS;
+    l.responseEvents  = FAULT_RESPONSE_EVENTS;
+    l.leakDrop        = FAULT_LEAK_DROP;
+    l.leakSamples     = constrain(leak, 3UL, 0xFFFFUL);
+    l.smoothShift     = sampleMs < 60000 ? 4 : 0;
+    return l;
+  }
+
+  // Feed the detector; true when this reading must not drive watering: a
+  // fault is latched, now or before, or the reading sits at an ADC rail
+  bool faultBlocks(int moisture, uint32_t now) {
+    if (fault_ != faultDetector::NONE) return true;
+    faultDetector::fault f = faults_.onSample(moisture, now + faultClockMs_);
+    if (f != faultDetector::NONE) latchFault(f, moisture);
+    return f != faultDetector::NONE || faults_.railed();
+  }
+
+  // Close the valve and keep it closed until cmd/fault clears it, reboots included
+  void latchFault(faultDetector::fault f, int moisture) {
+    LOG_WARN("fault %s at reading %d, watering locked out", faultDetector::name(f), moisture);
+    stopWatering();
+    fault_         = f;
+    faultMoisture_ = moisture;
+    faultAlert_    = true;
+    faultChanges_++;
+    prefs_.begin("irrig_cfg", false);   // no-op after begin(); deep-sleep wakes open it here
+    prefs_.putUChar("fault", fault_);
+    prefs_.putInt("fault_at", moisture);
+  }
+
+  // Valve time for a threshold event starting at `moisture`; the fixed
+  // duration unless adaptive and the estimate is reliable
+  uint32_t plannedDuration(int moisture) const {
+    uint32_t fixed = logic_.getWaterDuration();
+    if (!adaptive_) return fixed;
+    return response_.duration(moisture, logic_.getThreshold() - band_ / 2, fixed, ADAPTIVE_MIN_MS,
+                              fixed * ADAPTIVE_MAX_FACTOR);
+  }
+
+  // One NVS write per learned event
+  void saveResponse() {
+    const soilResponse::state& st = response_.get();
+    prefs_.putBytes("resp", &st, sizeof(st));
+  }
+
+  // Valve changes go through here so traces and the journal see every
+  // transition. START is durable before the valve opens and STOP is written
+  // after it closed, so a power cut between the two is always an open event.
+  void openValve(uint32_t now, uint32_t plannedMs) {
+    journalStart(now, plannedMs);
+    waterMgr_.start();
+    traceRec.valve(now, true);
+    response_.valve(true, now);
+    faults_.valve(true, now + faultClockMs_);
+  }
+
+  void closeValve(uint32_t now, wateringJournal::reason why) {
+    waterMgr_.stop();
+    traceRec.valve(now, false);
+    response_.valve(false, now);
+    faults_.valve(false, now + faultClockMs_);
+    rtcWatering.magic = 0;
+    journal_.end(why, now - openedMs_);
+  }
+
+  void journalStart(uint32_t now, uint32_t plannedMs) {
+    if (!journalLoaded_) journal_.load();   // deep-sleep wakes skip begin()
+    journalLoaded_ = true;
+    journal_.begin(plannedMs);
+    openedMs_   = now;
+    rtcWatering = {RTC_WATERING_MAGIC, journal_.seq(), 0};
+  }
+
+  // Boot: finish or close a watering event that a reset interrupted. Resuming
+  // writes nothing; the STOP at its end closes the original START.
+  void recoverWatering() {
+    journal_.load();
+    journalLoaded_ = true;
+    bool rtcKnown = rtcWatering.magic == RTC_WATERING_MAGIC && rtcWatering.seq == journal_.seq();
+    wateringJournal::recovery r = journal_.recover(rtcKnown, rtcWatering.openMs);
+    if (r.what == wateringJournal::IDLE) return;
+
+    recoveries_++;
+    uint32_t now = millis();
+    if (r.what == wateringJournal::RESUME && fault_ == faultDetector::NONE) {
+      LOG_WARN("watering interrupted by a reset, resuming for %u ms", r.remainingMs);
+      uint32_t duration = logic_.getWaterDuration();
+      logic_.startWatering(now, duration > r.remainingMs ? duration - r.remainingMs : 0);
+      openedMs_   = now - r.elapsedMs;
+      rtcWatering = {RTC_WATERING_MAGIC, journal_.seq(), r.elapsedMs};
+      waterMgr_.start();
+      traceRec.valve(now, true);
+      return;
+    }
+    LOG_WARN("watering interrupted by a reset after %u ms (0 = unknown), closed", r.elapsedMs);
+    journal_.end(wateringJournal::INTERRUPTED, r.elapsedMs);
+    rtcWatering.magic = 0;
+  }
 };
 
 // ----------------------- Time and Irrigation Controllers -----------------------
 timeControl timeCtrl("south-america.pool.ntp.org", -10800, 0); // NTP time sync
 IrrigationManager irrigationCtrl(DEFAULT_WATER_DELAY);         // Main irrigation logic
 
+// ----------------------- Control Task -----------------------
+// Irrigation decisions run in their own FreeRTOS task every CONTROL_PERIOD_MS,
+// above the network stack, so a WiFi reconnect, a DNS lookup or a slow broker
+// cannot delay closing the valve. While the task runs nothing else touches
+// irrigationCtrl: other tasks read the ControlSnapshot it publishes each
+// period and post ControlCommands, applied at the start of the next period.
+// Before begin(), after halt() (deep sleep, reboot) and with
+// FEATURE_CONTROL_TASK=0 the calling task owns irrigationCtrl instead:
+// commands apply at once and loop() runs the period through handle().
+struct ControlCommand {
+  enum Op : uint8_t { SCHEDULE, PULSES, ADAPTIVE, RESET_RESPONSE, CLEAR_FAULT, FAULT_CHECKS, FAULT_SENT,
+                      TRACE_START, TRACE_STOP, RESET_TIMING };
+  Op       op;
+  int32_t  a;
+  uint32_t b;
+  int32_t  c;
+};
+
+// How late each period started against its due time; log2 buckets give a
+// percentile without keeping samples
+struct ControlTiming {
+  uint32_t steps;
+  uint64_t lateUsTotal;
+  uint32_t lateUsMax;
+  uint32_t execUsMax;
+  uint32_t overruns;        // periods a whole period late, skipped rather than run back to back
+  uint32_t lateHist[16];    // bucket k: under 2^k us late, the last one takes the rest
+
+  // Upper bound of the bucket holding the p-th percentile (0..100)
+  uint32_t lateUsPercentile(uint8_t p) const {
+    uint64_t want = ((uint64_t)steps * p + 99) / 100, seen = 0;
+    for (uint8_t k = 0; k < 15; ++k) {
+      seen += lateHist[k];
+      if (seen >= want) return 1UL << k;
+    }
+    return lateUsMax;
+  }
+};
+
+struct ControlSnapshot {
+  uint32_t applied;         // commands applied so far
+  // Last moisture sample
+  uint32_t samples;
+  int64_t  sampleUs;
+  uint32_t sampleMs;
+  uint32_t adcUs;
+  int16_t  moisture;
+  bool     watering;
+  bool     tracing;
+  // Settings
+  uint8_t  pulses;
+  uint32_t soakMs;
+  int32_t  target;
+  bool     adaptive;
+  int32_t  band;
+  // Fault lockout
+  uint8_t  fault;
+  int16_t  faultMoisture;
+  bool     faultAlert;
+  uint32_t faultChanges;
+  uint8_t  faultChecks;
+  int16_t  faultLastDrop;
+  // Counters for cmd/stats
+  uint32_t journalWrites;
+  uint32_t journalRecoveries;
+  uint32_t pulsesRun;
+  uint32_t earlyStops;
+  uint32_t lastEventMs;
+  soilResponse::state response;
+  bool     responseReliable;
+  ControlTiming timing;
+};
+
+class ControlTask {
+  seqSnapshot<ControlSnapshot>                  snap_;
+  spscQueue<ControlCommand, CONTROL_QUEUE_SIZE> commands_;   // loop() -> control task
+  ControlTiming     timing_;
+  uint32_t          posted_;      // commands posted, loop() side
+  uint32_t          applied_;     // commands applied, control side
+  int64_t           dueUs_;       // when the next period should start
+  std::atomic<bool> halting_;     // set by halt(), read by the task each period
+  bool              running_;     // the task owns irrigationCtrl; only loop() changes it
+#if FEATURE_CONTROL_TASK
+  TaskHandle_t      task_;
+  SemaphoreHandle_t exited_;      // given by the task right before it deletes itself
+#endif
+
+public:
+  ControlTask()
+    : timing_(), posted_(0), applied_(0), dueUs_(0), halting_(false), running_(false)
+#if FEATURE_CONTROL_TASK
+      , task_(nullptr), exited_(nullptr)
+#endif
+  {}
+
+  // Hand irrigationCtrl to the task, once setup() is done with it
+  void begin() {
+    publish();
+#if FEATURE_CONTROL_TASK
+    if (!exited_) exited_ = xSemaphoreCreateBinary();
+    running_ = exited_ && xTaskCreate(taskMain, "control", CONTROL_STACK_BYTES, this, CONTROL_PRIORITY, &task_) == pdPASS;
+    if (!running_) LOG_ERROR("control task not created, the period runs in loop()");
+#endif
+  }
+
+  // From loop(): runs the period while no task does
+  void handle() {
+    if (running_) return;
+    int64_t now = esp_timer_get_time();
+    if (now >= dueUs_) step(now);
+  }
+
+  // Apply a change on the control side; returns once it is applied, so the
+  // next snapshot() reflects it, or false after CONTROL_WAIT_MS
+  bool post(const ControlCommand& cmd) {
+    posted_++;
+    if (!running_) {
+      apply(cmd);
+      publish();
+      return true;
+    }
+    if (!commands_.push(cmd)) {
+      posted_--;
+      LOG_WARN("control command %u dropped, queue full", cmd.op);
+      return false;
+    }
+    uint32_t t0 = millis();
+    while ((int32_t)(snap_.read().applied - posted_) < 0) {
+      if (millis() - t0 > CONTROL_WAIT_MS) return false;
+      delay(1);
+    }
+    return true;
+  }
+
+  // Latest published state; fresh when the caller owns irrigationCtrl
+  ControlSnapshot snapshot() {
+    if (!running_) publish();
+    return snap_.read();
+  }
+
+  // Stop the task and take irrigationCtrl back, e.g. before sleeping or
+  // rebooting. Blocks until the task has left its last period: a full queue
+  // or a long step must not leave two tasks driving the valve, so there is
+  // no timeout. Commands still queued are applied here.
+  void halt() {
+    if (!running_) return;
+#if FEATURE_CONTROL_TASK
+    halting_.store(true);
+    xSemaphoreTake(exited_, portMAX_DELAY);
+    task_ = nullptr;
+#endif
+    running_ = false;
+    ControlCommand cmd;
+    while (commands_.pop(cmd)) apply(cmd);
+    publish();
+  }
+
+  bool     threaded() const      { return running_; }
+  uint32_t commandsDropped() const { return commands_.dropped(); }
+  uint32_t snapshotRetries() const { return snap_.retries(); }
+  uint32_t stackFree() const {
+#if FEATURE_CONTROL_TASK
+    if (running_) return uxTaskGetStackHighWaterMark(task_);
+#endif
+    return 0;
+  }
+
+private:
+#if FEATURE_CONTROL_TASK
+  // Fixed-rate periods; after an overrun the schedule restarts from now
+  // instead of running the missed periods back to back
+  static void taskMain(void* arg) {
+    ControlTask* self = static_cast<ControlTask*>(arg);
+    TickType_t wake = xTaskGetTickCount();
+    while (!self->halting_.load()) {
+      self->step(esp_timer_get_time());
+      if (!xTaskDelayUntil(&wake, pdMS_TO_TICKS(CONTROL_PERIOD_MS))) wake = xTaskGetTickCount();
+    }
+    xSemaphoreGive(self->exited_);   // above loop()'s priority: deleted before halt() resumes
+    vTaskDelete(nullptr);
+  }
+#endif
+
+  // One period: pending commands, the irrigation logic, then the snapshot
+  void step(int64_t startUs) {
+    ControlCommand cmd;
+    while (commands_.pop(cmd)) apply(cmd);
+    irrigationCtrl.update();
+    traceRec.handle();
+
+    int64_t  periodUs = CONTROL_PERIOD_MS * 1000LL;
+    uint32_t late     = dueUs_ && startUs > dueUs_ ? startUs - dueUs_ : 0;
+    uint32_t exec     = esp_timer_get_time() - startUs;
+    uint8_t  bucket   = 0;
+    while (bucket < 15 && late >= (1UL << bucket)) bucket++;
+    timing_.steps++;
+    timing_.lateUsTotal += late;
+    timing_.lateHist[bucket]++;
+    if (late > timing_.lateUsMax) timing_.lateUsMax = late;
+    if (exec > timing_.execUsMax) timing_.execUsMax = exec;
+    if (late >= periodUs) timing_.overruns++;
+    dueUs_ = dueUs_ && late < periodUs ? dueUs_ + periodUs : startUs + periodUs;
+    publish();
+  }
+
+  void apply(const ControlCommand& cmd) {
+    switch (cmd.op) {
+      case ControlCommand::SCHEDULE:       irrigationCtrl.applySchedule(cmd.a, cmd.b); break;
+      case ControlCommand::PULSES:         irrigationCtrl.setPulses(cmd.a, cmd.b, cmd.c); break;
+      case ControlCommand::ADAPTIVE:       irrigationCtrl.setAdaptive(cmd.a, cmd.c); break;
+      case ControlCommand::RESET_RESPONSE: irrigationCtrl.resetResponse(); break;
+      case ControlCommand::CLEAR_FAULT:    irrigationCtrl.clearFault(); break;
+      case ControlCommand::FAULT_CHECKS:   irrigationCtrl.setFaultChecks(cmd.a); break;
+      case ControlCommand::FAULT_SENT:     irrigationCtrl.faultAlertSent(cmd.b); break;
+      case ControlCommand::TRACE_START:    irrigationCtrl.startTrace(cmd.b); break;
+      case ControlCommand::TRACE_STOP:     traceRec.stop(); break;
+      case ControlCommand::RESET_TIMING:   timing_ = ControlTiming(); break;
+    }
+    applied_++;
+  }
+
+  void publish() {
+    ControlSnapshot s;
+    s.applied           = applied_;
+    s.samples           = irrigationCtrl.samples();
+    s.sampleUs          = irrigationCtrl.sampleUs();
+    s.sampleMs          = irrigationCtrl.sampleMs();
+    s.adcUs             = irrigationCtrl.adcUs();
+    s.moisture          = irrigationCtrl.moisture();
+    s.watering          = irrigationCtrl.isCurrentlyWatering();
+    s.tracing           = traceRec.active();
+    s.pulses            = irrigationCtrl.getPulses();
+    s.soakMs            = irrigationCtrl.getSoakMs();
+    s.target            = irrigationCtrl.getTarget();
+    s.adaptive          = irrigationCtrl.adaptive();
+    s.band              = irrigationCtrl.band();
+    s.fault             = irrigationCtrl.fault();
+    s.faultMoisture     = irrigationCtrl.faultMoisture();
+    s.faultAlert        = irrigationCtrl.faultAlertPending();
+    s.faultChanges      = irrigationCtrl.faultChanges();
+    s.faultChecks       = irrigationCtrl.faults().getChecks();
+    s.faultLastDrop     = irrigationCtrl.faults().get().lastDrop;
+    s.journalWrites     = irrigationCtrl.journalWrites();
+    s.journalRecoveries = irrigationCtrl.journalRecoveries();
+    s.pulsesRun         = irrigationCtrl.pulsesRun();
+    s.earlyStops        = irrigationCtrl.earlyStops();
+    s.lastEventMs       = irrigationCtrl.lastEventMs();
+    s.response          = irrigationCtrl.response().get();
+    s.responseReliable  = irrigationCtrl.response().reliable();
+    s.timing            = timing_;
+    snap_.publish(s);
+  }
+};
+
+ControlTask controlTask;
+
+// ----------------------- Watering Schedule -----------------------
+// Time-of-day rules on local time, persisted in "sched_cfg" together with the
+// daylight saving offset. The loop only pays one comparison until the next edge.
+class ScheduleService {
+  Preferences      prefs_;
+  wateringSchedule schedule_;
+
+public:
+  // Load rules and daylight saving offset from preferences
+  void begin() {
+    prefs_.begin("sched_cfg", false);
+    wateringSchedule::rule rules[wateringSchedule::MAX_RULES];
+    size_t len = prefs_.getBytes("rules", rules, sizeof(rules));
+    schedule_.load(rules, len / sizeof(wateringSchedule::rule));
+    timeCtrl.setDaylightOffset(prefs_.getInt("dst", 0));
+    schedule_.setUtcOffset(timeCtrl.getUtcOffset());
+  }
+
+  // Push schedule edges to the irrigation manager
+  void handle() {
+    if (schedule_.poll(timeCtrl.getEpoch())) {
+      LOG_INFO("Schedule: allowed=%d forced=%d", schedule_.allowed(), schedule_.forced());
+      controlTask.post({ControlCommand::SCHEDULE, schedule_.allowed(), schedule_.forced(), 0});
+    }
+  }
+
+  // Replace the rules from their text form and save them
+  bool set(const String& text) {
+    if (!schedule_.parse(text.c_str())) return false;
+    prefs_.putBytes("rules", schedule_.rules(), schedule_.count() * sizeof(wateringSchedule::rule));
+    return true;
+  }
+
+  // Set and save the daylight saving offset in seconds
+  void setDaylightOffset(int seconds) {
+    prefs_.putInt("dst", seconds);
+    timeCtrl.setDaylightOffset(seconds);
+    schedule_.setUtcOffset(timeCtrl.getUtcOffset());
+  }
+
+  String describe() const {
+    char buf[wateringSchedule::MAX_RULES * 32];
+    schedule_.format(buf, sizeof(buf));
+    return String(buf);
+  }
+
+  const wateringSchedule& schedule() const { return schedule_; }
+};
+
+ScheduleService scheduleSrv;
+
 // ----------------------- MQTT Service -----------------------
 // Handles MQTT connection, publishing, and configuration
 class MqttService {
-  WiFiClient    wifiConn_;        // WiFi client for MQTT
+public:
+  typedef std::function<void(const uint8_t* payload, unsigned int length)> CommandHandler;
+
+private:
+  struct Command {
+    String         name;        // Sub-topic below "<site>/<device>/cmd/"
+    CommandHandler handler;
+  };
+
+  WiFiClient    wifiConn_;        // Plain TCP transport
+#if FEATURE_TLS
+  tlsClient     tlsConn_;         // TLS transport, non-blocking handshake with session resumption
+#endif
+  bool          useTls_;          // MQTT over tlsConn_ (always false without FEATURE_TLS)
+  bool          reconnectAsked_;  // cmd/reconnect, handled outside the message callback
+  bool          dropSession_;     // ... with a full handshake
   PubSubClient  client_;          // MQTT client
   Preferences   prefs_;           // Store broker/port
-  timedLoop     reconnectLoop_;   // Reconnect interval
-  timedLoop     publishLoop_;     // Publish interval
-  String        broker_;          // MQTT broker address
+  backoff       retry_;           // Jittered delay between failed attempts
+  uint32_t      nextAttemptMs_;   // When the next attempt is due
+  bool          wasConnected_;    // Detects the connection going down
+  uint32_t      downSinceMs_;     // Connection loss or new IP, for the reconnect latency
+  uint32_t      attempts_;        // Connection attempts since boot
+  uint32_t      reconnects_;      // Successful ones
+  uint32_t      reconnectMs_;     // Down to connected, last time
+  uint32_t      reconnectMaxMs_;
+  String        broker_;          // MQTT broker address, empty = discover via mDNS
   int           port_;            // MQTT broker port
+  brokerResolver resolver_;       // Async DNS / mDNS with a TTL cache
+  bool          connectNow_;      // Skip the reconnect interval (new IP)
+  uint32_t      gotIpMs_;         // When the current network came up
+  uint32_t      firstPublishMs_;  // GOT_IP to "online" published, last network change
+  bool          persistent_;      // prefs_ open (false on the deep-sleep wake path)
+  String        deviceId_;        // Unique client ID derived from the MAC
+  String        site_;            // Site name, first level of the topic tree
+  String        topicBase_;       // "<site>/<device>/"
+  std::vector<Command> commands_; // Registered command handlers
+  uint8_t       format_;          // TELEMETRY_ASCII / TELEMETRY_PACKED / TELEMETRY_ROLLUP mask
+  uint8_t       packedBuf_[PACKED_BLOCK_BYTES];
+  telemetryEncoder packed_;       // Block being filled for MQTT_PACKED_TOPIC
+  rollupTier    shortTier_;       // Per-sample aggregates, e.g. 1 min
+  rollupTier    longTier_;        // Fed by closed short windows, e.g. 1 h
+  String        shortTopic_;      // "telemetry/1m"
+  String        longTopic_;       // "telemetry/1h"
+  timeout       rawStream_;       // ASCII samples requested through cmd/raw
+  uint32_t      seq_;             // Last control sample sent on (samples since boot, published or not)
+  reportFilter  rbe_;             // Report by exception for the ASCII and packed streams
+  uint32_t      reportSeq_;       // Last sample published, so consumers tell suppressed from lost
+  uint32_t      writes_;          // ASCII telemetry handed to PubSubClient...
+  uint64_t      writeUsTotal_;    // ...and the time publish() took
+  uint32_t      writeUsMax_;
 
 public:
   MqttService()
-    : client_(wifiConn_),
-      reconnectLoop_(10000),
-      publishLoop_(1000),
+    : useTls_(false),
+      reconnectAsked_(false),
+      dropSession_(false),
+      client_(wifiConn_),
+      retry_(MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_CAP_MS),
+      nextAttemptMs_(0),
+      wasConnected_(false),
+      downSinceMs_(0),
+      attempts_(0),
+      reconnects_(0),
+      reconnectMs_(0),
+      reconnectMaxMs_(0),
       broker_(""),
-      port_(1883)
+      port_(1883),
+      connectNow_(false),
+      gotIpMs_(0),
+      firstPublishMs_(0),
+      persistent_(false),
+      format_(TELEMETRY_ROLLUP),
+      packed_(packedBuf_, sizeof(packedBuf_)),
+      shortTier_(DEFAULT_ROLLUP_SHORT_SEC),
+      longTier_(DEFAULT_ROLLUP_LONG_SEC),
+      rawStream_(0),
+      seq_(0),
+      reportSeq_(0),
+      writes_(0),
+      writeUsTotal_(0),
+      writeUsMax_(0)
   {}
 
-  // Load broker/port from preferences and set up MQTT client
+  // Load broker/port/site from preferences and set up MQTT client
   void begin() {
-    prefs_.begin("mqtt_cfg", false);
-    broker_ = prefs_.getString("broker", "");
-    port_   = prefs_.getInt("port", 1883);
-    client_.setCallback(onMessage);
-    client_.setServer(broker_.c_str(), port_);
+    persistent_ = prefs_.begin("mqtt_cfg", false);
+    broker_   = prefs_.getString("broker", "");
+#if FEATURE_TLS
+    useTls_   = prefs_.getBool("tls", false);
+    port_     = prefs_.getInt("port", useTls_ ? MQTT_TLS_PORT : 1883);
+#else
+    port_     = prefs_.getInt("port", 1883);
+#endif
+    site_     = prefs_.getString("site", DEFAULT_MQTT_SITE);
+    format_   = prefs_.getUChar("format", TELEMETRY_ROLLUP);
+    setRollupWindows(prefs_.getULong("roll_short", DEFAULT_ROLLUP_SHORT_SEC),
+                     prefs_.getULong("roll_long", DEFAULT_ROLLUP_LONG_SEC), false);
+    setReportByException(prefs_.getBool("rbe", false), prefs_.getUShort("rbe_band", DEFAULT_RBE_DEADBAND),
+                         prefs_.getULong("rbe_heartbeat", DEFAULT_RBE_HEARTBEAT_SEC), false);
+    deviceId_ = buildDeviceId();
+    updateTopicBase();
+    retry_.seed(esp_random());
+    Serial.print("MQTT device ID: "); Serial.println(deviceId_);
+    client_.setBufferSize(MQTT_BUFFER_SIZE);
+    client_.setCallback([this](char* t, byte* p, unsigned int l) { onMessage(t, p, l); });
+#if FEATURE_TLS
+    if (useTls_) setupTls(prefs_.getString("ca", ""));
+#endif
+    resolver_.setHost(broker_, port_);
+    if (prefs_.getString("last_host", "-") == broker_) {   // connect right away, refresh in the background
+      resolver_.seed(IPAddress(prefs_.getULong("last_ip", 0)), prefs_.getUShort("last_port", port_));
+    }
+  }
+
+  // New IP: addresses may have changed, resolve again and connect without waiting
+  void onNetworkUp() {
+    resolver_.invalidate();
+    retry_.reset();
+    connectNow_ = true;
+    gotIpMs_    = millis();
+    if (!client_.connected()) downSinceMs_ = gotIpMs_;
+  }
+
+  // Set up the client from cached settings without touching NVS or DNS (deep-sleep wake path).
+  // With TLS the caller pins the certificate and loads the session through tls().
+  void beginRetained(IPAddress brokerIp, int port, const char* site, bool tls) {
+    port_     = port;
+    site_     = site;
+    deviceId_ = buildDeviceId();
+    updateTopicBase();
+    client_.setBufferSize(MQTT_BUFFER_SIZE);
+    client_.setCallback([this](char* t, byte* p, unsigned int l) { onMessage(t, p, l); });
+#if FEATURE_TLS
+    useTls_   = tls;
+    if (useTls_) client_.setClient(tlsConn_);
+#endif
+    client_.setServer(brokerIp, port_);
+  }
+
+  // Drop the connection and reconnect on the next loop(); full = without session resumption
+  void requestReconnect(bool full) {
+    reconnectAsked_ = true;
+    dropSession_    = full;
+  }
+
+  // Connect right away instead of waiting for the reconnect interval
+  bool connectNow() {
+    if (!client_.connected()) reconnect();
+    return client_.connected();
+  }
+
+  // Process incoming messages without publishing telemetry
+  void poll() {
+    client_.loop();
+  }
+
+  // Close the connection cleanly (the broker does not send the will)
+  void disconnect() {
+    client_.disconnect();
+  }
+
+  // Register a handler for messages on "<site>/<device>/cmd/<name>"
+  void onCommand(const char* name, CommandHandler handler) {
+    commands_.push_back({String(name), handler});
   }
 
-  // Handle incoming MQTT messages
-  static void onMessage(char* topic, byte* payload, unsigned int length) {
-    String msg;
-    for (unsigned int i = 0; i < length; ++i) {
-      msg += char(payload[i]);
+  // Handle incoming MQTT messages, dispatching commands to their handlers
+  void onMessage(char* topic, byte* payload, unsigned int length) {
+    String cmdPrefix = topicBase_ + "cmd/";
+    if (strncmp(topic, cmdPrefix.c_str(), cmdPrefix.length()) == 0) {
+      const char* name = topic + cmdPrefix.length();
+      for (auto& cmd : commands_) {
+        if (cmd.name == name) {
+          cmd.handler(payload, length);
+          return;
+        }
+      }
     }
-    Serial.print("MQTT @"); Serial.print(topic); Serial.print(" => "); Serial.println(msg);
+
+    LOG_INFO("MQTT message without handler on %s, %u bytes", topic, length);
   }
 
   // Set and save new broker address
   void setBroker(const String& b) {
     broker_ = b;
     prefs_.putString("broker", broker_);
-    client_.setServer(broker_.c_str(), port_);
+    resolver_.setHost(broker_, port_);
   }
 
   // Set and save new port
   void setPort(int p) {
     port_ = p;
     prefs_.putInt("port", port_);
-    client_.setServer(broker_.c_str(), port_);
+    resolver_.setHost(broker_, port_);
   }
 
-  // Return if MQTT is connected
-  bool connected() {
-    return client_.connected();
+  // Set and save new site name (takes effect on the next connection)
+  void setSite(const String& s) {
+    site_ = s;
+    prefs_.putString("site", site_);
+    updateTopicBase();
+    client_.disconnect();
   }
 
-  // Handle MQTT connection, reconnection, and publishing
-  void loop() {
-    if (!client_.connected() && reconnectLoop_.check() && WiFi.status() == WL_CONNECTED) {
-      reconnect();
-    }
+  // Set and save the telemetry format mask
+  void setFormat(uint8_t format) {
+    format_ = format;
+    prefs_.putUChar("format", format_);
+    packed_.reset();
+  }
 
-    client_.loop();
+  // Set the rollup window lengths; the long one is rounded to a multiple of the short one
+  bool setRollupWindows(uint32_t shortSec, uint32_t longSec, bool save = true) {
+    if (shortSec == 0 || longSec < shortSec) return false;
+    longSec -= longSec % shortSec;
+    shortTier_.setWindow(shortSec);
+    longTier_.setWindow(longSec);
+    shortTopic_ = rollupTopic(shortSec);
+    longTopic_  = rollupTopic(longSec);
+    if (save) {
+      prefs_.putULong("roll_short", shortSec);
+      prefs_.putULong("roll_long", longSec);
+    }
+    return true;
+  }
 
-    // Publish time, moisture, and watering status periodically
-    if (client_.connected() && publishLoop_.check()) {
-        String payload = timeCtrl.getTimeString();
-        payload += "," + String(irrigationCtrl.readMoisture());
-        payload += "," + String(irrigationCtrl.isCurrentlyWatering());
-        client_.publish(MQTT_TOPIC, payload.c_str());
+  // Report by exception: per-sample telemetry only when moisture moves more
+  // than `deadband` counts, the valve changes, or after heartbeatSec of silence
+  void setReportByException(bool on, uint16_t deadband, uint32_t heartbeatSec, bool save = true) {
+    if (heartbeatSec == 0 || heartbeatSec > MAX_RBE_HEARTBEAT_SEC) heartbeatSec = MAX_RBE_HEARTBEAT_SEC;
+    rbe_.configure(on, deadband, heartbeatSec * 1000UL);
+    rbe_.resetCounters();   // the suppression ratio is per setting
+    if (save) {
+      prefs_.putBool("rbe", on);
+      prefs_.putUShort("rbe_band", deadband);
+      prefs_.putULong("rbe_heartbeat", heartbeatSec);
     }
   }
 
-private:
-  // Attempt to reconnect to MQTT broker
-  void reconnect() {
-    if (broker_.length() == 0) {
-      Serial.println("MQTT broker not set");
+  // Stream raw ASCII samples for a limited time (0 stops)
+  void streamRaw(uint32_t seconds) {
+    if (seconds == 0) {
+      rawStream_.stop();
       return;
     }
-    Serial.print("Connecting to MQTT...");
-    if (client_.connect(DEVICE_ID)) {
-      Serial.println("connected");
-      client_.subscribe(MQTT_TOPIC);
-    } else {
-      Serial.print("failed, rc=");
-      Serial.println(client_.state());
-    }
+    rawStream_.start(min(seconds, MAX_RAW_STREAM_SEC) * 1000UL);
   }
-};
 
-// ----------------------- Global Objects -----------------------
-wifiManager       netMgr(1);   // WiFi manager
-MqttService       mqttSrv;     // MQTT service
+  // Return the full topic for a per-device sub-topic
+  String topic(const char* sub) const {
+    return topicBase_ + sub;
+  }
 
-// ----------------------- Arduino Setup & Loop -----------------------
-void setup() {
-  Serial.begin(SERIAL_SPEED);                                      // Start serial
-  netMgr.begin(true);                                              // Start WiFi
-  irrigationCtrl.begin(VALVE_OUTPUT_PIN, MOISTURE_INPUT_PIN);      // Init irrigation
-  mqttSrv.begin();                                                 // Init MQTT
-  timeCtrl.begin();                                                // Init NTP time
+  // Return the device ID used as MQTT client ID
+  const String& deviceId() const {
+    return deviceId_;
+  }
+
+  // Return the last resolved broker address; false if none is cached
+  bool resolvedBroker(IPAddress& ip, uint16_t& port) const {
+    if (!resolver_.hasAddress()) return false;
+    ip   = resolver_.address();
+    port = resolver_.port();
+    return true;
+  }
+
+  const brokerResolver& resolver() const { return resolver_; }
+  uint32_t              attempts() const       { return attempts_; }
+  uint32_t              reconnects() const     { return reconnects_; }
+  uint32_t              reconnectMs() const    { return reconnectMs_; }
+  uint32_t              reconnectMaxMs() const { return reconnectMaxMs_; }
+  uint32_t              backoffWindowMs() const { return retry_.window(); }
+#if FEATURE_TLS
+  tlsClient&            tls()            { return tlsConn_; }
+#endif
+  bool                  usesTls() const  { return useTls_; }
+  uint32_t firstPublishMs() const        { return firstPublishMs_; }
+  uint32_t telemetrySeq() const          { return seq_; }
+  const reportFilter& reportByException() const { return rbe_; }
+  uint32_t telemetryWriteUsAvg() const   { return writes_ ? writeUsTotal_ / writes_ : 0; }
+  uint32_t telemetryWriteUsMax() const   { return writeUsMax_; }
+
+  // Return the configured broker host, port and site
+  const String& broker() const { return broker_; }
+  int           port() const   { return port_; }
+  const String& site() const   { return site_; }
+
+  // Publish to a per-device sub-topic
+  bool publish(const char* sub, const String& payload, bool retained = false) {
+    return client_.publish(topic(sub).c_str(), payload.c_str(), retained);
+  }
+
+  // Publish binary data to a per-device sub-topic
+  bool publish(const char* sub, const uint8_t* payload, unsigned int length, bool retained = false) {
+    return client_.publish(topic(sub).c_str(), payload, length, retained);
+  }
+
+  // Return if MQTT is connected
+  bool connected() {
+    return client_.connected();
+  }
+
+  // Handle MQTT connection, reconnection, and publishing
+  void loop() {
+    if (reconnectAsked_) {
+      reconnectAsked_ = false;
+#if FEATURE_TLS
+      if (dropSession_) tlsConn_.clearSession();
+#endif
+      client_.disconnect();
+      connectNow_ = true;
+    }
+
+    bool up = client_.connected();
+    if (!up && wasConnected_) {
+      // Lost the broker: the first retry is already jittered, so a restarted
+      // broker does not see the whole fleet at once
+      wasConnected_  = false;
+      downSinceMs_   = millis();
+      nextAttemptMs_ = downSinceMs_ + retry_.next();
+    }
+
+    if (!up && WiFi.status() == WL_CONNECTED && resolver_.poll()) {
+#if FEATURE_TLS
+      if (useTls_ && tlsConn_.pending()) {
+        // Handshake in progress: a bounded slice per pass, MQTT CONNECT once it is done
+        tlsClient::state s = tlsConn_.poll();
+        if (s == tlsClient::READY)  attemptDone(reconnect());
+        if (s == tlsClient::FAILED) attemptDone(false);
+      } else
+#endif
+      if (connectNow_ || (int32_t)(millis() - nextAttemptMs_) >= 0) {
+        connectNow_ = false;
+        attempts_++;
+        client_.setServer(resolver_.address(), resolver_.port());   // no DNS inside connect()
+        if (!useTls_) {
+          attemptDone(reconnect());
+        }
+#if FEATURE_TLS
+        else if (!tlsConn_.begin(resolver_.address(), resolver_.port())) {
+          attemptDone(false);
+        }
+#endif
+      }
+    }
+
+    client_.loop();
+    rawStream_.finished();   // lets isRunning() drop once the requested time is over
+
+    // Each new sample of the control task once; rollups keep aggregating while
+    // offline. The stamps start at the sample, so enqueue includes the hand-off.
+    ControlSnapshot c = controlTask.snapshot();
+    if (c.samples != seq_) {
+      seq_ = c.samples;
+      int64_t  t0       = c.sampleUs;
+      uint32_t upMs     = c.sampleMs;
+      uint64_t wallMs   = wallClockMs();
+      uint32_t seq      = c.samples;
+      int  moisture = c.moisture;
+      bool watering = c.watering;
+      uint32_t adcUs    = c.adcUs;
+      if (wallMs) wallMs -= (esp_timer_get_time() - t0) / 1000;
+
+      if (format_ & TELEMETRY_ROLLUP) {
+        addRollup(moisture, watering);
+      }
+      if (!client_.connected()) return;
+
+      // Per-sample streams only carry the samples report by exception lets through
+      bool ascii  = (format_ & TELEMETRY_ASCII) || rawStream_.isRunning();
+      bool packed = format_ & TELEMETRY_PACKED;
+      if (!ascii && !packed) return;
+      if (rbe_.offer(upMs, moisture, watering) == reportFilter::SUPPRESSED) return;
+
+      bool sent = true;
+      if (ascii) {
+        String payload = timeCtrl.getTimeString();
+        payload += "," + String(moisture);
+        payload += "," + String(watering);
+        payload += "," + String(seq) + "," + String(upMs) + "," + String(wallMs) + "," + String(adcUs);
+        payload += "," + String((uint32_t)(esp_timer_get_time() - t0));   // enqueued: formatted
+        String sub  = topic(MQTT_TELEMETRY_TOPIC);
+        String prev = "," + String(reportSeq_);                            // sample published before this one
+        int64_t w0 = esp_timer_get_time();
+        payload += "," + String((uint32_t)(w0 - t0)) + prev;              // handed to PubSubClient
+        sent = client_.publish(sub.c_str(), payload.c_str());
+        noteWrite(esp_timer_get_time() - w0);
+      }
+      if (packed) {
+        appendPacked(timeCtrl.getEpoch(), moisture, watering);
+      }
+      if (sent) reportSeq_ = seq;
+      else      rbe_.resync();   // the next sample goes out whatever its value
+    }
+  }
+
+private:
+  // NTP-disciplined wall clock in ms, 0 before the first sync; lets the host
+  // line device stage stamps up with its own
+  uint64_t wallClockMs() const {
+    if (timeCtrl.getEpoch() == 0) return 0;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  }
+
+  // Time PubSubClient spent writing a telemetry message into the TCP stack
+  void noteWrite(uint32_t us) {
+    writes_++;
+    writeUsTotal_ += us;
+    if (us > writeUsMax_) writeUsMax_ = us;
+  }
+
+  // "telemetry/1m", "telemetry/1h" or "telemetry/90s"
+  static String rollupTopic(uint32_t sec) {
+    String t = String(MQTT_TELEMETRY_TOPIC) + "/";
+    if (sec % 3600 == 0) return t + String(sec / 3600) + "h";
+    if (sec % 60 == 0)   return t + String(sec / 60) + "m";
+    return t + String(sec) + "s";
+  }
+
+  // Feed the short tier; each closed short window feeds the long tier
+  void addRollup(int moisture, bool watering) {
+    time_t epoch = timeCtrl.getEpoch();
+    uint32_t t = epoch ? (uint32_t)epoch : millis() / 1000;   // uptime until NTP syncs
+    uint32_t valveSec = watering ? 1 : 0;   // one sample per IRRIGATION_SAMPLE_MS (1 s)
+
+    if (!shortTier_.add(t, (uint16_t)moisture, valveSec)) return;
+    publishRollup(shortTopic_, shortTier_.closed());
+    if (longTier_.add(shortTier_.closed().start, shortTier_.closed())) {
+      publishRollup(longTopic_, longTier_.closed());
+    }
+  }
+
+  void publishRollup(const String& sub, const rollupStats& stats) {
+    if (!client_.connected()) return;
+    char payload[80];
+    stats.format(payload, sizeof(payload));
+    client_.publish(topic(sub.c_str()).c_str(), payload);
+  }
+
+  // Add a sample to the packed block, publishing the block once it is complete
+  void appendPacked(time_t epoch, int moisture, bool watering) {
+    if (epoch == 0) return;   // packed samples need an absolute time base
+
+    if (!packed_.append((uint32_t)epoch, (uint16_t)moisture, watering)) {
+      packed_.reset();
+      packed_.append((uint32_t)epoch, (uint16_t)moisture, watering);
+    }
+    if (packed_.count() >= PACKED_BLOCK_SAMPLES) {
+      publish(MQTT_PACKED_TOPIC, packed_.data(), packed_.size());
+      packed_.reset();
+    }
+  }
+
+  // Keep the working broker address for the next boot (only written when it changes)
+  void rememberBroker() {
+    uint32_t ip = (uint32_t)resolver_.address();
+    if (!persistent_ || !resolver_.hasAddress() || prefs_.getULong("last_ip", 0) == ip) return;
+    prefs_.putString("last_host", broker_);
+    prefs_.putULong("last_ip", ip);
+    prefs_.putUShort("last_port", resolver_.port());
+  }
+
+#if FEATURE_TLS
+  // Switch the MQTT client to the TLS transport; the host name is checked unless it is an IP literal
+  void setupTls(const String& caPem) {
+    client_.setClient(tlsConn_);
+    tlsConn_.setStepBudget(TLS_STEP_BUDGET_MS);
+    tlsConn_.setCACert(caPem.c_str());
+    IPAddress literal;
+    if (broker_.length() && !literal.fromString(broker_)) tlsConn_.setHostname(broker_.c_str());
+  }
+#endif
+
+  // Rebuild "<site>/<device>/" after the site or device ID changes
+  void updateTopicBase() {
+    topicBase_ = site_ + "/" + deviceId_ + "/";
+  }
+
+  // Record the outcome of a connection attempt and schedule the next one
+  void attemptDone(bool ok) {
+    if (!ok) {
+      resolver_.forget();                               // the cached address may be stale
+      nextAttemptMs_ = millis() + retry_.next();
+      return;
+    }
+    retry_.reset();
+    wasConnected_ = true;
+    reconnects_++;
+    reconnectMs_ = millis() - downSinceMs_;
+    if (reconnectMs_ > reconnectMaxMs_) reconnectMaxMs_ = reconnectMs_;
+  }
+
+  // Attempt to reconnect to MQTT broker
+  bool reconnect() {
+    String statusTopic = topic(MQTT_STATUS_TOPIC);
+    if (client_.connect(deviceId_.c_str(), statusTopic.c_str(), 1, true, "offline")) {
+      LOG_INFO("MQTT connected");
+      client_.publish(statusTopic.c_str(), "online", true);
+      rbe_.resync();   // consumers get a fresh value with every new connection
+      if (gotIpMs_) {
+        firstPublishMs_ = millis() - gotIpMs_;
+        gotIpMs_ = 0;
+      }
+      rememberBroker();
+      client_.subscribe(topic(MQTT_COMMAND_TOPIC).c_str());
+      return true;
+    }
+    LOG_WARN("MQTT connect failed, rc=%d", client_.state());
+    return false;
+  }
+};
+
+// ----------------------- Global Objects -----------------------
+wifiManager       netMgr(1);   // WiFi manager
+MqttService       mqttSrv;     // MQTT service
+#if FEATURE_OTA
+otaUpdater        ota;         // Delta OTA receiver
+timeout           rebootDelay(1000); // Lets the last OTA status leave before restarting
+#endif
+
+// ----------------------- Local Live Stream -----------------------
+#if FEATURE_LIVE_STREAM
+// HTTP page on "/" and binary sample frames on ws://<device>/ws for field
+// commissioning without a broker. Sampling runs in loop() only while a viewer
+// is connected; a client whose send queue is full skips frames (counted)
+// instead of stalling the loop.
+class LiveStream {
+  struct FrameHeader {
+    uint8_t  version;
+    uint8_t  count;
+    uint16_t periodMs;
+    uint32_t seq;
+    uint32_t t0Ms;
+    uint8_t  valve;
+    uint8_t  reserved;
+  } __attribute__((packed));
+
+  AsyncWebServer    server_;
+  AsyncWebSocket    ws_;
+  volatile uint32_t periodMs_;      // set from the AsyncTCP task
+  uint32_t          lastSampleMs_;
+  uint32_t          lastCleanupMs_;
+  uint32_t          seq_;
+  uint32_t          framesSent_;
+  uint32_t          framesDropped_;
+  uint8_t           count_;
+  uint8_t           frame_[sizeof(FrameHeader) + LIVE_MAX_BATCH * 2];
+
+public:
+  LiveStream()
+    : server_(80), ws_("/ws"), periodMs_(1000 / LIVE_DEFAULT_RATE_HZ), lastSampleMs_(0),
+      lastCleanupMs_(0), seq_(0), framesSent_(0), framesDropped_(0), count_(0)
+  {}
+
+  // Register the page and the socket; the server listens on all interfaces
+  void begin() {
+    ws_.onEvent([this](AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type,
+                       void* arg, uint8_t* data, size_t len) {
+      onEvent(client, type, arg, data, len);
+    });
+    server_.addHandler(&ws_);
+    server_.on("/", HTTP_GET, [](AsyncWebServerRequest* req) {
+      req->send(200, "text/html", LIVE_PAGE_HTML);
+    });
+    server_.begin();
+  }
+
+  // Sample at the requested rate and send a frame every LIVE_FRAME_MS
+  void handle() {
+    uint32_t now = millis();
+    if (now - lastCleanupMs_ >= 1000) {
+      ws_.cleanupClients(LIVE_MAX_CLIENTS);
+      lastCleanupMs_ = now;
+    }
+    if (ws_.count() == 0) {
+      count_ = 0;
+      return;
+    }
+
+    uint32_t period = periodMs_;
+    if (now - lastSampleMs_ < period) return;
+    // Keep the cadence, but never burst to catch up after a long loop pass
+    lastSampleMs_ = now - lastSampleMs_ < 2 * period ? lastSampleMs_ + period : now;
+
+    FrameHeader* h = (FrameHeader*)frame_;
+    if (count_ == 0) h->t0Ms = now;
+    uint16_t v = irrigationCtrl.readMoistureFast();
+    memcpy(frame_ + sizeof(FrameHeader) + count_ * 2, &v, 2);
+    count_++;
+
+    if (count_ >= LIVE_MAX_BATCH || now - h->t0Ms + period >= LIVE_FRAME_MS) {
+      h->version  = 1;
+      h->count    = count_;
+      h->periodMs = period;
+      h->seq      = seq_++;
+      h->valve    = controlTask.snapshot().watering;
+      h->reserved = 0;
+      send(sizeof(FrameHeader) + count_ * 2);
+      count_ = 0;
+    }
+  }
+
+  size_t   clients()             { return ws_.count(); }
+  uint32_t framesSent() const    { return framesSent_; }
+  uint32_t framesDropped() const { return framesDropped_; }
+
+private:
+  // Per-client backpressure: skip clients whose queue is full
+  void send(size_t len) {
+    for (auto& c : ws_.getClients()) {
+      if (c.status() != WS_CONNECTED) continue;
+      if (c.queueIsFull()) {
+        framesDropped_++;
+        continue;
+      }
+      c.binary(frame_, len);
+      framesSent_++;
+    }
+  }
+
+  // Text commands from the page: "rate <hz>"
+  void onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
+    if (type == WS_EVT_CONNECT && ws_.count() > LIVE_MAX_CLIENTS) {
+      client->close(1013, "too many viewers");
+      return;
+    }
+    if (type != WS_EVT_DATA) return;
+    AwsFrameInfo* info = (AwsFrameInfo*)arg;
+    if (!info->final || info->index != 0 || info->len != len || info->opcode != WS_TEXT) return;
+
+    char cmd[24];
+    size_t n = min(len, sizeof(cmd) - 1);
+    memcpy(cmd, data, n);
+    cmd[n] = '\0';
+    unsigned hz;
+    if (sscanf(cmd, "rate %u", &hz) == 1 && hz > 0) {
+      periodMs_ = 1000 / min(hz, (unsigned)LIVE_MAX_RATE_HZ);
+    }
+  }
+};
+
+LiveStream liveSrv;
+#endif
+
+// ----------------------- Raw ADC Stream -----------------------
+#if FEATURE_CONSOLE
+// Raw moisture ADC readings at up to STREAM_MAX_HZ for sensor
+// characterization. An esp_timer callback fills one block while loop() sends
+// the other as a lib/sampleFrame frame, a slice per pass, so a slow host never
+// stalls the loop. A block that fills while the other is still waiting is
+// dropped; the receiver sees the gap in the sample index. Log output is held
+// back while streaming so it does not interleave with frames.
+class AdcStream {
+  struct Block {
+    uint16_t samples[STREAM_BLOCK_SAMPLES];
+    uint16_t count;
+    uint32_t first;      // sample index
+    uint32_t timeUs;
+  };
+
+  Block               blocks_[2];
+  uint8_t             fill_;        // block the timer writes
+  uint16_t            filled_;
+  std::atomic<int8_t> ready_;       // block waiting for loop(), -1 if none
+  esp_timer_handle_t  timer_;
+  uint32_t            periodUs_;
+  uint32_t            next_;        // index of the next sample
+  uint32_t            dropped_;     // samples lost to overruns
+  uint32_t            seq_;
+  bool                active_;      // timer running
+  bool                stopping_;    // flush the partial block, then END
+  uint8_t             scratch_[sampleFrame::rawBytes(STREAM_BLOCK_SAMPLES)];
+  uint8_t             frame_[sampleFrame::maxEncodedBytes(STREAM_BLOCK_SAMPLES)];
+  size_t              frameLen_;
+  size_t              frameSent_;
+
+public:
+  AdcStream()
+    : fill_(0), filled_(0), ready_(-1), timer_(nullptr), periodUs_(0), next_(0), dropped_(0), seq_(0),
+      active_(false), stopping_(false), frameLen_(0), frameSent_(0) {}
+
+  bool start(uint32_t hz) {
+    if (active_ || stopping_ || frameLen_) return false;
+    if (!timer_) {
+      esp_timer_create_args_t args = {};
+      args.callback = [](void* self) { static_cast<AdcStream*>(self)->sample(); };
+      args.arg      = this;
+      args.name     = "adc_stream";
+      if (esp_timer_create(&args, &timer_) != ESP_OK) return false;
+    }
+    hz        = constrain(hz, 1UL, STREAM_MAX_HZ);
+    periodUs_ = 1000000UL / hz;
+    fill_     = 0;
+    filled_   = 0;
+    next_     = 0;
+    dropped_  = 0;
+    seq_      = 0;
+    ready_.store(-1);
+    active_   = esp_timer_start_periodic(timer_, periodUs_) == ESP_OK;
+    return active_;
+  }
+
+  // The callback runs in the esp_timer task, which preempts loop() on this
+  // single-core chip, so once esp_timer_stop() returns it is not mid-sample
+  void stop() {
+    if (!active_) return;
+    esp_timer_stop(timer_);
+    active_   = false;
+    stopping_ = true;
+  }
+
+  bool     active() const   { return active_ || stopping_ || frameLen_; }
+  uint32_t samples() const  { return next_; }
+  uint32_t dropped() const  { return dropped_; }
+  uint32_t rateHz() const   { return periodUs_ ? 1000000UL / periodUs_ : 0; }
+
+  // Send the pending frame as far as the USB buffer allows, then the next one
+  void handle() {
+    if (frameLen_ == 0 && !nextFrame()) return;
+    int room = Serial.availableForWrite();
+    if (room <= 0) return;
+    frameSent_ += Serial.write(frame_ + frameSent_, min((size_t)room, frameLen_ - frameSent_));
+    if (frameSent_ == frameLen_) frameLen_ = 0;
+  }
+
+private:
+  void sample() {
+    Block& b = blocks_[fill_];
+    if (filled_ == 0) {
+      b.first  = next_;
+      b.timeUs = (uint32_t)esp_timer_get_time();
+    }
+    b.samples[filled_++] = analogRead(MOISTURE_INPUT_PIN);
+    next_++;
+    if (filled_ < STREAM_BLOCK_SAMPLES) return;
+
+    filled_ = 0;
+    if (ready_.load(std::memory_order_acquire) >= 0) {
+      dropped_ += STREAM_BLOCK_SAMPLES;   // overwrite this block, the other one is still queued
+      return;
+    }
+    b.count = STREAM_BLOCK_SAMPLES;
+    ready_.store(fill_, std::memory_order_release);
+    fill_ ^= 1;
+  }
+
+  // Encode the queued block (or, when stopping, the partial one and END)
+  bool nextFrame() {
+    int8_t r = ready_.load(std::memory_order_acquire);
+    if (r < 0 && stopping_ && filled_ > 0) {
+      blocks_[fill_].count = filled_;
+      filled_ = 0;
+      r = fill_;
+    }
+
+    sampleFrame::header h = {};
+    h.seq      = seq_;
+    h.periodUs = periodUs_;
+    if (r >= 0) {
+      const Block& b = blocks_[r];
+      h.type   = sampleFrame::SAMPLES;
+      h.count  = b.count;
+      h.first  = b.first;
+      h.timeUs = b.timeUs;
+      frameLen_ = sampleFrame::encode(h, b.samples, scratch_, frame_);
+      ready_.store(-1, std::memory_order_release);   // the block is free once encoded
+    } else if (stopping_) {
+      h.type    = sampleFrame::END;
+      h.first   = next_;
+      stopping_ = false;
+      frameLen_ = sampleFrame::encode(h, nullptr, scratch_, frame_);
+    } else {
+      return false;
+    }
+    seq_++;
+    frameSent_ = 0;
+    return true;
+  }
+};
+
+AdcStream adcStream;
+#endif
+
+// ----------------------- Fault Alerts -----------------------
+// A latched fault is published on fault (retained) as "<fault> <reading>",
+// and "none" once cleared, retried until the broker has it. cmd/fault takes
+// "clear" (send it unretained: a retained clear would lift every future
+// lockout at boot) or "checks,<mask>" with one bit per faultDetector::fault.
+static void handleFaultAlert() {
+  if (!mqttSrv.connected()) return;
+  ControlSnapshot c = controlTask.snapshot();
+  if (!c.faultAlert) return;
+  faultDetector::fault f = (faultDetector::fault)c.fault;
+  String msg = faultDetector::name(f);
+  if (f != faultDetector::NONE) msg += " " + String(c.faultMoisture);
+  if (mqttSrv.publish("fault", msg, true)) controlTask.post({ControlCommand::FAULT_SENT, 0, c.faultChanges, 0});
+}
+
+static void setupFaultCommands() {
+  mqttSrv.onCommand("fault", [](const uint8_t* p, unsigned int n) {
+    String arg;
+    for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+    if (arg == "clear") {
+      controlTask.post({ControlCommand::CLEAR_FAULT, 0, 0, 0});
+    } else if (arg.startsWith("checks,")) {
+      controlTask.post({ControlCommand::FAULT_CHECKS, (int32_t)arg.substring(7).toInt(), 0, 0});
+    }
+  });
+}
+
+// ----------------------- Sample History -----------------------
+#if FEATURE_HISTORY
+// historyStore segments as LittleFS files. Appends open, write and close, so
+// each record is committed; the last file read stays open for lookups.
+class LittleFsHistoryStore : public historyStore::store {
+  File    readFile_;
+  int16_t readSegment_;
+
+  static String path(uint8_t segment) { return "/hist/" + String(segment); }
+
+  File& reader(uint8_t segment) {
+    if (readSegment_ != segment) {
+      readFile_.close();
+      String p = path(segment);
+      readFile_    = LittleFS.exists(p) ? LittleFS.open(p, "r") : File();
+      readSegment_ = segment;
+    }
+    return readFile_;
+  }
+
+  void dropReader(uint8_t segment) {
+    if (readSegment_ != segment) return;
+    readFile_.close();
+    readSegment_ = -1;
+  }
+
+public:
+  LittleFsHistoryStore() : readSegment_(-1) {}
+
+  bool begin() {
+    if (!LittleFS.begin(true)) return false;
+    return LittleFS.exists("/hist") || LittleFS.mkdir("/hist");
+  }
+
+  uint32_t size(uint8_t segment) override {
+    File& f = reader(segment);
+    return f ? f.size() : 0;
+  }
+
+  size_t read(uint8_t segment, uint32_t offset, uint8_t* buf, size_t len) override {
+    File& f = reader(segment);
+    if (!f || !f.seek(offset)) return 0;
+    return f.read(buf, len);
+  }
+
+  bool append(uint8_t segment, const uint8_t* buf, size_t len) override {
+    dropReader(segment);
+    File f = LittleFS.open(path(segment), "a");
+    if (!f) return false;
+    bool ok = f.write(buf, len) == len;
+    f.close();
+    return ok;
+  }
+
+  bool erase(uint8_t segment) override {
+    dropReader(segment);
+    String p = path(segment);
+    return !LittleFS.exists(p) || LittleFS.remove(p);
+  }
+};
+
+// Keeps one-minute summaries of the control samples (count, min, max, mean,
+// valve seconds) for HISTORY_SEGMENTS - 1 days and answers range requests.
+// cmd/history takes "<from>[,<to>[,<step>[,<id>]]]": epoch seconds, or
+// seconds before now when <= 0 (to defaults to now, exclusive); step > 0
+// merges records into buckets of that many seconds from <from>. The answer
+// streams on history/<id> (id defaults to 0) as chunks of u8 format, u8
+// flags (bit 0: last chunk), u16 record count, u32 chunk number, then 14-byte
+// records (lib/historyStore layout), one chunk per loop() pass; a new request
+// replaces the running one. "end <id> <records> <chunks>" or
+// "error <id> <reason>" follows on history/status.
+class HistoryService {
+  LittleFsHistoryStore files_;
+  historyStore  store_;
+  historyQuery  query_;
+  rollupTier    minute_;
+  uint32_t      seen_;            // last control sample added
+  uint32_t      writeErrors_;
+  uint32_t      queries_;
+  bool          ready_;
+  // Range request being streamed
+  historyStore::record chunk_[HISTORY_CHUNK_RECORDS];
+  size_t        chunkCount_;
+  bool          chunkReady_;      // filled, not yet taken by the broker
+  uint32_t      chunkSeq_;
+  uint32_t      sent_;
+  String        id_;
+  bool          active_;
+
+public:
+  HistoryService()
+    : store_(files_, HISTORY_SEGMENTS, HISTORY_SEGMENT_RECORDS), query_(store_), minute_(HISTORY_WINDOW_SEC),
+      seen_(0), writeErrors_(0), queries_(0), ready_(false), chunkCount_(0), chunkReady_(false), chunkSeq_(0),
+      sent_(0), active_(false) {}
+
+  void begin() {
+    ready_ = files_.begin();
+    if (ready_) store_.load();
+    else        LOG_ERROR("history: LittleFS unavailable");
+
+    mqttSrv.onCommand("history", [this](const uint8_t* p, unsigned int n) {
+      String arg;
+      for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+      String field[4];
+      for (int i = 0, pos = 0; i < 4 && pos <= (int)arg.length(); ++i) {
+        int comma = arg.indexOf(',', pos);
+        if (comma < 0) comma = arg.length();
+        field[i] = arg.substring(pos, comma);
+        pos = comma + 1;
+      }
+      request(field[0].toInt(), field[1].toInt(), field[2].toInt(), field[3].length() ? field[3] : String("0"));
+    });
+  }
+
+  // Feed the minute window from the control samples, then send the next chunk
+  void handle() {
+    if (!ready_) return;
+    addSample();
+    transfer();
+  }
+
+  bool busy() const { return active_; }
+
+  uint32_t records() const     { return store_.records(); }
+  uint32_t capacity() const    { return store_.capacity(); }
+  uint32_t oldest() const      { return store_.first(); }
+  uint32_t refused() const     { return store_.refused(); }
+  uint32_t writeErrors() const { return writeErrors_; }
+  uint32_t queries() const     { return queries_; }
+
+private:
+  void request(int32_t from, int32_t to, int32_t step, const String& id) {
+    uint32_t now = timeCtrl.getEpoch();
+    active_ = false;
+    if (!ready_ || id.indexOf('#') >= 0 || id.indexOf('+') >= 0 || step < 0) {
+      mqttSrv.publish("history/status", "error " + id + (ready_ ? " request" : " storage"));
+      return;
+    }
+    if ((from <= 0 || to <= 0) && now == 0) {
+      mqttSrv.publish("history/status", "error " + id + " time");   // relative range before NTP
+      return;
+    }
+    uint32_t begin = from <= 0 ? now + from : (uint32_t)from;
+    uint32_t end   = to <= 0 ? now + to : (uint32_t)to;
+    query_.begin(begin, end, step);
+    queries_++;
+    id_         = id;
+    chunkSeq_   = 0;
+    sent_       = 0;
+    chunkReady_ = false;
+    active_     = true;
+  }
+
+  // Records start when the clock is set; the sample time is the control
+  // task's, not the (later) moment loop() sees it
+  void addSample() {
+    ControlSnapshot c = controlTask.snapshot();
+    if (c.samples == seen_) return;
+    seen_ = c.samples;
+    time_t epoch = timeCtrl.getEpoch();
+    if (epoch == 0) return;
+    uint32_t t = (uint32_t)epoch - (millis() - c.sampleMs) / 1000;
+    if (!minute_.add(t, (uint16_t)c.moisture, c.watering ? 1 : 0)) return;
+
+    const rollupStats& w = minute_.closed();
+    historyStore::record r;
+    r.start    = w.start;
+    r.count    = w.count > 0xFFFF ? 0xFFFF : w.count;
+    r.min      = w.min;
+    r.max      = w.max;
+    r.mean     = (uint16_t)((w.sum + w.count / 2) / w.count);
+    r.valveSec = w.valveOnSec > 0xFFFF ? 0xFFFF : w.valveOnSec;
+    uint32_t refused = store_.refused();
+    if (!store_.append(r) && store_.refused() == refused) writeErrors_++;
+  }
+
+  // One chunk per pass; a chunk the broker did not take is sent again
+  void transfer() {
+    if (!active_ || !mqttSrv.connected()) return;
+    if (!chunkReady_) {
+      chunkCount_ = query_.fill(chunk_, HISTORY_CHUNK_RECORDS, HISTORY_SCAN_BUDGET);
+      chunkReady_ = chunkCount_ > 0 || query_.done();   // a long bucket can take several passes
+      if (!chunkReady_) return;
+    }
+
+    uint8_t buf[8 + HISTORY_CHUNK_RECORDS * historyStore::RECORD_BYTES];
+    buf[0] = HISTORY_FORMAT;
+    buf[1] = query_.done() ? 1 : 0;
+    buf[2] = chunkCount_ & 0xFF;
+    buf[3] = chunkCount_ >> 8;
+    memcpy(buf + 4, &chunkSeq_, 4);   // little endian
+    for (size_t i = 0; i < chunkCount_; ++i) {
+      historyStore::encode(buf + 8 + i * historyStore::RECORD_BYTES, chunk_[i]);
+    }
+    String sub = "history/" + id_;
+    if (!mqttSrv.publish(sub.c_str(), buf, 8 + chunkCount_ * historyStore::RECORD_BYTES)) return;
+
+    sent_      += chunkCount_;
+    chunkSeq_++;
+    chunkReady_ = false;
+    if (!query_.done()) return;
+    active_ = false;
+    mqttSrv.publish("history/status", "end " + id_ + " " + String(sent_) + " " + String(chunkSeq_));
+  }
+};
+
+HistoryService historySrv;
+#endif
+
+// ----------------------- Deep-Sleep Duty Cycle -----------------------
+#if FEATURE_DEEP_SLEEP
+// Everything a timer wake needs lives in RTC memory so it can sample, decide
+// and (every few wakes) publish without scans or DNS, and without DHCP while
+// the last lease lasts. The WiFi password is read from NVS, not kept here.
+struct RtcSample {
+  uint32_t epoch;
+  uint16_t moisture;
+  uint8_t  valve;
+};
+
+struct RtcState {
+  uint32_t  magic;
+  // Configuration captured when the duty cycle started
+  uint32_t  intervalSec;
+  uint8_t   publishEvery;     // wakes per MQTT batch
+  int32_t   threshold;
+  uint32_t  waterMs;
+  uint8_t   pulses;           // cycle and soak
+  uint32_t  soakMs;
+  int32_t   target;
+  // Fault lockout and the detector between wakes
+  uint8_t   fault;
+  uint8_t   faultChecks;
+  bool      faultAlert;
+  faultDetector::state faults;
+  // Network parameters for a scan-free, DHCP-free reconnect
+  bool      networkValid;
+  char      ssid[33];         // checked against the saved list on a wake
+  uint8_t   networkIndex;     // into wifiManager's saved list; the password stays in NVS
+  uint8_t   bssid[6];
+  uint8_t   channel;
+  uint32_t  ip, gateway, subnet, dns;
+  uint32_t  leaseUntil;       // epoch when the DHCP lease of ip expires, 0 = unknown
+  uint32_t  brokerIp;
+  uint16_t  brokerPort;
+  char      site[32];
+  // TLS: broker certificate pinned on the full boot and the session to resume
+  bool      tls;
+#if FEATURE_TLS
+  uint8_t   tlsPin[32];
+  uint16_t  tlsSessionLen;
+  uint8_t   tlsSession[TLS_SESSION_BYTES];
+#endif
+  uint8_t   netFailures;
+  uint32_t  lastNtpEpoch;
+  // Watering windows, evaluated without NVS on each wake
+  int32_t   utcOffset;
+  uint8_t   ruleCount;
+  wateringSchedule::rule rules[wateringSchedule::MAX_RULES];
+  // Samples waiting for the next batch
+  uint8_t   sampleCount;
+  uint32_t  samplesDropped;
+  RtcSample samples[PACKED_BLOCK_SAMPLES];
+  // Awake time of timer wakes
+  uint32_t  wakes;
+  uint32_t  awakeLastMs;
+  uint32_t  awakeMaxMs;
+  uint64_t  awakeTotalMs;
+};
+
+static const uint32_t RTC_STATE_MAGIC = 0x32594344;   // "DCY2", bumped when the layout changes
+RTC_DATA_ATTR static RtcState rtcState;
+
+class SleepController {
+  Preferences prefs_;
+  bool        prefsOpen_;
+  uint32_t    intervalSec_;       // 0 = always on
+  uint8_t     publishEvery_;
+  uint32_t    onlineSinceMs_;     // when a full boot first had MQTT and time
+  uint32_t    nextScheduleEdge_;  // wake early for a watering window, 0 if none
+
+public:
+  SleepController()
+    : prefsOpen_(false), intervalSec_(0), publishEvery_(1), onlineSinceMs_(0), nextScheduleEdge_(0) {}
+
+  // Load the duty cycle settings and register cmd/sleep (full boot only)
+  void begin() {
+    openPrefs();
+    intervalSec_  = prefs_.getULong("interval", 0);
+    publishEvery_ = prefs_.getUChar("batch", 1);
+    registerCommand();
+  }
+
+  // Change and save the duty cycle; interval 0 keeps the device awake
+  void configure(uint32_t intervalSec, uint8_t publishEvery) {
+    if (publishEvery == 0) publishEvery = 1;
+    if (publishEvery > PACKED_BLOCK_SAMPLES) publishEvery = PACKED_BLOCK_SAMPLES;
+    if (intervalSec == intervalSec_ && publishEvery == publishEvery_) return;  // retained cmd/sleep on every wake
+
+    intervalSec_  = intervalSec;
+    publishEvery_ = publishEvery;
+    openPrefs();
+    prefs_.putULong("interval", intervalSec_);
+    prefs_.putUChar("batch", publishEvery_);
+    if (rtcState.magic == RTC_STATE_MAGIC) {
+      rtcState.intervalSec  = intervalSec_;
+      rtcState.publishEvery = publishEvery_;
+      if (intervalSec_ == 0) rtcState.magic = 0;
+    }
+  }
+
+  bool enabled() const {
+    return intervalSec_ != 0;
+  }
+
+  // Called first in setup(). On a timer wake with valid RTC state this runs the
+  // whole cycle and goes back to sleep; it returns only if a full boot is needed.
+  bool resumeFromDeepSleep() {
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER || rtcState.magic != RTC_STATE_MAGIC) {
+      return false;
+    }
+    intervalSec_  = rtcState.intervalSec;
+    publishEvery_ = rtcState.publishEvery;
+
+    irrigationCtrl.beginFromRetained(VALVE_OUTPUT_PIN, MOISTURE_INPUT_PIN,
+                                     rtcState.threshold, rtcState.waterMs,
+                                     rtcState.pulses, rtcState.soakMs, rtcState.target);
+    // The detector's clock is approximate: wakes at a window edge come early
+    irrigationCtrl.restoreFaults(rtcState.fault, rtcState.faultChecks, rtcState.faultAlert, rtcState.faults,
+                                 intervalSec_ * 1000, rtcState.wakes * intervalSec_ * 1000);
+    wateringSchedule schedule;
+    schedule.load(rtcState.rules, rtcState.ruleCount);
+    schedule.setUtcOffset(rtcState.utcOffset);
+    schedule.poll(epochNow());
+    nextScheduleEdge_ = schedule.nextChange();
+
+    bool watered;
+    int moisture = irrigationCtrl.runSingleCycle(watered, schedule.allowed(), schedule.forced());
+    storeSample(moisture, watered);
+    rtcState.wakes++;
+    rtcState.fault  = irrigationCtrl.fault();
+    rtcState.faults = irrigationCtrl.faults().get();
+
+    if (rtcState.sampleCount >= rtcState.publishEvery || watered || irrigationCtrl.faultAlertPending()) {
+      if (!rtcState.networkValid) return false;   // a full boot re-learns the network and publishes
+      registerCommand();
+      if (fastConnect()) {
+        rtcState.netFailures = 0;
+        publishPending();
+        publishAwakeStats();
+        handleFaultAlert();
+        keepTlsSession();
+        uint32_t t0 = millis();
+        while (millis() - t0 < FAST_WAKE_CMD_MS) mqttSrv.poll();   // retained cmd/sleep
+        if (!enabled()) ESP.restart();            // switched to always-on
+        resyncClockIfDue();
+        mqttSrv.publish(MQTT_STATUS_TOPIC, "sleeping", true);
+        mqttSrv.disconnect();
+      } else if (++rtcState.netFailures >= FAST_WAKE_MAX_FAILS) {
+        rtcState.networkValid = false;
+      }
+    }
+    rtcState.faultAlert = irrigationCtrl.faultAlertPending();   // retried on the next wake
+    sleepNow(true);
+    return true;   // not reached
+  }
+
+  // Called from loop() on a full boot: flush pending samples, then sleep once
+  // the device has been reachable long enough or commissioning timed out.
+  void handle() {
+    if (!enabled() || busy()) return;
+
+    bool online = mqttSrv.connected() && timeCtrl.getEpoch() != 0;
+    if (online && onlineSinceMs_ == 0) {
+      onlineSinceMs_ = millis() | 1;
+      if (rtcState.magic == RTC_STATE_MAGIC) publishPending();
+    }
+    bool ready = online && millis() - onlineSinceMs_ >= SLEEP_CMD_WINDOW_MS;
+    if (ready || millis() >= SLEEP_COMMISSION_MS) {
+      controlTask.halt();   // irrigationCtrl is ours from here to the sleep
+      enterDutyCycle();
+      mqttSrv.publish(MQTT_STATUS_TOPIC, "sleeping", true);
+      mqttSrv.disconnect();
+      sleepNow(false);
+    }
+  }
+
+private:
+  void openPrefs() {
+    if (!prefsOpen_) prefsOpen_ = prefs_.begin("sleep_cfg", false);
+  }
+
+  // Work that must not be cut short by sleeping
+  bool busy() {
+    ControlSnapshot c = controlTask.snapshot();
+    if (c.watering || c.tracing) return true;
+#if FEATURE_OTA
+    if (ota.active()) return true;
+#endif
+#if FEATURE_LIVE_STREAM
+    if (liveSrv.clients()) return true;
+#endif
+#if FEATURE_CONSOLE
+    if (adcStream.active()) return true;
+#endif
+#if FEATURE_HISTORY
+    if (historySrv.busy()) return true;
+#endif
+    return false;
+  }
+
+  // cmd/sleep: "off" or "<intervalSec>[,<wakesPerBatch>]"
+  void registerCommand() {
+    mqttSrv.onCommand("sleep", [this](const uint8_t* p, unsigned int n) {
+      String arg;
+      for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+      if (arg == "off") {
+        configure(0, 1);
+        return;
+      }
+      int comma = arg.indexOf(',');
+      uint32_t interval = arg.toInt();
+      uint8_t  batch    = comma > 0 ? arg.substring(comma + 1).toInt() : 1;
+      if (interval > 0) configure(interval, batch);
+    });
+  }
+
+  static uint32_t epochNow() {
+    time_t now = time(nullptr);   // the RTC keeps system time through deep sleep
+    return now > 1600000000 ? (uint32_t)now : 0;
+  }
+
+  void storeSample(int moisture, bool watered) {
+    if (rtcState.sampleCount >= PACKED_BLOCK_SAMPLES) {
+      memmove(rtcState.samples, rtcState.samples + 1, sizeof(RtcSample) * (PACKED_BLOCK_SAMPLES - 1));
+      rtcState.sampleCount--;
+      rtcState.samplesDropped++;
+    }
+    rtcState.samples[rtcState.sampleCount++] = {epochNow(), (uint16_t)moisture, (uint8_t)watered};
+  }
+
+  // Publish the retained samples as one telemetryCodec block
+  void publishPending() {
+    uint8_t buf[PACKED_BLOCK_BYTES];
+    telemetryEncoder block(buf, sizeof(buf));
+    for (uint8_t i = 0; i < rtcState.sampleCount; ++i) {
+      const RtcSample& s = rtcState.samples[i];
+      if (s.epoch != 0) block.append(s.epoch, s.moisture, s.valve);   // unsynced samples have no time base
+    }
+    if (block.count() == 0 || mqttSrv.publish(MQTT_PACKED_TOPIC, block.data(), block.size())) {
+      rtcState.sampleCount = 0;
+    }
+  }
+
+  void publishAwakeStats() {
+    String s = "wakes=" + String(rtcState.wakes);
+    s += ",awake_ms=" + String(rtcState.awakeLastMs);
+    s += ",awake_max_ms=" + String(rtcState.awakeMaxMs);
+    s += ",awake_avg_ms=" + String(rtcState.wakes > 1 ? (uint32_t)(rtcState.awakeTotalMs / (rtcState.wakes - 1)) : 0);
+    s += ",samples_dropped=" + String(rtcState.samplesDropped);
+#if FEATURE_TLS
+    if (rtcState.tls) {
+      s += ",tls_ms=" + String(mqttSrv.tls().lastHandshakeMs());
+      s += ",tls_resumed=" + String(mqttSrv.tls().lastResumed());
+    }
+#endif
+    mqttSrv.publish("stats", s);
+  }
+
+  // Reconnect with the cached BSSID/channel and, while its lease lasts, the
+  // last DHCP address as a static IP; then MQTT by IP
+  bool fastConnect() {
+    netMgr.loadSavedNetworks();
+    int idx = rtcState.networkIndex;
+    if (idx >= netMgr.getNumberOfSavedNetworks() || netMgr.getSavedNetwork(idx) != rtcState.ssid) {
+      rtcState.networkValid = false;   // the list changed, a full boot picks the network again
+      return false;
+    }
+    uint32_t now = epochNow();
+    bool leased = now != 0 && now + LEASE_MARGIN_SEC < rtcState.leaseUntil;
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    if (leased) {
+      WiFi.config(IPAddress(rtcState.ip), IPAddress(rtcState.gateway),
+                  IPAddress(rtcState.subnet), IPAddress(rtcState.dns));
+    }
+    WiFi.begin(rtcState.ssid, netMgr.getSavedPassword(idx).c_str(), rtcState.channel, rtcState.bssid);
+    uint32_t t0 = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+      if (millis() - t0 > (leased ? FAST_WAKE_NET_MS : FAST_WAKE_DHCP_MS)) return false;
+      delay(2);
+    }
+    if (!leased) rememberAddress();   // the following wakes reuse the new lease
+    mqttSrv.beginRetained(IPAddress(rtcState.brokerIp), rtcState.brokerPort, rtcState.site, rtcState.tls);
+#if FEATURE_TLS
+    if (rtcState.tls) {
+      mqttSrv.tls().setPinnedCert(rtcState.tlsPin);
+      mqttSrv.tls().loadSession(rtcState.tlsSession, rtcState.tlsSessionLen);
+    }
+#endif
+    return mqttSrv.connectNow();
+  }
+
+  // The broker may have issued a new ticket; keep the latest for the next wake
+  void keepTlsSession() {
+#if FEATURE_TLS
+    if (!rtcState.tls) return;
+    rtcState.tlsSessionLen = mqttSrv.tls().saveSession(rtcState.tlsSession, sizeof(rtcState.tlsSession));
+#endif
+  }
+
+  void resyncClockIfDue() {
+    uint32_t now = epochNow();
+    if (now != 0 && now - rtcState.lastNtpEpoch < NTP_RESYNC_SEC) return;
+    timeCtrl.begin();
+    uint32_t t0 = millis();
+    while (sntp_get_sync_status() != SNTP_SYNC_STATUS_COMPLETED && millis() - t0 < 1500) delay(10);
+    if (sntp_get_sync_status() == SNTP_SYNC_STATUS_COMPLETED) rtcState.lastNtpEpoch = epochNow();
+  }
+
+  // Snapshot configuration and network parameters before the first sleep
+  void enterDutyCycle() {
+    if (rtcState.magic != RTC_STATE_MAGIC) {
+      memset(&rtcState, 0, sizeof(rtcState));
+      rtcState.magic = RTC_STATE_MAGIC;
+    }
+    rtcState.intervalSec  = intervalSec_;
+    rtcState.publishEvery = publishEvery_;
+    rtcState.threshold    = irrigationCtrl.getThreshold();
+    rtcState.waterMs      = irrigationCtrl.getDelay();
+    rtcState.pulses       = irrigationCtrl.getPulses();
+    rtcState.soakMs       = irrigationCtrl.getSoakMs();
+    rtcState.target       = irrigationCtrl.getTarget();
+    rtcState.fault        = irrigationCtrl.fault();
+    rtcState.faultChecks  = irrigationCtrl.faults().getChecks();
+    rtcState.faultAlert   = irrigationCtrl.faultAlertPending();
+    rtcState.faults       = faultDetector::state();   // the limits change with the sample rate
+    rtcState.utcOffset    = timeCtrl.getUtcOffset();
+    rtcState.ruleCount    = scheduleSrv.schedule().count();
+    memcpy(rtcState.rules, scheduleSrv.schedule().rules(), sizeof(wateringSchedule::rule) * rtcState.ruleCount);
+    nextScheduleEdge_     = scheduleSrv.schedule().nextChange();
+    if (timeCtrl.getEpoch() != 0) rtcState.lastNtpEpoch = epochNow();
+
+    IPAddress brokerIp;
+    uint16_t  brokerPort;
+    rtcState.networkValid = WiFi.status() == WL_CONNECTED && mqttSrv.resolvedBroker(brokerIp, brokerPort);
+    rtcState.netFailures = 0;
+    if (!rtcState.networkValid) return;
+    int idx = netMgr.getSavedNetworkIndex(WiFi.SSID());
+    if (idx < 0) {
+      rtcState.networkValid = false;   // connected to a network that is not in the list
+      return;
+    }
+    strlcpy(rtcState.ssid, WiFi.SSID().c_str(), sizeof(rtcState.ssid));
+    rtcState.networkIndex = idx;
+    strlcpy(rtcState.site, mqttSrv.site().c_str(), sizeof(rtcState.site));
+    memcpy(rtcState.bssid, WiFi.BSSID(), sizeof(rtcState.bssid));
+    rtcState.channel    = WiFi.channel();
+    rememberAddress();
+    rtcState.brokerIp   = (uint32_t)brokerIp;
+    rtcState.brokerPort = brokerPort;
+    rtcState.tls        = mqttSrv.usesTls();
+#if FEATURE_TLS
+    if (rtcState.tls && !mqttSrv.tls().peerFingerprint(rtcState.tlsPin)) {
+      rtcState.networkValid = false;   // nothing to authenticate the broker with on a wake
+      return;
+    }
+#endif
+    keepTlsSession();
+  }
+
+  // Address, gateway and DNS from DHCP, and when the lease runs out
+  void rememberAddress() {
+    rtcState.ip         = (uint32_t)WiFi.localIP();
+    rtcState.gateway    = (uint32_t)WiFi.gatewayIP();
+    rtcState.subnet     = (uint32_t)WiFi.subnetMask();
+    rtcState.dns        = (uint32_t)WiFi.dnsIP();
+    uint32_t left = leaseLeftSec();
+    uint32_t now  = epochNow();
+    rtcState.leaseUntil = left && now ? now + left : 0;
+  }
+
+  // Seconds left on the station's DHCP lease, 0 if unknown (no DHCP, not bound)
+  static uint32_t leaseLeftSec() {
+    esp_netif_t* sta = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    struct netif* nif = sta ? (struct netif*)esp_netif_get_netif_impl(sta) : nullptr;
+    struct dhcp* d = nif ? netif_dhcp_data(nif) : nullptr;
+    if (!d || d->state != DHCP_STATE_BOUND) return 0;
+    uint32_t used = (uint32_t)d->lease_used * DHCP_COARSE_TIMER_SECS;
+    return d->offered_t0_lease > used ? d->offered_t0_lease - used : 0;
+  }
+
+  // Close the valve, latch it, and sleep for the rest of the interval or
+  // until the next watering window edge, whichever comes first
+  void sleepNow(bool timerWake) {
+    irrigationCtrl.prepareForSleep();
+    uint32_t awakeMs = millis();
+    if (timerWake) {
+      rtcState.awakeLastMs   = awakeMs;
+      rtcState.awakeTotalMs += awakeMs;
+      if (awakeMs > rtcState.awakeMaxMs) rtcState.awakeMaxMs = awakeMs;
+    }
+    binLog::drain(Serial);
+    uint64_t intervalUs = (uint64_t)intervalSec_ * 1000000ULL;
+    uint64_t awakeUs    = (uint64_t)awakeMs * 1000ULL;
+    uint32_t now        = epochNow();
+    if (nextScheduleEdge_ > now && now != 0) {
+      uint64_t edgeUs = (uint64_t)(nextScheduleEdge_ - now) * 1000000ULL + awakeUs;
+      if (edgeUs < intervalUs) intervalUs = edgeUs;
+    }
+    esp_sleep_enable_timer_wakeup(awakeUs + 1000000ULL < intervalUs ? intervalUs - awakeUs : 1000000ULL);
+    esp_deep_sleep_start();
+  }
+};
+
+SleepController sleepCtrl;
+#endif
+
+// ----------------------- Delta OTA Commands -----------------------
+#if FEATURE_OTA
+// cmd/ota/begin carries the 80-byte patch header, cmd/ota/chunk a little
+// endian u32 patch offset followed by data; progress goes to ota/status.
+static void setupOtaCommands() {
+  mqttSrv.onCommand("ota/begin", [](const uint8_t* p, unsigned int n) {
+    if (ota.begin(p, n)) mqttSrv.publish("ota/status", "ack 0");
+    else                 mqttSrv.publish("ota/status", String("error ") + ota.lastError());
+  });
+
+  mqttSrv.onCommand("ota/chunk", [](const uint8_t* p, unsigned int n) {
+    if (n < 4) return;
+    uint32_t offset = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    if (!ota.chunk(offset, p + 4, n - 4)) {
+      mqttSrv.publish("ota/status", String("error ") + ota.lastError());
+    } else if (ota.completed()) {
+      mqttSrv.publish("ota/status", "done");
+      rebootDelay.start();
+    } else {
+      mqttSrv.publish("ota/status", "ack " + String(ota.nextOffset()));
+    }
+  });
+
+  mqttSrv.onCommand("ota/abort", [](const uint8_t*, unsigned int) {
+    ota.abort();
+    mqttSrv.publish("ota/status", "aborted");
+  });
+}
+#endif
+
+// ----------------------- Telemetry Commands -----------------------
+// cmd/format takes "ascii", "packed", "rollup" joined by '+' ("both" = ascii+packed),
+// cmd/raw streams ASCII samples for N seconds, cmd/rollup sets "<short>,<long>" seconds,
+// cmd/rbe takes "off", "on" or "<deadband>[,<heartbeat seconds>]" (report by
+// exception); the active setting is echoed on rbe (retained)
+static void publishReportByException() {
+  const reportFilter& f = mqttSrv.reportByException();
+  String s = f.enabled() ? String(f.deadband()) + "," + String(f.heartbeatMs() / 1000) : String("off");
+  mqttSrv.publish("rbe", s, true);
+}
+
+static void setupTelemetryCommands() {
+  mqttSrv.onCommand("format", [](const uint8_t* p, unsigned int n) {
+    String fmt;
+    for (unsigned int i = 0; i < n; ++i) fmt += char(p[i]);
+    uint8_t mask = 0;
+    if (fmt.indexOf("ascii") >= 0)  mask |= TELEMETRY_ASCII;
+    if (fmt.indexOf("packed") >= 0) mask |= TELEMETRY_PACKED;
+    if (fmt.indexOf("rollup") >= 0) mask |= TELEMETRY_ROLLUP;
+    if (fmt == "both")              mask  = TELEMETRY_ASCII | TELEMETRY_PACKED;
+    if (mask) mqttSrv.setFormat(mask);
+  });
+
+  mqttSrv.onCommand("raw", [](const uint8_t* p, unsigned int n) {
+    String arg;
+    for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+    mqttSrv.streamRaw(arg.toInt());
+  });
+
+  mqttSrv.onCommand("rollup", [](const uint8_t* p, unsigned int n) {
+    String arg;
+    for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+    int comma = arg.indexOf(',');
+    if (comma > 0) mqttSrv.setRollupWindows(arg.toInt(), arg.substring(comma + 1).toInt());
+  });
+
+  mqttSrv.onCommand("rbe", [](const uint8_t* p, unsigned int n) {
+    String arg;
+    for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+    const reportFilter& f = mqttSrv.reportByException();
+    uint32_t heartbeatSec = f.heartbeatMs() / 1000;
+    if (arg == "off") {
+      mqttSrv.setReportByException(false, f.deadband(), heartbeatSec);
+    } else if (arg == "on") {
+      mqttSrv.setReportByException(true, f.deadband(), heartbeatSec);
+    } else {
+      int comma = arg.indexOf(',');
+      if (comma > 0) heartbeatSec = arg.substring(comma + 1).toInt();
+      mqttSrv.setReportByException(true, arg.toInt(), heartbeatSec);
+    }
+    publishReportByException();
+  });
+}
+
+// ----------------------- Schedule Commands -----------------------
+// cmd/schedule replaces the rules ("" clears them), cmd/dst sets the daylight
+// saving offset in seconds; the active rules are echoed on schedule (retained)
+static void setupScheduleCommands() {
+  mqttSrv.onCommand("schedule", [](const uint8_t* p, unsigned int n) {
+    String text;
+    for (unsigned int i = 0; i < n; ++i) text += char(p[i]);
+    if (!scheduleSrv.set(text)) {
+      mqttSrv.publish("schedule/error", "invalid: " + text);
+      return;
+    }
+    mqttSrv.publish("schedule", scheduleSrv.describe(), true);
+  });
+
+  mqttSrv.onCommand("dst", [](const uint8_t* p, unsigned int n) {
+    String arg;
+    for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+    scheduleSrv.setDaylightOffset(arg.toInt());
+  });
+}
+
+// ----------------------- Watering Commands -----------------------
+// cmd/pulses sets cycle and soak as "<pulses>,<soak seconds>[,<target>]"
+// ("1" = continuous, target -1 or omitted = the threshold); the active
+// setting is echoed on pulses (retained). cmd/adaptive takes "on[,<band>]",
+// "off" or "reset" (forget the learned soil response).
+static void publishPulses() {
+  ControlSnapshot c = controlTask.snapshot();
+  mqttSrv.publish("pulses", String(c.pulses) + "," + String(c.soakMs / 1000) + "," + String(c.target), true);
+}
+
+static void setupWateringCommands() {
+  mqttSrv.onCommand("pulses", [](const uint8_t* p, unsigned int n) {
+    String arg;
+    for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+    int first  = arg.indexOf(',');
+    int second = first > 0 ? arg.indexOf(',', first + 1) : -1;
+    uint32_t soakSec = first > 0 ? arg.substring(first + 1).toInt() : controlTask.snapshot().soakMs / 1000;
+    int      target  = second > 0 ? arg.substring(second + 1).toInt() : -1;
+    controlTask.post({ControlCommand::PULSES, (int32_t)arg.toInt(), soakSec * 1000, target});
+    publishPulses();
+  });
+
+  mqttSrv.onCommand("adaptive", [](const uint8_t* p, unsigned int n) {
+    String arg;
+    for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+    int comma = arg.indexOf(',');
+    if (arg == "reset") {
+      controlTask.post({ControlCommand::RESET_RESPONSE, 0, 0, 0});
+    } else {
+      int band = comma > 0 ? arg.substring(comma + 1).toInt() : controlTask.snapshot().band;
+      controlTask.post({ControlCommand::ADAPTIVE, arg.startsWith("on"), 0, band});
+    }
+  });
+}
+
+// ----------------------- Trace Commands -----------------------
+#if FEATURE_TRACE
+// cmd/trace: "start [minutes]", "stop" or "get [offset]". A get publishes the
+// stored trace on trace/data as u32 offset + up to TRACE_CHUNK_BYTES, one chunk
+// per loop pass, then "end <size>" on trace/status.
+static uint32_t traceSendOffset = 0;
+static uint32_t traceSendSize   = 0;
+
+static void handleTraceCommand(const String& action, uint32_t value, Print& reply) {
+  if (action == "start") {
+    controlTask.post({ControlCommand::TRACE_START, 0, value ? value : 60, 0});
+    bool ok = controlTask.snapshot().tracing;
+    reply.println(ok ? "trace started" : "trace error: cannot open file");
+  } else if (action == "stop") {
+    controlTask.post({ControlCommand::TRACE_STOP, 0, 0, 0});
+    reply.println("trace stopped " + String(traceRec.size()));
+  } else {
+    reply.println("trace size " + String(traceRec.size()) + (controlTask.snapshot().tracing ? " (capturing)" : ""));
+  }
+}
+
+// Adapter so command replies end up on trace/status
+class TraceStatusPrint : public Print {
+  String line_;
+public:
+  size_t write(uint8_t c) override {
+    if (c == '\n') {
+      mqttSrv.publish("trace/status", line_);
+      line_ = "";
+    } else if (c != '\r') {
+      line_ += char(c);
+    }
+    return 1;
+  }
+};
+
+static void setupTraceCommands() {
+  mqttSrv.onCommand("trace", [](const uint8_t* p, unsigned int n) {
+    String arg;
+    for (unsigned int i = 0; i < n; ++i) arg += char(p[i]);
+    int space = arg.indexOf(' ');
+    String action = space > 0 ? arg.substring(0, space) : arg;
+    uint32_t value = space > 0 ? arg.substring(space + 1).toInt() : 0;
+
+    if (action == "get") {
+      traceSendSize   = traceRec.size();
+      traceSendOffset = min(value, traceSendSize);
+      mqttSrv.publish("trace/status", "size " + String(traceSendSize));
+      return;
+    }
+    TraceStatusPrint reply;
+    handleTraceCommand(action, value, reply);
+  });
+}
+
+// Send the next chunk of a requested trace, if any
+static void handleTraceTransfer() {
+  if (traceSendSize == 0 || !mqttSrv.connected()) return;
+
+  uint8_t chunk[4 + TRACE_CHUNK_BYTES];
+  size_t n = traceRec.read(traceSendOffset, chunk + 4, TRACE_CHUNK_BYTES);
+  if (n == 0) {
+    mqttSrv.publish("trace/status", "end " + String(traceSendSize));
+    traceSendSize = 0;
+    return;
+  }
+  memcpy(chunk, &traceSendOffset, 4);   // little endian
+  if (mqttSrv.publish("trace/data", chunk, 4 + n)) traceSendOffset += n;
+}
+#endif
+
+// ----------------------- Serial Console -----------------------
+#if FEATURE_CONSOLE
+// Line-based commands on the USB serial port. "trace get" dumps the trace as
+// frames 0xFE 0xB2, u32 offset, u16 length, data; a zero-length frame ends it.
+SimpleCLI shell;
+String    shellLine;
+
+#if FEATURE_TRACE
+static void dumpTraceToSerial() {
+  uint8_t frame[8 + TRACE_CHUNK_BYTES];
+  uint32_t size = traceRec.size(), offset = 0;
+  for (;;) {
+    size_t n = offset < size ? traceRec.read(offset, frame + 8, TRACE_CHUNK_BYTES) : 0;
+    frame[0] = 0xFE;
+    frame[1] = 0xB2;
+    memcpy(frame + 2, &offset, 4);
+    frame[6] = n & 0xFF;
+    frame[7] = n >> 8;
+    Serial.write(frame, 8 + n);
+    if (n == 0) break;
+    offset += n;
+  }
+  Serial.flush();
+}
+#endif
+
+static void setupSerialConsole() {
+#if FEATURE_TRACE
+  Command trace = shell.addCommand("trace", [](cmd* c) {
+    Command command(c);
+    String action = command.getArgument("action").getValue();
+    uint32_t value = command.getArgument("value").getValue().toInt();
+    if (action == "get") dumpTraceToSerial();
+    else                 handleTraceCommand(action, value, Serial);
+  });
+  trace.addPositionalArgument("action", "size");
+  trace.addPositionalArgument("value", "0");
+#endif
+
+  // "stream start [hz]" / "stream stop" / "stream": raw ADC frames, see tools/adcstream
+  Command stream = shell.addCommand("stream", [](cmd* c) {
+    Command command(c);
+    String action = command.getArgument("action").getValue();
+    uint32_t hz = command.getArgument("hz").getValue().toInt();
+    if (action == "start") {
+      if (adcStream.start(hz ? hz : STREAM_DEFAULT_HZ)) Serial.println("stream started " + String(adcStream.rateHz()) + " Hz");
+      else                                              Serial.println("stream error: busy");
+    } else if (action == "stop") {
+      adcStream.stop();
+    } else {
+      Serial.println("stream " + String(adcStream.active() ? "running" : "idle") + ", samples " +
+                     String(adcStream.samples()) + ", dropped " + String(adcStream.dropped()));
+    }
+  });
+  stream.addPositionalArgument("action", "status");
+  stream.addPositionalArgument("hz", "0");
+  shell.setOnError([](cmd_error* e) {
+    CommandError error(e);
+    Serial.println(error.toString());
+  });
+}
+
+// Collect a line from USB and run it
+static void handleSerialConsole() {
+  while (Serial.available()) {
+    char ch = Serial.read();
+    if (ch == '\n' || ch == '\r') {
+      if (shellLine.length()) shell.parse(shellLine);
+      shellLine = "";
+    } else if (shellLine.length() < 64) {
+      shellLine += ch;
+    }
+  }
+}
+#endif
+
+// ----------------------- Diagnostics Commands -----------------------
+// cmd/stats publishes runtime counters as "key=value" pairs on stats
+static void setupDiagnosticsCommands() {
+  mqttSrv.onCommand("stats", [](const uint8_t*, unsigned int) {
+    String s = "uptime_ms=" + String(millis());
+    s += ",wifi_events=" + String(netMgr.getEventsHandled());
+    s += ",wifi_events_dropped=" + String(netMgr.getEventsDropped());
+    s += ",wifi_event_lat_avg_us=" + String(netMgr.getEventLatencyAvgUs());
+    s += ",wifi_event_lat_max_us=" + String(netMgr.getEventLatencyMaxUs());
+    s += ",roams=" + String(netMgr.getRoamCount());
+    s += ",roam_scans=" + String(netMgr.getRoamScans());
+    s += ",rssi=" + String(netMgr.getRssiLast());
+    s += ",rssi_min=" + String(netMgr.getRssiMin());
+    s += ",rssi_max=" + String(netMgr.getRssiMax());
+    s += ",rssi_avg=" + String(netMgr.getRssiAvg());
+    s += ",rssi_low_pct=" + String(netMgr.getRssiLowPercent());
+    s += ",mqtt_first_publish_ms=" + String(mqttSrv.firstPublishMs());
+    s += ",telemetry_seq=" + String(mqttSrv.telemetrySeq());
+    s += ",telemetry_write_us_avg=" + String(mqttSrv.telemetryWriteUsAvg());
+    s += ",telemetry_write_us_max=" + String(mqttSrv.telemetryWriteUsMax());
+    const reportFilter& rbe = mqttSrv.reportByException();
+    s += ",rbe=" + String(rbe.enabled() ? 1 : 0);
+    s += ",rbe_samples=" + String(rbe.offered());
+    s += ",rbe_reported=" + String(rbe.reported());
+    s += ",rbe_suppressed_pct=" + String(rbe.suppressedPermille() / 10.0f, 1);
+    s += ",rbe_deadband_reports=" + String(rbe.count(reportFilter::DEADBAND));
+    s += ",rbe_valve_reports=" + String(rbe.count(reportFilter::STATE));
+    s += ",rbe_heartbeat_reports=" + String(rbe.count(reportFilter::HEARTBEAT));
+    s += ",broker_lookups=" + String(mqttSrv.resolver().lookups());
+    s += ",broker_lookup_ms=" + String(mqttSrv.resolver().lastLookupMs());
+    s += ",mqtt_attempts=" + String(mqttSrv.attempts());
+    s += ",mqtt_reconnects=" + String(mqttSrv.reconnects());
+    s += ",mqtt_reconnect_ms=" + String(mqttSrv.reconnectMs());
+    s += ",mqtt_reconnect_max_ms=" + String(mqttSrv.reconnectMaxMs());
+    s += ",mqtt_backoff_ms=" + String(mqttSrv.backoffWindowMs());
+    ControlSnapshot c = controlTask.snapshot();
+    s += ",journal_writes=" + String(c.journalWrites);
+    s += ",journal_recoveries=" + String(c.journalRecoveries);
+    s += ",water_pulses=" + String(c.pulsesRun);
+    s += ",water_early_stops=" + String(c.earlyStops);
+    s += ",water_last_ms=" + String(c.lastEventMs);
+    s += ",adaptive=" + String(c.adaptive ? 1 : 0);
+    s += ",resp_gain_milli=" + String((int32_t)((int64_t)c.response.gainQ16 * 1000 >> 16));
+    s += ",resp_observations=" + String(c.response.count);
+    s += ",resp_err=" + String(c.response.errAvg);
+    s += ",resp_reliable=" + String(c.responseReliable ? 1 : 0);
+    s += ",fault=" + String(faultDetector::name((faultDetector::fault)c.fault));
+    s += ",fault_checks=" + String(c.faultChecks);
+    s += ",fault_last_drop=" + String(c.faultLastDrop);
+    s += ",ctrl_task=" + String(controlTask.threaded() ? 1 : 0);
+    s += ",ctrl_periods=" + String(c.timing.steps);
+    s += ",ctrl_late_us_avg=" + String(c.timing.steps ? (uint32_t)(c.timing.lateUsTotal / c.timing.steps) : 0);
+    s += ",ctrl_late_us_p99=" + String(c.timing.lateUsPercentile(99));
+    s += ",ctrl_late_us_max=" + String(c.timing.lateUsMax);
+    s += ",ctrl_exec_us_max=" + String(c.timing.execUsMax);
+    s += ",ctrl_overruns=" + String(c.timing.overruns);
+    s += ",ctrl_stack_free=" + String(controlTask.stackFree());
+    s += ",ctrl_cmd_dropped=" + String(controlTask.commandsDropped());
+    s += ",ctrl_snapshot_retries=" + String(controlTask.snapshotRetries());
+#if FEATURE_HISTORY
+    s += ",history_records=" + String(historySrv.records());
+    s += ",history_capacity=" + String(historySrv.capacity());
+    s += ",history_oldest=" + String(historySrv.oldest());
+    s += ",history_refused=" + String(historySrv.refused());
+    s += ",history_write_errors=" + String(historySrv.writeErrors());
+    s += ",history_queries=" + String(historySrv.queries());
+#endif
+#if FEATURE_LIVE_STREAM
+    s += ",live_clients=" + String(liveSrv.clients());
+    s += ",live_frames=" + String(liveSrv.framesSent());
+    s += ",live_frames_dropped=" + String(liveSrv.framesDropped());
+#endif
+#if FEATURE_TLS
+    if (mqttSrv.usesTls()) {
+      tlsClient& tls = mqttSrv.tls();
+      s += ",tls_full=" + String(tls.fullHandshakes());
+      s += ",tls_full_ms=" + String(tls.fullAverageMs());
+      s += ",tls_resumed=" + String(tls.resumedHandshakes());
+      s += ",tls_resumed_ms=" + String(tls.resumedAverageMs());
+      s += ",tls_last_ms=" + String(tls.lastHandshakeMs());
+      s += ",tls_step_max_ms=" + String(tls.maxStepMs());
+      s += ",tls_failures=" + String(tls.failures());
+    }
+#endif
+    mqttSrv.publish("stats", s);
+  });
+
+  // cmd/ctrl: "reset" starts the ctrl_* timing counters over, e.g. before a load test
+  mqttSrv.onCommand("ctrl", [](const uint8_t* p, unsigned int n) {
+    if (n == 5 && memcmp(p, "reset", 5) == 0) controlTask.post({ControlCommand::RESET_TIMING, 0, 0, 0});
+  });
+
+  // cmd/reconnect: drop the MQTT connection and reconnect; "full" forgets the TLS session first
+  mqttSrv.onCommand("reconnect", [](const uint8_t* p, unsigned int n) {
+    mqttSrv.requestReconnect(n == 4 && memcmp(p, "full", 4) == 0);
+  });
+}
+
+// ----------------------- Arduino Setup & Loop -----------------------
+void setup() {
+#if FEATURE_DEEP_SLEEP
+  if (sleepCtrl.resumeFromDeepSleep()) return;                     // Timer wake: sample, maybe publish, sleep
+#endif
+#if FEATURE_CONSOLE
+  Serial.setTxBufferSize(STREAM_TX_BUFFER);                        // Room for raw ADC stream frames
+#endif
+  Serial.begin(SERIAL_SPEED);                                      // Start serial
+  netMgr.begin(true);                                              // Start WiFi
+  netMgr.enableRoaming(ROAM_THRESHOLD_DBM, ROAM_HYSTERESIS_DB);    // Roam before the link drops
+  irrigationCtrl.begin(VALVE_OUTPUT_PIN, MOISTURE_INPUT_PIN);      // Init irrigation
+  mqttSrv.begin();                                                 // Init MQTT
+  netMgr.onGotIp([]() { mqttSrv.onNetworkUp(); });                 // Reconnect as soon as there is an IP
+#if FEATURE_LIVE_STREAM
+  liveSrv.begin();                                                 // Local HTTP/WebSocket live view
+  netMgr.addMDNSService("http", "tcp", 80);                        // Advertise it with the hostname
+#endif
+#if FEATURE_OTA
+  setupOtaCommands();                                              // Register OTA commands
+#endif
+  setupTelemetryCommands();                                        // Register telemetry commands
+  setupDiagnosticsCommands();                                      // Register diagnostics commands
+  setupScheduleCommands();                                         // Register schedule commands
+  setupWateringCommands();                                         // Register cycle-and-soak commands
+  setupFaultCommands();                                            // Register fault lockout commands
+#if FEATURE_TRACE
+  setupTraceCommands();                                            // Register trace capture commands
+#endif
+#if FEATURE_CONSOLE
+  setupSerialConsole();                                            // USB commands
+#endif
+#if FEATURE_DEEP_SLEEP
+  sleepCtrl.begin();                                               // Load duty cycle, register cmd/sleep
+#endif
+  timeCtrl.begin();                                                // Init NTP time
+  scheduleSrv.begin();                                             // Load watering windows
+  controlTask.begin();                                             // Irrigation leaves loop() for its own task
+#if FEATURE_HISTORY
+  historySrv.begin();                                              // Load the history index, register cmd/history
+#endif
+#ifdef BINLOG_BENCHMARK
+  binLog::benchmark(Serial);                                       // Log call cost vs Serial.println
+#endif
 }
 
 void loop() {
   netMgr.handle();         // Handle WiFi events
-  irrigationCtrl.update(); // Run irrigation logic
+  scheduleSrv.handle();    // Apply watering window edges
+  controlTask.handle();    // Run irrigation logic, unless its task does
   mqttSrv.loop();          // Handle MQTT
+  handleFaultAlert();      // Publish a new or cleared fault
+#if FEATURE_LIVE_STREAM
+  liveSrv.handle();        // Stream samples to local viewers
+#endif
   timeCtrl.handle();       // Update time
+#if FEATURE_CONSOLE
+  if (!adcStream.active()) binLog::drain(Serial);   // Logs wait while raw ADC frames are streaming
+  adcStream.handle();      // Send raw ADC frames
+#else
+  binLog::drain(Serial);   // Flush deferred log records if USB has room
+#endif
+#if FEATURE_TRACE
+  handleTraceTransfer();   // Send the next requested trace chunk
+#endif
+#if FEATURE_HISTORY
+  historySrv.handle();     // Store closed minutes, send the next history chunk
+#endif
+#if FEATURE_CONSOLE
+  handleSerialConsole();   // USB commands
+#endif
+#if FEATURE_DEEP_SLEEP
+  sleepCtrl.handle();      // Enter deep sleep when the duty cycle is enabled
+#endif
+
+#if FEATURE_OTA
+  if (rebootDelay.finished()) {
+    controlTask.halt();
+    irrigationCtrl.stopWatering();   // never reboot with the valve open
+    ESP.restart();
+  }
+#endif
 }
\ No newline at end of file
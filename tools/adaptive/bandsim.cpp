@@ -0,0 +1,192 @@
+// Adaptive watering duration (lib/soilResponse) against the fixed duration on
+// the clay bed of tools/common/clayBed.h. Threshold watering is only allowed
+// at night and the daily evapotranspiration varies, so the soil is at a
+// different dryness each evening; the glue between irrigationLogic and the
+// estimator is the one in IrrigationManager::update().
+//
+// For every event the reading RESPONSE_SETTLE_MS after the valve closed is
+// compared with the target band [threshold - band, threshold].
+//
+// Build: g++ -O2 -std=c++17 -I../common -I../../lib/irrigationLogic -I../../lib/soilResponse bandsim.cpp
+//            ../../lib/irrigationLogic/irrigationLogic.cpp ../../lib/soilResponse/soilResponse.cpp -o bandsim
+// Usage: ./bandsim [-d days] [-w waterSec] [-b band] [-p pulses,soakSec] [-v]
+
+#include "clayBed.h"
+#include "irrigationLogic.h"
+#include "soilResponse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmath>
+#include <random>
+
+static const uint32_t TICK_MS            = 100;
+static const uint32_t SAMPLE_MS          = 1000;       // IRRIGATION_SAMPLE_MS
+static const uint32_t RESPONSE_SETTLE_MS = 1800000;    // as in main.cpp
+static const uint32_t ADAPTIVE_MIN_MS    = 2000;
+static const uint32_t ADAPTIVE_MAX       = 3;          // x the fixed duration
+static const double   RATE_MM_S          = 0.04;
+static const int      THRESHOLD          = 2300;
+static const int      NIGHT_FROM_H       = 20;         // threshold watering allowed 20:00-06:00
+static const int      NIGHT_TO_H         = 6;
+
+struct settings
+{
+    double   days     = 60;
+    uint32_t waterMs  = 600000;
+    int      band     = 200;
+    uint8_t  pulses   = 1;
+    uint32_t soakMs   = 0;
+    bool     verbose  = false;
+};
+
+struct result
+{
+    uint32_t events   = 0;
+    uint32_t observed = 0;
+    uint32_t inBand   = 0;
+    uint32_t tooWet   = 0;     // below the band
+    uint32_t tooDry   = 0;     // still above the threshold
+    double   aimErr   = 0;     // sum of |settled - aim|
+    double   appliedMm = 0;
+    double   runoffMm  = 0;
+    double   deepMm    = 0;
+    double   dryHours  = 0;    // reading above threshold + 100
+};
+
+static bool night(uint64_t t)
+{
+    int h = (int)(t / 3600000 % 24);
+    return h >= NIGHT_FROM_H || h < NIGHT_TO_H;
+}
+
+static result run(const settings& s, bool adaptive)
+{
+    irrigationLogic logic(SAMPLE_MS, s.waterMs, THRESHOLD);
+    logic.setPulses(s.pulses, s.soakMs, -1);
+    soilResponse response(RESPONSE_SETTLE_MS);
+    clayBed bed;
+    std::mt19937 rng(5);                            // same weather for both runs
+    std::uniform_real_distribution<double> etDay(2.0, 9.0);
+
+    result   res;
+    bool     valve = false, allowed = true;
+    double   dt = TICK_MS / 1000.0, et = 0;
+    int      aim = THRESHOLD - s.band / 2;
+    uint32_t planned = 0, sampleCount = 0, dryCount = 0;
+    int      startReading = 0;
+    uint64_t end = (uint64_t)(s.days * 86400000.0);
+
+    for (uint64_t t = 0; t < end; t += TICK_MS)
+    {
+        uint32_t now = (uint32_t)t;
+        if (t % 86400000 == 0) et = etDay(rng) / 86400.0 * M_PI;   // mm/s at noon, sine from 6 to 18 h
+
+        // ScheduleService edge: leaving the window cuts a running event short
+        if (night(t) != allowed)
+        {
+            allowed = night(t);
+            if (!allowed && logic.watering())
+            {
+                logic.cancelWatering();
+                response.abort();
+                valve = false;
+            }
+        }
+
+        irrigationLogic::action a = logic.update(now);
+        if (a == irrigationLogic::STOP_WATERING || a == irrigationLogic::PAUSE_WATERING)
+        {
+            valve = false;
+            response.valve(false, now);
+            if (a == irrigationLogic::STOP_WATERING) response.end(now);
+        }
+        if (logic.sampleDue(now))
+        {
+            int m = bed.reading(rng);
+            sampleCount++;
+            if (m > THRESHOLD + 100) dryCount++;
+            if (response.onSample(m, now))
+            {
+                res.observed++;
+                res.aimErr += std::abs(m - aim);
+                if (m > THRESHOLD)                res.tooDry++;
+                else if (m < THRESHOLD - s.band)  res.tooWet++;
+                else                              res.inBand++;
+                if (s.verbose && res.observed <= 15)
+                {
+                    printf("  %s event %2u: start %4d, valve %4u s, settled %4d, gain %.3f/s%s\n",
+                           adaptive ? "adaptive" : "fixed   ", res.observed, startReading, planned / 1000, m,
+                           response.get().gainQ16 / 65536.0, response.reliable() ? "" : " (learning)");
+                }
+            }
+            a = allowed ? logic.onSample(m, now) : irrigationLogic::NONE;
+            if (a == irrigationLogic::START_WATERING)
+            {
+                res.events++;
+                response.begin(m, now);
+                startReading = m;
+                planned = adaptive ? response.duration(m, aim, s.waterMs, ADAPTIVE_MIN_MS, s.waterMs * ADAPTIVE_MAX)
+                                   : s.waterMs;
+                logic.setEventDuration(planned);
+            }
+            if (a == irrigationLogic::START_WATERING || a == irrigationLogic::RESUME_WATERING)
+            {
+                valve = true;
+                response.valve(true, now);
+            }
+            if (a == irrigationLogic::STOP_WATERING) response.end(now);
+        }
+
+        double hour = (t % 86400000) / 3600000.0;
+        double etNow = et * std::max(0.0, std::sin((hour - 6) / 12 * M_PI));
+        bed.step(valve ? RATE_MM_S * dt : 0, dt, etNow);
+    }
+    res.appliedMm = bed.appliedMm;
+    res.runoffMm  = bed.runoffMm;
+    res.deepMm    = bed.deepMm;
+    res.dryHours  = dryCount * (SAMPLE_MS / 3600000.0);
+    return res;
+}
+
+static void printRow(const char* label, const result& r)
+{
+    double n = r.observed ? r.observed : 1;
+    printf("%-9s %6u %7.0f%% %7.0f%% %7.0f%% %8.0f %8.1f %8.1f %7.1f %7.1f\n", label, r.events, 100 * r.inBand / n,
+           100 * r.tooWet / n, 100 * r.tooDry / n, r.aimErr / n, r.appliedMm, r.runoffMm, r.deepMm, r.dryHours);
+}
+
+int main(int argc, char** argv)
+{
+    settings s;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-v"))
+        {
+            s.verbose = true;
+            continue;
+        }
+        if (i + 1 >= argc) break;
+        if      (!strcmp(argv[i], "-d")) s.days = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-w")) s.waterMs = atoi(argv[++i]) * 1000u;
+        else if (!strcmp(argv[i], "-b")) s.band = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-p"))
+        {
+            unsigned pulses = 1, soak = 0;
+            sscanf(argv[++i], "%u,%u", &pulses, &soak);
+            s.pulses = pulses;
+            s.soakMs = soak * 1000;
+        }
+    }
+    printf("%.0f days, fixed %u s, band %d..%d (aim %d), %u pulse(s)\n", s.days, s.waterMs / 1000,
+           THRESHOLD - s.band, THRESHOLD, THRESHOLD - s.band / 2, s.pulses);
+    result fixed = run(s, false);
+    result adapt = run(s, true);
+    printf("\n%-9s %6s %8s %8s %8s %8s %8s %8s %7s %7s\n", "duration", "events", "in band", "too wet", "too dry",
+           "|err|", "applied", "runoff", "deep", "dry h");
+    printRow("fixed", fixed);
+    printRow("adaptive", adapt);
+    return 0;
+}
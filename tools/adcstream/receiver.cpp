@@ -0,0 +1,337 @@
+// Host side of the raw ADC stream (console command "stream", diag profile):
+// splits the USB CDC byte stream on 0x00, decodes the COBS/CRC-32 frames of
+// lib/sampleFrame, writes the samples to a file as raw little-endian u16 and
+// reports throughput, lost samples, lost frames and bad frames once a second.
+//
+// Build: g++ -O2 -std=c++17 -I../../lib/sampleFrame receiver.cpp ../../lib/sampleFrame/sampleFrame.cpp -o receiver
+// Usage: ./receiver /dev/ttyACM0 out.raw [-r hz] [-t seconds]
+//                                          start the stream, stop it on Ctrl+C or after -t
+//        ./receiver -f capture.bin out.raw decode a saved byte stream
+//        ./receiver --synth capture.bin [samples] [hz]
+//                                          write a synthetic stream with losses and noise
+
+#include "sampleFrame.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+static const size_t MAX_SAMPLES = 4096;
+static const size_t MAX_FRAME   = sampleFrame::maxEncodedBytes(MAX_SAMPLES);
+
+static volatile sig_atomic_t interrupted = 0;
+
+struct totals
+{
+    uint64_t samples    = 0;
+    uint64_t bytes      = 0;
+    uint64_t frames     = 0;
+    uint64_t lost       = 0;   // gaps in `first`
+    uint64_t lostFrames = 0;   // gaps in `seq`
+    uint64_t bad        = 0;   // COBS or CRC errors
+    uint64_t noise      = 0;   // bytes outside frames (log text before the stream)
+};
+
+class receiver
+{
+public:
+    explicit receiver(FILE* out) : out_(out) { buf_.reserve(MAX_FRAME); }
+
+    // Feed raw bytes; returns true once the END frame was seen
+    bool feed(const uint8_t* p, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            all_.bytes++;
+            if (p[i] != 0)
+            {
+                if (buf_.size() < MAX_FRAME) buf_.push_back(p[i]);
+                else overflow_ = true;
+                continue;
+            }
+            if (!buf_.empty() && frame()) ended_ = true;
+            buf_.clear();
+            overflow_ = false;
+        }
+        return ended_;
+    }
+
+    const totals& all() const { return all_; }
+    uint32_t      periodUs() const { return periodUs_; }
+
+    // One line of the per-second report, with rates since the previous one
+    void report(double seconds)
+    {
+        const totals& a = all_;
+        printf("%8.0f samples/s %7.1f KB/s   samples %llu lost %llu   frames %llu lost %llu bad %llu\n",
+               (a.samples - prev_.samples) / seconds, (a.bytes - prev_.bytes) / seconds / 1000.0,
+               (unsigned long long)a.samples, (unsigned long long)a.lost, (unsigned long long)a.frames,
+               (unsigned long long)a.lostFrames, (unsigned long long)a.bad);
+        prev_ = a;
+    }
+
+private:
+    bool frame()
+    {
+        uint8_t raw[sampleFrame::rawBytes(MAX_SAMPLES)];
+        size_t  n = overflow_ ? 0 : sampleFrame::cobsDecode(buf_.data(), buf_.size(), raw, sizeof(raw));
+        sampleFrame::header h;
+        if (!n || !sampleFrame::parse(raw, n, h, samples_, MAX_SAMPLES))
+        {
+            // stray text ahead of the first frame is expected, not an error
+            if (all_.frames) all_.bad++;
+            else             all_.noise += buf_.size();
+            return false;
+        }
+
+        if (all_.frames)
+        {
+            if (h.seq != seq_ + 1) all_.lostFrames += h.seq - seq_ - 1;
+            if (h.first != next_)  all_.lost += h.first - next_;
+        }
+        else if (h.first)
+        {
+            all_.lost += h.first;
+        }
+        all_.frames++;
+        seq_      = h.seq;
+        next_     = h.first + h.count;
+        periodUs_ = h.periodUs;
+        if (h.type == sampleFrame::END) return true;
+
+        all_.samples += h.count;
+        for (uint16_t i = 0; i < h.count; ++i)
+        {
+            uint8_t le[2] = {(uint8_t)samples_[i], (uint8_t)(samples_[i] >> 8)};
+            fwrite(le, 1, 2, out_);
+        }
+        return false;
+    }
+
+    FILE*                out_;
+    std::vector<uint8_t> buf_;
+    bool                 overflow_ = false;
+    bool                 ended_    = false;
+    uint16_t             samples_[MAX_SAMPLES];
+    uint32_t             seq_      = 0;
+    uint32_t             next_     = 0;
+    uint32_t             periodUs_ = 0;
+    totals               all_;
+    totals               prev_;
+};
+
+static void summary(const receiver& r, double seconds)
+{
+    const totals& a = r.all();
+    printf("\n%llu samples in %.1f s (%.0f/s, %.1f KB/s), period %u us\n",
+           (unsigned long long)a.samples, seconds, seconds > 0 ? a.samples / seconds : 0.0,
+           seconds > 0 ? a.bytes / seconds / 1000.0 : 0.0, r.periodUs());
+    printf("lost samples %llu, lost frames %llu, bad frames %llu, bytes outside frames %llu\n",
+           (unsigned long long)a.lost, (unsigned long long)a.lostFrames, (unsigned long long)a.bad,
+           (unsigned long long)a.noise);
+}
+
+static int openSerial(const char* path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) return -1;
+    termios t;
+    if (tcgetattr(fd, &t) == 0)
+    {
+        cfmakeraw(&t);
+        cfsetspeed(&t, B115200);   // ignored by USB CDC
+        t.c_cc[VMIN]  = 0;
+        t.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &t);
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+static void command(int fd, const std::string& line)
+{
+    std::string s = line + "\n";
+    if (write(fd, s.data(), s.size()) != (ssize_t)s.size()) perror("write");
+}
+
+static int fromSerial(const char* port, FILE* out, uint32_t hz, double limit)
+{
+    int fd = openSerial(port);
+    if (fd < 0)
+    {
+        perror(port);
+        return 1;
+    }
+    signal(SIGINT, [](int) { interrupted = 1; });
+
+    receiver r(out);
+    command(fd, "stream start " + std::to_string(hz));
+    using clock = std::chrono::steady_clock;
+    clock::time_point start = clock::now(), tick = start, stopAt = {};
+    bool stopping = false, ended = false;
+    uint8_t buf[4096];
+
+    while (!ended)
+    {
+        clock::time_point now = clock::now();
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        if (!stopping && (interrupted || (limit > 0 && elapsed >= limit)))
+        {
+            command(fd, "stream stop");
+            stopping = true;
+            stopAt   = now;
+        }
+        if (stopping && now - stopAt > std::chrono::seconds(2))
+        {
+            fprintf(stderr, "no END frame from the device\n");
+            break;
+        }
+        if (now - tick >= std::chrono::seconds(1))
+        {
+            r.report(std::chrono::duration<double>(now - tick).count());
+            tick = now;
+        }
+
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 100) <= 0) continue;
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0)
+        {
+            perror("read");
+            break;
+        }
+        ended = r.feed(buf, n);
+    }
+    if (!stopping) command(fd, "stream stop");
+    close(fd);
+    summary(r, std::chrono::duration<double>(clock::now() - start).count());
+    return 0;
+}
+
+static int fromFile(const char* path, FILE* out)
+{
+    FILE* in = fopen(path, "rb");
+    if (!in)
+    {
+        perror(path);
+        return 1;
+    }
+    receiver r(out);
+    uint8_t  buf[4096];
+    size_t   n;
+    bool     ended = false;
+    while (!ended && (n = fread(buf, 1, sizeof(buf), in)) > 0) ended = r.feed(buf, n);
+    fclose(in);
+
+    // time as the device saw it
+    summary(r, r.all().samples * (double)r.periodUs() / 1e6);
+    if (!ended) printf("no END frame, stream cut short\n");
+    return 0;
+}
+
+// A sine on the 12-bit range in 512-sample frames, with a log line in front, a
+// dropped block (an overrun on the device), a frame lost on the link and one
+// corrupted frame, so each counter of the report has something to count
+static int synth(const char* path, uint32_t total, uint32_t hz)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return 1;
+    }
+    const uint16_t BLOCK = 512;
+    std::vector<uint16_t> s(BLOCK);
+    std::vector<uint8_t>  scratch(sampleFrame::rawBytes(BLOCK)), frame(sampleFrame::maxEncodedBytes(BLOCK));
+    std::mt19937 rng(7);
+    fputs("I (1234) stream started\r\n", f);
+
+    sampleFrame::header h = {sampleFrame::SAMPLES, 0, 0, 0, 0, 1000000 / hz};
+    uint32_t blocks = (total + BLOCK - 1) / BLOCK, written = 0, lost = 0, lostFrames = 0, bad = 0;
+    for (uint32_t b = 0; b < blocks; ++b)
+    {
+        h.count  = std::min<uint32_t>(BLOCK, total - b * BLOCK);
+        h.first  = b * BLOCK;
+        h.timeUs = h.first * h.periodUs;
+        if (b == blocks / 4)
+        {
+            lost += h.count;       // overrun: the device never frames this block
+            continue;
+        }
+        for (uint16_t i = 0; i < h.count; ++i)
+            s[i] = 2048 + 1500 * std::sin((h.first + i) * 0.01) + rng() % 16;
+        size_t n = sampleFrame::encode(h, s.data(), scratch.data(), frame.data());
+        h.seq++;
+        if (b == blocks / 2)
+        {
+            lost += h.count;       // lost on the link
+            lostFrames++;
+            continue;
+        }
+        if (b == 3 * blocks / 4)
+        {
+            frame[n / 2] ^= 0x40;  // corrupted on the link
+            if (frame[n / 2] == 0) frame[n / 2] = 1;
+            lost += h.count;       // a bad frame is also a gap in `seq`
+            lostFrames++;
+            bad++;
+        }
+        else
+        {
+            written += h.count;
+        }
+        fwrite(frame.data(), 1, n, f);
+    }
+    h.type  = sampleFrame::END;
+    h.first = total;
+    h.count = 0;
+    fwrite(frame.data(), 1, sampleFrame::encode(h, s.data(), scratch.data(), frame.data()), f);
+    fclose(f);
+    printf("%u samples, %u written, lost %u, lost frames %u, bad frames %u\n", total, written, lost, lostFrames, bad);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "--synth") == 0)
+        return synth(argv[2], argc > 3 ? atoi(argv[3]) : 100000, argc > 4 ? atoi(argv[4]) : 1000);
+
+    bool file = argc >= 2 && strcmp(argv[1], "-f") == 0;
+    int  arg  = file ? 2 : 1;
+    if (argc < arg + 2)
+    {
+        fprintf(stderr, "usage: %s /dev/ttyACM0 out.raw [-r hz] [-t seconds]\n"
+                        "       %s -f capture.bin out.raw\n"
+                        "       %s --synth capture.bin [samples] [hz]\n", argv[0], argv[0], argv[0]);
+        return 2;
+    }
+    uint32_t hz    = 1000;
+    double   limit = 0;
+    for (int i = arg + 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-r") == 0) hz = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-t") == 0) limit = atof(argv[i + 1]);
+    }
+
+    FILE* out = fopen(argv[arg + 1], "wb");
+    if (!out)
+    {
+        perror(argv[arg + 1]);
+        return 1;
+    }
+    int rc = file ? fromFile(argv[arg], out) : fromSerial(argv[arg], out, hz, limit);
+    fclose(out);
+    return rc;
+}
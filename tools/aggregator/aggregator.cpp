@@ -0,0 +1,375 @@
+// Fleet aggregator: subscribes to "<site>/+/telemetry", the rollup tier
+// "<site>/+/telemetry/<tier>" and "<site>/+/status", and keeps the latest state
+// and rolling statistics of every device. Rollup windows count as one sample
+// (their mean, valve on if it ran at all inside the window).
+//
+// Per-sample telemetry is read as a step function: samples a device did not
+// send (report by exception, cmd/rbe, seen as a gap in the sequence numbers)
+// repeat its last value, so the rolling window still spans the same time. With
+// report by exception a device can stay silent for its heartbeat; -b sets it,
+// so the device does not count as offline in between.
+//
+// Build: g++ -O2 -std=c++20 -I../common aggregator.cpp -o aggregator
+// Usage: ./aggregator [-h host] [-p port] [-s site|+] [-t tier] [-w window] [-r reportSec] [-b heartbeatSec]
+//        ./aggregator --bench [devices] [messages]   (offline parser/update throughput)
+
+#include "mqttLite.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static int64_t nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct stringHash
+{
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+// Per-device state in structure-of-arrays layout: the hot update path only
+// touches the arrays it needs, and fleet-wide scans walk contiguous memory.
+class fleetState
+{
+private:
+    std::unordered_map<std::string, uint32_t, stringHash, std::equal_to<>> index_;
+    uint32_t window_;
+
+public:
+    std::vector<std::string> name;           // "<site>/<device>"
+    std::vector<uint16_t>    lastMoisture;
+    std::vector<uint8_t>     lastValve;
+    std::vector<uint8_t>     online;
+    std::vector<int64_t>     lastSeenMs;
+    std::vector<uint64_t>    samples;
+    std::vector<uint32_t>    lastSeq;        // telemetry sequence number, 0 = none yet
+    std::vector<uint64_t>    held;           // samples filled in from the last reported value
+    // Rolling window of the last `window_` samples per device
+    std::vector<uint16_t>    ring;           // window_ entries per device
+    std::vector<uint32_t>    ringPos;
+    std::vector<uint32_t>    ringFill;
+    std::vector<uint64_t>    sum;
+    std::vector<uint64_t>    sumSq;
+    std::vector<uint32_t>    valveOn;        // valve-on samples inside the window
+    std::vector<uint8_t>     valveRing;
+
+    explicit fleetState(uint32_t window) : window_(window) {}
+
+    uint32_t size() const { return (uint32_t)name.size(); }
+    uint32_t window() const { return window_; }
+
+    uint32_t slot(std::string_view key)
+    {
+        auto it = index_.find(key);
+        if (it != index_.end()) return it->second;
+
+        uint32_t id = size();
+        index_.emplace(std::string(key), id);
+        name.emplace_back(key);
+        lastMoisture.push_back(0);
+        lastValve.push_back(0);
+        online.push_back(0);
+        lastSeenMs.push_back(0);
+        samples.push_back(0);
+        lastSeq.push_back(0);
+        held.push_back(0);
+        ring.resize(ring.size() + window_, 0);
+        valveRing.resize(valveRing.size() + window_, 0);
+        ringPos.push_back(0);
+        ringFill.push_back(0);
+        sum.push_back(0);
+        sumSq.push_back(0);
+        valveOn.push_back(0);
+        return id;
+    }
+
+    void addSample(uint32_t id, uint16_t moisture, uint8_t valve, int64_t t)
+    {
+        size_t base = (size_t)id * window_;
+        uint32_t pos = ringPos[id];
+        if (ringFill[id] == window_) {
+            uint16_t old = ring[base + pos];
+            sum[id]     -= old;
+            sumSq[id]   -= (uint64_t)old * old;
+            valveOn[id] -= valveRing[base + pos];
+        } else {
+            ringFill[id]++;
+        }
+        ring[base + pos]      = moisture;
+        valveRing[base + pos] = valve;
+        sum[id]     += moisture;
+        sumSq[id]   += (uint64_t)moisture * moisture;
+        valveOn[id] += valve;
+        ringPos[id]  = pos + 1 == window_ ? 0 : pos + 1;
+
+        lastMoisture[id] = moisture;
+        lastValve[id]    = valve;
+        lastSeenMs[id]   = t;
+        online[id]       = 1;
+        samples[id]++;
+    }
+
+    // Samples the device suppressed keep the last reported value; more than a
+    // window of them only has to fill the window once
+    void hold(uint32_t id, uint32_t count, int64_t t)
+    {
+        if (ringFill[id] == 0) return;
+        held[id] += count;
+        count = std::min(count, window_);
+        for (uint32_t k = 0; k < count; ++k) addSample(id, lastMoisture[id], lastValve[id], t);
+    }
+
+    double mean(uint32_t id) const
+    {
+        return ringFill[id] ? (double)sum[id] / ringFill[id] : 0.0;
+    }
+
+    double stddev(uint32_t id) const
+    {
+        if (ringFill[id] < 2) return 0.0;
+        double m = mean(id);
+        double v = (double)sumSq[id] / ringFill[id] - m * m;
+        return v > 0 ? __builtin_sqrt(v) : 0.0;
+    }
+
+    void minMax(uint32_t id, uint16_t& lo, uint16_t& hi) const
+    {
+        const uint16_t* r = &ring[(size_t)id * window_];
+        lo = 0xFFFF; hi = 0;
+        for (uint32_t i = 0; i < ringFill[id]; ++i) {
+            lo = std::min(lo, r[i]);
+            hi = std::max(hi, r[i]);
+        }
+    }
+};
+
+class aggregator
+{
+private:
+    fleetState  fleet_;
+    std::string rollupTopic_;
+    uint64_t    messages_ = 0;
+    uint64_t    badPayloads_ = 0;
+
+public:
+    explicit aggregator(uint32_t window, std::string_view tier = "1m")
+        : fleet_(window), rollupTopic_("telemetry/" + std::string(tier)) {}
+
+    fleetState& fleet() { return fleet_; }
+    uint64_t messages() const { return messages_; }
+    uint64_t badPayloads() const { return badPayloads_; }
+
+    void onPublish(std::string_view topic, std::string_view payload, int64_t t)
+    {
+        std::string_view site, device, rest;
+        if (!mqttLite::splitDeviceTopic(topic, site, device, rest)) return;
+        messages_++;
+        uint32_t id = fleet_.slot(topic.substr(0, site.size() + 1 + device.size()));
+
+        if (rest == "status") {
+            fleet_.online[id] = payload == "online";
+            return;
+        }
+        if (rest == rollupTopic_) {
+            onRollup(id, payload, t);
+            return;
+        }
+        if (rest != "telemetry") return;
+
+        // Payload is "<time>,<moisture>,<valve>[,<seq>,<latency stamps>...]"
+        size_t c1 = payload.find(',');
+        size_t c2 = c1 == std::string_view::npos ? c1 : payload.find(',', c1 + 1);
+        size_t c3 = c2 == std::string_view::npos ? c2 : payload.find(',', c2 + 1);
+        size_t c4 = c3 == std::string_view::npos ? c3 : payload.find(',', c3 + 1);
+        if (c3 == std::string_view::npos) c3 = payload.size();
+        if (c4 == std::string_view::npos) c4 = payload.size();
+        unsigned moisture = 0, valve = 0;
+        if (c2 == std::string_view::npos ||
+            std::from_chars(payload.data() + c1 + 1, payload.data() + c2, moisture).ec != std::errc() ||
+            std::from_chars(payload.data() + c2 + 1, payload.data() + c3, valve).ec != std::errc()) {
+            badPayloads_++;
+            return;
+        }
+        uint32_t seq = 0;
+        if (c3 < payload.size() && std::from_chars(payload.data() + c3 + 1, payload.data() + c4, seq).ec == std::errc()) {
+            uint32_t last = fleet_.lastSeq[id];
+            if (last && seq > last + 1) fleet_.hold(id, seq - last - 1, t);
+            fleet_.lastSeq[id] = seq;   // lower after a reboot
+        }
+        fleet_.addSample(id, (uint16_t)moisture, (uint8_t)(valve != 0), t);
+    }
+
+    // Payload is "<start>,<count>,<min>,<max>,<mean>,<stddev>,<valve_on_s>"
+    void onRollup(uint32_t id, std::string_view payload, int64_t t)
+    {
+        size_t f[6], pos = 0;
+        for (size_t& c : f) {
+            c = payload.find(',', pos);
+            if (c == std::string_view::npos) { badPayloads_++; return; }
+            pos = c + 1;
+        }
+        double mean = 0;
+        unsigned valveOn = 0;
+        if (std::from_chars(payload.data() + f[3] + 1, payload.data() + f[4], mean).ec != std::errc() ||
+            std::from_chars(payload.data() + f[5] + 1, payload.data() + payload.size(), valveOn).ec != std::errc()) {
+            badPayloads_++;
+            return;
+        }
+        fleet_.addSample(id, (uint16_t)(mean + 0.5), (uint8_t)(valveOn != 0), t);
+    }
+
+    void report(double seconds, uint64_t msgsInPeriod, int64_t t, int64_t staleMs)
+    {
+        uint32_t n = fleet_.size(), live = 0, watering = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            if (fleet_.online[i] && t - fleet_.lastSeenMs[i] > staleMs) fleet_.online[i] = 0;
+            live     += fleet_.online[i];
+            watering += fleet_.lastValve[i];
+        }
+        uint64_t held = 0;
+        for (uint32_t i = 0; i < n; ++i) held += fleet_.held[i];
+        printf("[agg] %.0f msg/s | devices %u (online %u, watering %u) | held samples %llu | bad %llu\n",
+               msgsInPeriod / seconds, n, live, watering, (unsigned long long)held, (unsigned long long)badPayloads_);
+
+        // Five driest devices by rolling mean
+        std::vector<uint32_t> order(n);
+        for (uint32_t i = 0; i < n; ++i) order[i] = i;
+        size_t top = std::min<size_t>(5, n);
+        std::partial_sort(order.begin(), order.begin() + top, order.end(),
+                          [&](uint32_t a, uint32_t b) { return fleet_.mean(a) > fleet_.mean(b); });
+        for (size_t k = 0; k < top; ++k) {
+            uint32_t i = order[k];
+            uint16_t lo, hi;
+            fleet_.minMax(i, lo, hi);
+            printf("      %-40s last %4u mean %7.1f sd %6.1f min %4u max %4u valve %3u/%u\n",
+                   fleet_.name[i].c_str(), fleet_.lastMoisture[i], fleet_.mean(i), fleet_.stddev(i),
+                   lo, hi, fleet_.valveOn[i], fleet_.ringFill[i]);
+        }
+        fflush(stdout);
+    }
+};
+
+static int runBench(uint32_t devices, uint64_t count)
+{
+    aggregator agg(60);
+    std::string stream;
+    std::vector<std::string> topics;
+    for (uint32_t d = 0; d < devices; ++d) {
+        char t[96];
+        snprintf(t, sizeof(t), "garden/garden_irrigator-%012x/telemetry", d);
+        topics.emplace_back(t);
+    }
+
+    // Pre-encode one batch so the bench measures parsing and state updates only
+    for (uint32_t d = 0; d < devices; ++d) {
+        char p[96];
+        snprintf(p, sizeof(p), "2026-10-18 12:00:00,%u,%u,%u,123456,1792335600000,850,910,960",
+                 1500 + (d * 37) % 2000, d % 7 == 0, d);
+        mqttLite::appendPublish(stream, topics[d], p);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    mqttLite::parser parser;
+    mqttLite::packet pkt;
+    uint64_t done = 0;
+    while (done < count) {
+        parser.feed(stream.data(), stream.size());
+        while (parser.next(pkt)) {
+            agg.onPublish(pkt.topic, pkt.payload, done);
+            ++done;
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("bench: %llu messages from %u devices in %.3f s -> %.0f msg/s\n",
+           (unsigned long long)done, devices, secs, done / secs);
+    agg.report(secs, done, done, INT64_MAX);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* host = "localhost";
+    int port = 1883;
+    std::string site = "+";
+    std::string tier = "1m";
+    uint32_t window = 60;
+    int reportSec = 5;
+    int heartbeatSec = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--bench") {
+            uint32_t devices = i + 1 < argc ? atoi(argv[i + 1]) : 5000;
+            uint64_t count   = i + 2 < argc ? atoll(argv[i + 2]) : 5000000;
+            return runBench(devices, count);
+        }
+        if (i + 1 >= argc) break;
+        if (a == "-h") host = argv[++i];
+        else if (a == "-p") port = atoi(argv[++i]);
+        else if (a == "-s") site = argv[++i];
+        else if (a == "-t") tier = argv[++i];
+        else if (a == "-w") window = atoi(argv[++i]);
+        else if (a == "-r") reportSec = atoi(argv[++i]);
+        else if (a == "-b") heartbeatSec = atoi(argv[++i]);
+    }
+
+    aggregator agg(window, tier);
+    mqttLite::connection conn;
+    char clientId[48];
+    snprintf(clientId, sizeof(clientId), "aggregator-%d", (int)getpid());
+
+    for (;;) {
+        if (!conn.open(host, port)) {
+            fprintf(stderr, "[agg] cannot reach %s:%d, retrying\n", host, port);
+            sleep(2);
+            continue;
+        }
+        conn.queue(mqttLite::connectPacket(clientId, 60));
+        conn.queue(mqttLite::subscribePacket(1, site + "/+/telemetry"));
+        conn.queue(mqttLite::subscribePacket(2, site + "/+/status"));
+        conn.queue(mqttLite::subscribePacket(3, site + "/+/telemetry/" + tier));
+        printf("[agg] connected to %s:%d, site filter '%s'\n", host, port, site.c_str());
+
+        int64_t lastReport = nowMs(), lastPing = lastReport;
+        uint64_t lastCount = agg.messages();
+        bool alive = true;
+        while (alive) {
+            pollfd pfd{conn.fd(), (short)(POLLIN | (conn.pending() ? POLLOUT : 0)), 0};
+            poll(&pfd, 1, 200);
+            if (pfd.revents & (POLLERR | POLLHUP)) break;
+            if (!conn.flush()) break;
+            if (pfd.revents & POLLIN) alive = conn.receive();
+
+            int64_t t = nowMs();
+            mqttLite::packet pkt;
+            while (conn.in.next(pkt)) {
+                if (pkt.type == mqttLite::PUBLISH) agg.onPublish(pkt.topic, pkt.payload, t);
+            }
+            if (t - lastPing > 30000) {
+                conn.queue(mqttLite::pingPacket());
+                lastPing = t;
+            }
+            if (t - lastReport >= reportSec * 1000) {
+                agg.report((t - lastReport) / 1000.0, agg.messages() - lastCount, t,
+                           (3 * reportSec + heartbeatSec) * 1000LL);
+                lastReport = t;
+                lastCount  = agg.messages();
+            }
+        }
+        fprintf(stderr, "[agg] connection lost, reconnecting\n");
+        conn.close();
+        sleep(1);
+    }
+}
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Decode lib/binLog frames from the device's serial output.
+
+    python3 decode.py .pio/build/controller/firmware.elf /dev/ttyACM0 [baud]
+    python3 decode.py firmware.elf capture.bin
+
+Format strings are looked up by address in the allocated sections of the
+firmware ELF (requires pyelftools; pyserial for a live port). Bytes
+outside frames are passed through, so plain Serial.print output still shows.
+"""
+import re
+import struct
+import sys
+
+SYNC = b"\xfe\xb1"
+RECORD = 32
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+
+# Arduino WiFi event ids, in arduino_event_id_t order
+WIFI_EVENTS = [
+    "WIFI_READY", "WIFI_SCAN_DONE", "WIFI_STA_START", "WIFI_STA_STOP", "WIFI_STA_CONNECTED",
+    "WIFI_STA_DISCONNECTED", "WIFI_STA_AUTHMODE_CHANGE", "WIFI_STA_GOT_IP", "WIFI_STA_GOT_IP6",
+    "WIFI_STA_LOST_IP", "WIFI_AP_START", "WIFI_AP_STOP", "WIFI_AP_STACONNECTED",
+    "WIFI_AP_STADISCONNECTED", "WIFI_AP_STAIPASSIGNED", "WIFI_AP_PROBEREQRECVED", "WIFI_AP_GOT_IP6",
+    "WIFI_FTM_REPORT", "ETH_START", "ETH_STOP", "ETH_CONNECTED", "ETH_DISCONNECTED", "ETH_GOT_IP",
+    "ETH_GOT_IP6", "WPS_ER_SUCCESS", "WPS_ER_FAILED", "WPS_ER_TIMEOUT", "WPS_ER_PIN",
+    "WPS_ER_PBC_OVERLAP", "SC_SCAN_DONE", "SC_FOUND_CHANNEL", "SC_GOT_SSID_PSWD", "SC_SEND_ACK_DONE",
+    "PROV_INIT", "PROV_DEINIT", "PROV_START", "PROV_END", "PROV_CRED_RECV", "PROV_CRED_FAIL",
+    "PROV_CRED_SUCCESS",
+]
+# Formats whose first argument is better shown as a name
+ENUMS = {"wifi event %u": WIFI_EVENTS}
+
+SPEC = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?(?:hh|h|ll|l|z)?([diuxXcs%])")
+
+
+class FormatTable:
+    def __init__(self, path):
+        from elftools.elf.elffile import ELFFile
+        self.sections = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            for sec in elf.iter_sections():
+                if sec["sh_flags"] & 0x2 and sec["sh_type"] == "SHT_PROGBITS" and sec["sh_size"]:
+                    self.sections.append((sec["sh_addr"], sec.data()))
+        self.cache = {}
+
+    def lookup(self, addr):
+        if addr not in self.cache:
+            text = None
+            for base, data in self.sections:
+                if base <= addr < base + len(data):
+                    end = data.index(b"\0", addr - base)
+                    text = data[addr - base:end].decode(errors="replace")
+                    break
+            self.cache[addr] = text
+        return self.cache[addr]
+
+
+def render(fmt, ints, string):
+    out, pos, i = [], 0, 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        conv = m.group(1)
+        if conv == "%":
+            out.append("%")
+        elif conv == "s":
+            out.append(string)
+        elif i < len(ints):
+            v = ints[i]
+            i += 1
+            if conv in "di":
+                v = v - (1 << 32) if v & 0x80000000 else v
+            spec = re.sub(r"(hh|h|ll|l|z)", "", m.group(0))
+            out.append(spec.replace("i", "d").replace("u", "d") % (v if conv != "c" else chr(v & 0xFF)))
+        pos = m.end()
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def decode_record(table, rec):
+    fmt_addr, ts, level, nargs, str_len = struct.unpack_from("<IIBBB", rec)
+    payload = rec[12:]
+    ints = list(struct.unpack_from(f"<{nargs}I", payload)) if nargs else []
+    string = payload[nargs * 4:nargs * 4 + str_len].decode(errors="replace")
+    if fmt_addr == 0:
+        return f"{ts / 1e6:12.6f} W <{ints[0] if ints else '?'} log records dropped>"
+    fmt = table.lookup(fmt_addr)
+    if fmt is None:
+        return f"{ts / 1e6:12.6f} ? <unknown format 0x{fmt_addr:08x}> {ints} {string!r}"
+    if fmt in ENUMS and ints and ints[0] < len(ENUMS[fmt]):
+        return f"{ts / 1e6:12.6f} {LEVELS.get(level, '?')} {fmt.split('%')[0]}{ENUMS[fmt][ints[0]]}"
+    return f"{ts / 1e6:12.6f} {LEVELS.get(level, '?')} {render(fmt, ints, string)}"
+
+
+def decode_stream(table, read):
+    """read() returns bytes (possibly empty on a timeout) or None at the end."""
+    buf = b""
+    while True:
+        chunk = read()
+        if chunk is None:
+            break
+        buf += chunk
+        while True:
+            k = buf.find(SYNC)
+            if k < 0:
+                keep = 1 if buf.endswith(SYNC[:1]) else 0
+                sys.stdout.write(buf[:len(buf) - keep].decode(errors="replace"))
+                buf = buf[len(buf) - keep:]
+                break
+            if k:
+                sys.stdout.write(buf[:k].decode(errors="replace"))
+            if len(buf) < k + 2 + RECORD:
+                buf = buf[k:]
+                break
+            print(decode_record(table, buf[k + 2:k + 2 + RECORD]))
+            buf = buf[k + 2 + RECORD:]
+        sys.stdout.flush()
+
+
+def main(argv):
+    if len(argv) < 3:
+        print(__doc__)
+        return 1
+    table = FormatTable(argv[1])
+    if argv[2].startswith("/dev/"):
+        import serial
+        port = serial.Serial(argv[2], int(argv[3]) if len(argv) > 3 else 115200, timeout=0.2)
+        decode_stream(table, lambda: port.read(4096))
+    else:
+        with open(argv[2], "rb") as f:
+            decode_stream(table, lambda: f.read(4096) or None)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,126 @@
+// Round-trip check and benchmark of lib/telemetryCodec on a recorded trace.
+//
+// Build: g++ -O2 -std=c++17 -I../../lib/telemetryCodec codecBench.cpp
+//            ../../lib/telemetryCodec/telemetryCodec.cpp -o codecBench
+// Usage: ./codecBench [trace.csv] [samplesPerBlock]
+//
+// The trace holds one "YYYY-mm-dd HH:MM:SS,moisture,valve" line per sample,
+// i.e. the ASCII telemetry payloads (mosquitto_sub -t '<site>/<dev>/telemetry',
+// with cmd/format "ascii"). Only that prefix counts as the ASCII baseline: the
+// latency stamps that follow it are not part of the sample.
+// Without a trace a synthetic 24 h, 1 Hz series is used.
+
+#include "telemetryCodec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+struct sample
+{
+    uint32_t t;
+    uint16_t value;
+    bool     flag;
+};
+
+static uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+static std::vector<sample> loadTrace(const char* path, size_t& asciiBytes)
+{
+    std::vector<sample> trace;
+    FILE* f = fopen(path, "r");
+    if (!f) { perror(path); exit(1); }
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        tm t{};
+        int value, flag;
+        if (!strptime(line, "%Y-%m-%d %H:%M:%S", &t)) continue;
+        const char* c = strchr(line, ',');
+        if (!c || sscanf(c, ",%d,%d", &value, &flag) != 2) continue;
+        trace.push_back({(uint32_t)timegm(&t), (uint16_t)value, flag != 0});
+        const char* end = strchr(strchr(c + 1, ',') + 1, ',');   // time,moisture,valve[,stamps...]
+        asciiBytes += end ? end - line : strcspn(line, "\r\n");
+    }
+    fclose(f);
+    return trace;
+}
+
+static std::vector<sample> syntheticTrace(size_t& asciiBytes)
+{
+    std::vector<sample> trace;
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 1.5);
+    double m = 2300;
+    bool valve = false;
+    int left = 0;
+    for (uint32_t i = 0; i < 86400; ++i) {
+        m += valve ? -4.0 : 0.02;
+        if (!valve && m > 2600) { valve = true; left = 10; }
+        if (valve && --left == 0) valve = false;
+        trace.push_back({1760000000u + i, (uint16_t)(m + noise(rng)), valve});
+        asciiBytes += 19 + 1 + 4 + 2;
+    }
+    return trace;
+}
+
+int main(int argc, char** argv)
+{
+    size_t asciiBytes = 0;
+    std::vector<sample> trace = argc > 1 ? loadTrace(argv[1], asciiBytes) : syntheticTrace(asciiBytes);
+    size_t perBlock = argc > 2 ? atoi(argv[2]) : 60;
+    if (trace.empty()) { fprintf(stderr, "empty trace\n"); return 1; }
+
+    std::vector<uint8_t> buf(8 + perBlock * 8);
+    size_t encodedBytes = 0, blocks = 0;
+    uint64_t encodeCycles = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < trace.size(); i += perBlock) {
+        size_t n = std::min(perBlock, trace.size() - i);
+        telemetryEncoder enc(buf.data(), buf.size());
+        uint64_t c0 = cycles();
+        for (size_t k = 0; k < n; ++k) {
+            if (!enc.append(trace[i + k].t, trace[i + k].value, trace[i + k].flag)) {
+                fprintf(stderr, "block overflow at sample %zu\n", i + k);
+                return 1;
+            }
+        }
+        encodeCycles += cycles() - c0;
+        encodedBytes += enc.size();
+        blocks++;
+
+        telemetryDecoder dec(enc.data(), enc.size());
+        sample s;
+        for (size_t k = 0; k < n; ++k) {
+            if (!dec.next(s.t, s.value, s.flag) || s.t != trace[i + k].t ||
+                s.value != trace[i + k].value || s.flag != trace[i + k].flag) {
+                fprintf(stderr, "round-trip mismatch at sample %zu\n", i + k);
+                return 1;
+            }
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("samples          %zu (%zu blocks of %zu)\n", trace.size(), blocks, perBlock);
+    printf("ascii payload    %.2f bytes/sample\n", (double)asciiBytes / trace.size());
+    printf("encoded          %.3f bytes/sample (ratio %.1fx)\n",
+           (double)encodedBytes / trace.size(), (double)asciiBytes / encodedBytes);
+    printf("encode           %.1f cycles/sample\n", (double)encodeCycles / trace.size());
+    printf("round trip       ok, %.1f ns/sample encode+decode\n", secs * 1e9 / trace.size());
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef CLAYBED_H
+#define CLAYBED_H
+
+// Soil model of a clay bed for the host-side watering simulators, in mm of
+// water over the bed:
+//   surface  ponding up to POND_MM, the excess runs off
+//   top      clay crust; it takes water at fc + (f0 - fc) * (1 - top / TOP_MM)^2,
+//            so it seals as it wets, and drains into the root zone with a
+//            time constant of TOP_DRAIN_S
+//   root     what the sensor sees; loses evapotranspiration, and drains to
+//            depth above field capacity
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+struct clayBed
+{
+    static constexpr double POND_MM      = 1.5;
+    static constexpr double TOP_MM       = 8.0;
+    static constexpr double F0_MM_S      = 0.06;     // infiltration into dry clay
+    static constexpr double FC_MM_S      = 0.004;    // sealed clay, about 15 mm/h
+    static constexpr double TOP_DRAIN_S  = 900.0;
+    static constexpr double ROOT_MM      = 80.0;
+    static constexpr double FIELD_MM     = 60.0;     // field capacity of the root zone
+    static constexpr double DEEP_DRAIN_S = 3600.0;
+    static constexpr int    ADC_DRY      = 3200;     // sensor reading at an empty root zone
+    static constexpr int    ADC_WET      = 1400;     // ... and at a full one
+
+    double pond = 0, top = 2.0, root = 45.0;
+
+    // Totals since the start
+    double appliedMm  = 0;
+    double runoffMm   = 0;
+    double deepMm     = 0;     // drained below the roots
+    double rootGainMm = 0;     // delivered to the root zone
+
+    // Advance dt seconds with inMm of water applied and etMmS evapotranspiration
+    void step(double inMm, double dt, double etMmS)
+    {
+        appliedMm += inMm;
+        pond += inMm;
+        double cap   = FC_MM_S + (F0_MM_S - FC_MM_S) * std::pow(1 - top / TOP_MM, 2);
+        double infil = std::min({pond, cap * dt, TOP_MM - top});
+        pond -= infil;
+        top  += infil;
+        if (pond > POND_MM)
+        {
+            runoffMm += pond - POND_MM;
+            pond = POND_MM;
+        }
+        double drain = std::min(top * dt / TOP_DRAIN_S, ROOT_MM - root);
+        top  -= drain;
+        root += drain;
+        rootGainMm += drain;
+        double deep = root > FIELD_MM ? (root - FIELD_MM) * dt / DEEP_DRAIN_S : 0;
+        root -= deep + std::min(root, etMmS * dt);
+        deepMm += deep;
+        pond -= std::min(pond, etMmS * dt);   // puddles evaporate too
+    }
+
+    // Averaged sensor reading, higher = drier like the device's
+    int reading(std::mt19937& rng) const
+    {
+        std::normal_distribution<double> noise(0, 15);
+        double r = ADC_DRY - (ADC_DRY - ADC_WET) * root / ROOT_MM + noise(rng);
+        return (int)std::clamp(r, 0.0, 4095.0);
+    }
+};
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef MQTTLITE_H
+#define MQTTLITE_H
+
+// Minimal MQTT 3.1.1 client for the host-side tools (QoS 0 only).
+// Sockets are non-blocking so many connections can share one event loop.
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mqttLite
+{
+
+enum packetType : uint8_t
+{
+    CONNECT = 1, CONNACK = 2, PUBLISH = 3, SUBSCRIBE = 8, SUBACK = 9,
+    PINGREQ = 12, PINGRESP = 13, DISCONNECT = 14
+};
+
+inline void putRemaining(std::string& out, size_t len)
+{
+    do {
+        uint8_t b = len % 128;
+        len /= 128;
+        if (len) b |= 0x80;
+        out.push_back((char)b);
+    } while (len);
+}
+
+inline void putString(std::string& out, std::string_view s)
+{
+    out.push_back((char)(s.size() >> 8));
+    out.push_back((char)(s.size() & 0xFF));
+    out.append(s.data(), s.size());
+}
+
+inline std::string connectPacket(std::string_view clientId, uint16_t keepAlive,
+                                 std::string_view willTopic = {}, std::string_view willMsg = {})
+{
+    std::string body;
+    putString(body, "MQTT");
+    body.push_back(4);                                    // protocol level 3.1.1
+    uint8_t flags = 0x02;                                 // clean session
+    if (!willTopic.empty()) flags |= 0x04 | 0x08 | 0x20;  // will, QoS 1, retain
+    body.push_back((char)flags);
+    body.push_back((char)(keepAlive >> 8));
+    body.push_back((char)(keepAlive & 0xFF));
+    putString(body, clientId);
+    if (!willTopic.empty()) {
+        putString(body, willTopic);
+        putString(body, willMsg);
+    }
+    std::string pkt(1, (char)(CONNECT << 4));
+    putRemaining(pkt, body.size());
+    return pkt + body;
+}
+
+inline std::string subscribePacket(uint16_t id, std::string_view filter)
+{
+    std::string body;
+    body.push_back((char)(id >> 8));
+    body.push_back((char)(id & 0xFF));
+    putString(body, filter);
+    body.push_back(0);                                    // QoS 0
+    std::string pkt(1, (char)((SUBSCRIBE << 4) | 0x02));
+    putRemaining(pkt, body.size());
+    return pkt + body;
+}
+
+inline void appendPublish(std::string& out, std::string_view topic, std::string_view payload,
+                          bool retain = false)
+{
+    out.push_back((char)((PUBLISH << 4) | (retain ? 1 : 0)));
+    putRemaining(out, 2 + topic.size() + payload.size());
+    putString(out, topic);
+    out.append(payload.data(), payload.size());
+}
+
+inline std::string pingPacket()       { return std::string("\xC0\x00", 2); }
+inline std::string disconnectPacket() { return std::string("\xE0\x00", 2); }
+
+// Incoming packet as seen by the parser; views point into the parser buffer
+// and stay valid until the next call to feed() or consume().
+struct packet
+{
+    uint8_t          type;
+    uint8_t          flags;
+    std::string_view body;
+    std::string_view topic;      // PUBLISH only
+    std::string_view payload;    // PUBLISH only
+};
+
+// Incremental stream parser
+class parser
+{
+private:
+    std::string buf_;
+    size_t      pos_ = 0;
+
+public:
+    void feed(const char* data, size_t len)
+    {
+        if (pos_ > 0 && pos_ == buf_.size()) {
+            buf_.clear();
+            pos_ = 0;
+        } else if (pos_ > 65536) {
+            buf_.erase(0, pos_);
+            pos_ = 0;
+        }
+        buf_.append(data, len);
+    }
+
+    // Extract the next complete packet; returns false if more data is needed
+    bool next(packet& p)
+    {
+        size_t avail = buf_.size() - pos_;
+        if (avail < 2) return false;
+        const uint8_t* b = (const uint8_t*)buf_.data() + pos_;
+        size_t len = 0, mult = 1, i = 1;
+        for (;; ++i) {
+            if (i >= avail || i > 4) return false;
+            len += (b[i] & 0x7F) * mult;
+            mult *= 128;
+            if (!(b[i] & 0x80)) break;
+        }
+        size_t header = i + 1;
+        if (avail < header + len) return false;
+
+        p.type  = b[0] >> 4;
+        p.flags = b[0] & 0x0F;
+        p.body  = std::string_view((const char*)b + header, len);
+        p.topic = p.payload = std::string_view();
+        if (p.type == PUBLISH && len >= 2) {
+            size_t tlen = (b[header] << 8) | b[header + 1];
+            size_t skip = 2 + tlen + (((p.flags >> 1) & 3) ? 2 : 0);
+            if (skip <= len) {
+                p.topic   = std::string_view((const char*)b + header + 2, tlen);
+                p.payload = p.body.substr(skip);
+            }
+        }
+        pos_ += header + len;
+        return true;
+    }
+};
+
+// Non-blocking TCP connection with an outgoing buffer
+class connection
+{
+private:
+    int         fd_ = -1;
+    std::string out_;
+    size_t      outPos_ = 0;
+
+public:
+    parser in;
+
+    ~connection() { close(); }
+
+    int fd() const { return fd_; }
+    size_t pending() const { return out_.size() - outPos_; }
+
+    // Start a non-blocking connect; returns false on immediate failure
+    bool open(const char* host, int port)
+    {
+        close();
+        addrinfo hints{}, *res = nullptr;
+        hints.ai_family   = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        std::string portStr = std::to_string(port);
+        if (getaddrinfo(host, portStr.c_str(), &hints, &res) != 0) return false;
+        fd_ = socket(res->ai_family, res->ai_socktype, 0);
+        if (fd_ < 0) { freeaddrinfo(res); return false; }
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        int rc = ::connect(fd_, res->ai_addr, res->ai_addrlen);
+        freeaddrinfo(res);
+        if (rc < 0 && errno != EINPROGRESS) { close(); return false; }
+        return true;
+    }
+
+    void close()
+    {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        out_.clear();
+        outPos_ = 0;
+        in = parser();
+    }
+
+    void queue(const std::string& data) { out_ += data; }
+    std::string& outBuffer() { return out_; }
+
+    // Write as much as the socket accepts; returns false on a fatal error.
+    // A non-zero pending() afterwards means the peer is applying backpressure.
+    bool flush()
+    {
+        while (outPos_ < out_.size()) {
+            ssize_t n = ::send(fd_, out_.data() + outPos_, out_.size() - outPos_, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN) return true;
+                return false;
+            }
+            outPos_ += n;
+        }
+        out_.clear();
+        outPos_ = 0;
+        return true;
+    }
+
+    // Read everything available into the parser; returns false on EOF/error
+    bool receive()
+    {
+        char tmp[16384];
+        for (;;) {
+            ssize_t n = ::recv(fd_, tmp, sizeof(tmp), 0);
+            if (n > 0) { in.feed(tmp, n); continue; }
+            if (n == 0) return false;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+};
+
+// Split "<site>/<device>/<rest>" into its parts; returns false if malformed
+inline bool splitDeviceTopic(std::string_view topic, std::string_view& site,
+                             std::string_view& device, std::string_view& rest)
+{
+    size_t a = topic.find('/');
+    if (a == std::string_view::npos) return false;
+    size_t b = topic.find('/', a + 1);
+    if (b == std::string_view::npos) return false;
+    site   = topic.substr(0, a);
+    device = topic.substr(a + 1, b - a - 1);
+    rest   = topic.substr(b + 1);
+    return true;
+}
+
+} // namespace mqttLite
+
+#endif
@@ -0,0 +1,153 @@
+// Cycle-and-soak against continuous watering on a clay bed: drives the
+// firmware's irrigationLogic in virtual time, the way IrrigationManager::update()
+// does, over the soil model of tools/common/clayBed.h (surface runoff, a
+// sealing crust that drains between pulses), and reports the water applied,
+// lost and delivered to the roots for each pulse count and soak time.
+//
+// Build: g++ -O2 -std=c++17 -I../common -I../../lib/irrigationLogic runoff.cpp ../../lib/irrigationLogic/irrigationLogic.cpp -o runoff
+// Usage: ./runoff [-d days] [-w waterSec] [-r mm/s] [-t threshold] [-g target]
+//                                               grid of pulses x soak against continuous
+//        ./runoff -p pulses,soakSec [...]       one setting against continuous
+// The target (early stop after a soak) defaults to 200 below the threshold.
+
+#include "clayBed.h"
+#include "irrigationLogic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+
+static const uint32_t TICK_MS      = 100;
+static const uint32_t SAMPLE_MS    = 1000;      // IRRIGATION_SAMPLE_MS
+static const double   ET_MM_DAY    = 5.0;
+
+struct settings
+{
+    double   days      = 30;
+    uint32_t waterMs   = 600000;
+    double   rateMmS   = 0.04;                   // valve flow over the bed area
+    int      threshold = 2300;
+    int      target    = -1;                     // -1: threshold - 200
+};
+
+struct result
+{
+    double   appliedMm   = 0;
+    double   runoffMm    = 0;
+    double   deepMm      = 0;                    // drained below the roots
+    double   rootGainMm  = 0;                    // delivered to the root zone
+    uint32_t events      = 0;
+    uint32_t pulses      = 0;
+    uint32_t earlyStops  = 0;
+    double   dryHours    = 0;                    // reading above threshold + 100
+    double   meanReading = 0;
+};
+
+static result run(const settings& s, uint8_t pulses, uint32_t soakMs)
+{
+    irrigationLogic logic(SAMPLE_MS, s.waterMs, s.threshold);
+    logic.setPulses(pulses, soakMs, s.target);
+    std::mt19937 rng(11);   // same noise for every setting
+
+    result   res;
+    clayBed  bed;
+    bool     valve = false;
+    double   dt = TICK_MS / 1000.0;
+    double   readings = 0;
+    uint64_t samples = 0, dryTicks = 0;
+    uint64_t end = (uint64_t)(s.days * 86400000.0);
+
+    for (uint64_t t = 0; t < end; t += TICK_MS)
+    {
+        uint32_t now = (uint32_t)t;
+        irrigationLogic::action a = logic.update(now);
+        if (a == irrigationLogic::STOP_WATERING || a == irrigationLogic::PAUSE_WATERING) valve = false;
+        if (logic.sampleDue(now))
+        {
+            int m = bed.reading(rng);
+            readings += m;
+            samples++;
+            if (m > s.threshold + 100) dryTicks++;
+            a = logic.onSample(m, now);
+            if (a == irrigationLogic::START_WATERING) res.events++;
+            if (a == irrigationLogic::START_WATERING || a == irrigationLogic::RESUME_WATERING)
+            {
+                valve = true;
+                res.pulses++;
+            }
+            if (a == irrigationLogic::STOP_WATERING) res.earlyStops++;
+        }
+
+        bed.step(valve ? s.rateMmS * dt : 0, dt, ET_MM_DAY / 86400.0);
+    }
+    res.appliedMm   = bed.appliedMm;
+    res.runoffMm    = bed.runoffMm;
+    res.deepMm      = bed.deepMm;
+    res.rootGainMm  = bed.rootGainMm;
+    res.dryHours    = dryTicks * (SAMPLE_MS / 3600000.0);
+    res.meanReading = samples ? readings / samples : 0;
+    return res;
+}
+
+static void printHeader()
+{
+    printf("%-18s %8s %8s %7s %8s %8s %6s %6s %6s %7s %7s %8s\n", "setting", "applied", "runoff", "runoff",
+           "deep", "to roots", "events", "pulses", "early", "dry h", "mean", "saved");
+    printf("%-18s %8s %8s %7s %8s %8s %6s %6s %6s %7s %7s %8s\n", "", "mm", "mm", "%", "mm", "mm", "", "",
+           "stops", "", "reading", "vs cont");
+}
+
+static void printRow(const char* label, const result& r, const result& base)
+{
+    printf("%-18s %8.1f %8.1f %6.1f%% %8.1f %8.1f %6u %6u %6u %7.1f %7.0f %7.1f%%\n", label, r.appliedMm,
+           r.runoffMm, r.appliedMm ? 100 * r.runoffMm / r.appliedMm : 0.0, r.deepMm, r.rootGainMm, r.events,
+           r.pulses, r.earlyStops, r.dryHours, r.meanReading,
+           base.appliedMm ? 100 * (base.appliedMm - r.appliedMm) / base.appliedMm : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+    settings s;
+    int      one = 0;
+    unsigned soakSec = 0;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if      (!strcmp(argv[i], "-d")) s.days = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-w")) s.waterMs = atoi(argv[i + 1]) * 1000u;
+        else if (!strcmp(argv[i], "-r")) s.rateMmS = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-t")) s.threshold = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-g")) s.target = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-p")) sscanf(argv[i + 1], "%d,%u", &one, &soakSec);
+        else
+        {
+            fprintf(stderr, "usage: %s [-d days] [-w waterSec] [-r mm/s] [-t threshold] [-g target] [-p pulses,soakSec]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (s.target < 0) s.target = s.threshold - 200;
+    printf("%.0f days, %u s per event at %.3f mm/s (%.1f mm), threshold %d, target %d\n\n", s.days,
+           s.waterMs / 1000, s.rateMmS, s.rateMmS * s.waterMs / 1000, s.threshold, s.target);
+    printHeader();
+
+    result base = run(s, 1, 0);
+    printRow("continuous", base, base);
+    char label[32];
+    if (one)
+    {
+        snprintf(label, sizeof(label), "%dx soak %us", one, soakSec);
+        printRow(label, run(s, one, soakSec * 1000), base);
+        return 0;
+    }
+    for (uint8_t pulses : {2, 3, 4, 6})
+    {
+        for (uint32_t soakMin : {5, 10, 20})
+        {
+            snprintf(label, sizeof(label), "%ux soak %2u min", pulses, soakMin);
+            printRow(label, run(s, pulses, soakMin * 60000), base);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Fault injection for lib/faultDetector: runs threshold watering on the clay
+// bed of tools/common/clayBed.h in virtual time, breaks one thing at a given
+// day and reports how many samples the detector took to lock the watering
+// out, and how much water went on in the meantime. The healthy run checks for
+// false alarms over the whole period.
+//
+// Build: g++ -O2 -std=c++17 -I../common -I../../lib/irrigationLogic -I../../lib/faultDetector faultsim.cpp
+//            ../../lib/irrigationLogic/irrigationLogic.cpp ../../lib/faultDetector/faultDetector.cpp -o faultsim
+// Usage: ./faultsim [-d days] [-f faultDay] [-w waterSec] [-s seed]
+
+#include "clayBed.h"
+#include "faultDetector.h"
+#include "irrigationLogic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+
+static const uint32_t TICK_MS    = 100;
+static const uint32_t SAMPLE_MS  = 1000;       // IRRIGATION_SAMPLE_MS
+static const double   RATE_MM_S  = 0.04;
+static const int      THRESHOLD  = 2300;
+
+// IrrigationManager::faultLimits(IRRIGATION_SAMPLE_MS)
+static const faultDetector::limits LIMITS = {16, 4080, 3, 1, 1800, 40, 1800000, 120000, 2, 150, 600, 4};
+
+enum scenario { HEALTHY, VALVE_STUCK_CLOSED, VALVE_STUCK_OPEN, PIPE_LEAK, PROBE_DISCONNECTED, PROBE_SHORTED,
+                ADC_STUCK, RAIN };
+
+static const char* SCENARIOS[] = {"healthy", "valve stuck closed", "valve stuck open", "pipe leak 1 mm/h",
+                                  "probe disconnected", "probe shorted", "ADC stuck", "rain 20 mm"};
+
+struct settings
+{
+    double   days     = 60;
+    double   faultDay = 31.4;     // mid-morning, the soil is drying
+    uint32_t waterMs  = 600000;
+    unsigned seed     = 5;
+};
+
+struct result
+{
+    faultDetector::fault fault = faultDetector::NONE;
+    uint64_t samples      = 0;     // from the injection to the lockout
+    uint32_t eventsAfter  = 0;     // watering events started after the injection
+    double   mmAfter      = 0;     // water delivered after the injection (leaks included)
+    double   hours        = 0;     // from the injection to the lockout
+};
+
+static result run(const settings& s, scenario sc)
+{
+    irrigationLogic logic(SAMPLE_MS, s.waterMs, THRESHOLD);
+    faultDetector   detector(LIMITS);
+    clayBed         bed;
+    std::mt19937    rng(s.seed);
+    std::uniform_real_distribution<double> etDay(2.0, 9.0);
+
+    result   res;
+    bool     valve = false, broken = false, locked = false;
+    double   dt = TICK_MS / 1000.0, et = 0, appliedAtFault = 0;
+    int      stuckReading = 0;
+    uint64_t end = (uint64_t)(s.days * 86400000.0);
+    uint64_t faultAt = (uint64_t)(s.faultDay * 86400000.0);
+
+    for (uint64_t t = 0; t < end && !locked; t += TICK_MS)
+    {
+        uint32_t now = (uint32_t)t;
+        if (t % 86400000 == 0) et = etDay(rng) / 86400.0 * M_PI;
+        if (!broken && sc != HEALTHY && t >= faultAt)
+        {
+            broken         = true;
+            appliedAtFault = bed.appliedMm;
+            stuckReading   = bed.reading(rng);
+        }
+
+        irrigationLogic::action a = logic.update(now);
+        if (a == irrigationLogic::STOP_WATERING)
+        {
+            valve = false;
+            detector.valve(false, now);
+        }
+        if (logic.sampleDue(now))
+        {
+            int m = bed.reading(rng);
+            if (broken && sc == PROBE_DISCONNECTED) m = 4095;
+            if (broken && sc == PROBE_SHORTED)      m = 0;
+            if (broken && sc == ADC_STUCK)          m = stuckReading;
+            if (broken) res.samples++;
+
+            faultDetector::fault f = detector.onSample(m, now);
+            if (f != faultDetector::NONE)
+            {
+                res.fault = f;
+                res.hours = broken ? (t - faultAt) / 3600000.0 : 0;
+                logic.cancelWatering();   // the lockout
+                valve  = false;
+                locked = sc != HEALTHY;   // a healthy run keeps counting false alarms
+                if (!locked)
+                {
+                    detector.reset();
+                    res.samples++;        // false alarms
+                }
+                continue;
+            }
+            if (!detector.railed() && logic.onSample(m, now) == irrigationLogic::START_WATERING)
+            {
+                valve = true;
+                detector.valve(true, now);
+                if (broken) res.eventsAfter++;
+            }
+        }
+
+        double hour  = (t % 86400000) / 3600000.0;
+        double etNow = et * std::max(0.0, std::sin((hour - 6) / 12 * M_PI));
+        double in    = valve ? RATE_MM_S * dt : 0;
+        if (broken && sc == VALVE_STUCK_CLOSED) in = 0;
+        if (broken && sc == VALVE_STUCK_OPEN)   in = RATE_MM_S * dt;
+        if (broken && sc == PIPE_LEAK)          in += 1.0 / 3600 * dt;
+        if (broken && sc == RAIN && t < faultAt + 7200000) in += 10.0 / 3600 * dt;
+        bed.step(in, dt, etNow);
+    }
+    res.mmAfter = broken ? bed.appliedMm - appliedAtFault : 0;
+    return res;
+}
+
+int main(int argc, char** argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if      (!strcmp(argv[i], "-d")) s.days = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-f")) s.faultDay = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-w")) s.waterMs = atoi(argv[i + 1]) * 1000u;
+        else if (!strcmp(argv[i], "-s")) s.seed = atoi(argv[i + 1]);
+    }
+    printf("%.0f days, fault injected at day %.2f, %u s per event, threshold %d\n\n", s.days, s.faultDay,
+           s.waterMs / 1000, THRESHOLD);
+    printf("%-20s %-14s %10s %8s %8s %10s\n", "scenario", "detected", "samples", "hours", "events", "water mm");
+
+    for (int sc = HEALTHY; sc <= RAIN; ++sc)
+    {
+        result r = run(s, (scenario)sc);
+        if (sc == HEALTHY)
+        {
+            printf("%-20s %-14s %10s %8s %8s %10s   false alarms: %llu\n", SCENARIOS[sc], "-", "-", "-", "-", "-",
+                   (unsigned long long)r.samples);
+            continue;
+        }
+        if (r.fault == faultDetector::NONE)
+        {
+            printf("%-20s %-14s %10s %8s %8u %10.1f\n", SCENARIOS[sc], "missed", "-", "-", r.eventsAfter, r.mmAfter);
+            continue;
+        }
+        printf("%-20s %-14s %10llu %8.2f %8u %10.1f\n", SCENARIOS[sc], faultDetector::name(r.fault),
+               (unsigned long long)r.samples, r.hours, r.eventsAfter, r.mmAfter);
+    }
+    return 0;
+}
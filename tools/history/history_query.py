@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Fetch a time range from the device's on-flash history (cmd/history) as CSV.
+
+    python3 history_query.py <broker> <site>/<device> <from> [to] [step] [out.csv]
+
+from/to are epoch seconds, or seconds before now when <= 0 (to defaults to
+0 = now); step > 0 merges the one-minute records into buckets of that many
+seconds. Examples: "-86400" is the last 24 h at 1 min, "-604800 0 3600" the
+last week hourly.
+
+The device streams chunks on history/<id>: u8 format, u8 flags (bit 0 =
+last), u16 record count, u32 chunk number, then 14-byte records (u32 start,
+u16 count, min, max, mean, valve seconds). A lost chunk shows up as a gap in
+the chunk numbers; the query is then sent again.
+"""
+import os
+import struct
+import sys
+import time
+
+HEADER = struct.Struct("<BBHI")
+RECORD = struct.Struct("<IHHHHH")
+
+
+def fetch(broker, prefix, start, end=0, step=0, timeout=20, attempts=3):
+    import paho.mqtt.client as mqtt
+
+    qid = f"q{os.getpid()}"
+    state = {"chunks": {}, "last": None, "status": None, "seen": time.monotonic()}
+
+    def request():
+        state["chunks"].clear()
+        state["last"] = None
+        state["status"] = None
+        state["seen"] = time.monotonic()
+        client.publish(f"{prefix}/cmd/history", f"{start},{end},{step},{qid}")
+
+    def on_connect(c, userdata, flags, rc):
+        c.subscribe(f"{prefix}/history/{qid}")
+        c.subscribe(f"{prefix}/history/status")
+        request()
+
+    def on_message(c, userdata, msg):
+        state["seen"] = time.monotonic()
+        if msg.topic.endswith("/status"):
+            text = msg.payload.decode(errors="replace")
+            if text.split()[1:2] == [qid]:
+                state["status"] = text
+            return
+        version, flags, count, seq = HEADER.unpack_from(msg.payload)
+        if version != 1:
+            raise ValueError(f"unknown history format {version}")
+        state["chunks"][seq] = [RECORD.unpack_from(msg.payload, HEADER.size + i * RECORD.size)
+                                for i in range(count)]
+        if flags & 1:
+            state["last"] = seq
+
+    client = mqtt.Client()
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(broker)
+    client.loop_start()
+    try:
+        for _ in range(attempts):
+            while state["status"] is None and time.monotonic() - state["seen"] < timeout:
+                time.sleep(0.05)
+            status = state["status"] or "timeout"
+            if status.startswith("error"):
+                raise RuntimeError(f"[device] {status}")
+            last = state["last"]
+            if last is not None and all(i in state["chunks"] for i in range(last + 1)):
+                return [r for i in range(last + 1) for r in state["chunks"][i]]
+            print(f"[history] incomplete answer ({status}), asking again", file=sys.stderr)
+            request()
+        raise TimeoutError("no complete answer")
+    finally:
+        client.loop_stop()
+
+
+def main():
+    if len(sys.argv) < 4:
+        print(__doc__)
+        return 2
+    args = sys.argv[3:]
+    out = args.pop() if args and args[-1].endswith(".csv") else None
+    start, end, step = (int(a) for a in (args + ["0", "0"])[:3])
+    records = fetch(sys.argv[1], sys.argv[2], start, end, step)
+
+    f = open(out, "w") if out else sys.stdout
+    f.write("start,count,min,max,mean,valve_on_s\n")
+    for r in records:
+        f.write(",".join(str(v) for v in r) + "\n")
+    if out:
+        f.close()
+        print(f"saved {len(records)} records to {out}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
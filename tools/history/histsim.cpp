@@ -0,0 +1,235 @@
+// Host check of lib/historyStore: fills an in-memory store with synthetic
+// one-minute summaries (several wraps of the segment ring, a few clock steps
+// back), reloads it like a reboot, tears the tail of the newest segment, and
+// compares random range queries, raw and downsampled, against a brute-force
+// scan of the records that should still be there. Also prints the store reads
+// a lookup costs, which must grow with log(records), not records.
+//
+// Build: g++ -O2 -std=c++17 -I../../lib/historyStore histsim.cpp ../../lib/historyStore/historyStore.cpp -o histsim
+// Usage: ./histsim [-s segments] [-n perSegment] [-d days] [-q queries]
+
+#include "historyStore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+using record = historyStore::record;
+
+class memStore : public historyStore::store
+{
+public:
+    std::vector<std::vector<uint8_t>> files;
+
+    explicit memStore(size_t segments) : files(segments) {}
+
+    uint32_t size(uint8_t segment) override
+    {
+        return files[segment].size();
+    }
+
+    size_t read(uint8_t segment, uint32_t offset, uint8_t* buf, size_t len) override
+    {
+        const std::vector<uint8_t>& f = files[segment];
+        if (offset >= f.size()) return 0;
+        if (len > f.size() - offset) len = f.size() - offset;
+        memcpy(buf, f.data() + offset, len);
+        return len;
+    }
+
+    bool append(uint8_t segment, const uint8_t* buf, size_t len) override
+    {
+        files[segment].insert(files[segment].end(), buf, buf + len);
+        return true;
+    }
+
+    bool erase(uint8_t segment) override
+    {
+        files[segment].clear();
+        return true;
+    }
+};
+
+static bool sameRecord(const record& a, const record& b)
+{
+    return a.start == b.start && a.count == b.count && a.min == b.min && a.max == b.max && a.mean == b.mean &&
+           a.valveSec == b.valveSec;
+}
+
+// What historyQuery should produce, from a plain vector
+static std::vector<record> expected(const std::vector<record>& all, uint32_t from, uint32_t to, uint32_t step)
+{
+    std::vector<record> out;
+    uint64_t count = 0, sum = 0, valve = 0;
+    record bucket{};
+    auto close = [&]() {
+        if (!count) return;
+        bucket.count    = count > 0xFFFF ? 0xFFFF : count;
+        bucket.mean     = (sum + count / 2) / count;
+        bucket.valveSec = valve > 0xFFFF ? 0xFFFF : valve;
+        out.push_back(bucket);
+        count = sum = valve = 0;
+    };
+    for (const record& r : all) {
+        if (r.start < from || r.start >= to) continue;
+        if (step == 0) {
+            out.push_back(r);
+            continue;
+        }
+        uint32_t b = from + (r.start - from) / step * step;
+        if (count && b != bucket.start) close();
+        if (!count) {
+            bucket.start = b;
+            bucket.min   = r.min;
+            bucket.max   = r.max;
+        }
+        count += r.count;
+        sum   += (uint64_t)r.mean * r.count;
+        valve += r.valveSec;
+        if (r.min < bucket.min) bucket.min = r.min;
+        if (r.max > bucket.max) bucket.max = r.max;
+    }
+    close();
+    return out;
+}
+
+// Runs the query the way the device does: small chunks, bounded scan per pass
+static std::vector<record> query(historyStore& h, uint32_t from, uint32_t to, uint32_t step, int& passes)
+{
+    historyQuery q(h);
+    q.begin(from, to, step);
+    std::vector<record> out;
+    record chunk[64];
+    passes = 0;
+    while (!q.done()) {
+        size_t n = q.fill(chunk, 64, 1024);
+        out.insert(out.end(), chunk, chunk + n);
+        passes++;
+    }
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    int segments = 22, perSegment = 1440, days = 60, queries = 2000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i];
+        if (a == "-s") segments = atoi(argv[i + 1]);
+        else if (a == "-n") perSegment = atoi(argv[i + 1]);
+        else if (a == "-d") days = atoi(argv[i + 1]);
+        else if (a == "-q") queries = atoi(argv[i + 1]);
+    }
+
+    memStore mem(segments);
+    historyStore h(mem, segments, perSegment);
+    h.load();
+
+    // Minutes with a daily moisture curve, watering at dawn, gaps and clock steps
+    std::mt19937 rng(7);
+    std::vector<record> all;
+    uint32_t t = 1700000000 / 60 * 60;
+    int refusedExpected = 0;
+    for (int m = 0; m < days * 1440; ++m) {
+        t += 60;
+        if (rng() % 500 == 0) t += 60 * (rng() % 120);    // device off for a while
+        uint32_t at = t;
+        if (rng() % 5000 == 0) at = t - 60 * (1 + rng() % 3);   // NTP stepped back
+        int minuteOfDay = (at / 60) % 1440;
+        uint16_t base = 1800 + 600 * (minuteOfDay > 360 && minuteOfDay < 400) + rng() % 40;
+        record r{at, (uint16_t)(50 + rng() % 11), (uint16_t)(base - 20), (uint16_t)(base + 20), base,
+                 (uint16_t)(minuteOfDay > 360 && minuteOfDay < 370 ? 60 : 0)};
+        if (!all.empty() && r.start <= all.back().start) {
+            refusedExpected++;
+            h.append(r);
+            continue;
+        }
+        if (!h.append(r)) {
+            printf("FAIL append at minute %d\n", m);
+            return 1;
+        }
+        all.push_back(r);
+    }
+
+    // Only the newest `records()` survive the ring
+    uint32_t kept = h.records();
+    std::vector<record> alive(all.end() - kept, all.end());
+    bool ok = true;
+    if (kept > h.capacity() || (all.size() > h.capacity() && kept + (uint32_t)perSegment < h.capacity())) {
+        printf("FAIL %u records kept of capacity %u\n", kept, h.capacity());
+        ok = false;
+    }
+    if (h.refused() != (uint32_t)refusedExpected) {
+        printf("FAIL refused %u, expected %d\n", h.refused(), refusedExpected);
+        ok = false;
+    }
+
+    // Reboot: the index must come back identical from the files alone
+    historyStore again(mem, segments, perSegment);
+    again.load();
+    if (again.records() != kept || again.first() != alive.front().start || again.last() != alive.back().start) {
+        printf("FAIL reload: %u records %u..%u\n", again.records(), again.first(), again.last());
+        ok = false;
+    }
+    printf("%zu appended, %u kept (capacity %u), %u refused, %.0f KB on flash\n", all.size(), kept, h.capacity(),
+           h.refused(), h.capacity() * historyStore::RECORD_BYTES / 1024.0);
+
+    // Random ranges, raw and downsampled
+    const uint32_t STEPS[] = {0, 60, 300, 3600, 86400};
+    uint32_t lo = alive.front().start - 3600, hi = alive.back().start + 3600;
+    uint32_t worstSeek = 0, worstPasses = 0;
+    for (int i = 0; i < queries && ok; ++i) {
+        uint32_t a = lo + rng() % (hi - lo), b = lo + rng() % (hi - lo);
+        if (a > b) std::swap(a, b);
+        if (i % 4 == 0) b = a + rng() % 7200;   // plenty of short ones
+        uint32_t step = STEPS[i % 5];
+
+        uint32_t before = again.reads();
+        again.seek(a);
+        uint32_t cost = again.reads() - before;
+        if (cost > worstSeek) worstSeek = cost;
+
+        int passes;
+        std::vector<record> got = query(again, a, b, step, passes), want = expected(alive, a, b, step);
+        if ((uint32_t)passes > worstPasses) worstPasses = passes;
+        bool same = got.size() == want.size();
+        for (size_t k = 0; same && k < got.size(); ++k) same = sameRecord(got[k], want[k]);
+        if (!same) {
+            printf("FAIL query %u..%u step %u: %zu records, expected %zu\n", a, b, step, got.size(), want.size());
+            ok = false;
+        }
+    }
+    printf("%d queries match brute force; seek costs at most %u reads (log2 of a segment is %.1f), "
+           "longest query %u passes\n", queries, worstSeek, __builtin_log2((double)perSegment), worstPasses);
+
+    // Torn tail: a reset mid-append leaves part of a record behind
+    uint8_t newest = 0;
+    for (int s = 0; s < segments; ++s) {
+        size_t n = mem.files[s].size() / historyStore::RECORD_BYTES;
+        record r;
+        if (!n) continue;
+        historyStore::decode(mem.files[s].data() + (n - 1) * historyStore::RECORD_BYTES, r);
+        if (r.start == alive.back().start) newest = s;
+    }
+    mem.files[newest].resize(mem.files[newest].size() + 5, 0xAB);
+    historyStore torn(mem, segments, perSegment);
+    torn.load();
+    bool ignored = torn.records() == kept && torn.last() == alive.back().start;
+    record next{alive.back().start + 60, 50, 1, 3, 2, 0};
+    bool appended = torn.append(next);
+    int passes;
+    std::vector<record> tail = query(torn, alive.back().start, next.start + 1, 0, passes);
+    if (!ignored || !appended || tail.empty() || !sameRecord(tail.back(), next) ||
+        tail.size() != (segments > 1 ? 2u : 1u)) {   // one segment: the fresh one is the torn one, erased
+        printf("FAIL torn tail: %zu records after the last good one\n", tail.size());
+        ok = false;
+    } else {
+        printf("torn tail ignored, next record went to a fresh segment\n");
+    }
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+// Control-period jitter of one device, idle and under network load. Each
+// phase resets the ctrl_* counters (cmd/ctrl "reset"), runs for a while and
+// reads them back from cmd/stats. The load phase floods cmd/load with
+// payloads the device receives, dispatches and drops, and keeps ASCII
+// telemetry streaming (cmd/raw), so PubSubClient and lwIP stay busy.
+//
+// Run it once against a build with FEATURE_CONTROL_TASK=1 and once with 0
+// (irrigation back in loop()) to see what the task split buys.
+//
+// Build: g++ -O2 -std=c++20 -I../common jitter.cpp -o jitter
+// Usage: ./jitter -d device [-h host] [-p port] [-s site] [-t seconds] [-r msgPerSec] [-b bytes]
+
+#include "mqttLite.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+
+static int64_t nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct settings
+{
+    const char* host    = "localhost";
+    int         port    = 1883;
+    std::string site    = "garden";
+    std::string device;
+    int         seconds = 60;
+    int         rate    = 50;       // cmd/load messages per second
+    int         bytes   = 1000;     // fits the device's 1280-byte MQTT buffer with the topic
+};
+
+class session
+{
+private:
+    const settings&       s_;
+    mqttLite::connection  conn_;
+    std::string           base_;
+    int64_t               lastPing_ = 0;
+    std::string           stats_;
+
+public:
+    explicit session(const settings& s) : s_(s), base_(s.site + "/" + s.device + "/") {}
+
+    bool open()
+    {
+        if (!conn_.open(s_.host, s_.port)) return false;
+        conn_.queue(mqttLite::connectPacket("jitter-" + std::to_string(getpid()), 60));
+        conn_.queue(mqttLite::subscribePacket(1, base_ + "stats"));
+        lastPing_ = nowMs();
+        return true;
+    }
+
+    void command(const std::string& name, const std::string& payload)
+    {
+        mqttLite::appendPublish(conn_.outBuffer(), base_ + "cmd/" + name, payload);
+    }
+
+    // Service the socket for `ms`; with a rate, publish cmd/load at that rate
+    bool run(int64_t ms, int rate)
+    {
+        std::string payload(s_.bytes, 'x');
+        int64_t start = nowMs(), sent = 0;
+        while (nowMs() - start < ms) {
+            int64_t t = nowMs();
+            while (rate && sent < (t - start) * rate / 1000 && conn_.pending() < 64 * 1024) {
+                command("load", payload);
+                sent++;
+            }
+            pollfd pfd{conn_.fd(), (short)(POLLIN | (conn_.pending() ? POLLOUT : 0)), 0};
+            poll(&pfd, 1, 5);
+            if (pfd.revents & (POLLERR | POLLHUP)) return false;
+            if (!conn_.flush()) return false;
+            if ((pfd.revents & POLLIN) && !conn_.receive()) return false;
+
+            mqttLite::packet pkt;
+            while (conn_.in.next(pkt)) {
+                if (pkt.type == mqttLite::PUBLISH && pkt.topic == base_ + "stats") stats_ = pkt.payload;
+            }
+            if (t - lastPing_ > 30000) {
+                conn_.queue(mqttLite::pingPacket());
+                lastPing_ = t;
+            }
+        }
+        return true;
+    }
+
+    // cmd/stats as key -> value, empty if the device did not answer
+    std::map<std::string, std::string> stats()
+    {
+        stats_.clear();
+        command("stats", "");
+        for (int i = 0; i < 50 && stats_.empty(); ++i) run(100, 0);
+        std::map<std::string, std::string> kv;
+        size_t pos = 0;
+        while (pos < stats_.size()) {
+            size_t end = stats_.find(',', pos);
+            if (end == std::string::npos) end = stats_.size();
+            size_t eq = stats_.find('=', pos);
+            if (eq < end) kv[stats_.substr(pos, eq - pos)] = stats_.substr(eq + 1, end - eq - 1);
+            pos = end + 1;
+        }
+        return kv;
+    }
+};
+
+static void printPhase(const char* name, std::map<std::string, std::string>& kv)
+{
+    if (kv.empty()) {
+        printf("%-6s no cmd/stats reply\n", name);
+        return;
+    }
+    printf("%-6s %4s %9s %9s %9s %9s %9s %9s %9s\n", name, kv["ctrl_task"].c_str(), kv["ctrl_periods"].c_str(),
+           kv["ctrl_late_us_avg"].c_str(), kv["ctrl_late_us_p99"].c_str(), kv["ctrl_late_us_max"].c_str(),
+           kv["ctrl_exec_us_max"].c_str(), kv["ctrl_overruns"].c_str(), kv["ctrl_stack_free"].c_str());
+}
+
+int main(int argc, char** argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i];
+        if (a == "-h") s.host = argv[i + 1];
+        else if (a == "-p") s.port = atoi(argv[i + 1]);
+        else if (a == "-s") s.site = argv[i + 1];
+        else if (a == "-d") s.device = argv[i + 1];
+        else if (a == "-t") s.seconds = atoi(argv[i + 1]);
+        else if (a == "-r") s.rate = atoi(argv[i + 1]);
+        else if (a == "-b") s.bytes = atoi(argv[i + 1]);
+    }
+    if (s.device.empty()) {
+        fprintf(stderr, "usage: %s -d device [-h host] [-p port] [-s site] [-t seconds] [-r msgPerSec] [-b bytes]\n",
+                argv[0]);
+        return 1;
+    }
+
+    session sess(s);
+    if (!sess.open()) {
+        fprintf(stderr, "[jitter] cannot reach %s:%d\n", s.host, s.port);
+        return 1;
+    }
+    printf("[jitter] %s/%s, %d s per phase, load %d msg/s of %d bytes\n\n", s.site.c_str(), s.device.c_str(),
+           s.seconds, s.rate, s.bytes);
+
+    sess.command("ctrl", "reset");
+    sess.run(s.seconds * 1000LL, 0);
+    auto idle = sess.stats();
+
+    sess.command("ctrl", "reset");
+    sess.command("raw", std::to_string(s.seconds + 10));
+    bool ok = sess.run(s.seconds * 1000LL, s.rate);
+    auto load = sess.stats();
+    sess.command("raw", "0");
+    sess.run(200, 0);
+
+    printf("%-6s %4s %9s %9s %9s %9s %9s %9s %9s\n", "phase", "task", "periods", "late avg", "late p99", "late max",
+           "exec max", "overruns", "stack");
+    printPhase("idle", idle);
+    printPhase("load", load);
+    printf("\n(us; p99 is the upper bound of a power-of-two bucket)\n");
+    if (!ok) fprintf(stderr, "[jitter] connection lost during the load phase\n");
+    return 0;
+}
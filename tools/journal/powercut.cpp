@@ -0,0 +1,342 @@
+// Power-cut simulation for lib/wateringJournal: replays a series of watering
+// events the way IrrigationManager drives the valve and the journal, cuts the
+// power at every journal write (torn at every byte) and every 100 ms while the
+// valve is open, reboots, recovers, and checks that no event waters longer
+// than planned, that interrupted events resume when the RTC counter survived,
+// that the journal always ends closed, and that an event costs two writes.
+//
+// Build: g++ -O2 -std=c++17 -I../../lib/wateringJournal powercut.cpp ../../lib/wateringJournal/wateringJournal.cpp -o powercut
+// Usage: ./powercut [-v]
+
+#include "wateringJournal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static const uint32_t TICK_MS      = 100;          // IrrigationManager::update() granularity here
+static const uint32_t OUTAGE_MS    = 5000;         // time the device stays off after a cut
+static const uint32_t END_MS       = 150000;
+static const uint32_t RTC_MAGIC    = 0x31524157;   // RTC_WATERING_MAGIC
+
+struct event
+{
+    uint32_t startMs;
+    uint32_t plannedMs;     // 0 = schedule window, closed at stopMs
+    uint32_t stopMs;        // cancel (stop command) or window end, 0 = none
+};
+
+static const event EVENTS[] = {
+    {1000, 30000, 0},
+    {40000, 30000, 50000},  // cancelled after 10 s
+    {80000, 0, 95000},      // fixed schedule window
+    {100000, 20000, 0},
+    {125000, 3000, 0},      // shorter than MIN_RESUME_MS + a bit
+};
+static const int EVENT_COUNT = sizeof(EVENTS) / sizeof(EVENTS[0]);
+
+struct powerCut {};
+
+// Slots in "flash". A cut write keeps the first `tear` bytes of the new record
+// over the old one: 0 models NVS (all or nothing), others a raw flash ring.
+class memStore : public wateringJournal::store
+{
+public:
+    uint8_t  slots[wateringJournal::SLOTS][wateringJournal::RECORD_BYTES];
+    int      writes = 0;     // attempts, including the cut one
+    int      done   = 0;     // completed
+    int      cutAt  = -1;
+    size_t   tear   = 0;
+
+    memStore() { memset(slots, 0xFF, sizeof(slots)); }
+
+    bool read(uint8_t slot, uint8_t* buf, size_t len) override
+    {
+        memcpy(buf, slots[slot], len);
+        return true;
+    }
+
+    bool write(uint8_t slot, const uint8_t* buf, size_t len) override
+    {
+        if (writes++ == cutAt)
+        {
+            memcpy(slots[slot], buf, tear < len ? tear : len);
+            if (tear >= len) done++;
+            throw powerCut();
+        }
+        memcpy(slots[slot], buf, len);
+        done++;
+        return true;
+    }
+};
+
+struct rtcWatering { uint32_t magic, seq, openMs; };
+
+// The valve/journal part of IrrigationManager, in virtual time
+struct device
+{
+    wateringJournal journal;
+    rtcWatering&    rtc;
+    bool            valve    = false;
+    uint32_t        openedMs = 0;
+    uint32_t        planned  = 0;
+
+    device(memStore& s, rtcWatering& r) : journal(s), rtc(r) {}
+
+    void open(uint32_t now, uint32_t plannedMs)
+    {
+        journal.begin(plannedMs);
+        openedMs = now;
+        planned  = plannedMs;
+        rtc      = {RTC_MAGIC, journal.seq(), 0};
+        valve    = true;
+    }
+
+    void close(uint32_t now, wateringJournal::reason why)
+    {
+        valve     = false;
+        rtc.magic = 0;
+        journal.end(why, now - openedMs);
+    }
+
+    void tick(uint32_t now)
+    {
+        if (valve) rtc.openMs = now - openedMs;
+    }
+
+    wateringJournal::action boot(uint32_t now)
+    {
+        journal.load();
+        bool known = rtc.magic == RTC_MAGIC && rtc.seq == journal.seq();
+        wateringJournal::recovery r = journal.recover(known, rtc.openMs);
+        if (r.what == wateringJournal::RESUME)
+        {
+            openedMs = now - r.elapsedMs;
+            planned  = journal.last().plannedMs;
+            rtc      = {RTC_MAGIC, journal.seq(), r.elapsedMs};
+            valve    = true;
+        }
+        else if (r.what == wateringJournal::CLOSE)
+        {
+            rtc.magic = 0;
+            journal.end(wateringJournal::INTERRUPTED, r.elapsedMs);
+        }
+        return r.what;
+    }
+};
+
+struct cutPlan
+{
+    int      writeIndex = -1;   // cut during this write...
+    size_t   tear       = 0;
+    uint32_t timeMs     = 0;    // ...or at this time (0 = none)
+    bool     rtcSurvives = true;
+    bool     cutRecovery = false;   // also cut the STOP written by the recovery
+};
+
+struct result
+{
+    uint32_t openMs[EVENT_COUNT] = {};
+    bool     started[EVENT_COUNT] = {};
+    int      cutEvent   = -1;   // event whose valve was open at the cut
+    uint32_t cutMs      = 0;
+    int      recoveries = 0;
+    int      resumed    = 0;
+    int      writes     = 0;
+    int      starts     = 0;
+    bool     closedAtEnd = false;
+};
+
+static result run(const cutPlan& plan)
+{
+    memStore     store;
+    rtcWatering  rtc = {};
+    result       res;
+    bool         cut = false;
+    int          current = -1;
+    store.cutAt = plan.writeIndex;
+    store.tear  = plan.tear;
+
+    device* dev = new device(store, rtc);
+    dev->boot(0);
+
+    for (uint32_t t = 0; t < END_MS; t += TICK_MS)
+    {
+        try
+        {
+            if (plan.timeMs && t == plan.timeMs && !cut) throw powerCut();
+            dev->tick(t);
+            if (dev->valve)
+            {
+                const event& e = EVENTS[current];
+                if (e.plannedMs && t - dev->openedMs >= dev->planned)
+                {
+                    dev->close(t, wateringJournal::DONE);
+                }
+                else if (e.stopMs == t)
+                {
+                    dev->close(t, e.plannedMs ? wateringJournal::CANCELLED : wateringJournal::DONE);
+                }
+            }
+            for (int i = 0; i < EVENT_COUNT && !dev->valve; ++i)
+            {
+                if (EVENTS[i].startMs != t) continue;
+                current = i;
+                res.started[i] = true;
+                res.starts++;
+                dev->open(t, EVENTS[i].plannedMs);
+            }
+            if (dev->valve) res.openMs[current] += TICK_MS;
+        }
+        catch (const powerCut&)
+        {
+            cut = true;
+            res.cutMs    = t;
+            res.cutEvent = dev->valve || dev->journal.open() ? current : -1;
+            delete dev;
+            if (!plan.rtcSurvives) rtc = {0x5A5A5A5A, 0xA5A5A5A5, 0xDEADBEEF};
+            t += OUTAGE_MS;
+            store.cutAt = plan.cutRecovery ? store.writes : -1;
+            for (;;)
+            {
+                dev = new device(store, rtc);
+                try
+                {
+                    wateringJournal::action a = dev->boot(t);
+                    store.cutAt = -1;
+                    if (a != wateringJournal::IDLE) res.recoveries++;
+                    if (a == wateringJournal::RESUME) res.resumed++;
+                    break;
+                }
+                catch (const powerCut&)
+                {
+                    delete dev;   // cut again during recovery; RTC kept as before
+                    t += OUTAGE_MS;
+                    store.cutAt = -1;
+                }
+            }
+            // the step that was cut is not repeated; the tick at t runs normally
+            t -= TICK_MS;
+        }
+    }
+    delete dev;
+
+    res.writes = store.done;
+    wateringJournal check(store);
+    check.load();
+    res.closedAtEnd = !check.open();
+    return res;
+}
+
+static std::string describe(const cutPlan& p)
+{
+    char buf[128];
+    if (p.timeMs) snprintf(buf, sizeof(buf), "cut at %u ms", p.timeMs);
+    else          snprintf(buf, sizeof(buf), "cut in write %d torn at %zu", p.writeIndex, p.tear);
+    std::string s = buf;
+    s += p.rtcSurvives ? ", RTC kept" : ", power loss";
+    if (p.cutRecovery) s += ", recovery cut too";
+    return s;
+}
+
+// Invariants; returns an empty string when they hold
+static std::string verify(const cutPlan& p, const result& r)
+{
+    char buf[160];
+    if (!r.closedAtEnd) return "journal left open";
+    if (r.writes > 2 * r.starts) return "more than two completed writes per event";
+    for (int i = 0; i < EVENT_COUNT; ++i)
+    {
+        const event& e = EVENTS[i];
+        if (e.plannedMs && r.openMs[i] > e.plannedMs + TICK_MS)
+        {
+            snprintf(buf, sizeof(buf), "event %d watered %u ms of %u", i, r.openMs[i], e.plannedMs);
+            return buf;
+        }
+        // a cut during the cancel's own STOP write still counts as cancelled
+        bool cancelled = r.cutMs == 0 || (p.timeMs ? r.cutMs > e.stopMs : r.cutMs >= e.stopMs);
+        if (e.stopMs && e.plannedMs && cancelled && r.openMs[i] > e.stopMs - e.startMs + TICK_MS)
+        {
+            snprintf(buf, sizeof(buf), "event %d ignored its cancel (%u ms)", i, r.openMs[i]);
+            return buf;
+        }
+    }
+    // A cut while the valve was open, with the RTC counter intact, must resume
+    int ev = r.cutEvent;
+    if (p.timeMs && p.rtcSurvives && ev >= 0 && EVENTS[ev].plannedMs && !EVENTS[ev].stopMs)
+    {
+        uint32_t before = p.timeMs - EVENTS[ev].startMs;
+        bool shouldResume = before < EVENTS[ev].plannedMs &&
+                            EVENTS[ev].plannedMs - before >= wateringJournal::MIN_RESUME_MS + TICK_MS;
+        if (shouldResume && r.openMs[ev] + TICK_MS < EVENTS[ev].plannedMs)
+        {
+            snprintf(buf, sizeof(buf), "event %d not resumed: %u ms of %u", ev, r.openMs[ev], EVENTS[ev].plannedMs);
+            return buf;
+        }
+    }
+    return "";
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+
+    result clean = run(cutPlan());
+    if (!verify(cutPlan(), clean).empty() || clean.writes != 2 * EVENT_COUNT)
+    {
+        printf("clean run failed: %d writes for %d events\n", clean.writes, EVENT_COUNT);
+        return 1;
+    }
+    printf("clean run: %d events, %d writes\n", EVENT_COUNT, clean.writes);
+
+    std::vector<cutPlan> plans;
+    for (int rtc = 0; rtc < 2; ++rtc)
+    {
+        for (int again = 0; again < 2; ++again)
+        {
+            for (int w = 0; w < clean.writes; ++w)
+            {
+                for (size_t tear = 0; tear <= wateringJournal::RECORD_BYTES; ++tear)
+                {
+                    cutPlan p;
+                    p.writeIndex = w;
+                    p.tear = tear;
+                    p.rtcSurvives = rtc;
+                    p.cutRecovery = again;
+                    plans.push_back(p);
+                }
+            }
+            for (uint32_t t = TICK_MS; t < END_MS; t += TICK_MS)
+            {
+                cutPlan p;
+                p.timeMs = t;
+                p.rtcSurvives = rtc;
+                p.cutRecovery = again;
+                plans.push_back(p);
+            }
+        }
+    }
+
+    int failures = 0, recovered = 0, resumed = 0;
+    for (const cutPlan& p : plans)
+    {
+        result r = run(p);
+        recovered += r.recoveries > 0;
+        resumed   += r.resumed > 0;
+        std::string err = verify(p, r);
+        if (!err.empty())
+        {
+            failures++;
+            if (failures <= 20 || verbose) printf("FAIL %s: %s\n", describe(p).c_str(), err.c_str());
+        }
+        else if (verbose && r.recoveries)
+        {
+            printf("ok   %s: %s\n", describe(p).c_str(), r.resumed ? "resumed" : "closed");
+        }
+    }
+    printf("%zu power cuts: %d needed recovery, %d resumed, %d failed\n",
+           plans.size(), recovered, resumed, failures);
+    return failures ? 1 : 0;
+}
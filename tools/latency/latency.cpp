@@ -0,0 +1,416 @@
+// End-to-end latency of the ASCII telemetry, per stage, from the stamps the
+// firmware adds to every sample (MqttService::loop) to the frame of
+// mqtt/mqtt_realtime_plot.py that drew it:
+//
+//   adc       sample start -> moisture averaged            device clock
+//   enqueue   -> payload formatted                         device clock
+//   publish   -> handed to PubSubClient                    device clock
+//   broker    -> received here, through the broker         wall clocks (NTP on both ends)
+//   ingest    -> the plotter's on_message                  this host's monotonic clock
+//   render    -> the plotter drew a frame with it          this host's monotonic clock
+//
+// Run it on the broker host, so "received here" stands for the broker's
+// delivery, next to the plotter with LATENCY_LOG set; without the plot log the
+// report stops at broker. A device without NTP sends wall 0: its broker stage
+// is then reported above the fastest message of the run (the clock offset is
+// unknown, the queueing on top of the fastest path is not).
+//
+// Sequence numbers count every sample since boot, published or not; the last
+// field is the sample published before this one. Samples between the two were
+// never sent (report by exception, offline) and count as held; a gap before
+// it was lost in PubSubClient or in the broker. Without that field every gap
+// counts as lost. An uptime going backwards is a reboot.
+//
+// Payload: "<time>,<moisture>,<valve>,<seq>,<uptime ms>,<wall ms>,<adc us>,<enqueue us>,<publish us>[,<prev seq>]"
+// Plot log: "<site>/<device>,<seq>,<uptime ms>,<ingest ns>,<render ns>"; seq
+// restarts on every boot, so a sample is matched by seq and uptime together.
+//
+// Build: g++ -O2 -std=c++20 -I../common latency.cpp -o latency
+// Usage: ./latency [-h host] [-p port] [-s site] [-d device|+] [-t seconds] [-l plotLog]
+//        ./latency --synth [samples]     (known delays and gaps, checks the report itself)
+
+#include "mqttLite.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static int64_t monoNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t wallMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+struct sample
+{
+    std::string device;       // "<site>/<device>"
+    uint32_t    boot;         // reboots seen before this sample
+    uint32_t    seq;
+    uint32_t    upMs;
+    uint64_t    wallMs;       // device wall clock at the sample start, 0 = not synced
+    uint32_t    adcUs;
+    uint32_t    enqUs;
+    uint32_t    pubUs;
+    int64_t     recvNs;       // monotonic, here
+    int64_t     recvWallMs;
+};
+
+struct plotStamp
+{
+    int64_t ingestNs;
+    int64_t renderNs;
+};
+
+struct seqTrack
+{
+    bool     any = false;
+    uint32_t last = 0;
+    uint32_t lastUpMs = 0;
+    uint32_t boots = 0;
+    uint64_t received = 0;
+    uint64_t missing = 0;
+    uint64_t gaps = 0;
+    uint64_t held = 0;        // not sent by the device
+    uint64_t late = 0;        // duplicates or out of order
+};
+
+static std::string plotKey(const std::string& device, uint32_t seq, uint32_t upMs)
+{
+    return device + "#" + std::to_string(seq) + "@" + std::to_string(upMs);
+}
+
+// Stage latencies of a run, in ms
+struct breakdown
+{
+    std::vector<double> adc, enq, pub, broker, brokerRel, ingest, render, total, period;
+    uint64_t            inconsistent = 0;   // plot-log matches with a negative stage or total < render
+};
+
+class latencyLog
+{
+private:
+    std::unordered_map<std::string, seqTrack>  tracks_;
+    std::unordered_map<std::string, plotStamp> plot_;
+    std::vector<sample> samples_;
+    uint64_t bad_ = 0;
+
+public:
+    const std::vector<sample>& samples() const { return samples_; }
+    const seqTrack* track(const std::string& device) const
+    {
+        auto it = tracks_.find(device);
+        return it == tracks_.end() ? nullptr : &it->second;
+    }
+
+    // Topic "<site>/<device>/telemetry"; false for payloads without stamps
+    bool onTelemetry(std::string_view topic, std::string_view payload, int64_t recvNs, int64_t recvWall)
+    {
+        std::string_view site, device, rest;
+        if (!mqttLite::splitDeviceTopic(topic, site, device, rest) || rest != "telemetry") return false;
+
+        uint64_t f[6];
+        size_t pos = payload.find(',');
+        for (int skip = 0; skip < 2 && pos != std::string_view::npos; ++skip) pos = payload.find(',', pos + 1);
+        for (uint64_t& v : f) {
+            if (pos == std::string_view::npos) { bad_++; return false; }
+            size_t end = payload.find(',', pos + 1);
+            if (end == std::string_view::npos) end = payload.size();
+            if (std::from_chars(payload.data() + pos + 1, payload.data() + end, v).ec != std::errc()) {
+                bad_++;
+                return false;
+            }
+            pos = end < payload.size() ? end : std::string_view::npos;
+        }
+        uint32_t prev = 0;
+        bool hasPrev = pos != std::string_view::npos &&
+                       std::from_chars(payload.data() + pos + 1, payload.data() + payload.size(), prev).ec == std::errc();
+        sample s{std::string(topic.substr(0, site.size() + 1 + device.size())), 0, (uint32_t)f[0],
+                 (uint32_t)f[1], f[2], (uint32_t)f[3], (uint32_t)f[4], (uint32_t)f[5], recvNs, recvWall};
+        seqTrack& t = tracks_[s.device];
+        if (t.any && s.upMs < t.lastUpMs) {
+            t.boots++;
+            t.any = false;
+        }
+        if (t.any && s.seq > t.last) {
+            uint32_t sent = hasPrev && prev < s.seq && prev >= t.last ? prev : s.seq - 1;
+            t.held += s.seq - 1 - sent;
+            if (sent > t.last) {
+                t.gaps++;
+                t.missing += sent - t.last;
+            }
+        } else if (t.any) {
+            t.late++;
+        }
+        if (!t.any || s.seq > t.last) t.last = s.seq;
+        t.any      = true;
+        t.lastUpMs = s.upMs;
+        t.received++;
+        s.boot = t.boots;
+        samples_.push_back(std::move(s));
+        return true;
+    }
+
+    void addPlot(const std::string& device, uint32_t seq, uint32_t upMs, int64_t ingestNs, int64_t renderNs)
+    {
+        plot_[plotKey(device, seq, upMs)] = {ingestNs, renderNs};
+    }
+
+    // Lines written by mqtt_realtime_plot.py; returns the number read
+    size_t loadPlotLog(const char* path)
+    {
+        FILE* f = fopen(path, "r");
+        if (!f) return 0;
+        char line[256], dev[160];
+        unsigned seq, up;
+        long long ingest, render;
+        size_t n = 0;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "%159[^,],%u,%u,%lld,%lld", dev, &seq, &up, &ingest, &render) != 5) continue;
+            addPlot(dev, seq, up, ingest, render);
+            n++;
+        }
+        fclose(f);
+        return n;
+    }
+
+    breakdown stages() const;
+    void      report() const;
+};
+
+static void printStage(const char* name, std::vector<double> v)
+{
+    if (v.empty()) {
+        printf("  %-10s %8s\n", name, "-");
+        return;
+    }
+    std::sort(v.begin(), v.end());
+    auto pct = [&](double p) { return v[std::min(v.size() - 1, (size_t)(p * v.size()))]; };
+    printf("  %-10s %8zu %9.2f %9.2f %9.2f %9.2f %9.2f\n", name, v.size(), v.front(), pct(0.50), pct(0.90),
+           pct(0.99), v.back());
+}
+
+static double median(std::vector<double> v)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+breakdown latencyLog::stages() const
+{
+    breakdown b;
+    std::unordered_map<std::string, double> fastest;   // per device and boot, for clocks without NTP
+
+    for (const sample& s : samples_) {
+        if (s.wallMs == 0) {
+            double raw = s.recvNs / 1e6 - (s.upMs + s.pubUs / 1000.0);
+            std::string key = s.device + "@" + std::to_string(s.boot);
+            auto it = fastest.find(key);
+            if (it == fastest.end() || raw < it->second) fastest[key] = raw;
+        }
+    }
+    const sample* prev = nullptr;
+    for (const sample& s : samples_) {
+        b.adc.push_back(s.adcUs / 1000.0);
+        b.enq.push_back((s.enqUs - s.adcUs) / 1000.0);
+        b.pub.push_back((s.pubUs - s.enqUs) / 1000.0);
+        double net = -1;
+        if (s.wallMs) {
+            net = s.recvWallMs - (s.wallMs + s.pubUs / 1000.0);
+            b.broker.push_back(net);
+        } else {
+            double raw = s.recvNs / 1e6 - (s.upMs + s.pubUs / 1000.0);
+            b.brokerRel.push_back(raw - fastest.at(s.device + "@" + std::to_string(s.boot)));
+        }
+        auto p = plot_.find(plotKey(s.device, s.seq, s.upMs));
+        if (p != plot_.end()) {
+            double in = (p->second.ingestNs - s.recvNs) / 1e6;
+            double rn = (p->second.renderNs - p->second.ingestNs) / 1e6;
+            b.ingest.push_back(in);
+            b.render.push_back(rn);
+            double tot = s.pubUs / 1000.0 + net + in + rn;
+            if (net >= 0) b.total.push_back(tot);
+            if (in < 0 || rn < 0 || (net >= 0 && tot < rn)) b.inconsistent++;
+        }
+        if (prev && prev->device == s.device && prev->boot == s.boot && s.seq == prev->seq + 1) {
+            b.period.push_back(s.upMs - prev->upMs);
+        }
+        prev = &s;
+    }
+    return b;
+}
+
+void latencyLog::report() const
+{
+    breakdown b = stages();
+    printf("\n%zu samples, %zu matched in the plot log, %llu unparsable\n\n", samples_.size(), b.ingest.size(),
+           (unsigned long long)bad_);
+    printf("  %-10s %8s %9s %9s %9s %9s %9s   (ms)\n", "stage", "n", "min", "p50", "p90", "p99", "max");
+    printStage("adc", b.adc);
+    printStage("enqueue", b.enq);
+    printStage("publish", b.pub);
+    printStage("broker", b.broker);
+    if (!b.brokerRel.empty()) printStage("broker*", b.brokerRel);
+    printStage("ingest", b.ingest);
+    printStage("render", b.render);
+    printStage("total", b.total);
+    if (!b.brokerRel.empty()) printf("  * no NTP on the device: above the fastest message of the run\n");
+    if (b.inconsistent) {
+        printf("  %llu plot-log matches with a negative stage: plot log from another run or boot?\n",
+               (unsigned long long)b.inconsistent);
+    }
+    if (!b.period.empty()) {
+        double p = median(b.period);
+        printf("\n  sample period %.0f ms: a change waits %.0f ms on average (up to %.0f) to be sampled\n", p,
+               p / 2, p);
+    }
+
+    printf("\n  %-44s %8s %8s %8s %6s %6s %6s\n", "device", "received", "held", "missing", "gaps", "late", "boots");
+    for (const auto& [device, t] : tracks_) {
+        printf("  %-44s %8llu %8llu %8llu %6llu %6llu %6u\n", device.c_str(), (unsigned long long)t.received,
+               (unsigned long long)t.held, (unsigned long long)t.missing, (unsigned long long)t.gaps,
+               (unsigned long long)t.late, t.boots);
+    }
+}
+
+// Generated stamps with known stage delays, bursts of samples held offline,
+// reports lost on the way, a late duplicate and a reboot; fails unless the
+// report gives back what went in
+static int runSynth(uint32_t count)
+{
+    latencyLog log;
+    std::mt19937 rng(1);
+    std::exponential_distribution<double> broker(1 / 8.0);    // ms
+    std::uniform_int_distribution<int> frame(0, 999);          // 1 s animation interval
+    int64_t  base = monoNs();
+    uint64_t wall0 = 1792335600000ULL;
+    uint32_t seq = 0, up = 5000, sent = 0;
+    uint64_t expectMissing = 0, expectHeld = 0, expectMatched = 0;
+
+    for (uint32_t i = 0; i < count; ++i, ++seq, up += 1000) {
+        if (i == count / 2) {                 // reboot
+            seq  = 0;
+            sent = 0;
+            up   = 3000;
+        }
+        if (i % 500 == 250) {                 // 7 samples not sent while offline
+            seq += 7;
+            up  += 7000;
+            expectHeld += 7;
+        }
+        bool lost = i % 500 == 400;           // published, lost in the broker
+        uint32_t adc = 850 + rng() % 50, enq = adc + 40, pub = enq + 15;
+        uint64_t w = wall0 + (up - 5000);
+        double net = 3 + broker(rng);
+        int64_t recvNs = base + (int64_t)((up + pub / 1000.0 + net) * 1e6);
+        char payload[128];
+        snprintf(payload, sizeof(payload), "2026-10-18 12:00:00,2300,0,%u,%u,%llu,%u,%u,%u,%u", seq, up,
+                 i % 3 ? (unsigned long long)w : 0ULL, adc, enq, pub, sent);
+        sent = seq;
+        if (lost) {
+            expectMissing++;
+            continue;
+        }
+        log.onTelemetry("garden/synth/telemetry", payload, recvNs, (int64_t)(w + pub / 1000.0 + net));
+        if (i == 100) {
+            log.onTelemetry("garden/synth/telemetry", payload, recvNs, (int64_t)(w + pub / 1000.0 + net));
+            expectMatched++;
+        }
+        int64_t ingest = recvNs + 200000;     // 0.2 ms to on_message, then 30..1029 ms to the frame
+        log.addPlot("garden/synth", seq, up, ingest, ingest + frame(rng) * 1000000LL + 30000000);
+        expectMatched++;
+    }
+    log.report();
+
+    breakdown b = log.stages();
+    const seqTrack* t = log.track("garden/synth");
+    int failures = 0;
+    auto check = [&](bool ok, const char* what) {
+        if (!ok) printf("  FAIL: %s\n", what);
+        failures += !ok;
+    };
+    double brokerP50 = 3 + 8 * 0.693;
+    check(b.ingest.size() == expectMatched, "every delivered sample matched in the plot log");
+    check(b.inconsistent == 0, "no negative stage, total >= render");
+    check(std::all_of(b.ingest.begin(), b.ingest.end(), [](double v) { return v > 0.199 && v < 0.201; }),
+          "ingest is the 0.2 ms that went in");
+    check(median(b.render) > 500 && median(b.render) < 560, "render p50 about 530 ms");
+    check(median(b.total) >= median(b.render), "total p50 >= render p50");
+    check(std::abs(median(b.broker) - brokerP50) < 1.5, "broker p50 about 8.5 ms");
+    check(t && t->held == expectHeld, "held samples");
+    check(t && t->missing == expectMissing, "missing samples");
+    check(t && t->late == 1 && t->boots == 1, "one late duplicate, one reboot");
+    printf(failures ? "\nFAILED\n" : "\nOK: the report matches the generated delays and gaps\n");
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* host = "localhost";
+    const char* plotLog = nullptr;
+    int port = 1883;
+    std::string site = "garden", device = "+";
+    int seconds = 60;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--synth") return runSynth(i + 1 < argc ? atoi(argv[i + 1]) : 3600);
+        if (i + 1 >= argc) break;
+        if (a == "-h") host = argv[++i];
+        else if (a == "-p") port = atoi(argv[++i]);
+        else if (a == "-s") site = argv[++i];
+        else if (a == "-d") device = argv[++i];
+        else if (a == "-t") seconds = atoi(argv[++i]);
+        else if (a == "-l") plotLog = argv[++i];
+    }
+
+    latencyLog log;
+    mqttLite::connection conn;
+    char clientId[48];
+    snprintf(clientId, sizeof(clientId), "latency-%d", (int)getpid());
+    if (!conn.open(host, port)) {
+        fprintf(stderr, "[latency] cannot reach %s:%d\n", host, port);
+        return 1;
+    }
+    conn.queue(mqttLite::connectPacket(clientId, 60));
+    conn.queue(mqttLite::subscribePacket(1, site + "/" + device + "/telemetry"));
+    printf("[latency] %s:%d, %s/%s/telemetry for %d s\n", host, port, site.c_str(), device.c_str(), seconds);
+
+    int64_t start = monoNs(), lastPing = start;
+    while (monoNs() - start < seconds * 1000000000LL) {
+        pollfd pfd{conn.fd(), (short)(POLLIN | (conn.pending() ? POLLOUT : 0)), 0};
+        poll(&pfd, 1, 200);
+        if (pfd.revents & (POLLERR | POLLHUP)) break;
+        if (!conn.flush()) break;
+        if ((pfd.revents & POLLIN) && !conn.receive()) break;
+
+        int64_t t = monoNs(), w = wallMs();
+        mqttLite::packet pkt;
+        while (conn.in.next(pkt)) {
+            if (pkt.type == mqttLite::PUBLISH) log.onTelemetry(pkt.topic, pkt.payload, t, w);
+        }
+        if (t - lastPing > 30000000000LL) {
+            conn.queue(mqttLite::pingPacket());
+            lastPing = t;
+        }
+    }
+    if (plotLog) printf("[latency] %zu plot log lines\n", log.loadPlotLog(plotLog));
+    log.report();
+    return 0;
+}
@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+"""Local client for the device live stream (ws://<device>/ws), stdlib only.
+
+    python3 ws_client.py <host> [--rate HZ] [--seconds N] [--slow MS]
+    python3 ws_client.py --selftest
+
+Prints samples/s, frames/s, lost frames (sequence gaps) and frame
+inter-arrival percentiles once per second. --slow sleeps after every frame to
+emulate a slow viewer, which makes the device skip frames for this client
+(visible as lost frames here and live_frames_dropped in cmd/stats).
+"""
+import argparse
+import base64
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+HEADER = struct.Struct("<BBHIIBB")   # version, count, periodMs, seq, t0Ms, valve, reserved
+
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        part = sock.recv(n - len(data))
+        if not part:
+            raise ConnectionError("connection closed")
+        data += part
+    return data
+
+
+def connect(host, port=80, path="/ws"):
+    sock = socket.create_connection((host, port), timeout=5)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    key = base64.b64encode(os.urandom(16)).decode()
+    sock.sendall((f"GET {path} HTTP/1.1\r\nHost: {host}\r\nUpgrade: websocket\r\n"
+                  f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\n"
+                  "Sec-WebSocket-Version: 13\r\n\r\n").encode())
+    reply = b""
+    while b"\r\n\r\n" not in reply:
+        reply += recv_exact(sock, 1)
+    if b" 101 " not in reply.split(b"\r\n", 1)[0]:
+        raise ConnectionError(reply.decode(errors="replace"))
+    return sock
+
+
+def send_text(sock, text):
+    payload = text.encode()
+    mask = os.urandom(4)
+    masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+    sock.sendall(bytes([0x81, 0x80 | len(payload)]) + mask + masked)
+
+
+def read_frame(sock):
+    """Return (opcode, payload) of the next unfragmented frame."""
+    b0, b1 = recv_exact(sock, 2)
+    n = b1 & 0x7F
+    if n == 126:
+        n = struct.unpack(">H", recv_exact(sock, 2))[0]
+    elif n == 127:
+        n = struct.unpack(">Q", recv_exact(sock, 8))[0]
+    mask = recv_exact(sock, 4) if b1 & 0x80 else None
+    data = recv_exact(sock, n)
+    if mask:
+        data = bytes(b ^ mask[i % 4] for i, b in enumerate(data))
+    return b0 & 0x0F, data
+
+
+def decode(payload):
+    version, count, period, seq, t0, valve, _ = HEADER.unpack_from(payload)
+    samples = struct.unpack_from(f"<{count}H", payload, HEADER.size)
+    return seq, t0, period, valve, samples
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def run(host, port, rate, seconds, slow_ms, out=print):
+    sock = connect(host, port)
+    if rate:
+        send_text(sock, f"rate {rate}")
+    last_seq, lost, totals = None, 0, [0, 0]
+    samples = frames = 0
+    gaps, last_arrival = [], None
+    start = report = time.monotonic()
+    while time.monotonic() - start < seconds:
+        opcode, payload = read_frame(sock)
+        if opcode == 0x8:
+            break
+        if opcode != 0x2:
+            continue
+        now = time.monotonic()
+        seq, t0, period, valve, values = decode(payload)
+        if last_seq is not None and seq != last_seq + 1:
+            lost += seq - last_seq - 1
+        last_seq = seq
+        if last_arrival is not None:
+            gaps.append((now - last_arrival) * 1000)
+        last_arrival = now
+        frames += 1
+        samples += len(values)
+        if slow_ms:
+            time.sleep(slow_ms / 1000)
+        if now - report >= 1.0:
+            out(f"{samples / (now - report):7.1f} samples/s {frames / (now - report):5.1f} frames/s "
+                f"period {period} ms valve {valve} last {values[-1] if values else '-'} lost {lost} "
+                f"gap p50 {percentile(gaps, 0.5):.1f} ms p99 {percentile(gaps, 0.99):.1f} ms")
+            totals[0] += samples
+            totals[1] += frames
+            samples = frames = 0
+            gaps = []
+            report = now
+    sock.close()
+    return totals[0] + samples, lost
+
+
+def selftest():
+    """Serve fake frames from a thread, skipping one, and check the client sees it."""
+    srv = socket.socket()
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(("127.0.0.1", 0))
+    srv.listen(1)
+    port = srv.getsockname()[1]
+
+    def serve():
+        conn, _ = srv.accept()
+        req = b""
+        while b"\r\n\r\n" not in req:
+            req += conn.recv(1024)
+        conn.sendall(b"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                     b"Connection: Upgrade\r\nSec-WebSocket-Accept: x\r\n\r\n")
+        for seq in range(60):
+            if seq == 30:
+                continue                      # dropped by "backpressure"
+            body = HEADER.pack(1, 4, 5, seq, seq * 20, seq % 2, 0) + struct.pack("<4H", *range(4))
+            conn.sendall(bytes([0x82, len(body)]) + body)
+            time.sleep(0.02)
+        conn.sendall(b"\x88\x00")
+        conn.close()
+
+    threading.Thread(target=serve, daemon=True).start()
+    total, lost = run("127.0.0.1", port, 50, 10, 0, out=lambda s: None)
+    srv.close()
+    ok = total == 59 * 4 and lost == 1
+    print(f"selftest: {total} samples, {lost} lost frame -> {'OK' if ok else 'FAIL'}")
+    return 0 if ok else 1
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("host", nargs="?")
+    ap.add_argument("--port", type=int, default=80)
+    ap.add_argument("--rate", type=int, default=0, help="sampling rate to request (Hz)")
+    ap.add_argument("--seconds", type=float, default=30)
+    ap.add_argument("--slow", type=float, default=0, help="sleep after each frame (ms)")
+    ap.add_argument("--selftest", action="store_true")
+    args = ap.parse_args()
+    if args.selftest:
+        return selftest()
+    if not args.host:
+        ap.error("host required")
+    run(args.host, args.port, args.rate, args.seconds, args.slow)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,128 @@
+// Applies a delta patch with the firmware's deltaPatch and patchInflater code
+// to a simulated OTA partition, fed in chunks like the MQTT messages the
+// device receives. MINIZ is the unpacked single-file miniz release
+// (miniz.c/miniz.h), which provides the same tinfl the device has in ROM.
+//
+// Build: gcc -O2 -c $MINIZ/miniz.c -o miniz.o
+//        g++ -O2 -std=c++17 -I../../lib/deltaOta -I$MINIZ applyDelta.cpp ../../lib/deltaOta/deltaPatch.cpp
+//            ../../lib/deltaOta/patchInflater.cpp miniz.o -lcrypto -o applyDelta
+// Usage: ./applyDelta old.bin patch.idp [out.bin] [chunkBytes]
+
+#include "deltaPatch.h"
+#include "patchInflater.h"
+
+#include <openssl/sha.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+static const uint32_t PARTITION_SIZE = 0x1E0000;
+
+struct simulatedFlash
+{
+    std::vector<uint8_t> oldImage;
+    std::vector<uint8_t> partition;
+    uint32_t             writePos = 0;
+};
+
+static bool readOld(void* ctx, uint32_t offset, uint8_t* buf, size_t len)
+{
+    simulatedFlash* f = (simulatedFlash*)ctx;
+    if (offset + len > f->oldImage.size()) return false;
+    memcpy(buf, f->oldImage.data() + offset, len);
+    return true;
+}
+
+static bool writeNew(void* ctx, const uint8_t* buf, size_t len)
+{
+    simulatedFlash* f = (simulatedFlash*)ctx;
+    if (f->writePos + len > f->partition.size()) return false;
+    memcpy(f->partition.data() + f->writePos, buf, len);
+    f->writePos += len;
+    return true;
+}
+
+static std::vector<uint8_t> readFile(const char* path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path, "rb");
+    if (!f) { perror(path); exit(1); }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    return data;
+}
+
+static uint32_t le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s old.bin patch.idp [out.bin] [chunkBytes]\n", argv[0]);
+        return 1;
+    }
+    simulatedFlash flash;
+    flash.oldImage = readFile(argv[1]);
+    std::vector<uint8_t> patch = readFile(argv[2]);
+    size_t chunk = argc > 4 ? atoi(argv[4]) : 1024;
+
+    if (patch.size() < 80 || memcmp(patch.data(), "IDP1", 4) != 0) {
+        fprintf(stderr, "bad header\n");
+        return 1;
+    }
+    uint32_t oldSize = le32(&patch[4]), newSize = le32(&patch[8]), patchSize = le32(&patch[12]);
+    uint8_t sha[32];
+    SHA256(flash.oldImage.data(), flash.oldImage.size(), sha);
+    if (oldSize != flash.oldImage.size() || memcmp(sha, &patch[16], 32) != 0) {
+        fprintf(stderr, "base image mismatch\n");
+        return 1;
+    }
+    if (patch.size() < 80 + patchSize || chunk == 0) {
+        fprintf(stderr, "truncated patch\n");
+        return 1;
+    }
+    flash.partition.assign(PARTITION_SIZE, 0xFF);
+
+    deltaPatch applier;
+    applier.begin(oldSize, newSize, readOld, writeNew, &flash);
+    patchInflater inflater;
+    if (inflater.begin(&applier) != patchInflater::OK) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (size_t off = 80; off < 80 + patchSize; off += chunk) {
+        size_t n = std::min(chunk, 80 + patchSize - off);
+        patchInflater::status st = inflater.feed(&patch[off], n, off + n == 80 + patchSize);
+        if (st != patchInflater::OK) {
+            fprintf(stderr, "%s error at patch byte %zu, %u bytes written\n",
+                    st == patchInflater::ERROR_PATCH ? "patch" : "inflate", off - 80, applier.written());
+            return 1;
+        }
+    }
+
+    if (!applier.finished()) {
+        fprintf(stderr, "short image: %u of %u bytes\n", applier.written(), newSize);
+        return 1;
+    }
+    SHA256(flash.partition.data(), newSize, sha);
+    if (memcmp(sha, &patch[48], 32) != 0) {
+        fprintf(stderr, "hash mismatch\n");
+        return 1;
+    }
+    printf("ok: %u bytes written, hash verified (%zu-byte chunks, %u bytes inflated, %u window wraps)\n",
+           newSize, chunk, inflater.inflated(), inflater.inflated() / 32768);
+
+    if (argc > 3) {
+        FILE* f = fopen(argv[3], "wb");
+        fwrite(flash.partition.data(), 1, newSize, f);
+        fclose(f);
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Build a compressed delta patch between two firmware images for the
+device-side otaUpdater (lib/deltaOta).
+
+    python3 make_delta.py old.bin new.bin patch.idp [--verify]
+    python3 make_delta.py --selftest
+
+Patch layout: 80-byte header ("IDP1", old size, new size, patch size,
+SHA-256 of the old and new image) followed by raw deflate data holding
+bsdiff-style blocks (u32 diffLen, u32 extraLen, i32 seek, diff, extra).
+"""
+import hashlib
+import random
+import struct
+import sys
+import zlib
+
+BLOCK       = 16    # bytes hashed per index entry
+STRIDE      = 8     # index every STRIDE-th position of the old image
+PARTITION   = 0x1E0000
+
+
+def build_index(old):
+    index = {}
+    for j in range(0, len(old) - BLOCK + 1, STRIDE):
+        index.setdefault(old[j:j + BLOCK], j)
+    return index
+
+
+def find_matches(old, new):
+    """Greedy exact-seed matching with bsdiff-like fuzzy forward extension."""
+    index = build_index(old)
+    matches = []
+    i = 0
+    n = len(new)
+    while i <= n - BLOCK:
+        j = index.get(new[i:i + BLOCK])
+        if j is None:
+            i += 1
+            continue
+        # Extend backwards over bytes not yet covered by a previous match
+        floor = matches[-1][0] + matches[-1][2] if matches else 0
+        while i > floor and j > 0 and new[i - 1] == old[j - 1]:
+            i -= 1
+            j -= 1
+        # Extend forwards, tolerating mismatches while they pay off
+        length, best, score, best_score = 0, 0, 0, 0
+        while i + length < n and j + length < len(old):
+            score += 1 if new[i + length] == old[j + length] else -1
+            length += 1
+            if score > best_score:
+                best_score, best = score, length
+            if score < best_score - 32:
+                break
+        matches.append((i, j, best))
+        i += max(best, 1)
+    return matches
+
+
+def make_patch(old, new):
+    matches = find_matches(old, new)
+    body = bytearray()
+    if not matches or matches[0][0] > 0:
+        first_new = matches[0][0] if matches else len(new)
+        first_old = matches[0][1] if matches else 0
+        body += struct.pack("<IIi", 0, first_new, first_old)
+        body += new[:first_new]
+    for k, (ns, os_, ln) in enumerate(matches):
+        nxt = matches[k + 1] if k + 1 < len(matches) else (len(new), os_ + ln, 0)
+        extra = new[ns + ln:nxt[0]]
+        seek = nxt[1] - (os_ + ln)
+        body += struct.pack("<IIi", ln, len(extra), seek)
+        body += bytes((new[ns + t] - old[os_ + t]) & 0xFF for t in range(ln))
+        body += extra
+
+    comp = zlib.compressobj(9, zlib.DEFLATED, -15)
+    payload = comp.compress(bytes(body)) + comp.flush()
+    header = b"IDP1" + struct.pack("<III", len(old), len(new), len(payload))
+    header += hashlib.sha256(old).digest() + hashlib.sha256(new).digest()
+    return header + payload
+
+
+def apply_patch(old, patch):
+    """Reference applier writing into a simulated (erased) OTA partition."""
+    assert patch[:4] == b"IDP1"
+    old_size, new_size, patch_size = struct.unpack_from("<III", patch, 4)
+    assert hashlib.sha256(old).digest() == patch[16:48], "base image mismatch"
+    body = zlib.decompressobj(-15).decompress(patch[80:80 + patch_size])
+
+    partition = bytearray(b"\xff" * max(PARTITION, new_size))
+    out, pos, old_pos = 0, 0, 0
+    while pos < len(body):
+        diff_len, extra_len, seek = struct.unpack_from("<IIi", body, pos)
+        pos += 12
+        for t in range(diff_len):
+            partition[out + t] = (old[old_pos + t] + body[pos + t]) & 0xFF
+        out += diff_len
+        pos += diff_len
+        partition[out:out + extra_len] = body[pos:pos + extra_len]
+        out += extra_len
+        pos += extra_len
+        old_pos += diff_len + seek
+    image = bytes(partition[:new_size])
+    assert out == new_size, "short image"
+    assert hashlib.sha256(image).digest() == patch[48:80], "hash mismatch"
+    return image
+
+
+def mutate(data, rng, edits):
+    data = bytearray(data)
+    for _ in range(edits):
+        pos = rng.randrange(len(data))
+        kind = rng.randrange(3)
+        if kind == 0:
+            data[pos:pos] = rng.randbytes(rng.randrange(1, 64))
+        elif kind == 1:
+            del data[pos:pos + rng.randrange(1, 64)]
+        else:
+            for t in range(pos, min(len(data), pos + 32), 4):
+                data[t] = (data[t] + 4) & 0xFF     # relocated pointers
+    return bytes(data)
+
+
+def selftest():
+    rng = random.Random(42)
+    for size, edits in ((0, 0), (100, 3), (20000, 20), (300000, 200)):
+        words = [rng.randbytes(8) for _ in range(256)]
+        old = b"".join(rng.choice(words) + rng.randbytes(4) for _ in range(size // 12))
+        new = mutate(old, rng, edits) if old else rng.randbytes(50)
+        patch = make_patch(old, new)
+        assert apply_patch(old, patch) == new
+        print(f"ok: {len(old):7d} -> {len(new):7d} bytes, patch {len(patch):6d} bytes")
+
+
+def main(argv):
+    if len(argv) == 2 and argv[1] == "--selftest":
+        selftest()
+        return 0
+    if len(argv) < 4:
+        print(__doc__)
+        return 1
+    old = open(argv[1], "rb").read()
+    new = open(argv[2], "rb").read()
+    patch = make_patch(old, new)
+    open(argv[3], "wb").write(patch)
+    print(f"{argv[3]}: {len(patch)} bytes ({100.0 * len(patch) / max(1, len(new)):.1f}% of full image)")
+    if "--verify" in argv:
+        apply_patch(old, patch)
+        print("verified against simulated partition")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
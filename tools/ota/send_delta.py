@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Deliver a delta patch built by make_delta.py to one device over MQTT.
+
+    python3 send_delta.py patch.idp <site>/<device> [broker] [port]
+
+Chunks go to <site>/<device>/cmd/ota/chunk as a little endian u32 patch
+offset followed by data; the device answers on ota/status with
+"ack <next offset>", "done" or "error <reason>". Lost chunks are resent
+from the last acknowledged offset.
+"""
+import struct
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+CHUNK   = 1024
+TIMEOUT = 5.0
+
+status = {"msg": None}
+event  = threading.Event()
+
+
+def on_message(client, userdata, msg):
+    status["msg"] = msg.payload.decode()
+    event.set()
+
+
+def wait_status():
+    event.clear()
+    if not event.wait(TIMEOUT):
+        return None
+    return status["msg"]
+
+
+def main(argv):
+    if len(argv) < 3:
+        print(__doc__)
+        return 1
+    patch = open(argv[1], "rb").read()
+    base = argv[2].rstrip("/") + "/"
+    broker = argv[3] if len(argv) > 3 else "localhost"
+    port = int(argv[4]) if len(argv) > 4 else 1883
+    header, body = patch[:80], patch[80:]
+
+    client = mqtt.Client()
+    client.on_message = on_message
+    client.connect(broker, port, 60)
+    client.subscribe(base + "ota/status")
+    client.loop_start()
+    time.sleep(0.5)
+
+    client.publish(base + "cmd/ota/begin", header)
+    reply = wait_status()
+    if reply != "ack 0":
+        print(f"device refused update: {reply}")
+        return 1
+
+    start = time.time()
+    offset, retries = 0, 0
+    while offset < len(body):
+        chunk = body[offset:offset + CHUNK]
+        client.publish(base + "cmd/ota/chunk", struct.pack("<I", offset) + chunk)
+        reply = wait_status()
+        if reply is None:
+            retries += 1
+            if retries > 10:
+                print("device stopped answering")
+                return 1
+            continue
+        retries = 0
+        if reply == "done":
+            offset = len(body)
+            break
+        if reply.startswith("error"):
+            print(f"device reported {reply}")
+            return 1
+        offset = int(reply.split()[1])
+        print(f"\r{offset}/{len(body)} bytes", end="", flush=True)
+
+    print(f"\npatch delivered in {time.time() - start:.1f} s, device is rebooting")
+    client.loop_stop()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,116 @@
+// Host stress test for lib/spscQueue, with the queue wifiManager uses for its
+// WiFi events (spscQueue<queuedEvent, 32>). A producer thread fires numbered
+// events the way the system event task does, in bursts and with no backoff,
+// while the consumer drains them like wifiManager::handle(). Checks that the
+// consumer sees the events in order, each at most once, with the payload it
+// was pushed with, and that every event is either popped or counted in
+// dropped(). A second pass retries refused pushes and must lose nothing.
+//
+// Build: g++ -O2 -std=c++17 -pthread -I../../lib/spscQueue spscstress.cpp -o spscstress
+// Usage: ./spscstress [-n events] [-b burst] [-s consumerSpinEvery]
+
+#include "spscQueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Same layout as wifiManager::queuedEvent, without the Arduino types
+struct queuedEvent
+{
+    int      event;
+    uint32_t timestampUs;   // carries the event number here
+    uint8_t  reason;
+};
+
+static queuedEvent make(uint32_t n)
+{
+    queuedEvent e;
+    e.event       = n % 40;
+    e.timestampUs = n;
+    e.reason      = (uint8_t)(n * 7);
+    return e;
+}
+
+struct result
+{
+    uint32_t popped   = 0;
+    uint32_t reorders = 0;   // seen after a later one, or twice
+    uint32_t corrupt  = 0;   // payload does not match its number
+    uint32_t maxSize  = 0;
+};
+
+// Fires `events` events; retry = spin on a full queue instead of dropping
+static result run(uint32_t events, uint32_t burst, uint32_t spinEvery, bool retry, uint32_t& dropped)
+{
+    spscQueue<queuedEvent, 32> q;
+    std::atomic<bool> done{false};
+    result r;
+
+    std::thread producer([&]() {
+        for (uint32_t n = 0; n < events; ++n) {
+            queuedEvent e = make(n);
+            while (!q.push(e) && retry) std::this_thread::yield();
+            if (burst && n % burst == burst - 1) std::this_thread::yield();
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    int64_t last = -1;
+    uint32_t spins = 0;
+    queuedEvent e;
+    for (;;) {
+        bool finished = done.load(std::memory_order_acquire);
+        bool any = false;
+        for (;;) {
+            uint32_t size = q.size();
+            if (size > r.maxSize) r.maxSize = size;
+            if (!q.pop(e)) break;
+            any = true;
+            r.popped++;
+            if ((int64_t)e.timestampUs <= last) r.reorders++;
+            else last = e.timestampUs;
+            queuedEvent want = make(e.timestampUs);
+            if (e.event != want.event || e.reason != want.reason) r.corrupt++;
+            if (spinEvery && ++spins % spinEvery == 0) std::this_thread::yield();   // a slow handle()
+        }
+        if (finished && !any && q.empty()) break;
+    }
+    producer.join();
+    dropped = q.dropped();
+    return r;
+}
+
+// dropped() counts refused pushes; when the producer retries them nothing may be missing
+static bool report(const char* name, uint32_t events, const result& r, uint32_t dropped, bool retry)
+{
+    bool ok = r.reorders == 0 && r.corrupt == 0 && r.maxSize <= spscQueue<queuedEvent, 32>::capacity() &&
+              (retry ? r.popped == events : r.popped + dropped == events);
+    printf("%-9s %u fired, %u popped, %u %s, %u out of order, %u corrupt, max depth %u  %s\n", name, events,
+           r.popped, dropped, retry ? "retried" : "dropped", r.reorders, r.corrupt, r.maxSize, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t events = 5000000, burst = 64, spinEvery = 16;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i];
+        if (a == "-n") events = strtoul(argv[i + 1], nullptr, 10);
+        else if (a == "-b") burst = strtoul(argv[i + 1], nullptr, 10);
+        else if (a == "-s") spinEvery = strtoul(argv[i + 1], nullptr, 10);
+    }
+
+    bool ok = true;
+    uint32_t dropped;
+    result r = run(events, burst, spinEvery, false, dropped);
+    ok &= report("dropping", events, r, dropped, false);
+    r = run(events, burst, spinEvery, true, dropped);
+    ok &= report("retrying", events, r, dropped, true);
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
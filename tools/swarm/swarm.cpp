@@ -0,0 +1,540 @@
+// Virtual device swarm: runs N copies of the firmware irrigation logic against
+// a soil model, each connected as its own MQTT client, from a single epoll loop.
+// A monitor client subscribed to the fleet wildcard measures end-to-end latency.
+//
+// Build: g++ -O2 -std=c++20 -I../common -I../../lib/irrigationLogic -I../../lib/backoff -I../../lib/reportFilter
+//            swarm.cpp ../../lib/irrigationLogic/irrigationLogic.cpp ../../lib/backoff/backoff.cpp
+//            ../../lib/reportFilter/reportFilter.cpp -o swarm
+// Usage: ./swarm [-n devices] [-h host] [-p port] [-s site] [-t seconds]
+//                [--outage-at sec --outage-for sec] [--wifi-recover ms]
+//                [--broker-restart-at sec --broker-down-for sec] [--reconnect backoff|fixed]
+//                [--rbe deadband,heartbeatSec]
+//
+// A broker restart drops every device at the same instant and refuses
+// connections while it is down; "fixed" replays the former 10 s reconnect
+// timer for comparison with the jittered backoff. --rbe turns on report by
+// exception (cmd/rbe) on every device, to compare the broker load.
+
+#include "mqttLite.h"
+#include "irrigationLogic.h"
+#include "backoff.h"
+#include "reportFilter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const uint32_t PUBLISH_INTERVAL_MS   = 1000;   // MqttService::publishLoop_
+static const uint32_t RECONNECT_INTERVAL_MS = 10000;  // former fixed MqttService reconnect timer
+static const uint32_t BACKOFF_BASE_MS       = 1000;   // MQTT_BACKOFF_BASE_MS
+static const uint32_t BACKOFF_CAP_MS        = 60000;  // MQTT_BACKOFF_CAP_MS
+static const uint32_t STORM_BUCKET_MS       = 100;    // connection attempts are counted per bucket
+static const uint32_t SAMPLE_INTERVAL_MS    = 1000;   // IrrigationManager sampling
+static const uint32_t WATER_DURATION_MS     = 10000;  // DEFAULT_WATER_DELAY
+static const uint32_t KEEPALIVE_S           = 15;     // PubSubClient default
+static const size_t   MAX_PENDING_BYTES     = 64 * 1024;
+
+static std::chrono::steady_clock::time_point g_start = std::chrono::steady_clock::now();
+
+static int64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - g_start).count();
+}
+
+// Same semantics as lib/timedLoop, driven by an explicit clock
+struct loopTimer
+{
+    uint32_t interval;
+    uint32_t lastRun;
+
+    explicit loopTimer(uint32_t i) : interval(i), lastRun(0 - i) {}
+
+    bool check(uint32_t now)
+    {
+        if (now - lastRun < interval) return false;
+        lastRun = now;
+        return true;
+    }
+};
+
+// First-order soil model: dries at a constant rate, wets while the valve is open
+struct soilModel
+{
+    double moisture;     // ADC counts, higher = drier
+    double dryRate;      // counts per second
+    double wetRate;      // counts per second of valve time
+    bool   valveOpen = false;
+
+    void advance(double seconds)
+    {
+        moisture += (valveOpen ? -wetRate : dryRate) * seconds;
+        moisture = std::clamp(moisture, 0.0, 4095.0);
+    }
+};
+
+struct virtualDevice
+{
+    enum linkState : uint8_t { OFFLINE, CONNECTING, ONLINE };
+
+    std::string         id;
+    std::string         telemetryTopic;
+    std::string         statusTopic;
+    irrigationLogic     logic{SAMPLE_INTERVAL_MS, WATER_DURATION_MS, 2600};
+    soilModel           soil;
+    mqttLite::connection conn;
+    linkState           state = OFFLINE;
+    bool                wantOut = false;
+    loopTimer           reconnectLoop{RECONNECT_INTERVAL_MS};
+    backoff             retry{BACKOFF_BASE_MS, BACKOFF_CAP_MS};
+    uint32_t            nextAttemptMs = 0;
+    bool                connectNow = true;   // boot or GOT_IP
+    bool                wifiWasUp = true;
+    loopTimer           publishLoop{PUBLISH_INTERVAL_MS};
+    uint32_t            bootMs = 0;
+    uint32_t            wifiBackMs = 0;
+    uint32_t            lastTickMs = 0;
+    uint32_t            lastPingMs = 0;
+    uint32_t            seq = 0;             // telemetry samples, as the firmware numbers them
+    reportFilter        filter;              // MqttService::rbe_
+    uint32_t            reportSeq = 0;
+    int64_t             connectStartUs = 0;
+    std::deque<std::pair<uint64_t, int64_t>> inFlight;   // payload hash, send time
+};
+
+struct periodStats
+{
+    uint64_t published = 0;
+    uint64_t suppressed = 0;     // report by exception
+    uint64_t received = 0;
+    uint64_t lost = 0;
+    uint64_t stalledSends = 0;
+    uint64_t droppedLocal = 0;
+    uint64_t connectAttempts = 0;
+    uint64_t connectOk = 0;
+    uint64_t linkDrops = 0;
+    uint64_t refused = 0;
+    uint32_t peakAttempts = 0;   // per STORM_BUCKET_MS
+    size_t   maxPending = 0;
+    std::vector<double> latencyMs;
+    std::vector<double> connectMs;
+};
+
+static double percentile(std::vector<double>& v, double p)
+{
+    if (v.empty()) return 0.0;
+    size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+static uint64_t hashPayload(std::string_view s)
+{
+    return std::hash<std::string_view>{}(s);
+}
+
+class swarm
+{
+private:
+    std::vector<virtualDevice> devices_;
+    std::unordered_map<std::string, uint32_t> byTopic_;
+    mqttLite::connection monitor_;
+    int         epfd_;
+    const char* host_;
+    int         port_;
+    periodStats stats_;
+    std::string sysConnected_ = "?";
+    std::string sysDropped_ = "?";
+    std::mt19937 rng_{1234};
+    bool        useBackoff_ = true;
+    uint32_t    brokerDownUntil_ = 0;
+    uint32_t    restartAt_ = 0;          // last broker restart, 0 once the fleet is back
+    uint32_t    restartAttempts_ = 0;
+    uint32_t    restartPeak_ = 0;
+    uint32_t    bucketStart_ = 0;
+    uint32_t    bucketAttempts_ = 0;
+
+    void arm(uint32_t i, virtualDevice& d)
+    {
+        bool want = d.conn.pending() > 0 || d.state == virtualDevice::CONNECTING;
+        if (want == d.wantOut) return;
+        epoll_event ev{};
+        ev.events = EPOLLIN | (want ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.u32 = i;
+        epoll_ctl(epfd_, EPOLL_CTL_MOD, d.conn.fd(), &ev);
+        d.wantOut = want;
+    }
+
+    void drop(virtualDevice& d)
+    {
+        if (d.conn.fd() >= 0) epoll_ctl(epfd_, EPOLL_CTL_DEL, d.conn.fd(), nullptr);
+        d.conn.close();
+        d.state = virtualDevice::OFFLINE;
+        d.wantOut = false;
+        d.nextAttemptMs = (uint32_t)(nowUs() / 1000) + d.retry.next();   // MqttService::attemptDone(false)
+    }
+
+    void countAttempt(uint32_t now)
+    {
+        stats_.connectAttempts++;
+        if (restartAt_) restartAttempts_++;
+        if (now - bucketStart_ >= STORM_BUCKET_MS) {
+            bucketStart_ = now - now % STORM_BUCKET_MS;
+            bucketAttempts_ = 0;
+        }
+        bucketAttempts_++;
+        stats_.peakAttempts = std::max(stats_.peakAttempts, bucketAttempts_);
+        if (restartAt_) restartPeak_ = std::max(restartPeak_, bucketAttempts_);
+    }
+
+    void startConnect(uint32_t i, virtualDevice& d, uint32_t now)
+    {
+        countAttempt(now);
+        if (now < brokerDownUntil_) {          // restarting broker refuses the connection
+            stats_.refused++;
+            d.nextAttemptMs = now + d.retry.next();
+            return;
+        }
+        if (!d.conn.open(host_, port_)) {
+            d.nextAttemptMs = now + d.retry.next();
+            return;
+        }
+        d.state = virtualDevice::CONNECTING;
+        d.connectStartUs = nowUs();
+        d.conn.queue(mqttLite::connectPacket(d.id, KEEPALIVE_S, d.statusTopic, "offline"));
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.u32 = i;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, d.conn.fd(), &ev);
+        d.wantOut = true;
+    }
+
+    void publish(uint32_t i, virtualDevice& d, uint32_t now)
+    {
+        uint32_t seq = d.seq++;              // counted published or not, as on the firmware
+        int moisture = (int)d.soil.moisture;
+        if (d.filter.offer(now, moisture, d.logic.watering()) == reportFilter::SUPPRESSED) {
+            stats_.suppressed++;
+            return;
+        }
+        if (d.conn.pending() > MAX_PENDING_BYTES) {
+            stats_.droppedLocal++;
+            d.filter.resync();
+            return;
+        }
+        // Same fields as the firmware, for tools/latency; no ADC averaging here
+        int64_t t0 = nowUs();
+        timespec wall;
+        clock_gettime(CLOCK_REALTIME, &wall);
+        time_t t = wall.tv_sec;
+        tm lt;
+        localtime_r(&t, &lt);
+        char payload[128];
+        size_t n = strftime(payload, sizeof(payload), "%Y-%m-%d %H:%M:%S", &lt);
+        n += snprintf(payload + n, sizeof(payload) - n, ",%d,%d,%u,%u,%lld,0",
+                      moisture, (int)d.logic.watering(), seq, now - d.bootMs,
+                      (long long)wall.tv_sec * 1000 + wall.tv_nsec / 1000000);
+        n += snprintf(payload + n, sizeof(payload) - n, ",%lld", (long long)(nowUs() - t0));
+        snprintf(payload + n, sizeof(payload) - n, ",%lld,%u", (long long)(nowUs() - t0), d.reportSeq);
+        d.reportSeq = seq;
+
+        mqttLite::appendPublish(d.conn.outBuffer(), d.telemetryTopic, payload);
+        if (!d.conn.flush()) { stats_.linkDrops++; drop(d); return; }
+        if (d.conn.pending()) stats_.stalledSends++;
+        stats_.maxPending = std::max(stats_.maxPending, d.conn.pending());
+        stats_.published++;
+        d.inFlight.emplace_back(hashPayload(payload), nowUs());
+        if (d.inFlight.size() > 256) d.inFlight.pop_front();
+        d.lastPingMs = now;
+        arm(i, d);
+    }
+
+    void onMonitorPublish(std::string_view topic, std::string_view payload)
+    {
+        if (topic == "$SYS/broker/clients/connected") { sysConnected_ = payload; return; }
+        if (topic == "$SYS/broker/publish/messages/dropped") { sysDropped_ = payload; return; }
+
+        auto it = byTopic_.find(std::string(topic));
+        if (it == byTopic_.end()) return;
+        virtualDevice& d = devices_[it->second];
+        uint64_t h = hashPayload(payload);
+        while (!d.inFlight.empty()) {
+            auto [hash, sentUs] = d.inFlight.front();
+            d.inFlight.pop_front();
+            if (hash == h) {
+                stats_.received++;
+                stats_.latencyMs.push_back((nowUs() - sentUs) / 1000.0);
+                return;
+            }
+            stats_.lost++;
+        }
+    }
+
+public:
+    swarm(uint32_t n, const char* host, int port, const std::string& site)
+        : devices_(n), epfd_(epoll_create1(0)), host_(host), port_(port)
+    {
+        std::uniform_real_distribution<double> dry(0.5, 3.0), wet(20.0, 60.0), start(1800, 2600);
+        std::uniform_int_distribution<uint32_t> boot(0, 5000);
+        for (uint32_t i = 0; i < n; ++i) {
+            virtualDevice& d = devices_[i];
+            d.retry.seed(rng_());                  // esp_random() on the device
+            char id[48];
+            snprintf(id, sizeof(id), "garden_irrigator-sim%07u", i);
+            d.id = id;
+            d.telemetryTopic = site + "/" + d.id + "/telemetry";
+            d.statusTopic    = site + "/" + d.id + "/status";
+            d.soil.moisture  = start(rng_);
+            d.soil.dryRate   = dry(rng_);
+            d.soil.wetRate   = wet(rng_);
+            d.bootMs         = boot(rng_);
+            byTopic_[d.telemetryTopic] = i;
+        }
+
+        monitor_.open(host_, port_);
+        monitor_.queue(mqttLite::connectPacket("swarm-monitor", 60));
+        monitor_.queue(mqttLite::subscribePacket(1, site + "/+/telemetry"));
+        monitor_.queue(mqttLite::subscribePacket(2, "$SYS/broker/clients/connected"));
+        monitor_.queue(mqttLite::subscribePacket(3, "$SYS/broker/publish/messages/dropped"));
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.u32 = UINT32_MAX;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, monitor_.fd(), &ev);
+    }
+
+    // Simulate a WiFi outage: every link drops, then comes back at a random offset
+    void outage(uint32_t now, uint32_t durationMs, uint32_t recoverMs)
+    {
+        std::uniform_int_distribution<uint32_t> recover(0, recoverMs);
+        for (auto& d : devices_) d.wifiBackMs = now + durationMs + recover(rng_);
+        printf("[swarm] WiFi outage for %u ms (recovery spread %u ms)\n", durationMs, recoverMs);
+    }
+
+    void setBackoff(bool on)
+    {
+        useBackoff_ = on;
+    }
+
+    void setReportByException(uint16_t deadband, uint32_t heartbeatMs)
+    {
+        for (auto& d : devices_) d.filter.configure(true, deadband, heartbeatMs);
+    }
+
+    // Simulate a broker restart: every session drops at once and connections
+    // are refused for downMs
+    void brokerRestart(uint32_t now, uint32_t downMs)
+    {
+        for (auto& d : devices_) {
+            if (d.state == virtualDevice::OFFLINE) continue;
+            stats_.linkDrops++;
+            drop(d);
+        }
+        brokerDownUntil_ = now + downMs;
+        restartAt_ = now;
+        restartAttempts_ = restartPeak_ = 0;
+        printf("[swarm] broker restart, down for %u ms\n", downMs);
+    }
+
+    void tick(uint32_t now)
+    {
+        for (uint32_t i = 0; i < devices_.size(); ++i) {
+            virtualDevice& d = devices_[i];
+            if (now < d.bootMs) continue;
+            bool wifiUp = now >= d.wifiBackMs;
+
+            if (!wifiUp && d.state != virtualDevice::OFFLINE) {
+                stats_.linkDrops++;
+                drop(d);
+            }
+            if (wifiUp && !d.wifiWasUp) {              // GOT_IP -> MqttService::onNetworkUp()
+                d.retry.reset();
+                d.connectNow = true;
+            }
+            d.wifiWasUp = wifiUp;
+
+            // IrrigationManager::update()
+            d.soil.advance((now - d.lastTickMs) / 1000.0);
+            d.lastTickMs = now;
+            if (d.logic.update(now) == irrigationLogic::STOP_WATERING) d.soil.valveOpen = false;
+            if (d.logic.sampleDue(now) &&
+                d.logic.onSample((int)d.soil.moisture, now) == irrigationLogic::START_WATERING) {
+                d.soil.valveOpen = true;
+            }
+
+            // MqttService::loop()
+            if (d.state == virtualDevice::OFFLINE) {
+                bool due = useBackoff_ ? d.connectNow || (int32_t)(now - d.nextAttemptMs) >= 0
+                                       : d.reconnectLoop.check(now);
+                if (due && wifiUp) {
+                    d.connectNow = false;
+                    startConnect(i, d, now);
+                }
+            }
+            if (d.state == virtualDevice::ONLINE) {
+                if (d.publishLoop.check(now)) publish(i, d, now);
+                else if (now - d.lastPingMs > KEEPALIVE_S * 1000 / 2) {
+                    d.conn.queue(mqttLite::pingPacket());
+                    d.lastPingMs = now;
+                    d.conn.flush();
+                    arm(i, d);
+                }
+            }
+        }
+        monitor_.flush();
+
+        if (restartAt_) {
+            uint32_t online = 0;
+            for (auto& d : devices_) online += d.state == virtualDevice::ONLINE;
+            if (online == devices_.size()) {
+                printf("[swarm] fleet back %u ms after the broker restart: %u attempts, peak %u per %u ms\n",
+                       now - restartAt_, restartAttempts_, restartPeak_, STORM_BUCKET_MS);
+                restartAt_ = 0;
+            }
+        }
+    }
+
+    void poll(int timeoutMs)
+    {
+        epoll_event events[512];
+        int n = epoll_wait(epfd_, events, 512, timeoutMs);
+        for (int k = 0; k < n; ++k) {
+            uint32_t i = events[k].data.u32;
+            if (i == UINT32_MAX) {
+                if (!monitor_.flush() || !monitor_.receive()) {
+                    fprintf(stderr, "[swarm] monitor connection lost\n");
+                    epoll_ctl(epfd_, EPOLL_CTL_DEL, monitor_.fd(), nullptr);
+                    monitor_.close();
+                    continue;
+                }
+                if (!monitor_.pending()) {
+                    epoll_event ev{};
+                    ev.events = EPOLLIN;
+                    ev.data.u32 = UINT32_MAX;
+                    epoll_ctl(epfd_, EPOLL_CTL_MOD, monitor_.fd(), &ev);
+                }
+                mqttLite::packet pkt;
+                while (monitor_.in.next(pkt)) {
+                    if (pkt.type == mqttLite::PUBLISH) onMonitorPublish(pkt.topic, pkt.payload);
+                }
+                continue;
+            }
+
+            virtualDevice& d = devices_[i];
+            if (events[k].events & (EPOLLERR | EPOLLHUP)) { drop(d); continue; }
+            if (!d.conn.flush() || ((events[k].events & EPOLLIN) && !d.conn.receive())) {
+                stats_.linkDrops++;
+                drop(d);
+                continue;
+            }
+            mqttLite::packet pkt;
+            while (d.conn.in.next(pkt)) {
+                if (pkt.type == mqttLite::CONNACK && pkt.body.size() >= 2 && pkt.body[1] == 0) {
+                    d.state = virtualDevice::ONLINE;
+                    d.retry.reset();
+                    d.filter.resync();
+                    stats_.connectOk++;
+                    stats_.connectMs.push_back((nowUs() - d.connectStartUs) / 1000.0);
+                    mqttLite::appendPublish(d.conn.outBuffer(), d.statusTopic, "online", true);
+                    d.conn.flush();
+                }
+            }
+            if (d.state != virtualDevice::OFFLINE) arm(i, d);
+        }
+    }
+
+    void report(double seconds)
+    {
+        uint32_t online = 0;
+        for (auto& d : devices_) online += d.state == virtualDevice::ONLINE;
+        printf("[swarm] online %5u/%zu | pub %7.0f/s (suppressed %.0f/s) | e2e ms p50 %6.2f p95 %6.2f p99 %7.2f | "
+               "lost %llu | stalled %llu, local drops %llu, max pending %zu B | "
+               "connects %llu/%llu (p95 %.1f ms, refused %llu, peak %u/%u ms) | drops %llu | "
+               "broker clients %s, dropped %s\n",
+               online, devices_.size(), stats_.published / seconds, stats_.suppressed / seconds,
+               percentile(stats_.latencyMs, 0.50), percentile(stats_.latencyMs, 0.95),
+               percentile(stats_.latencyMs, 0.99), (unsigned long long)stats_.lost,
+               (unsigned long long)stats_.stalledSends, (unsigned long long)stats_.droppedLocal,
+               stats_.maxPending, (unsigned long long)stats_.connectOk,
+               (unsigned long long)stats_.connectAttempts, percentile(stats_.connectMs, 0.95),
+               (unsigned long long)stats_.refused, stats_.peakAttempts, STORM_BUCKET_MS,
+               (unsigned long long)stats_.linkDrops, sysConnected_.c_str(), sysDropped_.c_str());
+        fflush(stdout);
+        stats_ = periodStats();
+    }
+};
+
+int main(int argc, char** argv)
+{
+    uint32_t n = 100;
+    const char* host = "localhost";
+    int port = 1883;
+    std::string site = "sim";
+    uint32_t duration = 60, outageAt = 0, outageFor = 0, wifiRecover = 7000;
+    uint32_t restartAt = 0, downFor = 0;
+    bool useBackoff = true;
+    int rbeDeadband = -1, rbeHeartbeat = 300;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i];
+        if (a == "-n") n = atoi(argv[i + 1]);
+        else if (a == "-h") host = argv[i + 1];
+        else if (a == "-p") port = atoi(argv[i + 1]);
+        else if (a == "-s") site = argv[i + 1];
+        else if (a == "-t") duration = atoi(argv[i + 1]);
+        else if (a == "--outage-at") outageAt = atoi(argv[i + 1]);
+        else if (a == "--outage-for") outageFor = atoi(argv[i + 1]);
+        else if (a == "--wifi-recover") wifiRecover = atoi(argv[i + 1]);
+        else if (a == "--broker-restart-at") restartAt = atoi(argv[i + 1]);
+        else if (a == "--broker-down-for") downFor = atoi(argv[i + 1]);
+        else if (a == "--reconnect") useBackoff = std::string(argv[i + 1]) != "fixed";
+        else if (a == "--rbe") sscanf(argv[i + 1], "%d,%d", &rbeDeadband, &rbeHeartbeat);
+    }
+
+    rlimit lim;
+    getrlimit(RLIMIT_NOFILE, &lim);
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+    if (lim.rlim_cur < n + 16) {
+        fprintf(stderr, "[swarm] file descriptor limit %llu too low for %u devices\n",
+                (unsigned long long)lim.rlim_cur, n);
+        return 1;
+    }
+
+    printf("[swarm] %u virtual devices -> %s:%d (site '%s') for %u s\n", n, host, port, site.c_str(), duration);
+    swarm sw(n, host, port, site);
+    sw.setBackoff(useBackoff);
+    if (rbeDeadband >= 0) sw.setReportByException(rbeDeadband, rbeHeartbeat * 1000);
+    uint32_t lastReport = 0;
+    bool outageDone = outageFor == 0;
+    bool restartDone = restartAt == 0;
+
+    for (;;) {
+        uint32_t now = (uint32_t)(nowUs() / 1000);
+        if (now >= duration * 1000) break;
+        if (!outageDone && now >= outageAt * 1000) {
+            sw.outage(now, outageFor * 1000, wifiRecover);
+            outageDone = true;
+        }
+        if (!restartDone && now >= restartAt * 1000) {
+            sw.brokerRestart(now, downFor * 1000);
+            restartDone = true;
+        }
+        sw.tick(now);
+        sw.poll(5);
+        if (now - lastReport >= 1000) {
+            sw.report((now - lastReport) / 1000.0);
+            lastReport = now;
+        }
+    }
+    return 0;
+}
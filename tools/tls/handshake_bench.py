@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Full versus resumed TLS handshake times against an MQTT broker.
+
+    python3 handshake_bench.py host <broker> [--port 8883] [--cafile ca.pem] [-n 20]
+    python3 handshake_bench.py device <broker> <site>/<device> [--port 8883] [--cafile ca.pem] [-n 10]
+
+"host" measures TLS 1.2 handshakes from this machine, first without and then
+with the previous session. It checks that the broker actually resumes sessions,
+and it gives a baseline without the device's CPU cost.
+
+"device" makes the device reconnect through cmd/reconnect: "full" forgets its
+session first, and an empty payload resumes. It waits for each "online" on
+status and then reads the tls_* counters from cmd/stats.
+"""
+import argparse
+import socket
+import ssl
+import statistics
+import sys
+import threading
+import time
+
+
+def tls_context(cafile):
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    ctx.maximum_version = ssl.TLSVersion.TLSv1_2   # what the device speaks
+    if cafile:
+        ctx.load_verify_locations(cafile)
+    else:
+        ctx.check_hostname = False
+        ctx.verify_mode = ssl.CERT_NONE
+    return ctx
+
+
+def handshake(ctx, host, port, session=None):
+    t0 = time.perf_counter()
+    raw = socket.create_connection((host, port), timeout=10)
+    sock = ctx.wrap_socket(raw, server_hostname=host, session=session)
+    ms = (time.perf_counter() - t0) * 1000
+    result = (ms, sock.session_reused, sock.session, sock.cipher()[0])
+    sock.close()
+    return result
+
+
+def summary(label, values):
+    if not values:
+        return f"{label}: none"
+    return (f"{label}: n={len(values)} median {statistics.median(values):.1f} ms "
+            f"min {min(values):.1f} ms max {max(values):.1f} ms")
+
+
+def bench_host(args):
+    ctx = tls_context(args.cafile)
+    full, resumed, session, not_resumed = [], [], None, 0
+    for _ in range(args.n):
+        ms, _, session, cipher = handshake(ctx, args.broker, args.port)
+        full.append(ms)
+    for _ in range(args.n):
+        ms, reused, session, _ = handshake(ctx, args.broker, args.port, session)
+        if reused:
+            resumed.append(ms)
+        else:
+            not_resumed += 1
+    print(f"cipher {cipher}")
+    print(summary("full   ", full))
+    print(summary("resumed", resumed))
+    if not_resumed:
+        print(f"warning: {not_resumed} handshakes were not resumed, check the broker's session cache/tickets")
+    return 0
+
+
+def bench_device(args):
+    import paho.mqtt.client as mqtt
+
+    online = threading.Event()
+    stats = {}
+    got_stats = threading.Event()
+
+    def on_connect(c, userdata, flags, rc):
+        c.subscribe(f"{args.prefix}/status")
+        c.subscribe(f"{args.prefix}/stats")
+
+    def on_message(c, userdata, msg):
+        text = msg.payload.decode(errors="replace")
+        if msg.topic.endswith("/status") and text == "online" and not msg.retain:
+            online.set()
+        elif msg.topic.endswith("/stats") and "tls_full=" in text:
+            stats.clear()
+            stats.update(kv.split("=", 1) for kv in text.split(",") if "=" in kv)
+            got_stats.set()
+
+    client = mqtt.Client()
+    if args.port == 8883 or args.cafile:
+        client.tls_set(ca_certs=args.cafile, cert_reqs=ssl.CERT_REQUIRED if args.cafile else ssl.CERT_NONE)
+        if not args.cafile:
+            client.tls_insecure_set(True)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.loop_start()
+    time.sleep(1)
+
+    def cycle(payload):
+        online.clear()
+        t0 = time.monotonic()
+        client.publish(f"{args.prefix}/cmd/reconnect", payload)
+        if not online.wait(30):
+            raise TimeoutError("device did not come back online")
+        return (time.monotonic() - t0) * 1000
+
+    def read_stats():
+        got_stats.clear()
+        client.publish(f"{args.prefix}/cmd/stats", "")
+        if not got_stats.wait(10):
+            raise TimeoutError("no stats with tls counters (is TLS enabled on the device?)")
+        return dict(stats)
+
+    full_rt, resumed_rt, full_dev, resumed_dev = [], [], [], []
+    for payload, rt, dev in (("full", full_rt, full_dev), ("", resumed_rt, resumed_dev)):
+        for _ in range(args.n):
+            rt.append(cycle(payload))
+            s = read_stats()
+            dev.append(float(s["tls_last_ms"]))
+            time.sleep(0.5)
+    s = read_stats()
+    client.loop_stop()
+
+    print(summary("device full handshake   ", full_dev))
+    print(summary("device resumed handshake", resumed_dev))
+    print(summary("reconnect to online, full   ", full_rt))
+    print(summary("reconnect to online, resumed", resumed_rt))
+    print(f"device counters: full={s['tls_full']} resumed={s['tls_resumed']} "
+          f"failures={s['tls_failures']} worst loop stall={s['tls_step_max_ms']} ms")
+    return 0
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("mode", choices=["host", "device"])
+    ap.add_argument("broker")
+    ap.add_argument("prefix", nargs="?", help="<site>/<device> (device mode)")
+    ap.add_argument("--port", type=int, default=8883)
+    ap.add_argument("--cafile")
+    ap.add_argument("-n", type=int, default=10)
+    args = ap.parse_args()
+    if args.mode == "device":
+        if not args.prefix:
+            ap.error("device mode needs <site>/<device>")
+        return bench_device(args)
+    return bench_host(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
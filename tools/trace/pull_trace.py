@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Download a sensor trace captured on the device (cmd/trace start N).
+
+    python3 pull_trace.py mqtt <broker> <site>/<device> out.bin
+    python3 pull_trace.py serial /dev/ttyACM0 out.bin
+
+Over MQTT the device publishes u32 offset + data chunks on trace/data and
+"end <size>" on trace/status; a chunk that arrives out of order triggers a new
+"get <offset>" from the first missing byte. Over USB the device answers
+"trace get" with frames 0xFE 0xB2, u32 offset, u16 length, data, ending with a
+zero-length frame. The result can be fed to tools/trace/replay.
+"""
+import struct
+import sys
+import time
+
+SYNC = b"\xFE\xB2"
+
+
+def pull_mqtt(broker, prefix, timeout=30):
+    import paho.mqtt.client as mqtt
+
+    data = bytearray()
+    state = {"size": None, "done": False, "last": time.monotonic()}
+
+    def request(offset):
+        client.publish(f"{prefix}/cmd/trace", f"get {offset}")
+
+    def on_connect(c, userdata, flags, rc):
+        c.subscribe(f"{prefix}/trace/data")
+        c.subscribe(f"{prefix}/trace/status")
+        request(0)
+
+    def on_message(c, userdata, msg):
+        state["last"] = time.monotonic()
+        if msg.topic.endswith("/status"):
+            text = msg.payload.decode(errors="replace")
+            if text.startswith("size "):
+                state["size"] = int(text.split()[1])
+            elif text.startswith("end "):
+                state["done"] = len(data) >= int(text.split()[1])
+                if not state["done"]:
+                    request(len(data))
+            else:
+                print(f"[device] {text}")
+            return
+        offset = struct.unpack_from("<I", msg.payload)[0]
+        if offset == len(data):
+            data.extend(msg.payload[4:])
+            if state["size"]:
+                print(f"\r{len(data)}/{state['size']} bytes", end="", flush=True)
+        elif offset > len(data):
+            request(len(data))          # lost a chunk: resume from the gap
+
+    client = mqtt.Client()
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(broker)
+    client.loop_start()
+    while not state["done"] and time.monotonic() - state["last"] < timeout:
+        time.sleep(0.1)
+    client.loop_stop()
+    print()
+    if not state["done"]:
+        raise TimeoutError(f"transfer stalled at {len(data)} bytes")
+    return bytes(data)
+
+
+def pull_serial(port, timeout=10):
+    import serial
+
+    data = bytearray()
+    with serial.Serial(port, 115200, timeout=timeout) as ser:
+        ser.reset_input_buffer()
+        ser.write(b"trace get\n")
+        while True:
+            # skip log output until the next frame marker
+            if ser.read(1) != SYNC[:1] or ser.read(1) != SYNC[1:]:
+                continue
+            head = ser.read(6)
+            if len(head) < 6:
+                raise TimeoutError(f"no data after {len(data)} bytes")
+            offset, length = struct.unpack("<IH", head)
+            if length == 0:
+                return bytes(data)
+            chunk = ser.read(length)
+            if offset != len(data) or len(chunk) != length:
+                raise IOError(f"bad frame at offset {offset} (have {len(data)})")
+            data.extend(chunk)
+
+
+def main():
+    if len(sys.argv) == 5 and sys.argv[1] == "mqtt":
+        data = pull_mqtt(sys.argv[2], sys.argv[3])
+    elif len(sys.argv) == 4 and sys.argv[1] == "serial":
+        data = pull_serial(sys.argv[2])
+    else:
+        print(__doc__)
+        return 2
+    with open(sys.argv[-1], "wb") as f:
+        f.write(data)
+    print(f"saved {len(data)} bytes to {sys.argv[-1]}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
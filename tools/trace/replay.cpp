@@ -0,0 +1,326 @@
+// Deterministic replay of a device sensor trace (lib/sensorTrace) through the
+// firmware's irrigationLogic in virtual time.
+//
+// Build: g++ -O2 -std=c++17 -I../../lib/irrigationLogic -I../../lib/sensorTrace replay.cpp
+//            ../../lib/irrigationLogic/irrigationLogic.cpp ../../lib/sensorTrace/sensorTrace.cpp -o replay
+// Usage: ./replay trace.bin                        verify: decisions must match bit for bit
+//        ./replay trace.bin [-t threshold] [-d durationMs] [-f mean|median|trimmed]
+//                                                  what-if: compare against the recorded run
+//        ./replay trace.bin --bench [repeats]      replay throughput
+//        ./replay --synth out.bin [minutes] [-p pulses,soakMs[,target]] [-a]
+//                                                  write a synthetic trace for testing
+//                                                  (-a: events sized like adaptive watering)
+
+#include "irrigationLogic.h"
+#include "sensorTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+using sensorTrace::record;
+
+enum filterKind { MEAN, MEDIAN, TRIMMED };
+
+static const uint32_t STOP_SLACK_MS = 250;   // a pulse may end this much after it was due (loop passes)
+
+// MEAN is the firmware filter; the others are candidates to evaluate offline
+static int applyFilter(filterKind f, const uint16_t* raw, uint16_t n)
+{
+    if (f == MEAN || n < 4) return irrigationLogic::average(raw, n);
+    uint16_t s[sensorTrace::MAX_RAW];
+    memcpy(s, raw, n * sizeof(uint16_t));
+    std::sort(s, s + n);
+    if (f == MEDIAN) return s[n / 2];
+    uint16_t cut = n / 10;                      // drop the top and bottom 10%
+    return irrigationLogic::average(s + cut, n - 2 * cut);
+}
+
+struct runStats
+{
+    uint32_t samples = 0;
+    uint32_t waterings = 0;
+    uint64_t valveOnMs = 0;
+    uint32_t mismatches = 0;
+    uint32_t durationMs = 0;
+};
+
+static std::vector<uint8_t> loadFile(const char* path)
+{
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path, "rb");
+    if (!f) return data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    return data;
+}
+
+// Valve-on time and waterings as recorded by the device
+static runStats recordedStats(const std::vector<uint8_t>& trace)
+{
+    runStats st;
+    sensorTrace::reader rd(trace.data(), trace.size());
+    static record r;
+    uint32_t openedAt = 0, first = rd.info().startMs, last = first;
+    bool open = false;
+    while (rd.next(r)) {
+        last = r.timeMs;
+        if (r.type == sensorTrace::SAMPLE) st.samples++;
+        if (r.type != sensorTrace::VALVE || (bool)r.value == open) continue;
+        open = r.value;
+        if (open) {
+            openedAt = r.timeMs;
+            st.waterings++;
+        } else {
+            st.valveOnMs += r.timeMs - openedAt;
+        }
+    }
+    if (open) st.valveOnMs += last - openedAt;
+    st.durationMs = last - first;
+    return st;
+}
+
+// Replays the trace with the recorded configuration and checks every decision
+static runStats verify(const std::vector<uint8_t>& trace, bool quiet)
+{
+    runStats st;
+    sensorTrace::reader rd(trace.data(), trace.size());
+    const sensorTrace::header& h = rd.info();
+    irrigationLogic logic(h.sampleIntervalMs, h.waterMs, h.threshold);
+    logic.setPulses(h.pulses, h.soakMs, h.target);
+    static record r;
+    uint8_t pending = irrigationLogic::NONE;   // decision a sample produced, due in the trace
+    uint32_t pendingAt = 0, startedAt = 0;
+    bool open = false;
+
+    auto mismatch = [&](const char* what, uint32_t t) {
+        st.mismatches++;
+        if (!quiet && st.mismatches <= 20) printf("  mismatch at %+.3f s: %s\n", (t - h.startMs) / 1000.0, what);
+    };
+
+    while (rd.next(r)) {
+        if (pending && (r.type != sensorTrace::DECISION || r.timeMs != pendingAt)) {
+            // The device did not start (e.g. blocked by a watering window): follow it
+            mismatch("replay decided after a sample, device did not", pendingAt);
+            logic.cancelWatering();
+            pending = irrigationLogic::NONE;
+        }
+        switch (r.type) {
+        case sensorTrace::CONFIG:
+            logic.setThreshold(r.value);
+            logic.setWaterDuration(r.waterMs);
+            break;
+        case sensorTrace::PULSES:
+            logic.setPulses(r.pulses, r.soakMs, r.value);
+            break;
+        case sensorTrace::EVENT:
+            logic.setEventDuration(r.waterMs);   // adaptive duration of the event just started
+            break;
+        case sensorTrace::SAMPLE: {
+            st.samples++;
+            if (logic.update(r.timeMs) != irrigationLogic::NONE) mismatch("replay stopped earlier", r.timeMs);
+            if (!logic.sampleDue(r.timeMs)) mismatch("sample not due in replay", r.timeMs);
+            int m = irrigationLogic::average(r.raw, r.count);
+            pending = logic.onSample(m, r.timeMs);
+            pendingAt = r.timeMs;
+            break;
+        }
+        case sensorTrace::DECISION:
+            if (pending) {
+                // START or RESUME, or the early STOP at the end of a soak
+                if (r.action != pending || r.timeMs != pendingAt) mismatch("device decided differently after a sample", r.timeMs);
+                else if (r.value != logic.lastMoisture()) mismatch("moisture differs", r.timeMs);
+                pending = irrigationLogic::NONE;
+            } else if (r.action == irrigationLogic::STOP_WATERING || r.action == irrigationLogic::PAUSE_WATERING) {
+                uint32_t dueAt = startedAt + logic.pulseDuration() + 1;
+                if (logic.update(r.timeMs) != r.action) mismatch("device stopped, replay did not", r.timeMs);
+                else if (r.timeMs - dueAt > STOP_SLACK_MS) mismatch("device watered longer than replay planned", r.timeMs);
+            } else {
+                mismatch("device started watering, replay did not", r.timeMs);
+            }
+            if (r.action == irrigationLogic::START_WATERING) st.waterings++;
+            if (r.action == irrigationLogic::START_WATERING || r.action == irrigationLogic::RESUME_WATERING) {
+                startedAt = r.timeMs;
+                open = true;
+            } else if (open) {
+                st.valveOnMs += r.timeMs - startedAt;
+                open = false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return st;
+}
+
+// Replays the raw samples under different settings. This is open loop: the
+// trace holds the soil as the recorded run watered it, so results are only
+// meaningful until the first watering that differs from the recording.
+// Samples that fall inside a replayed watering are skipped like on the device.
+static runStats whatIf(const std::vector<uint8_t>& trace, int threshold, uint32_t durationMs, filterKind f)
+{
+    runStats st;
+    sensorTrace::reader rd(trace.data(), trace.size());
+    const sensorTrace::header& h = rd.info();
+    irrigationLogic logic(h.sampleIntervalMs, durationMs, threshold);
+    static record r;
+    uint32_t startedAt = 0, first = h.startMs, last = first;
+
+    while (rd.next(r)) {
+        if (r.type != sensorTrace::SAMPLE) continue;
+        last = r.timeMs;
+        if (logic.watering()) {
+            uint32_t stopAt = startedAt + durationMs + 1;   // first ms at which update() reports STOP
+            if (r.timeMs < stopAt) continue;
+            logic.update(stopAt);
+            st.valveOnMs += stopAt - startedAt;
+        }
+        if (!logic.sampleDue(r.timeMs)) continue;
+        st.samples++;
+        if (logic.onSample(applyFilter(f, r.raw, r.count), r.timeMs) == irrigationLogic::START_WATERING) {
+            startedAt = r.timeMs;
+            st.waterings++;
+        }
+    }
+    if (logic.watering()) st.valveOnMs += std::min(last - startedAt, durationMs);
+    st.durationMs = last - first;
+    return st;
+}
+
+// Plausible soil: slow drying, noisy ADC, wetting while the valve is open.
+// `adaptive` gives each event its own duration, as cmd/adaptive does.
+static int synthesize(const char* path, uint32_t minutes, uint8_t pulses, uint32_t soakMs, int target, bool adaptive)
+{
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0, 18);
+    std::vector<uint8_t> out(sensorTrace::HEADER_BYTES);
+    sensorTrace::header h{100, 1000, 2300, 20000, 1792319400, 5000, pulses, (int16_t)target, soakMs};
+    sensorTrace::writeHeader(out.data(), h);
+
+    irrigationLogic logic(h.sampleIntervalMs, h.waterMs, h.threshold);
+    logic.setPulses(h.pulses, h.soakMs, h.target);
+    uint8_t rec[sensorTrace::MAX_RECORD_BYTES];
+    uint32_t lastMs = h.startMs;
+    double soil = 2200;
+    bool valve = false;
+    auto put = [&](size_t n) { out.insert(out.end(), rec, rec + n); };
+
+    for (uint32_t now = h.startMs; now < h.startMs + minutes * 60000; now += 7) {   // ~7 ms loop passes
+        soil += valve ? -0.35 : 0.0015;
+        irrigationLogic::action a = logic.update(now);
+        if (a != irrigationLogic::NONE) {
+            put(sensorTrace::encodeDecision(rec, lastMs, now, a, logic.lastMoisture()));
+            put(sensorTrace::encodeValve(rec, lastMs, now, valve = false));
+        }
+        if (!logic.sampleDue(now)) continue;
+        uint16_t raw[100];
+        for (auto& v : raw) v = (uint16_t)std::clamp(soil + noise(rng) + (rng() % 500 == 0 ? 900 : 0), 0.0, 4095.0);
+        int m = irrigationLogic::average(raw, 100);
+        put(sensorTrace::encodeSample(rec, lastMs, now, raw, 100));
+        a = logic.onSample(m, now);
+        if (a != irrigationLogic::NONE) put(sensorTrace::encodeDecision(rec, lastMs, now, a, m));
+        if (a == irrigationLogic::START_WATERING && adaptive) {
+            uint32_t eventMs = 8000 + (m % 7) * 8000;   // 8..56 s around the fixed 20 s
+            logic.setEventDuration(eventMs);
+            put(sensorTrace::encodeEvent(rec, lastMs, now, eventMs));
+        }
+        if (a == irrigationLogic::START_WATERING || a == irrigationLogic::RESUME_WATERING) {
+            put(sensorTrace::encodeValve(rec, lastMs, now, valve = true));
+        }
+    }
+    FILE* f = fopen(path, "wb");
+    if (!f) return 1;
+    fwrite(out.data(), 1, out.size(), f);
+    fclose(f);
+    printf("wrote %s: %u min, %zu bytes (%.1f B/sample)\n", path, minutes, out.size(),
+           out.size() / (minutes * 60.0));
+    return 0;
+}
+
+static void printStats(const char* label, const runStats& st)
+{
+    printf("%-10s samples %7u  waterings %4u  valve on %8.1f s\n", label, st.samples, st.waterings, st.valveOnMs / 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 3 && !strcmp(argv[1], "--synth")) {
+        int n = 1, target = -1;
+        unsigned soak = 0;
+        bool adaptive = false;
+        for (int i = 3; i < argc; ++i) {
+            if (!strcmp(argv[i], "-p") && i + 1 < argc) sscanf(argv[i + 1], "%d,%u,%d", &n, &soak, &target);
+            if (!strcmp(argv[i], "-a")) adaptive = true;
+        }
+        return synthesize(argv[2], argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 60, n, soak, target, adaptive);
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace.bin [-t threshold] [-d durationMs] [-f mean|median|trimmed] [--bench N]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> trace = loadFile(argv[1]);
+    sensorTrace::reader probe(trace.data(), trace.size());
+    if (!probe.valid()) {
+        fprintf(stderr, "%s: not a sensor trace\n", argv[1]);
+        return 2;
+    }
+    const sensorTrace::header& h = probe.info();
+
+    int threshold = h.threshold;
+    uint32_t duration = h.waterMs;
+    filterKind filter = MEAN;
+    bool overridden = false;
+    int bench = 0;
+    for (int i = 2; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--bench") { bench = i + 1 < argc ? atoi(argv[++i]) : 20; continue; }
+        if (i + 1 >= argc) break;
+        overridden = true;
+        if      (a == "-t") threshold = atoi(argv[++i]);
+        else if (a == "-d") duration = atoi(argv[++i]);
+        else if (a == "-f") {
+            std::string f = argv[++i];
+            filter = f == "median" ? MEDIAN : f == "trimmed" ? TRIMMED : MEAN;
+        }
+    }
+
+    printf("trace: %zu bytes, %u raw/sample, threshold %d, water %u ms, %u pulses, soak %u ms\n",
+           trace.size(), h.rawPerSample, h.threshold, h.waterMs, h.pulses, h.soakMs);
+
+    if (bench) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t samples = 0;
+        for (int i = 0; i < bench; ++i) samples += verify(trace, true).samples;
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("bench: %llu samples in %.3f s -> %.0f samples/s, %.0f ns/sample\n",
+               (unsigned long long)samples, secs, samples / secs, secs * 1e9 / samples);
+        return 0;
+    }
+
+    runStats recorded = recordedStats(trace);
+    printStats("recorded", recorded);
+    if (!overridden) {
+        runStats st = verify(trace, false);
+        printStats("replay", st);
+        printf("%s: %u mismatches\n", st.mismatches ? "FAIL" : "OK", st.mismatches);
+        return st.mismatches ? 1 : 0;
+    }
+
+    runStats st = whatIf(trace, threshold, duration, filter);
+    printStats("what-if", st);
+    printf("threshold %d, water %u ms, filter %s: valve time %+.1f%%, waterings %+d\n",
+           threshold, duration, filter == MEAN ? "mean" : filter == MEDIAN ? "median" : "trimmed",
+           recorded.valveOnMs ? 100.0 * ((double)st.valveOnMs - recorded.valveOnMs) / recorded.valveOnMs : 0.0,
+           (int)st.waterings - (int)recorded.waterings);
+    return 0;
+}